@@ -18,15 +18,242 @@
 
 using namespace LATfield2;
 
+//////////////////////////
+// particle_arrays
+//////////////////////////
+// Description:
+//   contiguous (structure-of-arrays) copy of the particles of one species
+//   on the local domain, sorted by cell; the particles of the i-th local
+//   cell (in the order of Site::first() / Site::next()) are stored at
+//   positions cell_offset[i] ... cell_offset[i+1]-1
+//
+//////////////////////////
+
+struct particle_arrays
+{
+	long count;          // number of particles
+	long capacity;       // number of particles that fit into the arrays
+	long numcells;       // number of local cells
+	long * cell_offset;  // numcells+1 offsets into the arrays
+	Real * pos;          // positions x0 y0 z0 x1 y1 z1 ...
+	Real * vel;          // velocities (same layout)
+	long * ID;           // particle IDs
+	Real dx;             // lattice resolution
+	double mass;         // individual particle mass
+};
+
+//////////////////////////
+// gadget2_file_info
+//////////////////////////
+// Description:
+//   creates the MPI-IO hints for the collective Gadget2 writes: collective
+//   buffering with GADGET_CB_BUFFER_SIZE bytes per aggregator and, if
+//   GADGET_CB_NODES > 0, that number of aggregators
+//
+// Arguments:
+//   info       MPI_Info object (to be released with MPI_Info_free)
+//
+// Returns:
+//
+//////////////////////////
+
+void gadget2_file_info(MPI_Info & info)
+{
+	char value[32];
+
+	MPI_Info_create(&info);
+	MPI_Info_set(info, (char *) "romio_cb_write", (char *) "enable");
+	sprintf(value, "%ld", (long) GADGET_CB_BUFFER_SIZE);
+	MPI_Info_set(info, (char *) "cb_buffer_size", value);
+	if (GADGET_CB_NODES > 0)
+	{
+		sprintf(value, "%d", (int) GADGET_CB_NODES);
+		MPI_Info_set(info, (char *) "cb_nodes", value);
+	}
+}
+
 template <typename part, typename part_info, typename part_dataType>
 class Particles_gevolution: public Particles<part, part_info, part_dataType>
 {
 	public:
+		Particles_gevolution();
+		~Particles_gevolution();
 		void saveGadget2(string filename, gadget2_header & hdr, const int tracer_factor = 1, double dtau_pos = 0., double dtau_vel = 0., Field<Real> * phi = NULL);
 		void saveGadget2(string filename, gadget2_header & hdr, lightcone_geometry & lightcone, double dist, double dtau, double dtau_old, double dadtau, double vertex[MAX_INTERSECTS][3], const int vertexcount, set<long> & IDbacklog, set<long> & IDprelog, Field<Real> * phi, const int tracer_factor = 1);
 		void loadGadget2(string filename, gadget2_header & hdr);
+		void updateArrays();
+		particle_arrays * arrays() { return &arrays_; }
+		long packLocal(part * buffer = NULL);
+		void unpackLocal(part * buffer, const long count);
+
+	private:
+		particle_arrays arrays_;
 };
 
+template <typename part, typename part_info, typename part_dataType>
+Particles_gevolution<part,part_info,part_dataType>::Particles_gevolution()
+{
+	arrays_.count = 0;
+	arrays_.capacity = 0;
+	arrays_.numcells = 0;
+	arrays_.cell_offset = NULL;
+	arrays_.pos = NULL;
+	arrays_.vel = NULL;
+	arrays_.ID = NULL;
+	arrays_.dx = 0.;
+	arrays_.mass = 0.;
+}
+
+template <typename part, typename part_info, typename part_dataType>
+Particles_gevolution<part,part_info,part_dataType>::~Particles_gevolution()
+{
+	free(arrays_.cell_offset);
+	free(arrays_.pos);
+	free(arrays_.vel);
+	free(arrays_.ID);
+}
+
+
+//////////////////////////
+// Particles_gevolution::updateArrays
+//////////////////////////
+// Description:
+//   copies the particles from the per-cell lists into the contiguous
+//   arrays, keeping them sorted by cell; has to be called again whenever
+//   the particles have been moved or kicked
+//
+// Arguments:
+//
+// Returns:
+//
+//////////////////////////
+
+template <typename part, typename part_info, typename part_dataType>
+void Particles_gevolution<part,part_info,part_dataType>::updateArrays()
+{
+	LATfield2::Site xPart(this->lat_part_);
+	typename std::list<part>::iterator it;
+	long c, n;
+
+	if (arrays_.cell_offset == NULL)
+	{
+		arrays_.numcells = this->lat_part_.sitesLocal();
+		arrays_.cell_offset = (long *) malloc((arrays_.numcells + 1) * sizeof(long));
+	}
+
+	for (xPart.first(), c = 0, n = 0; xPart.test(); xPart.next(), c++)
+	{
+		arrays_.cell_offset[c] = n;
+		n += this->field_part_(xPart).size;
+	}
+	arrays_.cell_offset[c] = n;
+
+	if (n > arrays_.capacity)
+	{
+		arrays_.capacity = n + n / 8;  // some headroom since particles move between processes
+		free(arrays_.pos);
+		free(arrays_.vel);
+		free(arrays_.ID);
+		arrays_.pos = (Real *) malloc(3 * arrays_.capacity * sizeof(Real));
+		arrays_.vel = (Real *) malloc(3 * arrays_.capacity * sizeof(Real));
+		arrays_.ID = (long *) malloc(arrays_.capacity * sizeof(long));
+
+		if (arrays_.pos == NULL || arrays_.vel == NULL || arrays_.ID == NULL)
+		{
+			cerr << " proc#" << parallel.rank() << ": error in Particles_gevolution::updateArrays! Memory error." << endl;
+			parallel.abortForce();
+		}
+	}
+
+	for (xPart.first(), n = 0; xPart.test(); xPart.next())
+	{
+		if (this->field_part_(xPart).size != 0)
+		{
+			for (it = (this->field_part_)(xPart).parts.begin(); it != (this->field_part_)(xPart).parts.end(); ++it, n++)
+			{
+				arrays_.pos[3*n] = (*it).pos[0];
+				arrays_.pos[3*n+1] = (*it).pos[1];
+				arrays_.pos[3*n+2] = (*it).pos[2];
+				arrays_.vel[3*n] = (*it).vel[0];
+				arrays_.vel[3*n+1] = (*it).vel[1];
+				arrays_.vel[3*n+2] = (*it).vel[2];
+				arrays_.ID[n] = (*it).ID;
+			}
+		}
+	}
+
+	arrays_.count = n;
+	arrays_.dx = this->res();
+	arrays_.mass = *(double*)((char*)this->parts_info() + this->mass_offset());
+}
+
+//////////////////////////
+// Particles_gevolution::packLocal
+//////////////////////////
+// Description:
+//   copies the local particles, in lattice order, into a contiguous buffer
+//   (used for the rank-local checkpoints, see hibernation.hpp)
+//
+// Arguments:
+//   buffer     buffer with room for all local particles; if NULL, the
+//              particles are only counted
+//
+// Returns: number of local particles
+//
+//////////////////////////
+
+template <typename part, typename part_info, typename part_dataType>
+long Particles_gevolution<part,part_info,part_dataType>::packLocal(part * buffer)
+{
+	LATfield2::Site xPart(this->lat_part_);
+	typename std::list<part>::iterator it;
+	long n = 0;
+
+	for (xPart.first(); xPart.test(); xPart.next())
+	{
+		if (buffer == NULL)
+			n += this->field_part_(xPart).size;
+		else if (this->field_part_(xPart).size != 0)
+		{
+			for (it = (this->field_part_)(xPart).parts.begin(); it != (this->field_part_)(xPart).parts.end(); ++it, n++)
+				buffer[n] = (*it);
+		}
+	}
+
+	return n;
+}
+
+
+//////////////////////////
+// Particles_gevolution::unpackLocal
+//////////////////////////
+// Description:
+//   replaces the local particles by the content of a buffer written by
+//   packLocal on the same process layout
+//
+// Arguments:
+//   buffer     particle buffer
+//   count      number of particles in the buffer
+//
+// Returns:
+//
+//////////////////////////
+
+template <typename part, typename part_info, typename part_dataType>
+void Particles_gevolution<part,part_info,part_dataType>::unpackLocal(part * buffer, const long count)
+{
+	LATfield2::Site xPart(this->lat_part_);
+
+	for (xPart.first(); xPart.test(); xPart.next())
+	{
+		this->field_part_(xPart).parts.clear();
+		this->field_part_(xPart).size = 0;
+	}
+
+	for (long n = 0; n < count; n++)
+		this->addParticle_global(buffer[n]);
+}
+
 template <typename part, typename part_info, typename part_dataType>
 void Particles_gevolution<part,part_info,part_dataType>::saveGadget2(string filename, gadget2_header & hdr, const int tracer_factor, double dtau_pos, double dtau_vel, Field<Real> * phi)
 {
@@ -34,11 +261,14 @@ void Particles_gevolution<part,part_info,part_dataType>::saveGadget2(string file
 	float * veldata;
 	void * IDs;
 	MPI_File outfile;
-	long count, npart;
+	MPI_Comm comm;
+	MPI_Info info;
+	long count, npart, capacity;
 	MPI_Offset offset_pos, offset_vel, offset_ID;
 	MPI_Status status;
 	uint32_t blocksize;
 	uint32_t i;
+	int rank, size;
 	char fname[filename.length()+8];
 	double rescale_vel = 1. / sqrt(hdr.time) / GADGET_VELOCITY_CONVERSION;
 #ifdef EXACT_OUTPUT_REDSHIFTS
@@ -60,92 +290,26 @@ void Particles_gevolution<part,part_info,part_dataType>::saveGadget2(string file
 		return;
 	}
 
-	posdata = (float *) malloc(3 * sizeof(float) * PCLBUFFER);
-	veldata = (float *) malloc(3 * sizeof(float) * PCLBUFFER);
+	// the local particles are gathered in one pass; the list sizes give
+	// the exact buffer size without tracers and an estimate otherwise
+	capacity = 0;
+	for(xPart.first(); xPart.test(); xPart.next())
+		capacity += this->field_part_(xPart).size;
+	capacity = capacity / tracer_factor + 1;
+
+	posdata = (float *) malloc(3 * sizeof(float) * capacity);
+	veldata = (float *) malloc(3 * sizeof(float) * capacity);
 
 #if GADGET_ID_BYTES == 8
-	IDs = malloc(sizeof(int64_t) * PCLBUFFER);
+	IDs = malloc(sizeof(int64_t) * capacity);
 #else
-	IDs = malloc(sizeof(int32_t) * PCLBUFFER);
+	IDs = malloc(sizeof(int32_t) * capacity);
 #endif
 
-	npart = 0;
-	for(xPart.first(); xPart.test(); xPart.next())
+	if (posdata == NULL || veldata == NULL || IDs == NULL)
 	{
-		if(this->field_part_(xPart).size!=0)
-		{
-			for (it=(this->field_part_)(xPart).parts.begin(); it != (this->field_part_)(xPart).parts.end(); ++it)
-			{
-				if ((*it).ID % tracer_factor == 0)
-					npart++;
-			}
-		}
-	}
-
-	if (hdr.num_files == 1)
-	{
-		if (parallel.rank() == 0)
-		{
-			parallel.send<long>(npart, 1);
-			parallel.receive<long>(count, parallel.size()-1);
-			if (count != hdr.npart[1]) cout << " error: number of particles in saveGadget2 does not match request!" << endl;
-			count = 0;
-		}
-		else
-		{
-			parallel.receive<long>(count, parallel.rank()-1);
-			npart += count;
-			parallel.send<long>(npart, (parallel.rank()+1)%parallel.size());
-		}
-
-		MPI_File_open(parallel.lat_world_comm(), fname, MPI_MODE_WRONLY | MPI_MODE_CREATE,  MPI_INFO_NULL, &outfile);
-	}
-	else
-	{
-		if (parallel.grid_rank()[0] == 0)
-		{
-			parallel.send_dim0<long>(npart, 1);
-			parallel.receive_dim0<long>(count, parallel.grid_size()[0]-1);
-			hdr.npart[1] = (uint32_t) count;
-			count = 0;
-		}
-		else
-		{
-			parallel.receive_dim0<long>(count, parallel.grid_rank()[0]-1);
-			npart += count;
-			parallel.send_dim0<long>(npart, (parallel.grid_rank()[0]+1)%parallel.grid_size()[0]);
-		}
-
-		parallel.broadcast_dim0<uint32_t>(hdr.npart[1], 0);
-
-		sprintf(fname+filename.length(), ".%d", parallel.grid_rank()[1]);
-
-		MPI_File_open(parallel.dim0_comm()[parallel.grid_rank()[1]], fname, MPI_MODE_WRONLY | MPI_MODE_CREATE,  MPI_INFO_NULL, &outfile);
-	}
-
-	offset_pos = (MPI_Offset) hdr.npart[1];
-	offset_pos *= (MPI_Offset) (6 * sizeof(float) + ((GADGET_ID_BYTES == 8) ? sizeof(int64_t) : sizeof(int32_t)));
-	offset_pos += (MPI_Offset) (8 * sizeof(uint32_t) + sizeof(hdr));
-	MPI_File_set_size(outfile, offset_pos);
-
-	offset_pos = (MPI_Offset) (3 * sizeof(uint32_t) + sizeof(hdr)) + ((MPI_Offset) count) * ((MPI_Offset) (3 * sizeof(float)));
-	offset_vel = offset_pos + (MPI_Offset) (2 * sizeof(uint32_t)) + ((MPI_Offset) hdr.npart[1]) * ((MPI_Offset) (3 * sizeof(float)));
-	offset_ID = offset_vel + (MPI_Offset) (2 * sizeof(uint32_t)) + ((MPI_Offset) hdr.npart[1] - (MPI_Offset) count) * ((MPI_Offset) (3 * sizeof(float))) + ((MPI_Offset) count) * ((MPI_Offset) ((GADGET_ID_BYTES == 8) ? sizeof(int64_t) : sizeof(int32_t)));
-
-	if ((hdr.num_files == 1 && parallel.rank() == 0) || (hdr.num_files > 1 && parallel.grid_rank()[0] == 0))
-	{
-		blocksize = sizeof(hdr);
-		MPI_File_write_at(outfile, 0, &blocksize, 1, MPI_UNSIGNED, &status);
-		MPI_File_write_at(outfile, sizeof(uint32_t), &hdr, sizeof(hdr), MPI_BYTE, &status);
-		MPI_File_write_at(outfile, sizeof(hdr) + sizeof(uint32_t), &blocksize, 1, MPI_UNSIGNED, &status);
-		blocksize = 3 * sizeof(float) * hdr.npart[1];
-		MPI_File_write_at(outfile, sizeof(hdr) + 2*sizeof(uint32_t), &blocksize, 1, MPI_UNSIGNED, &status);
-		MPI_File_write_at(outfile, offset_vel - 2*sizeof(uint32_t), &blocksize, 1, MPI_UNSIGNED, &status);
-		MPI_File_write_at(outfile, offset_vel - sizeof(uint32_t), &blocksize, 1, MPI_UNSIGNED, &status);
-		MPI_File_write_at(outfile, offset_ID - 2*sizeof(uint32_t), &blocksize, 1, MPI_UNSIGNED, &status);
-		blocksize = ((GADGET_ID_BYTES == 8) ? sizeof(int64_t) : sizeof(int32_t)) * hdr.npart[1];
-		MPI_File_write_at(outfile, offset_ID - sizeof(uint32_t), &blocksize, 1, MPI_UNSIGNED, &status);
-		MPI_File_write_at(outfile, offset_ID + blocksize, &blocksize, 1, MPI_UNSIGNED, &status);
+		cerr << " proc#" << parallel.rank() << ": error in saveGadget2! Memory error." << endl;
+		parallel.abortForce();
 	}
 
 	count = 0;
@@ -164,6 +328,23 @@ void Particles_gevolution<part,part_info,part_dataType>::saveGadget2(string file
 			{
 				if ((*it).ID % tracer_factor == 0)
 				{
+					if (count == capacity)
+					{
+						capacity += capacity / 2 + 1;
+						posdata = (float *) realloc((void *) posdata, 3 * sizeof(float) * capacity);
+						veldata = (float *) realloc((void *) veldata, 3 * sizeof(float) * capacity);
+#if GADGET_ID_BYTES == 8
+						IDs = realloc(IDs, sizeof(int64_t) * capacity);
+#else
+						IDs = realloc(IDs, sizeof(int32_t) * capacity);
+#endif
+						if (posdata == NULL || veldata == NULL || IDs == NULL)
+						{
+							cerr << " proc#" << parallel.rank() << ": error in saveGadget2! Memory error." << endl;
+							parallel.abortForce();
+						}
+					}
+
 #ifdef EXACT_OUTPUT_REDSHIFTS
 					if (phi != NULL)
 					{
@@ -219,18 +400,6 @@ void Particles_gevolution<part,part_info,part_dataType>::saveGadget2(string file
 #endif
 
 					count++;
-
-					if (count == PCLBUFFER)
-					{
-						MPI_File_write_at(outfile, offset_pos, posdata, 3 * count, MPI_FLOAT, &status);
-						offset_pos += 3 * PCLBUFFER * sizeof(float);
-						MPI_File_write_at(outfile, offset_vel, veldata, 3 * count, MPI_FLOAT, &status);
-						offset_vel += 3 * PCLBUFFER * sizeof(float);
-						count *= (GADGET_ID_BYTES == 8) ? sizeof(int64_t) : sizeof(int32_t);
-						MPI_File_write_at(outfile, offset_ID, IDs, count, MPI_BYTE, &status);
-						offset_ID += count;
-						count = 0;
-					}
 				}
 			}
 		}
@@ -239,10 +408,72 @@ void Particles_gevolution<part,part_info,part_dataType>::saveGadget2(string file
 #endif
 	}
 
-	MPI_File_write_at_all(outfile, offset_pos, posdata, 3 * count, MPI_FLOAT, &status);
-	MPI_File_write_at_all(outfile, offset_vel, veldata, 3 * count, MPI_FLOAT, &status);
-	count *= (GADGET_ID_BYTES == 8) ? sizeof(int64_t) : sizeof(int32_t);
-	MPI_File_write_at_all(outfile, offset_ID, IDs, count, MPI_BYTE, &status);
+	npart = count;
+
+	if (hdr.num_files == 1)
+	{
+		comm = parallel.lat_world_comm();
+		rank = parallel.rank();
+		size = parallel.size();
+	}
+	else
+	{
+		comm = parallel.dim0_comm()[parallel.grid_rank()[1]];
+		rank = parallel.grid_rank()[0];
+		size = parallel.grid_size()[0];
+	}
+
+	// offset of the local particles in the file (the result is undefined on the first process)
+	MPI_Exscan(&npart, &count, 1, MPI_LONG, MPI_SUM, comm);
+	if (rank == 0) count = 0;
+
+	if (hdr.num_files == 1)
+	{
+		if (rank == size-1 && count + npart != hdr.npart[1]) cout << " error: number of particles in saveGadget2 does not match request!" << endl;
+	}
+	else
+	{
+		MPI_Allreduce(&npart, &capacity, 1, MPI_LONG, MPI_SUM, comm);
+		hdr.npart[1] = (uint32_t) capacity;
+		sprintf(fname+filename.length(), ".%d", parallel.grid_rank()[1]);
+	}
+
+	gadget2_file_info(info);
+	MPI_File_open(comm, fname, MPI_MODE_WRONLY | MPI_MODE_CREATE, info, &outfile);
+	MPI_Info_free(&info);
+
+	offset_pos = (MPI_Offset) hdr.npart[1];
+	offset_pos *= (MPI_Offset) (6 * sizeof(float) + ((GADGET_ID_BYTES == 8) ? sizeof(int64_t) : sizeof(int32_t)));
+	offset_pos += (MPI_Offset) (8 * sizeof(uint32_t) + sizeof(hdr));
+	MPI_File_set_size(outfile, offset_pos);
+
+	offset_pos = (MPI_Offset) (3 * sizeof(uint32_t) + sizeof(hdr)) + ((MPI_Offset) count) * ((MPI_Offset) (3 * sizeof(float)));
+	offset_vel = offset_pos + (MPI_Offset) (2 * sizeof(uint32_t)) + ((MPI_Offset) hdr.npart[1]) * ((MPI_Offset) (3 * sizeof(float)));
+	offset_ID = offset_vel + (MPI_Offset) (2 * sizeof(uint32_t)) + ((MPI_Offset) hdr.npart[1] - (MPI_Offset) count) * ((MPI_Offset) (3 * sizeof(float))) + ((MPI_Offset) count) * ((MPI_Offset) ((GADGET_ID_BYTES == 8) ? sizeof(int64_t) : sizeof(int32_t)));
+
+	if (rank == 0)
+	{
+		blocksize = sizeof(hdr);
+		MPI_File_write_at(outfile, 0, &blocksize, 1, MPI_UNSIGNED, &status);
+		MPI_File_write_at(outfile, sizeof(uint32_t), &hdr, sizeof(hdr), MPI_BYTE, &status);
+		MPI_File_write_at(outfile, sizeof(hdr) + sizeof(uint32_t), &blocksize, 1, MPI_UNSIGNED, &status);
+		blocksize = 3 * sizeof(float) * hdr.npart[1];
+		MPI_File_write_at(outfile, sizeof(hdr) + 2*sizeof(uint32_t), &blocksize, 1, MPI_UNSIGNED, &status);
+		MPI_File_write_at(outfile, offset_vel - 2*sizeof(uint32_t), &blocksize, 1, MPI_UNSIGNED, &status);
+		MPI_File_write_at(outfile, offset_vel - sizeof(uint32_t), &blocksize, 1, MPI_UNSIGNED, &status);
+		MPI_File_write_at(outfile, offset_ID - 2*sizeof(uint32_t), &blocksize, 1, MPI_UNSIGNED, &status);
+		blocksize = ((GADGET_ID_BYTES == 8) ? sizeof(int64_t) : sizeof(int32_t)) * hdr.npart[1];
+		MPI_File_write_at(outfile, offset_ID - sizeof(uint32_t), &blocksize, 1, MPI_UNSIGNED, &status);
+		MPI_File_write_at(outfile, offset_ID + blocksize, &blocksize, 1, MPI_UNSIGNED, &status);
+	}
+
+	MPI_File_write_at_all(outfile, offset_pos, posdata, 3 * npart, MPI_FLOAT, &status);
+	MPI_File_write_at_all(outfile, offset_vel, veldata, 3 * npart, MPI_FLOAT, &status);
+#if GADGET_ID_BYTES == 8
+	MPI_File_write_at_all(outfile, offset_ID, IDs, npart, MPI_INT64_T, &status);
+#else
+	MPI_File_write_at_all(outfile, offset_ID, IDs, npart, MPI_INT32_T, &status);
+#endif
 
 	MPI_File_close(&outfile);
 
@@ -259,7 +490,8 @@ void Particles_gevolution<part,part_info,part_dataType>::saveGadget2(string file
 	float * veldata;
 	void * IDs;
 	MPI_File outfile;
-	long count, npart;
+	MPI_Info info;
+	long count, npart, ntotal;
 	MPI_Offset offset_pos, offset_vel, offset_ID;
 	MPI_Status status;
 	uint32_t blocksize;
@@ -389,29 +621,20 @@ void Particles_gevolution<part,part_info,part_dataType>::saveGadget2(string file
 		}
 	}
 
-	if (parallel.rank() == 0)
-	{
-		parallel.send<long>(npart, 1);
-		parallel.receive<long>(count, parallel.size()-1);
-		hdr.npart[1] = (uint32_t) (count % (1ll << 32));
-		hdr.npartTotal[1] = (uint32_t) (count % (1ll << 32));
-		hdr.npartTotalHW[1] = (uint32_t) (count / (1ll << 32));
-		count = 0;
-	}
-	else
-	{
-		parallel.receive<long>(count, parallel.rank()-1);
-		count += npart;
-		parallel.send<long>(count, (parallel.rank()+1)%parallel.size());
-		count -= npart;
-	}
+	// offset of the local particles in the file (the result is undefined on the first process)
+	MPI_Exscan(&npart, &count, 1, MPI_LONG, MPI_SUM, parallel.lat_world_comm());
+	if (parallel.rank() == 0) count = 0;
+	MPI_Allreduce(&npart, &ntotal, 1, MPI_LONG, MPI_SUM, parallel.lat_world_comm());
 
-	parallel.broadcast<uint32_t>(hdr.npartTotal[1], 0);
-	parallel.broadcast<uint32_t>(hdr.npartTotalHW[1], 0);
+	hdr.npart[1] = (uint32_t) (ntotal % (1ll << 32));
+	hdr.npartTotal[1] = (uint32_t) (ntotal % (1ll << 32));
+	hdr.npartTotalHW[1] = (uint32_t) (ntotal / (1ll << 32));
 
-	if (hdr.npartTotal[1] + ((int64_t) hdr.npartTotalHW[1] << 32) > 0)
+	if (ntotal > 0)
 	{
-		MPI_File_open(parallel.lat_world_comm(), fname, MPI_MODE_WRONLY | MPI_MODE_CREATE,  MPI_INFO_NULL, &outfile);
+		gadget2_file_info(info);
+		MPI_File_open(parallel.lat_world_comm(), fname, MPI_MODE_WRONLY | MPI_MODE_CREATE, info, &outfile);
+		MPI_Info_free(&info);
 
 		offset_pos = (MPI_Offset) ((int64_t) hdr.npartTotal[1] + ((int64_t) hdr.npartTotalHW[1] << 32));
 		offset_pos *= (MPI_Offset) (6 * sizeof(float) + ((GADGET_ID_BYTES == 8) ? sizeof(int64_t) : sizeof(int32_t)));
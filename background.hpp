@@ -355,6 +355,291 @@ void rungekutta4bg(double &a, const double fourpiG,
 }
 
 
+#ifdef HAVE_HICLASS_BG
+//////////////////////////
+// background_table
+//////////////////////////
+// Description:
+//   conformal Hubble rate, its derivative and the sound speed of the scalar
+//   field on a grid which is uniform in ln(a), such that the background at
+//   any time is obtained from a single index computation instead of a
+//   search in the hiclass splines (which, moreover, share one interpolation
+//   accelerator). Hconf and Hconf_prime are interpolated with cubic Hermite
+//   polynomials in ln(a), using the derivatives dHconf/dln(a) =
+//   Hconf_prime / Hconf and dHconf_prime/dln(a) = Hconf_prime_prime / Hconf
+//   at the nodes; cs2 is interpolated linearly. The normalisation to code
+//   units is applied once when the table is filled.
+//
+//////////////////////////
+
+struct background_node
+{
+	double Hconf;
+	double Hconf_slope;        // dHconf/dln(a) times the node spacing
+	double Hconf_prime;
+	double Hconf_prime_slope;  // dHconf_prime/dln(a) times the node spacing
+	double cs2;
+};
+
+struct background_table
+{
+	int size;
+	double lna_min;
+	double inv_dlna;
+	background_node * node;
+};
+
+#define BG_TABLE_TOLERANCE 1.e-6  // maximum relative deviation from the hiclass splines accepted at startup
+
+
+//////////////////////////
+// initialize_background_table
+//////////////////////////
+// Description:
+//   tabulates the background from the hiclass splines between a_min (or
+//   the first spline node, if larger) and the last spline node; this is
+//   done once at startup
+//
+// Arguments:
+//   table      reference to the table which will be allocated and filled
+//   size       number of nodes
+//   a_min      smallest scale factor required by the simulation
+//   fourpiG    "4 pi G"
+//   H_spline   Class spline with physical H
+//   cs2_spline Class spline with the sound speed of the scalar field
+//
+// Returns:
+//
+//////////////////////////
+
+void initialize_background_table(background_table & table, const int size, const double a_min, const double fourpiG, gsl_spline * H_spline, gsl_spline * cs2_spline)
+{
+	gsl_interp_accel * acc_H = gsl_interp_accel_alloc();
+	gsl_interp_accel * acc_cs2 = gsl_interp_accel_alloc();
+	double a, Ha, dHda, d2Hda2, Hc, Hc_prime, Hc_prime_prime, dlna;
+	double lna_max = log(H_spline->x[H_spline->size-1]);
+	double norm = sqrt(2./3.*fourpiG) / gsl_spline_eval(H_spline, 1., acc_H);
+
+	table.size = (size > 1) ? size : 2;
+	table.lna_min = log((a_min > H_spline->x[0]) ? a_min : H_spline->x[0]);
+	table.inv_dlna = (table.size - 1) / (lna_max - table.lna_min);
+	table.node = (background_node *) malloc(sizeof(background_node) * table.size);
+	dlna = 1. / table.inv_dlna;
+
+	for (int i = 0; i < table.size; i++)
+	{
+		a = exp(table.lna_min + i * dlna);
+		if (i == 0 && a < H_spline->x[0]) a = H_spline->x[0]; // avoid round-off outside the spline range
+		if (i == table.size - 1) a = H_spline->x[H_spline->size-1];
+
+		Ha = gsl_spline_eval(H_spline, a, acc_H);
+		dHda = gsl_spline_eval_deriv(H_spline, a, acc_H);
+		d2Hda2 = gsl_spline_eval_deriv2(H_spline, a, acc_H);
+
+		// same expressions as in Hconf, Hconf_prime and Hconf_prime_prime
+		Hc = norm * a * Ha;
+		Hc_prime = a * Hc * (Hc / a + a * norm * dHda);
+
+		Hc_prime_prime = 2. * Hc_prime * Hc + (2. * a * a * dHda + a * a * a * d2Hda2) * Hc * Hc * norm + norm * a * a * dHda * Hc_prime;
+
+		table.node[i].Hconf = Hc;
+		table.node[i].Hconf_slope = dlna * Hc_prime / Hc;
+		table.node[i].Hconf_prime = Hc_prime;
+		table.node[i].Hconf_prime_slope = dlna * Hc_prime_prime / Hc;
+		table.node[i].cs2 = gsl_spline_eval(cs2_spline, a, acc_cs2);
+	}
+
+	gsl_interp_accel_free(acc_H);
+	gsl_interp_accel_free(acc_cs2);
+}
+
+
+//////////////////////////
+// free_background_table
+//////////////////////////
+// Description:
+//   releases the memory of a table set up by initialize_background_table
+//
+// Arguments:
+//   table      reference to the table
+//
+// Returns:
+//
+//////////////////////////
+
+void free_background_table(background_table & table)
+{
+	free(table.node);
+	table.node = NULL;
+	table.size = 0;
+}
+
+
+//////////////////////////
+// background_table_locate
+//////////////////////////
+// Description:
+//   finds the interval of the background table which contains a given
+//   scale factor; outside the tabulated range the first / last interval
+//   is extrapolated
+//
+// Arguments:
+//   table      reference to the background table
+//   a          scale factor
+//   u          will contain the position within the interval, in units of
+//              the node spacing
+//
+// Returns: pointer to the node at the lower end of the interval
+//
+//////////////////////////
+
+inline const background_node * background_table_locate(const background_table & table, const double a, double & u)
+{
+	u = (log(a) - table.lna_min) * table.inv_dlna;
+	int i = (int) floor(u);
+
+	if (i < 0) i = 0;
+	else if (i > table.size - 2) i = table.size - 2;
+	u -= i;
+
+	return table.node + i;
+}
+
+inline double hermite_interpolation(const double y0, const double m0, const double y1, const double m1, const double u)
+{
+	return y0 + u * (m0 + u * (3. * (y1 - y0) - 2. * m0 - m1 + u * (2. * (y0 - y1) + m0 + m1)));
+}
+
+
+//////////////////////////
+// Hconf, Hconf_prime, cs2_kgb (tabulated background)
+//////////////////////////
+// Description:
+//   background quantities at given scale factor, interpolated from the
+//   background table (see background_table)
+//
+// Arguments:
+//   a          scale factor
+//   fourpiG    "4 pi G" (Hconf, Hconf_prime; unused, the normalisation is part of the table)
+//   table      reference to the background table
+//
+// Returns: conformal Hubble rate, its derivative with respect to conformal
+//          time, or the sound speed of the scalar field
+//
+//////////////////////////
+
+inline double Hconf(const double a, const double fourpiG, const background_table & table)
+{
+	double u;
+	const background_node * n = background_table_locate(table, a, u);
+	return hermite_interpolation(n[0].Hconf, n[0].Hconf_slope, n[1].Hconf, n[1].Hconf_slope, u);
+}
+
+inline double Hconf_prime(const double a, const double fourpiG, const background_table & table)
+{
+	double u;
+	const background_node * n = background_table_locate(table, a, u);
+	return hermite_interpolation(n[0].Hconf_prime, n[0].Hconf_prime_slope, n[1].Hconf_prime, n[1].Hconf_prime_slope, u);
+}
+
+inline double cs2_kgb(const double a, const background_table & table)
+{
+	double u;
+	const background_node * n = background_table_locate(table, a, u);
+	return n[0].cs2 + u * (n[1].cs2 - n[0].cs2);
+}
+
+
+//////////////////////////
+// rungekutta4bg (tabulated background)
+//////////////////////////
+// Description:
+//   integrates the Friedmann equation for the background model using a
+//   fourth-order Runge-Kutta method, with Hconf from the background table
+//
+// Arguments:
+//   a          scale factor (will be advanced by dtau)
+//   fourpiG    "4 pi G" (unused, the normalisation is part of the table)
+//   table      reference to the background table
+//   dtau       time step by which the scale factor should be advanced
+//
+// Returns:
+//
+//////////////////////////
+
+void rungekutta4bg(double &a, const double fourpiG, const background_table & table, const double dtau)
+{
+	double k1a, k2a, k3a, k4a;
+
+	k1a = a * Hconf(a, fourpiG, table);
+	k2a = (a + k1a * dtau / 2.) * Hconf(a + k1a * dtau / 2., fourpiG, table);
+	k3a = (a + k2a * dtau / 2.) * Hconf(a + k2a * dtau / 2., fourpiG, table);
+	k4a = (a + k3a * dtau) * Hconf(a + k3a * dtau, fourpiG, table);
+
+	a += dtau * (k1a + 2. * k2a + 2. * k3a + k4a) / 6.;
+}
+
+
+//////////////////////////
+// background_table_deviation
+//////////////////////////
+// Description:
+//   compares the background table with the hiclass splines at the nodes
+//   and at the midpoints of all intervals (where the interpolation error is
+//   largest); Hconf_prime, which changes sign, is compared relative to
+//   Hconf^2, and cs2 relative to its largest absolute value
+//
+// Arguments:
+//   table      reference to the background table
+//   fourpiG    "4 pi G"
+//   H_spline   Class spline with physical H
+//   cs2_spline Class spline with the sound speed of the scalar field
+//   dev        array of size 3 which will contain the maximum relative
+//              deviation of Hconf, Hconf_prime and cs2
+//
+// Returns: largest of the three deviations
+//
+//////////////////////////
+
+double background_table_deviation(const background_table & table, const double fourpiG, gsl_spline * H_spline, gsl_spline * cs2_spline, double * dev)
+{
+	gsl_interp_accel * acc_H = gsl_interp_accel_alloc();
+	gsl_interp_accel * acc_cs2 = gsl_interp_accel_alloc();
+	double a, Hc, d, cs2_max = 0.;
+
+	dev[0] = dev[1] = dev[2] = 0.;
+
+	for (int i = 0; i < 2 * table.size - 1; i++)
+	{
+		a = exp(table.lna_min + 0.5 * i / table.inv_dlna);
+		if (a < H_spline->x[0] || a > H_spline->x[H_spline->size-1]) continue;
+
+		Hc = Hconf(a, fourpiG, H_spline, acc_H);
+
+		d = fabs(Hconf(a, fourpiG, table) - Hc) / Hc;
+		if (d > dev[0]) dev[0] = d;
+		d = fabs(Hconf_prime(a, fourpiG, table) - Hconf_prime(a, fourpiG, H_spline, acc_H)) / (Hc * Hc);
+		if (d > dev[1]) dev[1] = d;
+		d = gsl_spline_eval(cs2_spline, a, acc_cs2);
+		if (fabs(d) > cs2_max) cs2_max = fabs(d);
+		d = fabs(cs2_kgb(a, table) - d);
+		if (d > dev[2]) dev[2] = d;
+	}
+
+	gsl_interp_accel_free(acc_H);
+	gsl_interp_accel_free(acc_cs2);
+
+	if (cs2_max > 0.) dev[2] /= cs2_max;
+
+	d = dev[0];
+	for (int i = 1; i < 3; i++)
+		if (dev[i] > d) d = dev[i];
+
+	return d;
+}
+#endif
+
+
 #ifndef HAVE_HICLASS_BG
 double particleHorizonIntegrand(double sqrta, void * cosmo)
 {
@@ -373,6 +658,9 @@ double particleHorizonIntegrand(double sqrta, void * cosmo)
 // Arguments:
 //   a          scale factor
 //   fourpiG    "4 pi G"
+//   H_spline_0 H today (hiclass)
+//   tau_spline conformal time as function of a (hiclass)
+//   acc        interpolation accelerator (hiclass)
 //   cosmo      structure containing the cosmological parameters
 //
 // Returns: particle horizon (tau)
@@ -381,16 +669,14 @@ double particleHorizonIntegrand(double sqrta, void * cosmo)
 
 double particleHorizon(const double a, const double fourpiG,
 	#ifdef HAVE_HICLASS_BG
-	const double H_spline_0, background & class_background
+	const double H_spline_0, gsl_spline * tau_spline, gsl_interp_accel * acc
 	#else
 	cosmology & cosmo
 	#endif
 )
 {
 	#ifdef HAVE_HICLASS_BG
-	double tau;
-	background_tau_of_z(&class_background, 1./a - 1., &tau);
-	return tau*H_spline_0/sqrt(2./3.*fourpiG);
+	return gsl_spline_eval(tau_spline, a, acc)*H_spline_0/sqrt(2./3.*fourpiG);
 	#else
 	double result;
 	gsl_function f;
@@ -32,12 +32,63 @@
 #ifndef GEVOLUTION_HEADER
 #define GEVOLUTION_HEADER
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #ifndef Cplx
 #define Cplx Imag
 #endif
 
 using namespace std;
 using namespace LATfield2;
+//////////////////////////
+// lattice_rows
+//////////////////////////
+// Description:
+//   description of the local lattice as a set of contiguous rows along
+//   dimension 0, which runs fastest in memory. Streaming kernels loop over
+//   the rows and address the sites of a row and their neighbours through
+//   raw pointers with fixed strides, such that the inner loop is free of
+//   index computations and can be vectorized ("omp simd" hints, enabled by
+//   -fopenmp-simd or -fopenmp). When compiled with -fopenmp, the planes
+//   (dimension 2) of the local domain are distributed among the threads of
+//   each MPI process. With depth > 0 the rows extend that many layers into
+//   the halo.
+//
+//////////////////////////
+
+struct lattice_rows
+{
+	int n0, n1, n2;      // sites per row, rows per plane, planes
+	long first;          // site index of the first site of the first row
+	long jump1, jump2;   // site index offset between rows / planes
+};
+
+inline void initialize_rows(lattice_rows & rows, Lattice & lat, const int depth = 0)
+{
+	rows.n0 = lat.sizeLocal(0) + 2 * depth;
+	rows.n1 = lat.sizeLocal(1) + 2 * depth;
+	rows.n2 = lat.sizeLocal(2) + 2 * depth;
+	rows.jump1 = lat.jump(1);
+	rows.jump2 = lat.jump(2);
+	rows.first = (long) (lat.halo() - depth) * (1 + rows.jump1 + rows.jump2);
+}
+
+// site index of the first site of row i1 in plane i2
+inline long row_index(const lattice_rows & rows, const int i1, const int i2)
+{
+	return rows.first + i1 * rows.jump1 + i2 * rows.jump2;
+}
+
+// 7-point Laplacian (times dx^2) of a single-component field at the site p points to
+// (evaluated in double precision also if the field is stored in single precision)
+template <class FieldType>
+inline double laplacian_7pt(const FieldType * p, const long jump1, const long jump2)
+{
+	return (double) p[-1] + p[1] + p[-jump1] + p[jump1] + p[-jump2] + p[jump2] - 6. * p[0];
+}
+
 //////////////////////////
 // prepareFTsource (1)
 //////////////////////////
@@ -172,245 +223,586 @@ void prepareFTsource(Field<FieldType> & phi, Field<FieldType> & Tij, Field<Field
 template <class FieldType>
 void prepareFTsource(Field<FieldType> & phi, Field<FieldType> & Tij, Field<FieldType> & Sij, Field<FieldType> & deltaPm, const double coeff)
 {
+	lattice_rows rows;
+	initialize_rows(rows, phi.lattice());
+
+	const long j1 = rows.jump1;
+	const long j2 = rows.jump2;
+	const int ncT = Tij.components();
+	const int ncS = Sij.components();
+	int i0, i1, i2;
 	Site x(phi.lattice());
 
-	for (x.first(); x.test(); x.next())
+#pragma omp parallel for private(i0, i1) firstprivate(x)
+	for (i2 = 0; i2 < rows.n2; i2++)
 	{
-		// 0-0-component:
-		Sij(x, 0, 0) = coeff * Tij(x, 0, 0);
+		for (i1 = 0; i1 < rows.n1; i1++)
+		{
+			x.setIndex(row_index(rows, i1, i2));
+
+			const FieldType * p = &phi(x);
+			const FieldType * T00 = &Tij(x, 0, 0);
+			const FieldType * T11 = &Tij(x, 1, 1);
+			const FieldType * T22 = &Tij(x, 2, 2);
+			const FieldType * T01 = &Tij(x, 0, 1);
+			const FieldType * T02 = &Tij(x, 0, 2);
+			const FieldType * T12 = &Tij(x, 1, 2);
+			FieldType * S00 = &Sij(x, 0, 0);
+			FieldType * S11 = &Sij(x, 1, 1);
+			FieldType * S22 = &Sij(x, 2, 2);
+			FieldType * S01 = &Sij(x, 0, 1);
+			FieldType * S02 = &Sij(x, 0, 2);
+			FieldType * S12 = &Sij(x, 1, 2);
+			FieldType * dP = &deltaPm(x);
+
+#pragma omp simd
+			for (i0 = 0; i0 < rows.n0; i0++)
+			{
+				const FieldType * q = p + i0;
+				const long t = (long) i0 * ncT;
+				const long s = (long) i0 * ncS;
+				double S; // components are accumulated in double precision
+
+				// 0-0-component:
+				S = coeff * T00[t];
 #ifdef PHINONLINEAR
 #ifdef ORIGINALMETRIC
-		Sij(x, 0, 0) -= 4. * phi(x) * (phi(x-0) + phi(x+0) - 2. * phi(x));
-		Sij(x, 0, 0) -= 0.5 * (phi(x+0) - phi(x-0)) * (phi(x+0) - phi(x-0));
+				S -= 4. * q[0] * (q[-1] + q[1] - 2. * q[0]);
+				S -= 0.5 * (q[1] - q[-1]) * (q[1] - q[-1]);
 #else
-		Sij(x, 0, 0) += 0.5 * (phi(x+0) - phi(x-0)) * (phi(x+0) - phi(x-0));
+				S += 0.5 * (q[1] - q[-1]) * (q[1] - q[-1]);
 #endif
 #endif
+				S00[s] = S;
 
-		// 1-1-component:
-		Sij(x, 1, 1) = coeff * Tij(x, 1, 1);
+				// 1-1-component:
+				S = coeff * T11[t];
 #ifdef PHINONLINEAR
 #ifdef ORIGINALMETRIC
-		Sij(x, 1, 1) -= 4. * phi(x) * (phi(x-1) + phi(x+1) - 2. * phi(x));
-		Sij(x, 1, 1) -= 0.5 * (phi(x+1) - phi(x-1)) * (phi(x+1) - phi(x-1));
+				S -= 4. * q[0] * (q[-j1] + q[j1] - 2. * q[0]);
+				S -= 0.5 * (q[j1] - q[-j1]) * (q[j1] - q[-j1]);
 #else
-		Sij(x, 1, 1) += 0.5 * (phi(x+1) - phi(x-1)) * (phi(x+1) - phi(x-1));
+				S += 0.5 * (q[j1] - q[-j1]) * (q[j1] - q[-j1]);
 #endif
 #endif
+				S11[s] = S;
 
-		// 2-2-component:
-		Sij(x, 2, 2) = coeff * Tij(x, 2, 2);
+				// 2-2-component:
+				S = coeff * T22[t];
 #ifdef PHINONLINEAR
 #ifdef ORIGINALMETRIC
-		Sij(x, 2, 2) -= 4. * phi(x) * (phi(x-2) + phi(x+2) - 2. * phi(x));
-		Sij(x, 2, 2) -= 0.5 * (phi(x+2) - phi(x-2)) * (phi(x+2) - phi(x-2));
+				S -= 4. * q[0] * (q[-j2] + q[j2] - 2. * q[0]);
+				S -= 0.5 * (q[j2] - q[-j2]) * (q[j2] - q[-j2]);
 #else
-		Sij(x, 2, 2) += 0.5 * (phi(x+2) - phi(x-2)) * (phi(x+2) - phi(x-2));
+				S += 0.5 * (q[j2] - q[-j2]) * (q[j2] - q[-j2]);
 #endif
 #endif
+				S22[s] = S;
 
-		// 0-1-component:
-		Sij(x, 0, 1) = coeff * Tij(x, 0, 1);
+				// 0-1-component:
+				S = coeff * T01[t];
 #ifdef PHINONLINEAR
-		Sij(x, 0, 1) += phi(x+0) * phi(x+1) - phi(x) * phi(x+0+1);
+				S += (double) q[1] * q[j1] - (double) q[0] * q[1+j1];
 #ifdef ORIGINALMETRIC
-		Sij(x, 0, 1) -= 1.5 * phi(x) * phi(x);
-		Sij(x, 0, 1) += 1.5 * phi(x+0) * phi(x+0);
-		Sij(x, 0, 1) += 1.5 * phi(x+1) * phi(x+1);
-		Sij(x, 0, 1) -= 1.5 * phi(x+0+1) * phi(x+0+1);
+				S -= 1.5 * q[0] * q[0];
+				S += 1.5 * q[1] * q[1];
+				S += 1.5 * q[j1] * q[j1];
+				S -= 1.5 * q[1+j1] * q[1+j1];
 #else
-		Sij(x, 0, 1) += 0.5 * phi(x) * phi(x);
-		Sij(x, 0, 1) -= 0.5 * phi(x+0) * phi(x+0);
-		Sij(x, 0, 1) -= 0.5 * phi(x+1) * phi(x+1);
-		Sij(x, 0, 1) += 0.5 * phi(x+0+1) * phi(x+0+1);
+				S += 0.5 * q[0] * q[0];
+				S -= 0.5 * q[1] * q[1];
+				S -= 0.5 * q[j1] * q[j1];
+				S += 0.5 * q[1+j1] * q[1+j1];
 #endif
 #endif
+				S01[s] = S;
 
-		// 0-2-component:
-		Sij(x, 0, 2) = coeff * Tij(x, 0, 2);
+				// 0-2-component:
+				S = coeff * T02[t];
 #ifdef PHINONLINEAR
-		Sij(x, 0, 2) += phi(x+0) * phi(x+2) - phi(x) * phi(x+0+2);
+				S += (double) q[1] * q[j2] - (double) q[0] * q[1+j2];
 #ifdef ORIGINALMETRIC
-		Sij(x, 0, 2) -= 1.5 * phi(x) * phi(x);
-		Sij(x, 0, 2) += 1.5 * phi(x+0) * phi(x+0);
-		Sij(x, 0, 2) += 1.5 * phi(x+2) * phi(x+2);
-		Sij(x, 0, 2) -= 1.5 * phi(x+0+2) * phi(x+0+2);
+				S -= 1.5 * q[0] * q[0];
+				S += 1.5 * q[1] * q[1];
+				S += 1.5 * q[j2] * q[j2];
+				S -= 1.5 * q[1+j2] * q[1+j2];
 #else
-		Sij(x, 0, 2) += 0.5 * phi(x) * phi(x);
-		Sij(x, 0, 2) -= 0.5 * phi(x+0) * phi(x+0);
-		Sij(x, 0, 2) -= 0.5 * phi(x+2) * phi(x+2);
-		Sij(x, 0, 2) += 0.5 * phi(x+0+2) * phi(x+0+2);
+				S += 0.5 * q[0] * q[0];
+				S -= 0.5 * q[1] * q[1];
+				S -= 0.5 * q[j2] * q[j2];
+				S += 0.5 * q[1+j2] * q[1+j2];
 #endif
 #endif
+				S02[s] = S;
 
-		// 1-2-component:
-		Sij(x, 1, 2) = coeff * Tij(x, 1, 2);
+				// 1-2-component:
+				S = coeff * T12[t];
 #ifdef PHINONLINEAR
-		Sij(x, 1, 2) += phi(x+1) * phi(x+2) - phi(x) * phi(x+1+2);
+				S += (double) q[j1] * q[j2] - (double) q[0] * q[j1+j2];
 #ifdef ORIGINALMETRIC
-		Sij(x, 1, 2) -= 1.5 * phi(x) * phi(x);
-		Sij(x, 1, 2) += 1.5 * phi(x+1) * phi(x+1);
-		Sij(x, 1, 2) += 1.5 * phi(x+2) * phi(x+2);
-		Sij(x, 1, 2) -= 1.5 * phi(x+1+2) * phi(x+1+2);
+				S -= 1.5 * q[0] * q[0];
+				S += 1.5 * q[j1] * q[j1];
+				S += 1.5 * q[j2] * q[j2];
+				S -= 1.5 * q[j1+j2] * q[j1+j2];
 #else
-		Sij(x, 1, 2) += 0.5 * phi(x) * phi(x);
-		Sij(x, 1, 2) -= 0.5 * phi(x+1) * phi(x+1);
-		Sij(x, 1, 2) -= 0.5 * phi(x+2) * phi(x+2);
-		Sij(x, 1, 2) += 0.5 * phi(x+1+2) * phi(x+1+2);
+				S += 0.5 * q[0] * q[0];
+				S -= 0.5 * q[j1] * q[j1];
+				S -= 0.5 * q[j2] * q[j2];
+				S += 0.5 * q[j1+j2] * q[j1+j2];
 #endif
 #endif
-       deltaPm(x) =  (Tij(x, 0, 0) + Tij(x, 1, 1) + Tij(x, 2, 2))/3.0;
-	//    COUT << "deltaPm =  " << deltaPm(x) << endl;
+				
+				S12[s] = S;
+
+				dP[i0] = (T00[t] + T11[t] + T22[t]) / 3.0;
+			}
+		}
 	}
 }
 
 //////////////////////////
-// KGB Stress Tensor
+// kgb_coefficients
 //////////////////////////
 // Description:
-//   Projection of the KGB field for the stress-energy tensor (Tmunu).
-//   This function calculates the components of the stress tensor and includes geometric corrections 
-//   through the Bardeen potential.
+//   background-dependent coefficients of the KGB equations of motion
+//   (update_zeta, update_kgb) and of the KGB stress tensor
+//   (projection_Tmunu_kgb), all in code units. The structure only contains
+//   doubles such that it can be interpolated component by component.
+//
+//////////////////////////
+
+struct kgb_coefficients
+{
+	double Hconf;
+	// zeta equation: A_zeta_prime zeta' + A_zeta zeta + A_pi pi + ... = 0
+	double A_zeta_prime, A_zeta, A_pi, A_psi, A_phi_prime, A_Laplace_pi, A_Laplace_psi, A_deltaPm;
+	// T00, including the factor a^3
+	double T00_Laplace_pi, T00_psi, T00_zeta, T00_phi_prime, T00_pi;
+	// Tij (diagonal), including the factor a^3
+	double Tij_deltaPm, Tij_Laplace_psi, Tij_psi, Tij_phi_prime, Tij_Laplace_pi, Tij_zeta, Tij_pi;
+};
+
+#define KGB_NUM_COEFFICIENTS (sizeof(kgb_coefficients) / sizeof(double))
+
+//////////////////////////
+// kgb_coefficients_compute
+//////////////////////////
+// Description:
+//   evaluates the KGB coefficients for a given background
 //
 // Arguments:
-//   T00           reference to the target field for the 00-component of the stress-energy tensor
-//   T0i           reference to the target field for the 0i-components of the stress-energy tensor
-//   Tij           reference to the target field for the ij-components of the stress-energy tensor
-//   dx            lattice spacing (unused in this function)
-//   a             scale factor at the time of projection 
-//   phi           reference to the KGB scalar field configuration
-//   pi_k          reference to the KGB momentum field (in units of 1/H)
-//   zeta_half      reference to the zeta field at half time steps for the stress tensor calculation -- Note that this can be improved as zeta better to be at integer steps synched with particles!
-//   coeff1        coefficient related to the pressure and energy density of the scalar field, normalized by critical density and divided by the sound speed squared: coeff1 = a^3 * (p_smg + rho_smg) / rho_crit / cs2
-//   coeff2        coefficient related to the energy density of the scalar field, normalized by critical density: coeff2 = a^3 * (p_smg + rho_smg) / rho_crit
-//   ca2           adiabatic sound speed squared (in the case of KGB without HiCLASS, c_a^2 = w)
-//   cs2           scalar field sound speed squared
-//   Hcon          conformal Hubble parameter (H/a), relevant in Gevolution's units
-//   non_linearity integer flag indicating whether non-linear terms are included (1 for yes, 0 for no)
-//   method        integer flag indicating the method used for solving the equations:
-//                    - method = 1: vector elliptic method is used
-//                    - method = 0: default method
+//   coeff          reference to the structure which will contain the result
+//   a              scale factor
+//   fourpiG        "4 pi G"
+//   H0_hiclass     Hubble constant in hiclass units
+//   Hconf          conformal Hubble rate
+//   Hconf_prime    derivative of the conformal Hubble rate
+//   Hconf_prime_prime  second derivative of the conformal Hubble rate
+//   rho_s          background energy density of the scalar field (hiclass units)
+//   P_s            background pressure of the scalar field (hiclass units)
+//   P_s_prime      derivative of the background pressure (hiclass units)
+//   rho_crit       critical density today (hiclass units)
+//   alpha_K        kineticity
+//   alpha_B        braiding
+//   alpha_K_prime  derivative of the kineticity (hiclass units)
+//   alpha_B_prime  derivative of the braiding (hiclass units)
 //
 // Returns:
-//   (none)
 //
-// Coefficients:
-//   coeff1: a^3 * (p_smg + rho_smg) / rho_crit / cs2, where
-//           - p_smg: pressure of the scalar field
-//           - rho_smg: energy density of the scalar field
-//           - rho_crit: critical density
-//           - cs2: scalar field sound speed squared
+//////////////////////////
+
+void kgb_coefficients_compute(kgb_coefficients & coeff, double a, double fourpiG, double H0_hiclass, double Hconf, double Hconf_prime, double Hconf_prime_prime,
+ double rho_s, double P_s, double P_s_prime, double rho_crit, double alpha_K, double alpha_B, double alpha_K_prime, double alpha_B_prime)
+{
+  double Mpl2 = 1./(2. * fourpiG); //   fourpiG   1/2 Mpl^2 in the code unit
+
+  // Introducing tilde rho and P (equations of motion)
+  double rho_s_tilde     =  3. * rho_s *(2./3.*fourpiG)/(H0_hiclass * H0_hiclass);
+  double P_s_tilde       =  3. * P_s *(2./3.*fourpiG)/(H0_hiclass * H0_hiclass);
+  double P_s_prime_tilde =  3. * P_s_prime *(2./3.*fourpiG)/(H0_hiclass * H0_hiclass) * sqrt(2./3.*fourpiG)/H0_hiclass; // sqrt is for the derivative unit consideration
+
+  // (stress tensor)
+  double rho_plus_P      =  (rho_s + P_s) / rho_crit;
+  double P_s_prime_gev   =  (P_s_prime / rho_crit) * sqrt(2./3.*fourpiG)/H0_hiclass;
+
+  // Other unit transformations
+  alpha_B_prime = alpha_B_prime * sqrt(2./3.*fourpiG)/H0_hiclass; // alpha_B_prime[gevolution]  = alpha_B_prime[hiclass ][1/Mpc] * H_0 [gevolution]/ H_0 [hiclass]
+  alpha_K_prime = alpha_K_prime * sqrt(2./3.*fourpiG)/H0_hiclass; // alpha_K_prime[gevolution]  = alpha_K_prime[hiclass ][1/Mpc] * H_0 [gevolution]/ H_0 [hiclass]
+
+  coeff.Hconf = Hconf;
+
+  // Coefficients of the perturbations in the equation of motion for the scalar field perturbation
+  coeff.A_Laplace_psi = - alpha_B / Hconf;
+  coeff.A_zeta_prime  = (3./2.) * alpha_B * alpha_B + alpha_K;
+  coeff.A_deltaPm     = - (3. * alpha_B * a * a) / (2. * Mpl2 * Hconf);
+  coeff.A_phi_prime   = - (3. * alpha_B_prime) / Hconf + alpha_B * (3. - 3. * Hconf_prime / (Hconf * Hconf))  - (3. * a * a / (Hconf * Hconf)) * (rho_s_tilde + P_s_tilde);
+  coeff.A_Laplace_pi  = - alpha_B_prime / Hconf - alpha_B * Hconf_prime / (Hconf * Hconf) - (a * a / (Hconf * Hconf)) * (rho_s_tilde + P_s_tilde);
+  coeff.A_psi         = - 3. * alpha_B_prime + alpha_B * (3. * Hconf - 3. * Hconf_prime / Hconf) - (3. * a * a / Hconf ) * (rho_s_tilde + P_s_tilde);
+  coeff.A_pi          = alpha_B_prime * (3. * Hconf - 3. * Hconf_prime /  Hconf) + alpha_B * (- 3. * Hconf_prime_prime / Hconf + 9. * Hconf_prime - 3. * Hconf_prime * Hconf_prime / (Hconf * Hconf) - 3. * a * a * P_s_prime_tilde / (2. * Hconf)) + a * a * (3. * rho_s_tilde - 3. * Hconf_prime * rho_s_tilde / (Hconf * Hconf) + 3. * P_s_tilde - 3. * Hconf_prime * P_s_tilde / (Hconf * Hconf));
+  coeff.A_zeta        = alpha_K_prime + alpha_B * alpha_B * (3. * Hconf + 3. * Hconf_prime / (2. * Hconf)) + alpha_K * (Hconf + 2 * Hconf_prime /  Hconf) + (3./2.) * alpha_B * ( alpha_B_prime - (a * a / Hconf) * (rho_s_tilde + P_s_tilde));
+
+  // T^0_0 = -\rho-\delta\rho, we have also -1 factor from gevolution notation and in the snapshots we record -T^0_0 and this makes everything positive
+  coeff.T00_Laplace_pi = -1 * pow(a , 3) * (Mpl2 / (a * a)) * alpha_B * Hconf;
+  coeff.T00_psi        = -1 * pow(a , 3) * (Mpl2 / (a * a)) * 3. * alpha_B * Hconf * Hconf;
+  coeff.T00_zeta       =      pow(a , 3) * (Mpl2 / (a * a)) * (3. * alpha_B + alpha_K) * Hconf * Hconf;
+  coeff.T00_phi_prime  = -1 * pow(a , 3) * (Mpl2 / (a * a)) * 3. * alpha_B * Hconf;
+  coeff.T00_pi         = -1 * pow(a , 3) * ( (Mpl2 / (a * a)) * alpha_B * Hconf_prime- (Mpl2 / (a * a)) * alpha_B * Hconf * Hconf + rho_plus_P) * 3. * Hconf;
+
+  // The coeffs for Tij only:
+  double Coeff0 = 3. * alpha_B * alpha_B + 2. * alpha_K;
+
+  coeff.Tij_deltaPm     = pow(a , 3) * (-3. * alpha_B * alpha_B / Coeff0);
+  coeff.Tij_Laplace_psi = pow(a , 3) * (-2. * Mpl2 * alpha_B * alpha_B / (Coeff0 * a * a));
+  coeff.Tij_psi         = pow(a , 3) * ( 6. * alpha_B * (Mpl2 * alpha_B * Hconf * Hconf - Mpl2 * Hconf * alpha_B_prime - Mpl2 * alpha_B * Hconf_prime - a * a * rho_plus_P) / (Coeff0 * a * a));
+  coeff.Tij_phi_prime   = coeff.Tij_psi / Hconf;
+  coeff.Tij_Laplace_pi  = pow(a , 3) * (-2. * alpha_B * (Mpl2 * Hconf * alpha_B_prime + Mpl2 * alpha_B * Hconf_prime + a * a * rho_plus_P) / (Coeff0 * Hconf * a * a));
+  coeff.Tij_zeta        = pow(a , 3) * (-2. * (Mpl2 * alpha_B * alpha_K * Hconf * Hconf + Mpl2 * alpha_K * Hconf * alpha_B_prime - Mpl2 * alpha_B * Hconf * alpha_K_prime - Mpl2 * alpha_B * alpha_K * Hconf_prime - alpha_K * a * a * rho_plus_P) / (Coeff0 * a * a));
+  coeff.Tij_pi          = pow(a , 3) * ( 2. * (3. * Mpl2 * alpha_B * alpha_B * (3. * Hconf * Hconf * Hconf_prime - Hconf * Hconf_prime_prime - Hconf_prime * Hconf_prime ) + 3. * Mpl2 * alpha_B * alpha_B_prime * ( Hconf * Hconf * Hconf - Hconf * Hconf_prime) +
+	3. * alpha_B * a * a * (Hconf * Hconf * rho_plus_P -  Hconf_prime * rho_plus_P) + alpha_K * Hconf * P_s_prime_gev * a * a ) / (Coeff0 * Hconf * a * a));
+}
+
+//////////////////////////
+// kgb_coefficient_table
+//////////////////////////
+// Description:
+//   table of KGB coefficients on a grid which is uniform in ln(a), such that
+//   the coefficients at any time can be obtained from a single index
+//   computation and a linear interpolation between two nodes
+//
+//////////////////////////
+
+struct kgb_coefficient_table
+{
+	int size;
+	double lna_min;
+	double inv_dlna;
+	kgb_coefficients * coeff;
+};
+
+#define KGB_TABLE_TOLERANCE 1.e-6  // maximum relative deviation from kgb_coefficients_compute accepted at startup
+
+//////////////////////////
+// kgb_coefficients_lookup
+//////////////////////////
+// Description:
+//   linear interpolation of the tabulated KGB coefficients in ln(a);
+//   outside the tabulated range the first / last interval is extrapolated
 //
-//   coeff2: a^3 * (p_smg + rho_smg) / rho_crit, where
-//           - p_smg: pressure of the scalar field
-//           - rho_smg: energy density of the scalar field
-//           - rho_crit: critical density
+// Arguments:
+//   table          reference to the coefficient table
+//   a              scale factor
+//   coeff          reference to the structure which will contain the result
+//
+// Returns:
 //
 //////////////////////////
 
+void kgb_coefficients_lookup(const kgb_coefficient_table & table, const double a, kgb_coefficients & coeff)
+{
+	double u = (log(a) - table.lna_min) * table.inv_dlna;
+	int i = (int) floor(u);
 
-template <class FieldType>
-void projection_Tmunu_kgb( Field<FieldType> & T00, Field<FieldType> & T0i, Field<FieldType> & Tij, double dx, double a, double fourpiG, double H0_hiclass, Field<FieldType> & phi, Field<FieldType> & chi,
- Field<FieldType> & phi_prime, Field<FieldType> & pi_k, Field<FieldType> & zeta_half, Field<FieldType> & deltaPm, double Hconf, double Hconf_prime, double Hconf_prime_prime, double rho_s, double P_s, double P_s_prime, double rho_crit,
- double alpha_K, double alpha_B, double alpha_K_prime, double alpha_B_prime)
-  {
+	if (i < 0) i = 0;
+	else if (i > table.size - 2) i = table.size - 2;
+	u -= i;
 
-    Site xField(phi.lattice());
-	// Site x(phi.lattice());
+	const double * c0 = (const double *) (table.coeff + i);
+	const double * c1 = (const double *) (table.coeff + i + 1);
+	double * c = (double *) &coeff;
 
-    double Mpl2 = 1./(2. * fourpiG); //   fourpiG   1/2 Mpl^2 in the code unit
-	// double Mpl2 = rho_crit / (3 * H0_hiclass * H0_hiclass); //   fourpiG   1/2 Mpl^2 in the code unit
+	for (size_t n = 0; n < KGB_NUM_COEFFICIENTS; n++)
+		c[n] = c0[n] + u * (c1[n] - c0[n]);
+}
 
+//////////////////////////
+// free_kgb_coefficient_table
+//////////////////////////
+// Description:
+//   releases the memory of a table set up by initialize_kgb_coefficient_table
+//
+// Arguments:
+//   table          reference to the coefficient table
+//
+// Returns:
+//
+//////////////////////////
 
-	// Introducing tilde rho and P
-	// double rho_s_gev      =  3. * rho_s *(2./3.*fourpiG)/(H0_hiclass * H0_hiclass);
-	// double P_s_gev      =  3. * P_s *(2./3.*fourpiG)/(H0_hiclass * H0_hiclass);
-	// double rho_plus_P     =  rho_s_gev + P_s_gev;
+void free_kgb_coefficient_table(kgb_coefficient_table & table)
+{
+	free(table.coeff);
+	table.coeff = NULL;
+	table.size = 0;
+}
 
-	// double P_s_prime_gev =  3. * P_s_prime *(2./3.*fourpiG)/(H0_hiclass * H0_hiclass) * sqrt(2./3.*fourpiG)/H0_hiclass; // sqrt is for the derivative unit consideration
+#ifdef HAVE_HICLASS_BG
+//////////////////////////
+// kgb_coefficients_spline
+//////////////////////////
+// Description:
+//   evaluates the KGB coefficients directly from the hiclass background
+//   splines (see kgb_coefficients_compute)
+//
+// Arguments:
+//   coeff          reference to the structure which will contain the result
+//   a              scale factor (within the range of the splines)
+//   fourpiG        "4 pi G"
+//   H_spline, ...  hiclass background splines
+//   acc            interpolation accelerator for the splines
+//
+// Returns:
+//
+//////////////////////////
 
-    double rho_plus_P     =  (rho_s + P_s) / rho_crit;
-    double P_s_prime_gev      =  (P_s_prime / rho_crit) * sqrt(2./3.*fourpiG)/H0_hiclass; // sqrt is for the derivative unit consideration
+void kgb_coefficients_spline(kgb_coefficients & coeff, const double a, const double fourpiG, gsl_spline * H_spline, gsl_spline * rho_smg_spline,
+ gsl_spline * p_smg_spline, gsl_spline * p_smg_prime_spline, gsl_spline * rho_crit_spline, gsl_spline * alpha_K_spline, gsl_spline * alpha_B_spline,
+ gsl_spline * alpha_K_prime_spline, gsl_spline * alpha_B_prime_spline, gsl_interp_accel * acc)
+{
+	kgb_coefficients_compute(coeff, a, fourpiG, gsl_spline_eval(H_spline, 1., acc),
+		Hconf(a, fourpiG, H_spline, acc), Hconf_prime(a, fourpiG, H_spline, acc), Hconf_prime_prime(a, fourpiG, H_spline, acc),
+		gsl_spline_eval(rho_smg_spline, a, acc), gsl_spline_eval(p_smg_spline, a, acc), gsl_spline_eval(p_smg_prime_spline, a, acc), gsl_spline_eval(rho_crit_spline, 1., acc),
+		gsl_spline_eval(alpha_K_spline, a, acc), gsl_spline_eval(alpha_B_spline, a, acc), gsl_spline_eval(alpha_K_prime_spline, a, acc), gsl_spline_eval(alpha_B_prime_spline, a, acc));
+}
 
-    // Other unit transformations
-    alpha_B_prime = alpha_B_prime * sqrt(2./3.*fourpiG)/H0_hiclass; // alpha_B_prime[gevolution]  = alpha_B_prime[hiclass ][1/Mpc] * H_0 [gevolution]/ H_0 [hiclass]
-	alpha_K_prime = alpha_K_prime * sqrt(2./3.*fourpiG)/H0_hiclass; // alpha_K_prime[gevolution]  = alpha_K_prime[hiclass ][1/Mpc] * H_0 [gevolution]/ H_0 [hiclass]
+//////////////////////////
+// initialize_kgb_coefficient_table
+//////////////////////////
+// Description:
+//   tabulates the KGB coefficients between a_min (or the first spline
+//   node, if larger) and the last node of the hiclass background splines;
+//   this is done once at startup
+//
+// Arguments:
+//   table          reference to the table which will be allocated and filled
+//   size           number of nodes
+//   a_min          smallest scale factor required by the simulation
+//   fourpiG        "4 pi G"
+//   H_spline, ...  hiclass background splines
+//   acc            interpolation accelerator for the splines
+//
+// Returns:
+//
+//////////////////////////
 
+void initialize_kgb_coefficient_table(kgb_coefficient_table & table, const int size, const double a_min, const double fourpiG, gsl_spline * H_spline, gsl_spline * rho_smg_spline,
+ gsl_spline * p_smg_spline, gsl_spline * p_smg_prime_spline, gsl_spline * rho_crit_spline, gsl_spline * alpha_K_spline, gsl_spline * alpha_B_spline,
+ gsl_spline * alpha_K_prime_spline, gsl_spline * alpha_B_prime_spline, gsl_interp_accel * acc)
+{
+	double a;
+	double lna_max = log(H_spline->x[H_spline->size-1]);
 
+	table.size = (size > 1) ? size : 2;
+	table.lna_min = log((a_min > H_spline->x[0]) ? a_min : H_spline->x[0]);
+	table.inv_dlna = (table.size - 1) / (lna_max - table.lna_min);
+	table.coeff = (kgb_coefficients *) malloc(sizeof(kgb_coefficients) * table.size);
 
-	double Coeff0;
-    Coeff0 = 3. * alpha_B * alpha_B + 2. * alpha_K;
+	for (int i = 0; i < table.size; i++)
+	{
+		a = exp(table.lna_min + i / table.inv_dlna);
+		if (i == 0 && a < H_spline->x[0]) a = H_spline->x[0]; // avoid round-off outside the spline range
+		if (i == table.size - 1) a = H_spline->x[H_spline->size-1];
 
-    double A_Laplace_psi, A_deltaPm, A_phi_prime, A_Laplace_pi, A_psi, A_pi, A_zeta;
+		kgb_coefficients_spline(table.coeff[i], a, fourpiG, H_spline, rho_smg_spline, p_smg_spline, p_smg_prime_spline, rho_crit_spline,
+			alpha_K_spline, alpha_B_spline, alpha_K_prime_spline, alpha_B_prime_spline, acc);
+	}
+}
 
-    // The coeffs for Tij only:
+//////////////////////////
+// kgb_coefficient_table_deviation
+//////////////////////////
+// Description:
+//   compares the tabulated KGB coefficients with kgb_coefficients_spline at
+//   the midpoints of all intervals (where the interpolation error is
+//   largest); since several coefficients change sign, each one is compared
+//   relative to its largest absolute value in the table
+//
+// Arguments:
+//   table          reference to the coefficient table
+//   fourpiG        "4 pi G"
+//   H_spline, ...  hiclass background splines
+//   acc            interpolation accelerator for the splines
+//
+// Returns: largest relative deviation of any coefficient
+//
+//////////////////////////
 
-	A_deltaPm      = -3. * alpha_B * alpha_B / Coeff0;
-	A_Laplace_psi  = -2. * Mpl2 * alpha_B * alpha_B / (Coeff0 * a * a);
-	A_psi          =  6. * alpha_B * (Mpl2 * alpha_B * Hconf * Hconf - Mpl2 * Hconf * alpha_B_prime - Mpl2 * alpha_B * Hconf_prime - a * a * rho_plus_P) / (Coeff0 * a * a);
-	A_phi_prime    = A_psi / Hconf;
-	A_Laplace_pi   = -2. * alpha_B * (Mpl2 * Hconf * alpha_B_prime + Mpl2 * alpha_B * Hconf_prime + a * a * rho_plus_P) / (Coeff0 * Hconf * a * a);
-	A_zeta         = -2. * (Mpl2 * alpha_B * alpha_K * Hconf * Hconf + Mpl2 * alpha_K * Hconf * alpha_B_prime - Mpl2 * alpha_B * Hconf * alpha_K_prime - Mpl2 * alpha_B * alpha_K * Hconf_prime - alpha_K * a * a * rho_plus_P) / (Coeff0 * a * a);
-	A_pi           =  2. * (3. * Mpl2 * alpha_B * alpha_B * (3. * Hconf * Hconf * Hconf_prime - Hconf * Hconf_prime_prime - Hconf_prime * Hconf_prime ) + 3. * Mpl2 * alpha_B * alpha_B_prime * ( Hconf * Hconf * Hconf - Hconf * Hconf_prime) + 
-	3. * alpha_B * a * a * (Hconf * Hconf * rho_plus_P -  Hconf_prime * rho_plus_P) + alpha_K * Hconf * P_s_prime_gev * a * a ) / (Coeff0 * Hconf * a * a);
+double kgb_coefficient_table_deviation(const kgb_coefficient_table & table, const double fourpiG, gsl_spline * H_spline, gsl_spline * rho_smg_spline,
+ gsl_spline * p_smg_spline, gsl_spline * p_smg_prime_spline, gsl_spline * rho_crit_spline, gsl_spline * alpha_K_spline, gsl_spline * alpha_B_spline,
+ gsl_spline * alpha_K_prime_spline, gsl_spline * alpha_B_prime_spline, gsl_interp_accel * acc)
+{
+	kgb_coefficients exact, interp;
+	double cmax[KGB_NUM_COEFFICIENTS], dev[KGB_NUM_COEFFICIENTS];
+	const double * c;
+	double a, d;
+	size_t n;
 
+	for (n = 0; n < KGB_NUM_COEFFICIENTS; n++)
+		cmax[n] = dev[n] = 0.;
 
-	double psi, Laplacian_pi, Laplacian_psi;
-    for (xField.first(); xField.test(); xField.next())
-      {
-		//****************************************************************
-		//Laplace pi, pi(n) since pi is not updated yet
-		//****************************************************************
-		Laplacian_pi = pi_k(xField-0) + pi_k(xField+0) - 2. * pi_k(xField); 
-		Laplacian_pi += pi_k(xField+1) + pi_k(xField-1) - 2. * pi_k(xField);
-		Laplacian_pi += pi_k(xField+2) + pi_k(xField-2) - 2. * pi_k(xField);
-		Laplacian_pi = Laplacian_pi/(dx*dx);
+	for (int i = 0; i < table.size; i++)
+	{
+		c = (const double *) (table.coeff + i);
+		for (n = 0; n < KGB_NUM_COEFFICIENTS; n++)
+			if (fabs(c[n]) > cmax[n]) cmax[n] = fabs(c[n]);
+	}
 
+	for (int i = 0; i < table.size - 1; i++)
+	{
+		a = exp(table.lna_min + (i + 0.5) / table.inv_dlna);
+		if (a < H_spline->x[0] || a > H_spline->x[H_spline->size-1]) continue;
+
+		kgb_coefficients_spline(exact, a, fourpiG, H_spline, rho_smg_spline, p_smg_spline, p_smg_prime_spline, rho_crit_spline,
+			alpha_K_spline, alpha_B_spline, alpha_K_prime_spline, alpha_B_prime_spline, acc);
+		kgb_coefficients_lookup(table, a, interp);
 
-		// Laplacian_pi = -1. * (pi_k(xField+0+0) + pi_k(xField-0-0)) + 16.* (pi_k(xField-0) + pi_k(xField+0)) - 30. * pi_k(xField); 
-		// Laplacian_pi += -1. * (pi_k(xField+1+1) + pi_k(xField-1-1)) + 16.* (pi_k(xField-1) + pi_k(xField+1))  - 30. * pi_k(xField);
-		// Laplacian_pi += -1. * (pi_k(xField+2+2) + pi_k(xField-2-2)) + 16.* (pi_k(xField-2) + pi_k(xField+2))  - 30. * pi_k(xField);
-		// Laplacian_pi = Laplacian_pi/(12.*dx*dx);
+		for (n = 0; n < KGB_NUM_COEFFICIENTS; n++)
+		{
+			d = fabs(((const double *) &interp)[n] - ((const double *) &exact)[n]);
+			if (d > dev[n]) dev[n] = d;
+		}
+	}
 
+	d = 0.;
+	for (n = 0; n < KGB_NUM_COEFFICIENTS; n++)
+	{
+		if (cmax[n] > 0.) dev[n] /= cmax[n];
+		if (dev[n] > d) d = dev[n];
+	}
 
+	return d;
+}
+#endif
+
+//////////////////////////
+// KGB Stress Tensor
+//////////////////////////
+// Description:
+//   Projection of the KGB field for the stress-energy tensor (Tmunu).
+//   This function calculates the components of the stress tensor and includes geometric corrections 
+//   through the Bardeen potential. The field has no momentum density and no anisotropic stress at
+//   the order considered here, hence T0i and the off-diagonal components of Tij are set to zero.
+//   Optionally, the result is added to the source fields of the Einstein equations in the same
+//   sweep (T00 to source, 2 Tij to Sij), and the averages needed for the homogeneous T00 are
+//   accumulated on the fly.
+//
+// Arguments:
+//   T00           reference to the target field for the 00-component of the stress-energy tensor
+//   T0i           reference to the target field for the 0i-components of the stress-energy tensor
+//   Tij           reference to the target field for the ij-components of the stress-energy tensor
+//   dx            lattice spacing
+//   phi           reference to the Bardeen potential phi(n)
+//   chi           reference to chi(n) = phi(n) - psi(n)
+//   phi_prime     reference to phi'(n)
+//   pi_k          reference to the KGB momentum field (in units of 1/H)
+//   zeta_half      reference to the zeta field at half time steps for the stress tensor calculation -- Note that this can be improved as zeta better to be at integer steps synched with particles!
+//   deltaPm       reference to the matter pressure perturbation
+//   coeff         KGB coefficients at the time of projection (see kgb_coefficients)
+//   source        pointer to the 00-source field to which T00 is added (optional)
+//   Sij           pointer to the ij-source field to which 2 Tij is added (required if source is given)
+//   sums          pointer to an array of two entries which will contain the sums over the entire
+//                 lattice of the updated source and of T00 (optional, requires source)
+//
+// Returns:
+//   (none)
+//
+//////////////////////////
+
+
+template <class FieldType>
+void projection_Tmunu_kgb( Field<FieldType> & T00, Field<FieldType> & T0i, Field<FieldType> & Tij, double dx, Field<FieldType> & phi, Field<FieldType> & chi,
+ Field<FieldType> & phi_prime, Field<FieldType> & pi_k, Field<FieldType> & zeta_half, Field<FieldType> & deltaPm, const kgb_coefficients & coeff,
+ Field<FieldType> * source = NULL, Field<FieldType> * Sij = NULL, double * sums = NULL)
+  {
+    lattice_rows rows, rowsKGB; // pi_k and zeta_half may carry a deeper halo
+    initialize_rows(rows, phi.lattice());
+    initialize_rows(rowsKGB, pi_k.lattice());
+
+    Site xField(phi.lattice());
+    Site xKGB(pi_k.lattice());
+
+    const double idx2 = 1. / (dx * dx);
+    const int ncT = Tij.components();
+    const int ncS = (Sij != NULL) ? Sij->components() : 0;
+    int i0, i1, i2;
+
+	double psi, Laplacian_pi, Laplacian_psi, Tii;
+	double sum_source = 0., sum_T00 = 0.;
+#pragma omp parallel for private(i0, i1, psi, Laplacian_pi, Laplacian_psi, Tii) firstprivate(xField, xKGB) reduction(+:sum_source,sum_T00)
+    for (i2 = 0; i2 < rows.n2; i2++)
+      {
+        for (i1 = 0; i1 < rows.n1; i1++)
+          {
+            xField.setIndex(row_index(rows, i1, i2));
+            xKGB.setIndex(row_index(rowsKGB, i1, i2));
+
+            const FieldType * pphi = &phi(xField);
+            const FieldType * pchi = &chi(xField);
+            const FieldType * pphi_prime = &phi_prime(xField);
+            const FieldType * pdeltaPm = &deltaPm(xField);
+            const FieldType * ppi = &pi_k(xKGB);
+            const FieldType * pzeta = &zeta_half(xKGB);
+            FieldType * pT00 = &T00(xField);
+            FieldType * pT0i = &T0i(xField, 0);
+            FieldType * pTij = &Tij(xField, 0, 0);
+
+#pragma omp simd private(psi, Laplacian_pi, Laplacian_psi, Tii)
+            for (i0 = 0; i0 < rows.n0; i0++)
+              {
+		//****************************************************************
+		//Laplace pi, pi(n) since pi is not updated yet
+		//****************************************************************
+		Laplacian_pi = laplacian_7pt(ppi + i0, rowsKGB.jump1, rowsKGB.jump2) * idx2;
 
 		//****************************************************************
 		//Laplace psi, psi(n) since psi is not updated yet
 		//****************************************************************
-		Laplacian_psi = (phi(xField-0)- chi(xField-0)) + (phi(xField+0)- chi(xField+0)) - 2. * (phi(xField)- chi(xField)); 
-		Laplacian_psi += (phi(xField-1)- chi(xField-1)) + (phi(xField+1)- chi(xField+1)) - 2. * (phi(xField)- chi(xField));
-		Laplacian_psi += (phi(xField-2)- chi(xField-2)) + (phi(xField+2)- chi(xField+2)) - 2. * (phi(xField)- chi(xField));
-		Laplacian_psi = Laplacian_psi/(dx*dx);
+		Laplacian_psi = (laplacian_7pt(pphi + i0, rows.jump1, rows.jump2) - laplacian_7pt(pchi + i0, rows.jump1, rows.jump2)) * idx2;
 
-		psi = phi(xField) - chi(xField); //psi(n)
+		psi = pphi[i0] - pchi[i0]; //psi(n)
         //************************
         //STRESS TENSOR COMPONENTS
         //************************
-        // 0-0-component: (Time,Time)
-        // T00(xField)       = -1 * pow(a,3) * (rho_s/rho_crit)+ 0.*((rho_s/rho_crit) -1 * pow(a , 3) * ((Mpl2 / (a * a)) * (alpha_B * Hconf * Laplacian_pi + 3. * alpha_B * Hconf * phi_prime(xField) ) 
-		// 					  ));
-
 	  // T^0_0 = -\rho-\delta\rho, we have also -1 factor from gevolution notation and in the snapshots we record -T^0_0 and this makes everything positive
 		
-		T00(xField)       =   -1 * pow(a , 3)  * ((Mpl2 / (a * a)) * ( alpha_B * Hconf * Laplacian_pi  + 3. * alpha_B * Hconf * Hconf * psi - (3. * alpha_B + alpha_K) * Hconf * Hconf * zeta_half(xField) + 3. * alpha_B * Hconf * phi_prime(xField))
-								+ ( (Mpl2 / (a * a)) * alpha_B * Hconf_prime- (Mpl2 / (a * a)) * alpha_B * Hconf * Hconf + rho_plus_P) * 3. * Hconf * pi_k(xField)); 
+		pT00[i0]          =   coeff.T00_Laplace_pi * Laplacian_pi + coeff.T00_psi * psi + coeff.T00_zeta * pzeta[i0] + coeff.T00_phi_prime * pphi_prime[i0] + coeff.T00_pi * ppi[i0];
 
-		// COUT<< COLORTEXT_CYAN << "delta_rho = "<< COLORTEXT_RESET << T00(xField) << endl;
-		// COUT<< COLORTEXT_LIGHT_BROWN  << "rho_back = "<< COLORTEXT_RESET << -1 * pow(a , 3) * rho_s/rho_crit << endl;					  
-        //*************************************************************************************
-		// T00(xField)  = 0;
-        // 1-1-component: (X,X)
-        Tij(xField, 0, 0) = pow(a , 3) * (+ A_deltaPm * deltaPm(xField) + A_Laplace_psi * Laplacian_psi + A_psi * psi + A_phi_prime * phi_prime(xField) + A_Laplace_pi * Laplacian_pi + A_zeta * zeta_half(xField) + A_pi * pi_k(xField)) ;
         //*************************************************************************************
-        // 2-2-component: (Y,Y)
-        Tij(xField, 1, 1) = pow(a , 3) * (+ A_deltaPm * deltaPm(xField) + A_Laplace_psi * Laplacian_psi + A_psi * psi + A_phi_prime * phi_prime(xField) + A_Laplace_pi * Laplacian_pi + A_zeta * zeta_half(xField) + A_pi * pi_k(xField)) ;
-        //*************************************************************************************
-        // 3-3-component: (Z,Z)
-        Tij(xField, 2, 2) = pow(a , 3) * (+ A_deltaPm * deltaPm(xField) + A_Laplace_psi * Laplacian_psi + A_psi * psi + A_phi_prime * phi_prime(xField) + A_Laplace_pi * Laplacian_pi + A_zeta * zeta_half(xField) + A_pi * pi_k(xField)) ;
-//  Tij(xField, 0, 0) = 0;
-//  Tij(xField, 1, 1) = 0;
-//  Tij(xField, 2, 2) = 0;
+        // diagonal components (X,X), (Y,Y), (Z,Z) are identical
+        Tii = coeff.Tij_deltaPm * pdeltaPm[i0] + coeff.Tij_Laplace_psi * Laplacian_psi + coeff.Tij_psi * psi + coeff.Tij_phi_prime * pphi_prime[i0] + coeff.Tij_Laplace_pi * Laplacian_pi + coeff.Tij_zeta * pzeta[i0] + coeff.Tij_pi * ppi[i0];
+        pTij[i0 * ncT]     = Tii; // (X,X)
+        pTij[i0 * ncT + 1] = 0.;
+        pTij[i0 * ncT + 2] = 0.;
+        pTij[i0 * ncT + 3] = Tii; // (Y,Y)
+        pTij[i0 * ncT + 4] = 0.;
+        pTij[i0 * ncT + 5] = Tii; // (Z,Z)
+        pT0i[3 * i0]     = 0.;
+        pT0i[3 * i0 + 1] = 0.;
+        pT0i[3 * i0 + 2] = 0.;
+              }
+
+            if (source != NULL) // the row just written is still in cache
+              {
+                FieldType * psource = &(*source)(xField);
+                FieldType * pSij = &(*Sij)(xField, 0, 0);
+
+#pragma omp simd reduction(+:sum_source,sum_T00)
+                for (i0 = 0; i0 < rows.n0; i0++)
+                  {
+                    psource[i0] += pT00[i0];
+                    pSij[i0 * ncS]     += 2. * pTij[i0 * ncT];
+                    pSij[i0 * ncS + 3] += 2. * pTij[i0 * ncT + 3];
+                    pSij[i0 * ncS + 5] += 2. * pTij[i0 * ncT + 5];
+                    sum_source += psource[i0];
+                    sum_T00 += pT00[i0];
+                  }
+              }
+          }
+      }
 
+    if (sums != NULL)
+      {
+        sums[0] = sum_source;
+        sums[1] = sum_T00;
+        parallel.sum<double>(sums, 2);
       }
   }
 
@@ -420,12 +812,37 @@ void projection_Tmunu_kgb( Field<FieldType> & T00, Field<FieldType> & T0i, Field
   void update_pi( double dtau, double dtau_main, Field<FieldType> & phi, Field<FieldType> & chi, Field<FieldType> & psi_prime, Field<FieldType> & pi_k , Field<FieldType> & zeta_half, double Hcon)
   {
     double psi_half;
-    double Coeff1 = 1./(1. + Hcon * dtau/2.); // everything at step n+1/2
+    const double Coeff1 = 1./(1. + Hcon * dtau/2.); // everything at step n+1/2
+
+    lattice_rows rows, rowsKGB;
+    initialize_rows(rows, phi.lattice());
+    initialize_rows(rowsKGB, pi_k.lattice()); // pi_k and zeta_half live on the KGB lattice (deep halo)
+
     Site x(phi.lattice());
-    for (x.first(); x.test(); x.next())
+    Site xKGB(pi_k.lattice());
+    int i0, i1, i2;
+
+#pragma omp parallel for private(i0, i1, psi_half) firstprivate(x, xKGB)
+    for (i2 = 0; i2 < rows.n2; i2++)
       {
-        psi_half =  phi(x) - chi(x) + psi_prime(x) * dtau_main/2.; //psi_half (n+1/2) = psi(n) + psi_prime'(n) dtau/2 // assuming psi is constant during a cycle time step of potential update
-        pi_k(x) = Coeff1 * ( pi_k(x)  + dtau * ( zeta_half(x) - Hcon * pi_k(x)/2. + psi_half ) ); //  pi_k(n+1) - pi Updating which is linear by definition
+        for (i1 = 0; i1 < rows.n1; i1++)
+          {
+            x.setIndex(row_index(rows, i1, i2));
+            xKGB.setIndex(row_index(rowsKGB, i1, i2));
+
+            const FieldType * pphi = &phi(x);
+            const FieldType * pchi = &chi(x);
+            const FieldType * ppsi_prime = &psi_prime(x);
+            const FieldType * pzeta = &zeta_half(xKGB);
+            FieldType * ppi = &pi_k(xKGB);
+
+#pragma omp simd private(psi_half)
+            for (i0 = 0; i0 < rows.n0; i0++)
+              {
+                psi_half = pphi[i0] - pchi[i0] + ppsi_prime[i0] * dtau_main/2.; //psi_half (n+1/2) = psi(n) + psi_prime'(n) dtau/2 // assuming psi is constant during a cycle time step of potential update
+                ppi[i0] = Coeff1 * ( ppi[i0] + dtau * ( pzeta[i0] - Hcon * ppi[i0]/2. + psi_half ) ); //  pi_k(n+1) - pi Updating which is linear by definition
+              }
+          }
       }
   }
 
@@ -433,94 +850,459 @@ void projection_Tmunu_kgb( Field<FieldType> & T00, Field<FieldType> & T0i, Field
 
 
 template <class FieldType>
-void update_zeta(double dtau, double dx, double a, double fourpiG, double H0_hiclass, Field<FieldType> & phi, Field<FieldType> & chi, Field<FieldType> & phi_prime,
- Field<FieldType> & pi_k , Field<FieldType> & zeta_half,  Field<FieldType> & deltaPm, double Hconf, double Hconf_prime, double Hconf_prime_prime, double rho_s, double P_s, double P_s_prime, double rho_crit,
- double alpha_K, double alpha_B, double alpha_K_prime, double alpha_B_prime, int non_linearity )
+void update_zeta(double dtau, double dx, Field<FieldType> & phi, Field<FieldType> & chi, Field<FieldType> & phi_prime,
+ Field<FieldType> & pi_k , Field<FieldType> & zeta_half,  Field<FieldType> & deltaPm, const kgb_coefficients & coeff)
 {
-  double C2, zeta_prime, psi, Laplacian_pi, Laplacian_psi;
-  double Mpl2 = 1./(2. * fourpiG); //   fourpiG   1/2 Mpl^2 in the code unit
+  double Laplacian_pi, Laplacian_psi;
 
-  // Introducing tilde rho and P
-  double rho_s_tilde     =  3. * rho_s *(2./3.*fourpiG)/(H0_hiclass * H0_hiclass);
-  double P_s_tilde       =  3. * P_s *(2./3.*fourpiG)/(H0_hiclass * H0_hiclass);
-  double P_s_prime_tilde =  3. * P_s_prime *(2./3.*fourpiG)/(H0_hiclass * H0_hiclass) * sqrt(2./3.*fourpiG)/H0_hiclass; // sqrt is for the derivative unit consideration
+  lattice_rows rows, rowsKGB;
+  initialize_rows(rows, phi.lattice());
+  initialize_rows(rowsKGB, pi_k.lattice());
+
+  Site x(phi.lattice());
+  Site xKGB(pi_k.lattice());
+
+  const double C2 = 1./ (1. + (coeff.A_zeta / coeff.A_zeta_prime)*(dtau/2.));
+  const double C_zeta = dtau / coeff.A_zeta_prime;
+  const double idx2 = 1. / (dx * dx);
+  int i0, i1, i2;
+
+#pragma omp parallel for private(i0, i1, Laplacian_pi, Laplacian_psi) firstprivate(x, xKGB)
+  for (i2 = 0; i2 < rows.n2; i2++)
+    {
+      for (i1 = 0; i1 < rows.n1; i1++)
+        {
+          x.setIndex(row_index(rows, i1, i2));
+          xKGB.setIndex(row_index(rowsKGB, i1, i2));
+
+          const FieldType * pphi = &phi(x);
+          const FieldType * pchi = &chi(x);
+          const FieldType * pphi_prime = &phi_prime(x);
+          const FieldType * pdeltaPm = &deltaPm(x);
+          const FieldType * ppi = &pi_k(xKGB);
+          FieldType * pzeta = &zeta_half(xKGB);
+
+#pragma omp simd private(Laplacian_pi, Laplacian_psi)
+          for (i0 = 0; i0 < rows.n0; i0++)
+            {
+              //Laplace pi, pi(n) since pi is not updated yet
+              Laplacian_pi = laplacian_7pt(ppi + i0, rowsKGB.jump1, rowsKGB.jump2) * idx2;
+
+              //Laplace psi, psi(n) since psi is not updated yet
+              Laplacian_psi = (laplacian_7pt(pphi + i0, rows.jump1, rows.jump2) - laplacian_7pt(pchi + i0, rows.jump1, rows.jump2)) * idx2;
+
+              pzeta[i0] = C2 * ( pzeta[i0] - C_zeta * (coeff.A_zeta * pzeta[i0]/2. + coeff.A_pi * ppi[i0] + coeff.A_psi * (pphi[i0] - pchi[i0]) + coeff.A_phi_prime * pphi_prime[i0]
+                                                   + coeff.A_Laplace_pi * Laplacian_pi + coeff.A_Laplace_psi * Laplacian_psi + coeff.A_deltaPm * pdeltaPm[i0]));
+            }
+        }
+    }
+}
+
+//////////////////////////
+// prepare_kgb_source
+//////////////////////////
+// Description:
+//   precomputes the metric-dependent source terms of the KGB equations of
+//   motion; phi and chi are frozen during the KGB sub-cycle, so these need to
+//   be evaluated only once per main cycle. If kgb_source lives on a lattice
+//   with a deeper halo, the halo is filled as well, such that update_kgb can
+//   work on the extended region. The time derivatives phi'(n) and psi'(n) are
+//   computed in the same sweep (see derivatives_update).
+//
+// Arguments:
+//   dx          lattice unit
+//   dtau_main   time step of the main cycle
+//   dtau_old    time step of the previous cycle
+//   cycle       cycle number (the time derivatives are set to zero in cycle 0)
+//   phi         reference to the Bardeen potential phi(n)
+//   chi         reference to chi(n) = phi(n) - psi(n)
+//   phi_old     reference to phi(n-1)
+//   chi_old     reference to chi(n-1)
+//   phi_prime   reference to allocated field which will contain phi'(n)
+//   psi_prime   reference to allocated field which will contain psi'(n)
+//   deltaPm     reference to the matter pressure perturbation
+//   kgb_source  reference to allocated five-component field which will contain
+//                 component 0: psi(n)
+//                 component 1: Laplacian of psi(n)
+//                 component 2: psi(n+1/2) = psi(n) + psi'(n) dtau_main/2
+//                 component 3: phi'(n)
+//                 component 4: deltaPm
+//   update_halo if 0, the deep halo of kgb_source is not filled and the caller
+//               has to call kgb_source.updateHalo() (default 1)
+//
+// Returns:
+//
+//////////////////////////
+
+template <class FieldType>
+void prepare_kgb_source(double dx, double dtau_main, double dtau_old, int cycle, Field<FieldType> & phi, Field<FieldType> & chi, Field<FieldType> & phi_old, Field<FieldType> & chi_old,
+ Field<FieldType> & phi_prime, Field<FieldType> & psi_prime, Field<FieldType> & deltaPm, Field<FieldType> & kgb_source, const int update_halo = 1)
+{
+  double psi, psi_prime_n;
+  lattice_rows rows, rowsKGB;
+  initialize_rows(rows, phi.lattice());
+  initialize_rows(rowsKGB, kgb_source.lattice());
+
+  Site x(phi.lattice());
+  Site xKGB(kgb_source.lattice());
+
+  const double idx2 = 1. / (dx * dx);
+  const double idtau = (cycle == 0) ? 0. : 1. / dtau_old;
+  const int nc = kgb_source.components();
+  int i0, i1, i2;
+
+#pragma omp parallel for private(i0, i1, psi, psi_prime_n) firstprivate(x, xKGB)
+  for (i2 = 0; i2 < rows.n2; i2++)
+    {
+      for (i1 = 0; i1 < rows.n1; i1++)
+        {
+          x.setIndex(row_index(rows, i1, i2));
+          xKGB.setIndex(row_index(rowsKGB, i1, i2));
+
+          const FieldType * pphi = &phi(x);
+          const FieldType * pchi = &chi(x);
+          const FieldType * pphi_old = &phi_old(x);
+          const FieldType * pchi_old = &chi_old(x);
+          const FieldType * pdeltaPm = &deltaPm(x);
+          FieldType * pphi_prime = &phi_prime(x);
+          FieldType * ppsi_prime = &psi_prime(x);
+          FieldType * psrc = &kgb_source(xKGB, 0);
+
+#pragma omp simd private(psi, psi_prime_n)
+          for (i0 = 0; i0 < rows.n0; i0++)
+            {
+              psi = pphi[i0] - pchi[i0];
+              psi_prime_n = (psi - (pphi_old[i0] - pchi_old[i0])) * idtau;
+
+              ppsi_prime[i0] = psi_prime_n;
+              pphi_prime[i0] = (pphi[i0] - pphi_old[i0]) * idtau;
+
+              psrc[i0 * nc]     = psi;
+              psrc[i0 * nc + 1] = (laplacian_7pt(pphi + i0, rows.jump1, rows.jump2) - laplacian_7pt(pchi + i0, rows.jump1, rows.jump2)) * idx2;
+              psrc[i0 * nc + 2] = psi + psi_prime_n * dtau_main / 2.;
+              psrc[i0 * nc + 3] = pphi_prime[i0];
+              psrc[i0 * nc + 4] = pdeltaPm[i0];
+            }
+        }
+    }
+
+  if (update_halo && kgb_source.lattice().halo() > 1)
+    kgb_source.updateHalo();
+}
+
+//////////////////////////
+// update_kgb
+//////////////////////////
+// Description:
+//   one leapfrog sub-step of the KGB field, zeta_half(n-1/2) -> zeta_half(n+1/2)
+//   followed by pi_k(n) -> pi_k(n+1), fused into a single sweep over the
+//   lattice. The pi_k update trails the zeta_half update by one z-plane, such
+//   that the Laplacian of pi_k in the zeta_half update still sees pi_k(n),
+//   and the plane just read is still in cache when it is written back.
+//   The result is equivalent to update_zeta followed by update_pi. When
+//   compiled with -fopenmp, each thread sweeps a contiguous block of planes.
+//
+//   The sweep covers the local domain extended by "depth" sites into the
+//   halo. With a halo of width H, H sub-steps with depth H-1, H-2, ..., 0
+//   can be carried out between two halo exchanges of pi_k and zeta_half.
+//
+// Arguments:
+//   dtau        sub-step time step
+//   dx          lattice unit
+//   pi_k        reference to the KGB field
+//   zeta_half   reference to zeta at half sub-steps
+//   kgb_source  reference to the frozen source terms from prepare_kgb_source
+//   coeff       KGB coefficients at the integer sub-step (for the zeta_half update)
+//   Hcon_half   conformal Hubble rate at the half sub-step (for the pi_k update)
+//   depth       number of halo layers to be updated in addition to the local
+//               domain (must be smaller than the halo width)
+//   update_pi   if 0, only zeta_half is updated (used for the initial half step)
+//
+// Returns:
+//
+//////////////////////////
+
+template <class FieldType>
+void update_kgb(double dtau, double dx, Field<FieldType> & pi_k, Field<FieldType> & zeta_half, Field<FieldType> & kgb_source,
+ const kgb_coefficients & coeff, double Hcon_half, const int depth = 0, const int update_pi = 1)
+{
+  // all site-independent factors are hoisted out of the sweep
+  const double A_zeta = coeff.A_zeta, A_pi = coeff.A_pi, A_psi = coeff.A_psi, A_phi_prime = coeff.A_phi_prime;
+  const double A_Laplace_pi = coeff.A_Laplace_pi, A_Laplace_psi = coeff.A_Laplace_psi, A_deltaPm = coeff.A_deltaPm;
+  const double C2 = 1./ (1. + (A_zeta / coeff.A_zeta_prime)*(dtau/2.));
+  const double C_zeta = dtau / coeff.A_zeta_prime;
+  const double C1 = 1./(1. + Hcon_half * dtau/2.);
+  const double idx2 = 1. / (dx * dx);
+
+  // rows of the (extended) local domain
+  lattice_rows rows;
+  initialize_rows(rows, pi_k.lattice(), depth);
+
+  const int nc = kgb_source.components();
+
+  // zeta_half on plane i2
+  auto zeta_plane = [&](Site & x, const int i2)
+    {
+      for (int i1 = 0; i1 < rows.n1; i1++)
+        {
+          x.setIndex(row_index(rows, i1, i2));
+
+          const FieldType * ppi = &pi_k(x);
+          const FieldType * psrc = &kgb_source(x, 0);
+          FieldType * pzeta = &zeta_half(x);
+
+#pragma omp simd
+          for (int i0 = 0; i0 < rows.n0; i0++)
+            {
+              const double Laplacian_pi = laplacian_7pt(ppi + i0, rows.jump1, rows.jump2) * idx2;
+
+              pzeta[i0] = C2 * ( pzeta[i0] - C_zeta * (A_zeta * pzeta[i0]/2. + A_pi * ppi[i0] + A_psi * psrc[i0 * nc] + A_phi_prime * psrc[i0 * nc + 3]
+                                                   + A_Laplace_pi * Laplacian_pi + A_Laplace_psi * psrc[i0 * nc + 1] + A_deltaPm * psrc[i0 * nc + 4]));
+            }
+        }
+    };
+
+  // pi_k on plane i2
+  auto pi_plane = [&](Site & x, const int i2)
+    {
+      for (int i1 = 0; i1 < rows.n1; i1++)
+        {
+          x.setIndex(row_index(rows, i1, i2));
+
+          FieldType * ppi = &pi_k(x);
+          const FieldType * psrc = &kgb_source(x, 0);
+          const FieldType * pzeta = &zeta_half(x);
+
+#pragma omp simd
+          for (int i0 = 0; i0 < rows.n0; i0++)
+            {
+              ppi[i0] = C1 * ( ppi[i0] + dtau * ( pzeta[i0] - Hcon_half * ppi[i0]/2. + psrc[i0 * nc + 2] ) );
+            }
+        }
+    };
+
+  // Each thread sweeps a contiguous block of planes [b0, b1). Within the
+  // block, pi_k on plane i2-1 trails zeta_half on plane i2; the pi_k updates
+  // on the two boundary planes of the block are deferred until all threads
+  // have finished their zeta_half sweep, since those planes are read by the
+  // neighbouring blocks.
+#pragma omp parallel
+  {
+    Site x(pi_k.lattice());
+    int b0 = 0, b1 = rows.n2;
+#ifdef _OPENMP
+    b0 = (int) (((long) rows.n2 * omp_get_thread_num()) / omp_get_num_threads());
+    b1 = (int) (((long) rows.n2 * (omp_get_thread_num() + 1)) / omp_get_num_threads());
+#endif
+
+    for (int i2 = b0; i2 <= b1; i2++)
+      {
+        if (i2 < b1)
+          zeta_plane(x, i2);
+
+        if (update_pi && i2 - 1 > b0 && i2 - 1 < b1 - 1) // plane i2-1 is no longer needed by any zeta_half update
+          pi_plane(x, i2 - 1);
+      }
+
+    if (update_pi)
+      {
+#pragma omp barrier
+        if (b1 > b0)
+          pi_plane(x, b0);
+        if (b1 - 1 > b0)
+          pi_plane(x, b1 - 1);
+      }
+  }
+}
+
+//////////////////////////
+// kgb_numsteps
+//////////////////////////
+// Description:
+//   number of KGB sub-steps required for a stable leapfrog integration over
+//   one main time step. The sub-step is limited by the effective sound speed
+//   of pi_k, c_s^2 = - A_Laplace_pi / A_zeta_prime as it enters update_kgb
+//   (the background c_s^2 from hiclass is used if it is larger), via the
+//   three-dimensional CFL condition dtau_kgb sqrt(3 c_s^2) <= Cf dx, and by
+//   the expansion rate, dtau_kgb Hconf <= Cf.
+//
+// Arguments:
+//   dtau           time step of the main cycle
+//   dx             lattice unit
+//   coeff          KGB coefficients at the beginning of the main time step
+//   cs2            background sound speed squared of the scalar field from hiclass
+//   Cf             Courant factor (should not exceed 1)
+//
+// Returns:
+//   number of sub-steps (at least one)
+//
+//////////////////////////
+
+int kgb_numsteps(double dtau, double dx, const kgb_coefficients & coeff, double cs2, double Cf)
+{
+  if (coeff.A_zeta_prime != 0. && -coeff.A_Laplace_pi / coeff.A_zeta_prime > cs2)
+    cs2 = -coeff.A_Laplace_pi / coeff.A_zeta_prime;
+
+  double numsteps = dtau * sqrt(3. * fabs(cs2)) / (Cf * dx);
+
+  if (dtau * coeff.Hconf / Cf > numsteps)
+    numsteps = dtau * coeff.Hconf / Cf;
+
+  return (numsteps > 1.) ? (int) ceil(numsteps) : 1;
+}
+
+//////////////
+
+//////////////////////////
+// derivatives_update
+//////////////////////////
+// Description:
+//   backward finite-difference estimate of the time derivatives of the
+//   Bardeen potentials, phi'(n) = (phi(n) - phi(n-1)) / dtau and
+//   psi'(n) = (psi(n) - psi(n-1)) / dtau; both are set to zero in the first
+//   cycle
+//
+// Arguments:
+//   dtau       time step of the previous cycle
+//   cycle      cycle number
+//   phi        reference to phi(n)
+//   phi_old    reference to phi(n-1)
+//   chi        reference to chi(n)
+//   chi_old    reference to chi(n-1)
+//   phi_prime  reference to allocated field which will contain phi'(n)
+//   psi_prime  reference to allocated field which will contain psi'(n)
+//
+// Returns:
+//
+//////////////////////////
+
+template <class FieldType>
+void derivatives_update(double dtau, int cycle, Field<FieldType> & phi, Field<FieldType> & phi_old, Field<FieldType> & chi, Field<FieldType> & chi_old, Field<FieldType> & phi_prime, Field<FieldType> & psi_prime)
+{
+	lattice_rows rows;
+	initialize_rows(rows, phi.lattice());
+
+	const double idtau = (cycle == 0) ? 0. : 1. / dtau;
+	int i0, i1, i2;
+	Site x(phi.lattice());
+
+#pragma omp parallel for private(i0, i1) firstprivate(x)
+	for (i2 = 0; i2 < rows.n2; i2++)
+	{
+		for (i1 = 0; i1 < rows.n1; i1++)
+		{
+			x.setIndex(row_index(rows, i1, i2));
+
+			const FieldType * pphi = &phi(x);
+			const FieldType * pphi_old = &phi_old(x);
+			const FieldType * pchi = &chi(x);
+			const FieldType * pchi_old = &chi_old(x);
+			FieldType * pphi_prime = &phi_prime(x);
+			FieldType * ppsi_prime = &psi_prime(x);
+
+#pragma omp simd
+			for (i0 = 0; i0 < rows.n0; i0++)
+			{
+				ppsi_prime[i0] = ((pphi[i0] - pchi[i0]) - (pphi_old[i0] - pchi_old[i0])) * idtau; //psi'(n)
+				pphi_prime[i0] = (pphi[i0] - pphi_old[i0]) * idtau; //phi'(n)
+			}
+		}
+	}
+}
 
-//   double rho_s_tilde     =   rho_s / rho_crit / Mpl2;
-//   double P_s_tilde       =   P_s / rho_crit / Mpl2 ;
 
+//////////////////////////
+// copy_potentials
+//////////////////////////
+// Description:
+//   stores phi(n) and chi(n) before the potentials are updated
+//
+// Arguments:
+//   phi        reference to phi
+//   chi        reference to chi
+//   phi_old    reference to allocated field which will contain a copy of phi
+//   chi_old    reference to allocated field which will contain a copy of chi
+//
+// Returns:
+//
+//////////////////////////
 
-  // Other unit transformations
-  alpha_B_prime = alpha_B_prime * sqrt(2./3.*fourpiG)/H0_hiclass; // alpha_B_prime[gevolution]  = alpha_B_prime[hiclass ][1/Mpc] * H_0 [gevolution]/ H_0 [hiclass]
-  alpha_K_prime = alpha_K_prime * sqrt(2./3.*fourpiG)/H0_hiclass; // alpha_K_prime[gevolution]  = alpha_K_prime[hiclass ][1/Mpc] * H_0 [gevolution]/ H_0 [hiclass]
+template <class FieldType>
+void copy_potentials(Field<FieldType> & phi, Field<FieldType> & chi, Field<FieldType> & phi_old, Field<FieldType> & chi_old)
+{
+	lattice_rows rows;
+	initialize_rows(rows, phi.lattice());
 
-  // Coefficients of the perturbations in the equation of motion for the scalar field perturbation
-  double A_Laplace_psi, A_zeta_prime, A_deltaPm, A_phi_prime, A_Laplace_pi, A_psi, A_pi, A_zeta;
+	int i0, i1, i2;
+	Site x(phi.lattice());
 
-  A_Laplace_psi = - alpha_B / Hconf;
-  A_zeta_prime  = (3./2.) * alpha_B * alpha_B + alpha_K;
-  A_deltaPm     = - (3. * alpha_B * a * a) / (2. * Mpl2 * Hconf);
-  A_phi_prime   = - (3. * alpha_B_prime) / Hconf + alpha_B * (3. - 3. * Hconf_prime / (Hconf * Hconf))  - (3. * a * a / (Hconf * Hconf)) * (rho_s_tilde + P_s_tilde);
-  A_Laplace_pi  = - alpha_B_prime / Hconf - alpha_B * Hconf_prime / (Hconf * Hconf) - (a * a / (Hconf * Hconf)) * (rho_s_tilde + P_s_tilde);
-  A_psi         = - 3. * alpha_B_prime + alpha_B * (3. * Hconf - 3. * Hconf_prime / Hconf) - (3. * a * a / Hconf ) * (rho_s_tilde + P_s_tilde);
-  A_pi          = alpha_B_prime * (3. * Hconf - 3. * Hconf_prime /  Hconf) + alpha_B * (- 3. * Hconf_prime_prime / Hconf + 9. * Hconf_prime - 3. * Hconf_prime * Hconf_prime / (Hconf * Hconf) - 3. * a * a * P_s_prime_tilde / (2. * Hconf)) + a * a * (3. * rho_s_tilde - 3. * Hconf_prime * rho_s_tilde / (Hconf * Hconf) + 3. * P_s_tilde - 3. * Hconf_prime * P_s_tilde / (Hconf * Hconf));
-  A_zeta        = alpha_K_prime + alpha_B * alpha_B * (3. * Hconf + 3. * Hconf_prime / (2. * Hconf)) + alpha_K * (Hconf + 2 * Hconf_prime /  Hconf) + (3./2.) * alpha_B * ( alpha_B_prime - (a * a / Hconf) * (rho_s_tilde + P_s_tilde));
+#pragma omp parallel for private(i0, i1) firstprivate(x)
+	for (i2 = 0; i2 < rows.n2; i2++)
+	{
+		for (i1 = 0; i1 < rows.n1; i1++)
+		{
+			x.setIndex(row_index(rows, i1, i2));
 
-  Site x(phi.lattice());
-  for (x.first(); x.test(); x.next())
-    {
+			const FieldType * pphi = &phi(x);
+			const FieldType * pchi = &chi(x);
+			FieldType * pphi_old = &phi_old(x);
+			FieldType * pchi_old = &chi_old(x);
 
-	  //****************************************************************
-      //Laplace pi, pi(n) since pi is not updated yet
-      //****************************************************************
-      Laplacian_pi = pi_k(x-0) + pi_k(x+0) - 2. * pi_k(x); 
-      Laplacian_pi += pi_k(x+1) + pi_k(x-1) - 2. * pi_k(x);
-      Laplacian_pi += pi_k(x+2) + pi_k(x-2) - 2. * pi_k(x);
-      Laplacian_pi = Laplacian_pi/(dx*dx);
+#pragma omp simd
+			for (i0 = 0; i0 < rows.n0; i0++)
+			{
+				pphi_old[i0] = pphi[i0];
+				pchi_old[i0] = pchi[i0];
+			}
+		}
+	}
+}
 
-	  //****************************************************************
-      //Laplace psi, psi(n) since psi is not updated yet
-      //****************************************************************
-	  Laplacian_psi = (phi(x-0)- chi(x-0)) + (phi(x+0)- chi(x+0)) - 2. * (phi(x)- chi(x)); 
-      Laplacian_psi += (phi(x-1)- chi(x-1)) + (phi(x+1)- chi(x+1)) - 2. * (phi(x)- chi(x));
-      Laplacian_psi += (phi(x-2)- chi(x-2)) + (phi(x+2)- chi(x+2)) - 2. * (phi(x)- chi(x));
-      Laplacian_psi = Laplacian_psi/(dx*dx);
 
-      psi = phi(x) - chi(x); //psi(n)
+//////////////////////////
+// average_field
+//////////////////////////
+// Description:
+//   computes the average of a single-component field over the entire lattice
+//
+// Arguments:
+//   field      reference to the field
+//   numpts3d   total number of lattice sites
+//
+// Returns:
+//   average of the field (the same on all processes)
+//
+//////////////////////////
 
-	  C2 = 1./ (1. + (A_zeta / A_zeta_prime)*(dtau/2.));
+template <class FieldType>
+double average_field(Field<FieldType> & field, const double numpts3d)
+{
+	lattice_rows rows;
+	initialize_rows(rows, field.lattice());
 
-	  zeta_half(x)  = C2 * ( zeta_half(x) - (dtau / A_zeta_prime) * (A_zeta * zeta_half(x)/2. + A_pi * pi_k(x) + A_psi * psi + A_phi_prime * phi_prime(x) 
-	  																+ A_Laplace_pi * Laplacian_pi + A_Laplace_psi * Laplacian_psi + A_deltaPm * deltaPm(x)));
-    }
+	double sum = 0.;
+	int i0, i1, i2;
+	Site x(field.lattice());
 
-}   
+#pragma omp parallel for private(i0, i1) firstprivate(x) reduction(+:sum)
+	for (i2 = 0; i2 < rows.n2; i2++)
+	{
+		for (i1 = 0; i1 < rows.n1; i1++)
+		{
+			x.setIndex(row_index(rows, i1, i2));
 
-//////////////
+			const FieldType * p = &field(x);
 
-  template <class FieldType>
-  void derivatives_update(double dtau, int cycle, Field<FieldType> & phi, Field<FieldType> & phi_old, Field<FieldType> & chi, Field<FieldType> & chi_old, Field<FieldType> & phi_prime, Field<FieldType> & psi_prime)
-  {
-    Site x(phi.lattice());
+#pragma omp simd reduction(+:sum)
+			for (i0 = 0; i0 < rows.n0; i0++)
+				sum += p[i0];
+		}
+	}
 
-    if (cycle == 0)
-    {
-      for (x.first(); x.test(); x.next())
-      {
-        psi_prime (x) =0.; //psi'(n)
-        phi_prime (x) = 0.; //psi'(n)
-      }
-    }
-    else
-    {
-      for (x.first(); x.test(); x.next())
-        {
-          psi_prime (x) = ((phi(x) - chi(x)) - (phi_old(x) - chi_old(x))) / dtau; //psi'(n)
-          phi_prime (x) = (phi(x) - phi_old(x)) / dtau; //psi'(n)
-        }
-    }
-  }
+	parallel.sum<double>(sum);
 
-  
+	return sum / numpts3d;
+}
 
 //////////////////////////
 // prepareFTsource (2)
@@ -537,34 +1319,72 @@ void update_zeta(double dtau, double dx, double a, double fourpiG, double H0_hic
 //   coeff      diffusion coefficient ("3 H_conformal dx^2 / dtau")
 //   coeff2     scaling coefficient for the source ("4 pi G dx^2 / a")
 //   coeff3     scaling coefficient for the psi-term ("3 H_conformal^2 dx^2")
+//   phi_old    pointer to allocated field which will contain a copy of phi (optional)
+//   chi_old    pointer to allocated field which will contain a copy of chi (optional);
+//              the copies are taken in the same sweep, before phi is updated
 //
 // Returns:
 //
 //////////////////////////
 
 template <class FieldType>
-void prepareFTsource(Field<FieldType> & phi, Field<FieldType> & chi, Field<FieldType> & source, const FieldType bgmodel, Field<FieldType> & result, const double coeff, const double coeff2, const double coeff3)
+void prepareFTsource(Field<FieldType> & phi, Field<FieldType> & chi, Field<FieldType> & source, const double bgmodel, Field<FieldType> & result, const double coeff, const double coeff2, const double coeff3,
+ Field<FieldType> * phi_old = NULL, Field<FieldType> * chi_old = NULL)
 {
+	lattice_rows rows;
+	initialize_rows(rows, phi.lattice());
 
+	const long j1 = rows.jump1;
+	const long j2 = rows.jump2;
+	int i0, i1, i2;
 	Site x(phi.lattice());
 
-	for (x.first(); x.test(); x.next())
+#pragma omp parallel for private(i0, i1) firstprivate(x)
+	for (i2 = 0; i2 < rows.n2; i2++)
 	{
-		result(x) = coeff2 * (source(x) - bgmodel);
+		for (i1 = 0; i1 < rows.n1; i1++)
+		{
+			x.setIndex(row_index(rows, i1, i2));
+
+			const FieldType * p = &phi(x);
+			const FieldType * pchi = &chi(x);
+			const FieldType * psource = &source(x);
+			FieldType * presult = &result(x);
+
+#pragma omp simd
+			for (i0 = 0; i0 < rows.n0; i0++)
+			{
+				const FieldType * q = p + i0;
+				double r = coeff2 * (psource[i0] - bgmodel);
 #ifdef PHINONLINEAR
 #ifdef ORIGINALMETRIC
-		result(x) *= 1. - 4. * phi(x);
-		result(x) -= 0.375 * (phi(x-0) - phi(x+0)) * (phi(x-0) - phi(x+0));
-		result(x) -= 0.375 * (phi(x-1) - phi(x+1)) * (phi(x-1) - phi(x+1));
-		result(x) -= 0.375 * (phi(x-2) - phi(x+2)) * (phi(x-2) - phi(x+2));
+				r *= 1. - 4. * q[0];
+				r -= 0.375 * (q[-1] - q[1]) * (q[-1] - q[1]);
+				r -= 0.375 * (q[-j1] - q[j1]) * (q[-j1] - q[j1]);
+				r -= 0.375 * (q[-j2] - q[j2]) * (q[-j2] - q[j2]);
 #else
-		result(x) *= 1. - 2. * phi(x);
-		result(x) += 0.125 * (phi(x-0) - phi(x+0)) * (phi(x-0) - phi(x+0));
-		result(x) += 0.125 * (phi(x-1) - phi(x+1)) * (phi(x-1) - phi(x+1));
-		result(x) += 0.125 * (phi(x-2) - phi(x+2)) * (phi(x-2) - phi(x+2));
+				r *= 1. - 2. * q[0];
+				r += 0.125 * (q[-1] - q[1]) * (q[-1] - q[1]);
+				r += 0.125 * (q[-j1] - q[j1]) * (q[-j1] - q[j1]);
+				r += 0.125 * (q[-j2] - q[j2]) * (q[-j2] - q[j2]);
 #endif
 #endif
-		result(x) += (coeff3 - coeff) * phi(x) - coeff3 * chi(x);
+				presult[i0] = r + (coeff3 - coeff) * q[0] - coeff3 * pchi[i0];
+			}
+
+			if (phi_old != NULL) // phi(n) and chi(n) are still needed for the time derivatives
+			{
+				FieldType * pphi_old = &(*phi_old)(x);
+				FieldType * pchi_old = &(*chi_old)(x);
+
+#pragma omp simd
+				for (i0 = 0; i0 < rows.n0; i0++)
+				{
+					pphi_old[i0] = p[i0];
+					pchi_old[i0] = pchi[i0];
+				}
+			}
+		}
 	}
 }
 
@@ -603,6 +1423,67 @@ void prepareFTsource_BackReactionTest( Field<FieldType> & short_wave, const doub
 }
 
 #ifdef FFT3D
+//////////////////////////
+// gridk_table
+//////////////////////////
+// Description:
+//   lattice wave numbers used by the k-space projections and solvers;
+//   gridk2[i] is the squared wave number of the discrete Laplacian and
+//   kshift[i] the wave number of the forward difference (including the
+//   phase of the half-cell shift) for mode i along one dimension
+//
+//////////////////////////
+
+struct gridk_table
+{
+	int linesize;
+	Real * gridk2;
+	Cplx * kshift;
+};
+
+
+//////////////////////////
+// get_gridk_table
+//////////////////////////
+// Description:
+//   returns the wave number tables for a given lattice size; the tables
+//   are computed on the first call and then kept for the rest of the run
+//
+// Arguments:
+//   linesize   number of lattice sites along one dimension
+//
+// Returns:
+//   reference to the tables
+//
+//////////////////////////
+
+const gridk_table & get_gridk_table(const int linesize)
+{
+	static gridk_table table = {0, NULL, NULL};
+	int i;
+
+	if (table.linesize != linesize)
+	{
+		free(table.gridk2);
+		free(table.kshift);
+
+		table.gridk2 = (Real *) malloc(linesize * sizeof(Real));
+		table.kshift = (Cplx *) malloc(linesize * sizeof(Cplx));
+
+		for (i = 0; i < linesize; i++)
+		{
+			table.gridk2[i] = 2. * (Real) linesize * sin(M_PI * (Real) i / (Real) linesize);
+			table.kshift[i] = table.gridk2[i] * Cplx(cos(M_PI * (Real) i / (Real) linesize), -sin(M_PI * (Real) i / (Real) linesize));
+			table.gridk2[i] *= table.gridk2[i];
+		}
+
+		table.linesize = linesize;
+	}
+
+	return table;
+}
+
+
 //////////////////////////
 // projectFTscalar
 //////////////////////////
@@ -622,21 +1503,11 @@ void prepareFTsource_BackReactionTest( Field<FieldType> & short_wave, const doub
 void projectFTscalar(Field<Cplx> & SijFT, Field<Cplx> & chiFT, const int add = 0)
 {
 	const int linesize = chiFT.lattice().size(1);
-	int i;
-	Real * gridk2;
-	Cplx * kshift;
+	const gridk_table & table = get_gridk_table(linesize);
+	const Real * gridk2 = table.gridk2;
+	const Cplx * kshift = table.kshift;
 	rKSite k(chiFT.lattice());
 
-	gridk2 = (Real *) malloc(linesize * sizeof(Real));
-	kshift = (Cplx *) malloc(linesize * sizeof(Cplx));
-
-	for (i = 0; i < linesize; i++)
-	{
-		gridk2[i] = 2. * (Real) linesize * sin(M_PI * (Real) i / (Real) linesize);
-		kshift[i] = gridk2[i] * Cplx(cos(M_PI * (Real) i / (Real) linesize), -sin(M_PI * (Real) i / (Real) linesize));
-		gridk2[i] *= gridk2[i];
-	}
-
 	k.first();
 	if (k.coord(0) == 0 && k.coord(1) == 0 && k.coord(2) == 0)
 	{
@@ -670,9 +1541,6 @@ void projectFTscalar(Field<Cplx> & SijFT, Field<Cplx> & chiFT, const int add = 0
 						(2. * (gridk2[k.coord(0)] + gridk2[k.coord(1)] + gridk2[k.coord(2)]) * (gridk2[k.coord(0)] + gridk2[k.coord(1)] + gridk2[k.coord(2)]) * linesize);
 		}
 	}
-
-	free(gridk2);
-	free(kshift);
 }
 
 
@@ -695,22 +1563,12 @@ void projectFTscalar(Field<Cplx> & SijFT, Field<Cplx> & chiFT, const int add = 0
 void evolveFTvector(Field<Cplx> & SijFT, Field<Cplx> & BiFT, const Real a2dtau)
 {
 	const int linesize = BiFT.lattice().size(1);
-	int i;
-	Real * gridk2;
-	Cplx * kshift;
+	const gridk_table & table = get_gridk_table(linesize);
+	const Real * gridk2 = table.gridk2;
+	const Cplx * kshift = table.kshift;
 	rKSite k(BiFT.lattice());
 	Real k4;
 
-	gridk2 = (Real *) malloc(linesize * sizeof(Real));
-	kshift = (Cplx *) malloc(linesize * sizeof(Cplx));
-
-	for (i = 0; i < linesize; i++)
-	{
-		gridk2[i] = 2. * (Real) linesize * sin(M_PI * (Real) i / (Real) linesize);
-		kshift[i] = gridk2[i] * Cplx(cos(M_PI * (Real) i / (Real) linesize), -sin(M_PI * (Real) i / (Real) linesize));
-		gridk2[i] *= gridk2[i];
-	}
-
 	k.first();
 	if (k.coord(0) == 0 && k.coord(1) == 0 && k.coord(2) == 0)
 	{
@@ -735,9 +1593,6 @@ void evolveFTvector(Field<Cplx> & SijFT, Field<Cplx> & BiFT, const Real a2dtau)
 				- gridk2[k.coord(0)] * SijFT(k, 0, 0) - gridk2[k.coord(1)] * SijFT(k, 1, 1) - 2. * kshift[k.coord(0)] * kshift[k.coord(1)] * SijFT(k, 0, 1))
 				+ (gridk2[k.coord(0)] + gridk2[k.coord(1)] - gridk2[k.coord(2)]) * (kshift[k.coord(0)] * SijFT(k, 0, 2) + kshift[k.coord(1)] * SijFT(k, 1, 2)));
 	}
-
-	free(gridk2);
-	free(kshift);
 }
 
 
@@ -761,23 +1616,13 @@ void evolveFTvector(Field<Cplx> & SijFT, Field<Cplx> & BiFT, const Real a2dtau)
 void projectFTvector(Field<Cplx> & SiFT, Field<Cplx> & BiFT, const Real coeff = 1., const Real modif = 0.)
 {
 	const int linesize = BiFT.lattice().size(1);
-	int i;
-	Real * gridk2;
-	Cplx * kshift;
+	const gridk_table & table = get_gridk_table(linesize);
+	const Real * gridk2 = table.gridk2;
+	const Cplx * kshift = table.kshift;
 	rKSite k(BiFT.lattice());
 	Real k2;
 	Cplx tmp(0., 0.);
 
-	gridk2 = (Real *) malloc(linesize * sizeof(Real));
-	kshift = (Cplx *) malloc(linesize * sizeof(Cplx));
-
-	for (i = 0; i < linesize; i++)
-	{
-		gridk2[i] = 2. * (Real) linesize * sin(M_PI * (Real) i / (Real) linesize);
-		kshift[i] = gridk2[i] * Cplx(cos(M_PI * (Real) i / (Real) linesize), -sin(M_PI * (Real) i / (Real) linesize));
-		gridk2[i] *= gridk2[i];
-	}
-
 	k.first();
 	if (k.coord(0) == 0 && k.coord(1) == 0 && k.coord(2) == 0)
 	{
@@ -797,9 +1642,6 @@ void projectFTvector(Field<Cplx> & SiFT, Field<Cplx> & BiFT, const Real coeff =
 		BiFT(k, 1) = (SiFT(k, 1) - kshift[k.coord(1)].conj() * tmp) * 4. * coeff / (k2 + modif);
 		BiFT(k, 2) = (SiFT(k, 2) - kshift[k.coord(2)].conj() * tmp) * 4. * coeff / (k2 + modif);
 	}
-
-	free(gridk2);
-	free(kshift);
 }
 
 
@@ -823,22 +1665,13 @@ void projectFTtensor(Field<Cplx> & SijFT, Field<Cplx> & hijFT)
 {
 	const int linesize = hijFT.lattice().size(1);
 	int i;
-	Real * gridk2;
-	Cplx * kshift;
+	const gridk_table & table = get_gridk_table(linesize);
+	const Real * gridk2 = table.gridk2;
+	const Cplx * kshift = table.kshift;
 	rKSite k(hijFT.lattice());
 	Cplx SxxFT, SxyFT, SxzFT, SyyFT, SyzFT, SzzFT;
 	Real k2, k6;
 
-	gridk2 = (Real *) malloc(linesize * sizeof(Real));
-	kshift = (Cplx *) malloc(linesize * sizeof(Cplx));
-
-	for (i = 0; i < linesize; i++)
-	{
-		gridk2[i] = 2. * (Real) linesize * sin(M_PI * (Real) i / (Real) linesize);
-		kshift[i] = gridk2[i] * Cplx(cos(M_PI * (Real) i / (Real) linesize), -sin(M_PI * (Real) i / (Real) linesize));
-		gridk2[i] *= gridk2[i];
-	}
-
 	k.first();
 	if (k.coord(0) == 0 && k.coord(1) == 0 && k.coord(2) == 0)
 	{
@@ -887,9 +1720,136 @@ void projectFTtensor(Field<Cplx> & SijFT, Field<Cplx> & hijFT)
 				+ ((gridk2[k.coord(2)] + k2) * (gridk2[k.coord(1)] + k2) - 2. * k2 * k2) * SyyFT
 				+ 2. * (gridk2[k.coord(2)] + k2) * kshift[k.coord(0)] * kshift[k.coord(1)] * SxyFT) / k6;
 	}
+}
 
-	free(gridk2);
-	free(kshift);
+
+//////////////////////////
+// projectFTsources
+//////////////////////////
+// Description:
+//   fused version of projectFTscalar, evolveFTvector and (optionally)
+//   projectFTtensor which reads the six components of the Fourier image of
+//   the tensor source only once per mode
+//
+// Arguments:
+//   SijFT      reference to the Fourier image of the input tensor field
+//   chiFT      reference to allocated field which will contain the Fourier
+//              image of the trace-free longitudinal (scalar) component
+//   BiFT       pointer to the Fourier image of the vector perturbation which
+//              is evolved as in evolveFTvector (NULL to skip)
+//   a2dtau     conformal time step times scale factor squared (a^2 * dtau)
+//   hijFT      pointer to allocated field which will contain the Fourier image
+//              of the transverse trace-free tensor component (NULL to skip;
+//              can be identical to SijFT)
+//   add        if nonzero, the scalar component is added to chiFT
+//
+// Returns:
+//
+//////////////////////////
+
+void projectFTsources(Field<Cplx> & SijFT, Field<Cplx> & chiFT, Field<Cplx> * BiFT, const Real a2dtau, Field<Cplx> * hijFT = NULL, const int add = 0)
+{
+	const int linesize = chiFT.lattice().size(1);
+	const gridk_table & table = get_gridk_table(linesize);
+	const Real * gridk2 = table.gridk2;
+	const Cplx * kshift = table.kshift;
+	rKSite k(chiFT.lattice());
+	Cplx SxxFT, SxyFT, SxzFT, SyyFT, SyzFT, SzzFT, tmp;
+	Real k2, k4, k6;
+	int i;
+
+	k.first();
+	if (k.coord(0) == 0 && k.coord(1) == 0 && k.coord(2) == 0)
+	{
+		chiFT(k) = Cplx(0.,0.);
+
+		if (BiFT != NULL)
+		{
+			(*BiFT)(k, 0) = Cplx(0.,0.);
+			(*BiFT)(k, 1) = Cplx(0.,0.);
+			(*BiFT)(k, 2) = Cplx(0.,0.);
+		}
+
+		if (hijFT != NULL)
+		{
+			for (i = 0; i < hijFT->components(); i++)
+				(*hijFT)(k, i) = Cplx(0.,0.);
+		}
+
+		k.next();
+	}
+
+	for (; k.test(); k.next())
+	{
+		SxxFT = SijFT(k, 0, 0);
+		SxyFT = SijFT(k, 0, 1);
+		SxzFT = SijFT(k, 0, 2);
+		SyyFT = SijFT(k, 1, 1);
+		SyzFT = SijFT(k, 1, 2);
+		SzzFT = SijFT(k, 2, 2);
+
+		k2 = gridk2[k.coord(0)] + gridk2[k.coord(1)] + gridk2[k.coord(2)];
+
+		tmp = ((gridk2[k.coord(1)] + gridk2[k.coord(2)] - 2. * gridk2[k.coord(0)]) * SxxFT +
+				(gridk2[k.coord(0)] + gridk2[k.coord(2)] - 2. * gridk2[k.coord(1)]) * SyyFT +
+				(gridk2[k.coord(0)] + gridk2[k.coord(1)] - 2. * gridk2[k.coord(2)]) * SzzFT -
+				6. * kshift[k.coord(0)] * kshift[k.coord(1)] * SxyFT -
+				6. * kshift[k.coord(0)] * kshift[k.coord(2)] * SxzFT -
+				6. * kshift[k.coord(1)] * kshift[k.coord(2)] * SyzFT) /
+				(2. * (gridk2[k.coord(0)] + gridk2[k.coord(1)] + gridk2[k.coord(2)]) * (gridk2[k.coord(0)] + gridk2[k.coord(1)] + gridk2[k.coord(2)]) * linesize);
+
+		if (add)
+			chiFT(k) += tmp;
+		else
+			chiFT(k) = tmp;
+
+		if (BiFT != NULL)
+		{
+			k4 = k2 * k2;
+
+			(*BiFT)(k, 0) += Cplx(0.,-2.*a2dtau/k4) * (kshift[k.coord(0)].conj() * ((gridk2[k.coord(1)] + gridk2[k.coord(2)]) * SxxFT
+					- gridk2[k.coord(1)] * SyyFT - gridk2[k.coord(2)] * SzzFT - 2. * kshift[k.coord(1)] * kshift[k.coord(2)] * SyzFT)
+					+ (gridk2[k.coord(1)] + gridk2[k.coord(2)] - gridk2[k.coord(0)]) * (kshift[k.coord(1)] * SxyFT + kshift[k.coord(2)] * SxzFT));
+			(*BiFT)(k, 1) += Cplx(0.,-2.*a2dtau/k4) * (kshift[k.coord(1)].conj() * ((gridk2[k.coord(0)] + gridk2[k.coord(2)]) * SyyFT
+					- gridk2[k.coord(0)] * SxxFT - gridk2[k.coord(2)] * SzzFT - 2. * kshift[k.coord(0)] * kshift[k.coord(2)] * SxzFT)
+					+ (gridk2[k.coord(0)] + gridk2[k.coord(2)] - gridk2[k.coord(1)]) * (kshift[k.coord(0)] * SxyFT + kshift[k.coord(2)] * SyzFT));
+			(*BiFT)(k, 2) += Cplx(0.,-2.*a2dtau/k4) * (kshift[k.coord(2)].conj() * ((gridk2[k.coord(0)] + gridk2[k.coord(1)]) * SzzFT
+					- gridk2[k.coord(0)] * SxxFT - gridk2[k.coord(1)] * SyyFT - 2. * kshift[k.coord(0)] * kshift[k.coord(1)] * SxyFT)
+					+ (gridk2[k.coord(0)] + gridk2[k.coord(1)] - gridk2[k.coord(2)]) * (kshift[k.coord(0)] * SxzFT + kshift[k.coord(1)] * SyzFT));
+		}
+
+		if (hijFT != NULL)
+		{
+			k6 = k2 * k2 * k2 * linesize;
+
+			(*hijFT)(k, 0, 0) = ((gridk2[k.coord(0)] - k2) * ((gridk2[k.coord(0)] - k2) * SxxFT + 2. * kshift[k.coord(0)] * (kshift[k.coord(1)] * SxyFT + kshift[k.coord(2)] * SxzFT))
+					+ ((gridk2[k.coord(0)] + k2) * (gridk2[k.coord(1)] + k2) - 2. * k2 * k2) * SyyFT
+					+ ((gridk2[k.coord(0)] + k2) * (gridk2[k.coord(2)] + k2) - 2. * k2 * k2) * SzzFT
+					+ 2. * (gridk2[k.coord(0)] + k2) * kshift[k.coord(1)] * kshift[k.coord(2)] * SyzFT) / k6;
+
+			(*hijFT)(k, 0, 1) = (2. * (gridk2[k.coord(0)] - k2) * (gridk2[k.coord(1)] - k2) * SxyFT + (gridk2[k.coord(2)] + k2) * kshift[k.coord(0)].conj() * kshift[k.coord(1)].conj() * SzzFT
+					+ (gridk2[k.coord(0)] - k2) * kshift[k.coord(1)].conj() * (kshift[k.coord(0)].conj() * SxxFT + 2. * kshift[k.coord(2)] * SxzFT)
+					+ (gridk2[k.coord(1)] - k2) * kshift[k.coord(0)].conj() * (kshift[k.coord(1)].conj() * SyyFT + 2. * kshift[k.coord(2)] * SyzFT)) / k6;
+
+			(*hijFT)(k, 0, 2) = (2. * (gridk2[k.coord(0)] - k2) * (gridk2[k.coord(2)] - k2) * SxzFT + (gridk2[k.coord(1)] + k2) * kshift[k.coord(0)].conj() * kshift[k.coord(2)].conj() * SyyFT
+					+ (gridk2[k.coord(0)] - k2) * kshift[k.coord(2)].conj() * (kshift[k.coord(0)].conj() * SxxFT + 2. * kshift[k.coord(1)] * SxyFT)
+					+ (gridk2[k.coord(2)] - k2) * kshift[k.coord(0)].conj() * (kshift[k.coord(2)].conj() * SzzFT + 2. * kshift[k.coord(1)] * SyzFT)) / k6;
+
+			(*hijFT)(k, 1, 1) = ((gridk2[k.coord(1)] - k2) * ((gridk2[k.coord(1)] - k2) * SyyFT + 2. * kshift[k.coord(1)] * (kshift[k.coord(0)] * SxyFT + kshift[k.coord(2)] * SyzFT))
+					+ ((gridk2[k.coord(1)] + k2) * (gridk2[k.coord(0)] + k2) - 2. * k2 * k2) * SxxFT
+					+ ((gridk2[k.coord(1)] + k2) * (gridk2[k.coord(2)] + k2) - 2. * k2 * k2) * SzzFT
+					+ 2. * (gridk2[k.coord(1)] + k2) * kshift[k.coord(0)] * kshift[k.coord(2)] * SxzFT) / k6;
+
+			(*hijFT)(k, 1, 2) = (2. * (gridk2[k.coord(1)] - k2) * (gridk2[k.coord(2)] - k2) * SyzFT + (gridk2[k.coord(0)] + k2) * kshift[k.coord(1)].conj() * kshift[k.coord(2)].conj() * SxxFT
+					+ (gridk2[k.coord(1)] - k2) * kshift[k.coord(2)].conj() * (kshift[k.coord(1)].conj() * SyyFT + 2. * kshift[k.coord(0)] * SxyFT)
+					+ (gridk2[k.coord(2)] - k2) * kshift[k.coord(1)].conj() * (kshift[k.coord(2)].conj() * SzzFT + 2. * kshift[k.coord(0)] * SxzFT)) / k6;
+
+			(*hijFT)(k, 2, 2) = ((gridk2[k.coord(2)] - k2) * ((gridk2[k.coord(2)] - k2) * SzzFT + 2. * kshift[k.coord(2)] * (kshift[k.coord(0)] * SxzFT + kshift[k.coord(1)] * SyzFT))
+					+ ((gridk2[k.coord(2)] + k2) * (gridk2[k.coord(0)] + k2) - 2. * k2 * k2) * SxxFT
+					+ ((gridk2[k.coord(2)] + k2) * (gridk2[k.coord(1)] + k2) - 2. * k2 * k2) * SyyFT
+					+ 2. * (gridk2[k.coord(2)] + k2) * kshift[k.coord(0)] * kshift[k.coord(1)] * SxyFT) / k6;
+		}
+	}
 }
 
 
@@ -912,19 +1872,10 @@ void projectFTtensor(Field<Cplx> & SijFT, Field<Cplx> & hijFT)
 void solveModifiedPoissonFT(Field<Cplx> & sourceFT, Field<Cplx> & potFT, Real coeff, const Real modif = 0.)
 {
 	const int linesize = potFT.lattice().size(1);
-	int i;
-	Real * gridk2;
-	Real * sinc;
+	const Real * gridk2 = get_gridk_table(linesize).gridk2;
 	rKSite k(potFT.lattice());
 
-	gridk2 = (Real *) malloc(linesize * sizeof(Real));
-
 	coeff /= -((long) linesize * (long) linesize * (long) linesize);
-	for (i = 0; i < linesize; i++)
-	{
-		gridk2[i] = 2. * (Real) linesize * sin(M_PI * (Real) i / (Real) linesize);
-		gridk2[i] *= gridk2[i];
-	}
 
 	k.first();
 	if (k.coord(0) == 0 && k.coord(1) == 0 && k.coord(2) == 0)
@@ -936,12 +1887,102 @@ void solveModifiedPoissonFT(Field<Cplx> & sourceFT, Field<Cplx> & potFT, Real co
 		k.next();
 	}
 
-	for (; k.test(); k.next())
+	for (; k.test(); k.next())
+	{
+		potFT(k) = sourceFT(k) * coeff / (gridk2[k.coord(0)] + gridk2[k.coord(1)] + gridk2[k.coord(2)] + modif);
+	}
+}
+
+
+//////////////////////////
+// pack_FTbatch
+//////////////////////////
+// Description:
+//   copies the Fourier images of several fields into consecutive components
+//   of a single multi-component field, such that all of them can be
+//   transformed back to position space with one plan, i.e. with one set of
+//   global transpositions instead of one set per field
+//
+// Arguments:
+//   batchFT    reference to the Fourier image of the batch; its number of
+//              components must equal the total number of components of
+//              the packed fields
+//   parts      array of pointers to the Fourier images to be packed
+//   numparts   number of fields to be packed
+//
+// Returns:
+//
+//////////////////////////
+
+void pack_FTbatch(Field<Cplx> & batchFT, Field<Cplx> ** parts, const int numparts)
+{
+	rKSite k(batchFT.lattice());
+	int n, c, offset;
+
+	for (k.first(); k.test(); k.next())
+	{
+		offset = 0;
+		for (n = 0; n < numparts; n++)
+		{
+			for (c = 0; c < parts[n]->components(); c++)
+				batchFT(k, offset + c) = (*parts[n])(k, c);
+			offset += parts[n]->components();
+		}
+	}
+}
+
+
+//////////////////////////
+// unpack_batch
+//////////////////////////
+// Description:
+//   distributes the components of a batch transformed with pack_FTbatch
+//   back to the individual fields in position space; halos are not updated
+//
+// Arguments:
+//   batch      reference to the batch in position space
+//   parts      array of pointers to the fields which will contain the result
+//   numparts   number of fields
+//
+// Returns:
+//
+//////////////////////////
+
+template <class FieldType>
+void unpack_batch(Field<FieldType> & batch, Field<FieldType> ** parts, const int numparts)
+{
+	lattice_rows rows;
+	initialize_rows(rows, batch.lattice());
+
+	const int ncB = batch.components();
+	int i0, i1, i2, n, c, offset;
+	Site x(batch.lattice());
+
+#pragma omp parallel for private(i0, i1, n, c, offset) firstprivate(x)
+	for (i2 = 0; i2 < rows.n2; i2++)
 	{
-		potFT(k) = sourceFT(k) * coeff / (gridk2[k.coord(0)] + gridk2[k.coord(1)] + gridk2[k.coord(2)] + modif);
-	}
+		for (i1 = 0; i1 < rows.n1; i1++)
+		{
+			x.setIndex(row_index(rows, i1, i2));
 
-	free(gridk2);
+			const FieldType * pB = &batch(x, 0);
+
+			offset = 0;
+			for (n = 0; n < numparts; n++)
+			{
+				const int nc = parts[n]->components();
+				FieldType * p = &(*parts[n])(x, 0);
+
+				for (c = 0; c < nc; c++)
+				{
+#pragma omp simd
+					for (i0 = 0; i0 < rows.n0; i0++)
+						p[i0 * nc + c] = pB[i0 * ncB + offset + c];
+				}
+				offset += nc;
+			}
+		}
+	}
 }
 #endif
 
@@ -954,6 +1995,10 @@ void solveModifiedPoissonFT(Field<Cplx> & sourceFT, Field<Cplx> & potFT, Real co
 //   Note that vel[3] in the particle structure is used to store q[3] in units
 //   of the particle mass, such that as q^2 << m^2 a^2 the meaning of vel[3]
 //   is ~ v*a.
+//   update_q_spec<nfield_t> is specialised for a fixed field configuration
+//   (1: phi, 2: phi and chi, 3: phi, chi and Bi), whose fields must all be
+//   allocated; update_q selects the specialisation for each particle and is
+//   kept for occasional use, see select_update_q for the time stepping.
 //
 // Arguments:
 //   dtau       time step
@@ -966,7 +2011,7 @@ void solveModifiedPoissonFT(Field<Cplx> & sourceFT, Field<Cplx> & potFT, Real co
 //              fields[1] = chi
 //              fields[2] = Bi
 //   sites      array of sites on the respective lattices
-//   nfield     number of fields
+//   nfield     number of fields (ignored by update_q_spec)
 //   params     array of additional parameters
 //              params[0] = a
 //              params[1] = scaling coefficient for Bi
@@ -977,7 +2022,8 @@ void solveModifiedPoissonFT(Field<Cplx> & sourceFT, Field<Cplx> & potFT, Real co
 //
 //////////////////////////
 
-Real update_q(double dtau, double dx, part_simple * part, double * ref_dist, part_simple_info partInfo, Field<Real> ** fields, Site * sites, int nfield, double * params, double * outputs, int noutputs)
+template <int nfield_t>
+Real update_q_spec(double dtau, double dx, part_simple * part, double * ref_dist, part_simple_info partInfo, Field<Real> ** fields, Site * sites, int nfield, double * params, double * outputs, int noutputs)
 {
 #define phi (*fields[0])
 #define chi (*fields[1])
@@ -1008,7 +2054,7 @@ Real update_q(double dtau, double dx, part_simple * part, double * ref_dist, par
 	gradphi[1] *= (v2 + e2) / e2;
 	gradphi[2] *= (v2 + e2) / e2;
 
-	if (nfield >= 2 && fields[1] != NULL)
+	if (nfield_t >= 2)
 	{
 		gradphi[0] -= (1.-ref_dist[1]) * (1.-ref_dist[2]) * (chi(xchi+0) - chi(xchi));
 		gradphi[1] -= (1.-ref_dist[0]) * (1.-ref_dist[2]) * (chi(xchi+1) - chi(xchi));
@@ -1026,7 +2072,7 @@ Real update_q(double dtau, double dx, part_simple * part, double * ref_dist, par
 
 	e2 = sqrt(e2);
 
-	if (nfield>=3 && fields[2] != NULL)
+	if (nfield_t >= 3)
 	{
 		pgradB[0] = ((1.-ref_dist[2]) * (Bi(xB+0,1) - Bi(xB,1)) + ref_dist[2] * (Bi(xB+2+0,1) - Bi(xB+2,1))) * (*part).vel[1];
 		pgradB[0] += ((1.-ref_dist[1]) * (Bi(xB+0,2) - Bi(xB,2)) + ref_dist[1] * (Bi(xB+1+0,2) - Bi(xB+1,2))) * (*part).vel[2];
@@ -1071,6 +2117,16 @@ Real update_q(double dtau, double dx, part_simple * part, double * ref_dist, par
 #undef xB
 }
 
+Real update_q(double dtau, double dx, part_simple * part, double * ref_dist, part_simple_info partInfo, Field<Real> ** fields, Site * sites, int nfield, double * params, double * outputs, int noutputs)
+{
+	if (nfield >= 3 && fields[2] != NULL)
+		return update_q_spec<3>(dtau, dx, part, ref_dist, partInfo, fields, sites, nfield, params, outputs, noutputs);
+	else if (nfield >= 2 && fields[1] != NULL)
+		return update_q_spec<2>(dtau, dx, part, ref_dist, partInfo, fields, sites, nfield, params, outputs, noutputs);
+	else
+		return update_q_spec<1>(dtau, dx, part, ref_dist, partInfo, fields, sites, nfield, params, outputs, noutputs);
+}
+
 
 //////////////////////////
 // update_q_Newton
@@ -1079,6 +2135,8 @@ Real update_q(double dtau, double dx, part_simple * part, double * ref_dist, par
 //   Update momentum method (Newtonian version)
 //   Note that vel[3] in the particle structure is used to store q[3] in units
 //   of the particle mass, such that the meaning of vel[3] is v*a.
+//   update_q_Newton_spec<nfield_t> is specialised for a fixed field
+//   configuration (1: psi, 2: psi and chi), as for update_q.
 //
 // Arguments:
 //   dtau       time step
@@ -1090,7 +2148,7 @@ Real update_q(double dtau, double dx, part_simple * part, double * ref_dist, par
 //              fields[0] = psi
 //              fields[1] = chi
 //   sites      array of sites on the respective lattices
-//   nfield     number of fields (should be 1)
+//   nfield     number of fields (ignored by update_q_Newton_spec)
 //   params     array of additional parameters
 //              params[0] = a
 //   outputs    array of reduction variables
@@ -1100,7 +2158,8 @@ Real update_q(double dtau, double dx, part_simple * part, double * ref_dist, par
 //
 //////////////////////////
 
-Real update_q_Newton(double dtau, double dx, part_simple * part, double * ref_dist, part_simple_info partInfo, Field<Real> ** fields, Site * sites, int nfield, double * params, double * outputs, int noutputs)
+template <int nfield_t>
+Real update_q_Newton_spec(double dtau, double dx, part_simple * part, double * ref_dist, part_simple_info partInfo, Field<Real> ** fields, Site * sites, int nfield, double * params, double * outputs, int noutputs)
 {
 #define psi (*fields[0])
 #define xpsi (sites[0])
@@ -1122,7 +2181,7 @@ Real update_q_Newton(double dtau, double dx, part_simple * part, double * ref_di
 	gradpsi[1] += ref_dist[0] * ref_dist[2] * (psi(xpsi+2+1+0) - psi(xpsi+2+0));
 	gradpsi[2] += ref_dist[0] * ref_dist[1] * (psi(xpsi+2+1+0) - psi(xpsi+1+0));
 
-	if (nfield>=2 && fields[1] != NULL)
+	if (nfield_t >= 2)
 	{
 		gradpsi[0] -= (1.-ref_dist[1]) * (1.-ref_dist[2]) * (chi(xchi+0) - chi(xchi));
 		gradpsi[1] -= (1.-ref_dist[0]) * (1.-ref_dist[2]) * (chi(xchi+1) - chi(xchi));
@@ -1153,6 +2212,14 @@ Real update_q_Newton(double dtau, double dx, part_simple * part, double * ref_di
 #undef xchi
 }
 
+Real update_q_Newton(double dtau, double dx, part_simple * part, double * ref_dist, part_simple_info partInfo, Field<Real> ** fields, Site * sites, int nfield, double * params, double * outputs, int noutputs)
+{
+	if (nfield >= 2 && fields[1] != NULL)
+		return update_q_Newton_spec<2>(dtau, dx, part, ref_dist, partInfo, fields, sites, nfield, params, outputs, noutputs);
+	else
+		return update_q_Newton_spec<1>(dtau, dx, part, ref_dist, partInfo, fields, sites, nfield, params, outputs, noutputs);
+}
+
 
 //////////////////////////
 // update_pos
@@ -1162,6 +2229,8 @@ Real update_q_Newton(double dtau, double dx, part_simple * part, double * ref_di
 //   Note that vel[3] in the particle structure is used to store q[3] in units
 //   of the particle mass, such that as q^2 << m^2 a^2 the meaning of vel[3]
 //   is ~ v*a.
+//   update_pos_spec<nfield_t> is specialised for a fixed number of fields
+//   (0 to 3), as for update_q.
 //
 // Arguments:
 //   dtau       time step
@@ -1174,7 +2243,7 @@ Real update_q_Newton(double dtau, double dx, part_simple * part, double * ref_di
 //              fields[1] = chi
 //              fields[2] = Bi
 //   sites      array of sites on the respective lattices
-//   nfield     number of fields
+//   nfield     number of fields (ignored by update_pos_spec)
 //   params     array of additional parameters
 //              params[0] = a
 //              params[1] = scaling coefficient for Bi
@@ -1185,7 +2254,8 @@ Real update_q_Newton(double dtau, double dx, part_simple * part, double * ref_di
 //
 //////////////////////////
 
-void update_pos(double dtau, double dx, part_simple * part, double * ref_dist, part_simple_info partInfo, Field<Real> ** fields, Site * sites, int nfield, double * params, double * outputs, int noutputs)
+template <int nfield_t>
+void update_pos_spec(double dtau, double dx, part_simple * part, double * ref_dist, part_simple_info partInfo, Field<Real> ** fields, Site * sites, int nfield, double * params, double * outputs, int noutputs)
 {
 	Real v[3];
 	Real v2 = (*part).vel[0] * (*part).vel[0] + (*part).vel[1] * (*part).vel[1] + (*part).vel[2] * (*part).vel[2];
@@ -1193,7 +2263,7 @@ void update_pos(double dtau, double dx, part_simple * part, double * ref_dist, p
 	Real phi = 0;
 	Real chi = 0;
 
-	if (nfield >= 1)
+	if (nfield_t >= 1)
 	{
 		phi = (*fields[0])(sites[0]) * (1.-ref_dist[0]) * (1.-ref_dist[1]) * (1.-ref_dist[2]);
 		phi += (*fields[0])(sites[0]+0) * ref_dist[0] * (1.-ref_dist[1]) * (1.-ref_dist[2]);
@@ -1205,7 +2275,7 @@ void update_pos(double dtau, double dx, part_simple * part, double * ref_dist, p
 		phi += (*fields[0])(sites[0]+0+1+2) * ref_dist[0] * ref_dist[1] * ref_dist[2];
 	}
 
-	if (nfield >= 2)
+	if (nfield_t >= 2)
 	{
 		chi = (*fields[1])(sites[1]) * (1.-ref_dist[0]) * (1.-ref_dist[1]) * (1.-ref_dist[2]);
 		chi += (*fields[1])(sites[1]+0) * ref_dist[0] * (1.-ref_dist[1]) * (1.-ref_dist[2]);
@@ -1223,7 +2293,7 @@ void update_pos(double dtau, double dx, part_simple * part, double * ref_dist, p
 	v[1] = (*part).vel[1] * v2;
 	v[2] = (*part).vel[2] * v2;
 
-	if (nfield >= 3)
+	if (nfield_t >= 3)
 	{
 		Real b[3];
 
@@ -1248,6 +2318,18 @@ void update_pos(double dtau, double dx, part_simple * part, double * ref_dist, p
 	}
 }
 
+void update_pos(double dtau, double dx, part_simple * part, double * ref_dist, part_simple_info partInfo, Field<Real> ** fields, Site * sites, int nfield, double * params, double * outputs, int noutputs)
+{
+	if (nfield >= 3)
+		update_pos_spec<3>(dtau, dx, part, ref_dist, partInfo, fields, sites, nfield, params, outputs, noutputs);
+	else if (nfield == 2)
+		update_pos_spec<2>(dtau, dx, part, ref_dist, partInfo, fields, sites, nfield, params, outputs, noutputs);
+	else if (nfield == 1)
+		update_pos_spec<1>(dtau, dx, part, ref_dist, partInfo, fields, sites, nfield, params, outputs, noutputs);
+	else
+		update_pos_spec<0>(dtau, dx, part, ref_dist, partInfo, fields, sites, nfield, params, outputs, noutputs);
+}
+
 
 //////////////////////////
 // update_pos_Newton
@@ -1281,6 +2363,202 @@ void update_pos_Newton(double dtau, double dx, part_simple * part, double * ref_
 }
 
 
+//////////////////////////
+// update_q_pos
+//////////////////////////
+// Description:
+//   Fused velocity and position update (kick and drift) for use with
+//   moveParticles, which replaces the separate traversal of the particles
+//   by updateVel; the particle is first kicked with update_q and then
+//   drifted with update_pos, both evaluated at the old particle position
+//   as in the two-pass scheme
+//   update_q_pos_spec<gr_t, nfield_t> is specialised for the gravity theory
+//   (gr_t = 1: update_q / update_pos, gr_t = 0: update_q_Newton /
+//   update_pos_Newton) and the field configuration of the kick.
+//
+// Arguments:
+//   dtau       time step for the drift
+//   dx         lattice unit
+//   part       pointer to particle structure
+//   ref_dist   distance vector to reference point
+//   partInfo   global particle properties (unused)
+//   fields     array of pointers to fields appearing in geodesic equation
+//              fields[0] = phi
+//              fields[1] = chi
+//              fields[2] = Bi
+//   sites      array of sites on the respective lattices
+//   nfield     number of fields for the kick; the drift uses the fields
+//              only if nfield >= 3 (ignored by update_q_pos_spec)
+//   params     array of additional parameters
+//              params[0] = a for the kick
+//              params[1] = scaling coefficient for Bi for the kick
+//              params[2] = time step for the kick
+//              params[3] = a for the drift
+//              params[4] = scaling coefficient for Bi for the drift
+//              params[5] = maximum of the squared velocity (updated)
+//   outputs    array of reduction variables
+//   noutputs   number of reduction variables
+//
+// Returns:
+//
+//////////////////////////
+
+template <int gr_t, int nfield_t>
+void update_q_pos_spec(double dtau, double dx, part_simple * part, double * ref_dist, part_simple_info partInfo, Field<Real> ** fields, Site * sites, int nfield, double * params, double * outputs, int noutputs)
+{
+	Real v2;
+
+	if (gr_t)
+		v2 = update_q_spec<nfield_t>(params[2], dx, part, ref_dist, partInfo, fields, sites, nfield, params, outputs, noutputs);
+	else
+		v2 = update_q_Newton_spec<nfield_t>(params[2], dx, part, ref_dist, partInfo, fields, sites, nfield, params, outputs, noutputs);
+
+	if (v2 > params[5]) params[5] = v2;
+
+	if (gr_t)
+		update_pos_spec<(nfield_t >= 3 ? 3 : 0)>(dtau, dx, part, ref_dist, partInfo, fields, sites, nfield, params + 3, outputs, noutputs);
+	else
+		update_pos_Newton(dtau, dx, part, ref_dist, partInfo, fields, sites, 0, params + 3, outputs, noutputs);
+}
+
+void update_q_pos(double dtau, double dx, part_simple * part, double * ref_dist, part_simple_info partInfo, Field<Real> ** fields, Site * sites, int nfield, double * params, double * outputs, int noutputs)
+{
+	if (nfield >= 3 && fields[2] != NULL)
+		update_q_pos_spec<1,3>(dtau, dx, part, ref_dist, partInfo, fields, sites, nfield, params, outputs, noutputs);
+	else if (nfield >= 2 && fields[1] != NULL)
+		update_q_pos_spec<1,2>(dtau, dx, part, ref_dist, partInfo, fields, sites, nfield, params, outputs, noutputs);
+	else
+		update_q_pos_spec<1,1>(dtau, dx, part, ref_dist, partInfo, fields, sites, nfield, params, outputs, noutputs);
+}
+
+
+//////////////////////////
+// update_q_pos_Newton
+//////////////////////////
+// Description:
+//   Fused velocity and position update (Newtonian version); see update_q_pos
+//
+// Arguments:
+//   dtau       time step for the drift
+//   dx         lattice unit
+//   part       pointer to particle structure
+//   ref_dist   distance vector to reference point
+//   partInfo   global particle properties (unused)
+//   fields     array of pointers to fields appearing in the equation of motion
+//   sites      array of sites on the respective lattices
+//   nfield     number of fields for the kick (the drift uses none)
+//   params     array of additional parameters, as for update_q_pos
+//   outputs    array of reduction variables
+//   noutputs   number of reduction variables
+//
+// Returns:
+//
+//////////////////////////
+
+void update_q_pos_Newton(double dtau, double dx, part_simple * part, double * ref_dist, part_simple_info partInfo, Field<Real> ** fields, Site * sites, int nfield, double * params, double * outputs, int noutputs)
+{
+	if (nfield >= 2 && fields[1] != NULL)
+		update_q_pos_spec<0,2>(dtau, dx, part, ref_dist, partInfo, fields, sites, nfield, params, outputs, noutputs);
+	else
+		update_q_pos_spec<0,1>(dtau, dx, part, ref_dist, partInfo, fields, sites, nfield, params, outputs, noutputs);
+}
+
+
+typedef Real (*update_q_function)(double, double, part_simple *, double *, part_simple_info, Field<Real> **, Site *, int, double *, double *, int);
+typedef void (*update_pos_function)(double, double, part_simple *, double *, part_simple_info, Field<Real> **, Site *, int, double *, double *, int);
+
+
+//////////////////////////
+// select_update_q
+//////////////////////////
+// Description:
+//   Selects the specialised momentum update for the gravity theory and the
+//   field configuration of the current cycle, such that the choice is made
+//   once per cycle instead of once per particle
+//
+// Arguments:
+//   gr_flag    use the relativistic (> 0) or the Newtonian (0) update
+//   nfield     number of fields passed to updateVel (all allocated)
+//
+// Returns: pointer to the update method, for use with updateVel
+//
+//////////////////////////
+
+update_q_function select_update_q(const int gr_flag, const int nfield)
+{
+	if (gr_flag > 0)
+	{
+		if (nfield >= 3) return update_q_spec<3>;
+		else if (nfield == 2) return update_q_spec<2>;
+		else return update_q_spec<1>;
+	}
+	else
+	{
+		if (nfield >= 2) return update_q_Newton_spec<2>;
+		else return update_q_Newton_spec<1>;
+	}
+}
+
+
+//////////////////////////
+// select_update_pos
+//////////////////////////
+// Description:
+//   Selects the specialised position update, see select_update_q
+//
+// Arguments:
+//   gr_flag    use the relativistic (> 0) or the Newtonian (0) update
+//   nfield     number of fields passed to moveParticles (all allocated)
+//
+// Returns: pointer to the update method, for use with moveParticles
+//
+//////////////////////////
+
+update_pos_function select_update_pos(const int gr_flag, const int nfield)
+{
+	if (gr_flag > 0)
+	{
+		if (nfield >= 3) return update_pos_spec<3>;
+		else if (nfield == 2) return update_pos_spec<2>;
+		else if (nfield == 1) return update_pos_spec<1>;
+		else return update_pos_spec<0>;
+	}
+	else
+		return update_pos_Newton;
+}
+
+
+//////////////////////////
+// select_update_q_pos
+//////////////////////////
+// Description:
+//   Selects the specialised fused velocity and position update, see
+//   select_update_q and update_q_pos
+//
+// Arguments:
+//   gr_flag    use the relativistic (> 0) or the Newtonian (0) update
+//   nfield     number of fields for the kick (all allocated)
+//
+// Returns: pointer to the update method, for use with moveParticles
+//
+//////////////////////////
+
+update_pos_function select_update_q_pos(const int gr_flag, const int nfield)
+{
+	if (gr_flag > 0)
+	{
+		if (nfield >= 3) return update_q_pos_spec<1,3>;
+		else if (nfield == 2) return update_q_pos_spec<1,2>;
+		else return update_q_pos_spec<1,1>;
+	}
+	else
+	{
+		if (nfield >= 2) return update_q_pos_spec<0,2>;
+		else return update_q_pos_spec<0,1>;
+	}
+}
+
+
 //////////////////////////
 // projection_T00_project
 //////////////////////////
@@ -1399,6 +2677,342 @@ void projection_T00_project(Particles<part, part_info, part_dataType> * pcls, Fi
 	}
 }
 
+//////////////////////////
+// projection_Tmunu_project
+//////////////////////////
+// Description:
+//   Particle-mesh projection for T00, T0i and Tij from the contiguous
+//   particle arrays in a single pass over the particles; the result is the
+//   same as for projection_T00_project, projection_T0i_project and
+//   projection_Tij_project (up to rounding in the summation order).
+//   The particles of each row of cells are processed as one batch, where
+//   the weights and energies are computed in a vectorizable loop. With
+//   -fopenmp the planes of cells are distributed among the threads; even
+//   and odd planes are done one after the other, such that no two threads
+//   deposit into the same plane at the same time.
+//
+// Arguments:
+//   pcla       pointer to particle arrays (see Particles_gevolution::updateArrays)
+//   T00        pointer to target field for T00 (NULL to skip)
+//   T0i        pointer to target field for T0i (NULL to skip)
+//   Tij        pointer to target field for Tij (NULL to skip)
+//   a          scale factor at projection (needed in order to convert
+//              canonical momenta to energies)
+//   phi        pointer to Bardeen potential which characterizes the
+//              geometric corrections (volume distortion); can be set to
+//              NULL which will result in no corrections applied
+//   coeff      coefficient applied to the projection operation (default 1)
+//
+// Returns:
+//
+//////////////////////////
+
+void projection_Tmunu_project(particle_arrays * pcla, Field<Real> * T00, Field<Real> * T0i, Field<Real> * Tij, double a = 1., Field<Real> * phi = NULL, double coeff = 1.)
+{
+	Field<Real> * target = (T00 != NULL) ? T00 : ((T0i != NULL) ? T0i : Tij);
+
+	if (target == NULL) return;
+
+	if (target->lattice().halo() == 0)
+	{
+		cout<< "projection_Tmunu_project: target field needs halo > 0" << endl;
+		exit(-1);
+	}
+
+	lattice_rows rows;
+	initialize_rows(rows, target->lattice());
+
+	const long corner[8] = {0, rows.jump2, rows.jump1, rows.jump1 + rows.jump2, 1, 1 + rows.jump2, 1 + rows.jump1, 1 + rows.jump1 + rows.jump2}; // XYZ = 000 | 001 | 010 | 011 | 100 | 101 | 110 | 111
+	const long * offset = pcla->cell_offset;
+	const Real dx = pcla->dx;
+	long maxrow = 0;
+	int i1, i2;
+	Site x(target->lattice());
+
+	double mass = coeff / (dx*dx*dx);
+	mass *= pcla->mass;
+	const double mass0i = mass;
+	mass /= a;
+
+	for (i2 = 0; i2 < rows.n2; i2++)
+	{
+		for (i1 = 0; i1 < rows.n1; i1++)
+		{
+			const long c = (long) (i1 + rows.n1 * i2) * rows.n0;
+			if (offset[c + rows.n0] - offset[c] > maxrow)
+				maxrow = offset[c + rows.n0] - offset[c];
+		}
+	}
+
+#pragma omp parallel private(i1, i2) firstprivate(x)
+	{
+		// batch buffers: weights towards the upper cell, energy and correction factors
+		Real * batch = (Real *) malloc((6 * maxrow + 1) * sizeof(Real));
+		Real * wu0 = batch;
+		Real * wu1 = wu0 + maxrow;
+		Real * wu2 = wu1 + maxrow;
+		Real * eb = wu2 + maxrow;
+		Real * f00 = eb + maxrow;
+		Real * fij = f00 + maxrow;
+
+		Real weightScalarGridUp[3];
+		Real weightScalarGridDown[3];
+		Real e, f, w;
+		const Real * q;
+
+		Real localCube[8];
+		Real qi[12];
+		Real tij[6];
+		Real tii[24];
+		Real localCubePhi[8];
+
+		for (int i = 0; i < 8; i++) localCubePhi[i] = 0.0;
+
+		for (int colour = 0; colour < 2; colour++)
+		{
+#pragma omp for schedule(dynamic)
+			for (i2 = colour; i2 < rows.n2; i2 += 2)
+			{
+				for (i1 = 0; i1 < rows.n1; i1++)
+				{
+					const long * cell = offset + (long) (i1 + rows.n1 * i2) * rows.n0;
+					const long first = cell[0];
+					const long num = cell[rows.n0] - first;
+
+					if (num == 0) continue;
+
+					x.setIndex(row_index(rows, i1, i2));
+
+					const int coord0 = x.coord(0);
+					const Real referPos1 = x.coord(1)*dx;
+					const Real referPos2 = x.coord(2)*dx;
+					const Real * pos = pcla->pos + 3 * first;
+					const Real * vel = pcla->vel + 3 * first;
+					long n;
+
+					for (int i0 = 0; i0 < rows.n0; i0++)
+					{
+						const Real referPos0 = (coord0 + i0)*dx;
+						for (n = cell[i0] - first; n < cell[i0+1] - first; n++)
+							wu0[n] = (pos[3*n] - referPos0) / dx;
+					}
+
+#pragma omp simd private(e, f)
+					for (n = 0; n < num; n++)
+					{
+						wu1[n] = (pos[3*n+1] - referPos1) / dx;
+						wu2[n] = (pos[3*n+2] - referPos2) / dx;
+
+						f = vel[3*n] * vel[3*n] + vel[3*n+1] * vel[3*n+1] + vel[3*n+2] * vel[3*n+2];
+						e = sqrt(f + a * a);
+						eb[n] = e;
+						f00[n] = 3. * e + f / e;
+						fij[n] = 4. + a * a / (f + a * a);
+					}
+
+					for (int i0 = 0; i0 < rows.n0; i0++)
+					{
+						if (cell[i0+1] == cell[i0]) continue;
+
+						x.setIndex(row_index(rows, i1, i2) + i0);
+
+						if (phi != NULL)
+						{
+							const Real * p = &(*phi)(x);
+							for (int i = 0; i < 8; i++) localCubePhi[i] = p[corner[i]];
+						}
+
+						for (int i = 0; i < 8; i++) localCube[i] = 0.0;
+						for (int i = 0; i < 12; i++) qi[i] = 0.0;
+						for (int i = 0; i < 6; i++)  tij[i] = 0.0;
+						for (int i = 0; i < 24; i++) tii[i] = 0.0;
+
+						for (n = cell[i0] - first; n < cell[i0+1] - first; n++)
+						{
+							weightScalarGridUp[0] = wu0[n];
+							weightScalarGridUp[1] = wu1[n];
+							weightScalarGridUp[2] = wu2[n];
+							for (int i = 0; i < 3; i++)
+								weightScalarGridDown[i] = 1.0l - weightScalarGridUp[i];
+
+							q = vel + 3*n;
+
+							if (T00 != NULL)
+							{
+								if (phi != NULL)
+								{
+									e = eb[n];
+									f = f00[n];
+								}
+								else
+								{
+									e = a;
+									f = 0.;
+								}
+
+								//000
+								localCube[0] += weightScalarGridDown[0]*weightScalarGridDown[1]*weightScalarGridDown[2]*(e+f*localCubePhi[0]);
+								//001
+								localCube[1] += weightScalarGridDown[0]*weightScalarGridDown[1]*weightScalarGridUp[2]*(e+f*localCubePhi[1]);
+								//010
+								localCube[2] += weightScalarGridDown[0]*weightScalarGridUp[1]*weightScalarGridDown[2]*(e+f*localCubePhi[2]);
+								//011
+								localCube[3] += weightScalarGridDown[0]*weightScalarGridUp[1]*weightScalarGridUp[2]*(e+f*localCubePhi[3]);
+								//100
+								localCube[4] += weightScalarGridUp[0]*weightScalarGridDown[1]*weightScalarGridDown[2]*(e+f*localCubePhi[4]);
+								//101
+								localCube[5] += weightScalarGridUp[0]*weightScalarGridDown[1]*weightScalarGridUp[2]*(e+f*localCubePhi[5]);
+								//110
+								localCube[6] += weightScalarGridUp[0]*weightScalarGridUp[1]*weightScalarGridDown[2]*(e+f*localCubePhi[6]);
+								//111
+								localCube[7] += weightScalarGridUp[0]*weightScalarGridUp[1]*weightScalarGridUp[2]*(e+f*localCubePhi[7]);
+							}
+
+							if (T0i != NULL)
+							{
+								w = mass0i * q[0];
+
+								qi[0] +=  w * weightScalarGridDown[1] * weightScalarGridDown[2];
+								qi[1] +=  w * weightScalarGridUp[1]   * weightScalarGridDown[2];
+								qi[2] +=  w * weightScalarGridDown[1] * weightScalarGridUp[2];
+								qi[3] +=  w * weightScalarGridUp[1]   * weightScalarGridUp[2];
+
+								w = mass0i * q[1];
+
+								qi[4] +=  w * weightScalarGridDown[0] * weightScalarGridDown[2];
+								qi[5] +=  w * weightScalarGridUp[0]   * weightScalarGridDown[2];
+								qi[6] +=  w * weightScalarGridDown[0] * weightScalarGridUp[2];
+								qi[7] +=  w * weightScalarGridUp[0]   * weightScalarGridUp[2];
+
+								w = mass0i * q[2];
+
+								qi[8] +=  w * weightScalarGridDown[0] * weightScalarGridDown[1];
+								qi[9] +=  w * weightScalarGridUp[0]   * weightScalarGridDown[1];
+								qi[10]+=  w * weightScalarGridDown[0] * weightScalarGridUp[1];
+								qi[11]+=  w * weightScalarGridUp[0]   * weightScalarGridUp[1];
+							}
+
+							if (Tij != NULL)
+							{
+								e = eb[n];
+								f = fij[n];
+
+								// diagonal components
+								for (int i = 0; i < 3; i++)
+								{
+									w = mass * q[i] * q[i] / e;
+									//000
+									tii[0+i*8] += w * weightScalarGridDown[0] * weightScalarGridDown[1] * weightScalarGridDown[2] * (1. + f * localCubePhi[0]);
+									//001
+									tii[1+i*8] += w * weightScalarGridDown[0] * weightScalarGridDown[1] * weightScalarGridUp[2]   * (1. + f * localCubePhi[1]);
+									//010
+									tii[2+i*8] += w * weightScalarGridDown[0] * weightScalarGridUp[1]   * weightScalarGridDown[2] * (1. + f * localCubePhi[2]);
+									//011
+									tii[3+i*8] += w * weightScalarGridDown[0] * weightScalarGridUp[1]   * weightScalarGridUp[2]   * (1. + f * localCubePhi[3]);
+									//100
+									tii[4+i*8] += w * weightScalarGridUp[0]   * weightScalarGridDown[1] * weightScalarGridDown[2] * (1. + f * localCubePhi[4]);
+									//101
+									tii[5+i*8] += w * weightScalarGridUp[0]   * weightScalarGridDown[1] * weightScalarGridUp[2]   * (1. + f * localCubePhi[5]);
+									//110
+									tii[6+i*8] += w * weightScalarGridUp[0]   * weightScalarGridUp[1]   * weightScalarGridDown[2] * (1. + f * localCubePhi[6]);
+									//111
+									tii[7+i*8] += w * weightScalarGridUp[0]   * weightScalarGridUp[1]   * weightScalarGridUp[2]   * (1. + f * localCubePhi[7]);
+								}
+
+								w = mass * q[0] * q[1] / e;
+								tij[0] +=  w * weightScalarGridDown[2] * (1. + f * 0.25 * (localCubePhi[0] + localCubePhi[2] + localCubePhi[4] + localCubePhi[6]));
+								tij[1] +=  w * weightScalarGridUp[2] * (1. + f * 0.25 * (localCubePhi[1] + localCubePhi[3] + localCubePhi[5] + localCubePhi[7]));
+
+								w = mass * q[0] * q[2] / e;
+								tij[2] +=  w * weightScalarGridDown[1] * (1. + f * 0.25 * (localCubePhi[0] + localCubePhi[1] + localCubePhi[4] + localCubePhi[5]));
+								tij[3] +=  w * weightScalarGridUp[1] * (1. + f * 0.25 * (localCubePhi[2] + localCubePhi[3] + localCubePhi[6] + localCubePhi[7]));
+
+								w = mass * q[1] * q[2] / e;
+								tij[4] +=  w * weightScalarGridDown[0] * (1. + f * 0.25 * (localCubePhi[0] + localCubePhi[1] + localCubePhi[2] + localCubePhi[3]));
+								tij[5] +=  w * weightScalarGridUp[0] * (1. + f * 0.25 * (localCubePhi[4] + localCubePhi[5] + localCubePhi[6] + localCubePhi[7]));
+							}
+						}
+
+						if (T00 != NULL)
+						{
+							Real * t = &(*T00)(x);
+							for (int i = 0; i < 8; i++)
+								t[corner[i] * T00->components()] += localCube[i] * mass;
+						}
+
+						if (T0i != NULL)
+						{
+							const int nc = T0i->components();
+							Real * t = &(*T0i)(x, 0);
+
+							t[0] += qi[0] * (1. + localCubePhi[0] + localCubePhi[4]);
+							t[1] += qi[4] * (1. + localCubePhi[0] + localCubePhi[2]);
+							t[2] += qi[8] * (1. + localCubePhi[0] + localCubePhi[1]);
+
+							t[corner[4] * nc + 1] += qi[5] * (1. + localCubePhi[4] + localCubePhi[6]);
+							t[corner[4] * nc + 2] += qi[9] * (1. + localCubePhi[4] + localCubePhi[5]);
+
+							t[corner[2] * nc] += qi[1] * (1. + localCubePhi[2] + localCubePhi[6]);
+							t[corner[2] * nc + 2] += qi[10] * (1. + localCubePhi[2] + localCubePhi[3]);
+
+							t[corner[1] * nc] += qi[2] * (1. + localCubePhi[1] + localCubePhi[5]);
+							t[corner[1] * nc + 1] += qi[6] * (1. + localCubePhi[1] + localCubePhi[3]);
+
+							t[corner[3] * nc] += qi[3] * (1. + localCubePhi[3] + localCubePhi[7]);
+							t[corner[5] * nc + 1] += qi[7] * (1. + localCubePhi[5] + localCubePhi[7]);
+							t[corner[6] * nc + 2] += qi[11] * (1. + localCubePhi[6] + localCubePhi[7]);
+						}
+
+						if (Tij != NULL)
+						{
+							for (int k = 0; k < 8; k++)
+							{
+								for (int i = 0; i < 3; i++)
+									(&(*Tij)(x, i, i))[corner[k] * Tij->components()] += tii[k+8*i];
+							}
+							(*Tij)(x,0,1) += tij[0];
+							(*Tij)(x,0,2) += tij[2];
+							(*Tij)(x,1,2) += tij[4];
+							(&(*Tij)(x,1,2))[corner[4] * Tij->components()] += tij[5];
+							(&(*Tij)(x,0,2))[corner[2] * Tij->components()] += tij[3];
+							(&(*Tij)(x,0,1))[corner[1] * Tij->components()] += tij[1];
+						}
+					}
+				}
+			}
+		}
+
+		free(batch);
+	}
+}
+
+
+//////////////////////////
+// projection_T00_project (particle arrays)
+//////////////////////////
+// Description:
+//   same as above, but using the contiguous particle arrays; see
+//   projection_Tmunu_project
+//
+// Arguments:
+//   pcla       pointer to particle arrays (see Particles_gevolution::updateArrays)
+//   T00        pointer to target field
+//   a          scale factor at projection (needed in order to convert
+//              canonical momenta to energies)
+//   phi        pointer to Bardeen potential which characterizes the
+//              geometric corrections (volume distortion); can be set to
+//              NULL which will result in no corrections applied
+//   coeff      coefficient applied to the projection operation (default 1)
+//
+// Returns:
+//
+//////////////////////////
+
+void projection_T00_project(particle_arrays * pcla, Field<Real> * T00, double a = 1., Field<Real> * phi = NULL, double coeff = 1.)
+{
+	projection_Tmunu_project(pcla, T00, NULL, NULL, a, phi, coeff);
+}
+
 #define projection_T00_comm scalarProjectionCIC_comm
 
 
@@ -1524,6 +3138,30 @@ void projection_T0i_project(Particles<part,part_info,part_dataType> * pcls, Fiel
 	}
 }
 
+//////////////////////////
+// projection_T0i_project (particle arrays)
+//////////////////////////
+// Description:
+//   same as above, but using the contiguous particle arrays; see
+//   projection_Tmunu_project
+//
+// Arguments:
+//   pcla       pointer to particle arrays (see Particles_gevolution::updateArrays)
+//   T0i        pointer to target field
+//   phi        pointer to Bardeen potential which characterizes the
+//              geometric corrections (volume distortion); can be set to
+//              NULL which will result in no corrections applied
+//   coeff      coefficient applied to the projection operation (default 1)
+//
+// Returns:
+//
+//////////////////////////
+
+void projection_T0i_project(particle_arrays * pcla, Field<Real> * T0i, Field<Real> * phi = NULL, double coeff = 1.)
+{
+	projection_Tmunu_project(pcla, NULL, T0i, NULL, 1., phi, coeff);
+}
+
 #define projection_T0i_comm vectorProjectionCICNGP_comm
 
 
@@ -1674,10 +3312,45 @@ void projection_Tij_project(Particles<part, part_info, part_dataType> * pcls, Fi
 	}
 }
 
+//////////////////////////
+// projection_Tij_project (particle arrays)
+//////////////////////////
+// Description:
+//   same as above, but using the contiguous particle arrays; see
+//   projection_Tmunu_project
+//
+// Arguments:
+//   pcla       pointer to particle arrays (see Particles_gevolution::updateArrays)
+//   Tij        pointer to target field
+//   a          scale factor at projection (needed in order to convert
+//              canonical momenta to energies)
+//   phi        pointer to Bardeen potential which characterizes the
+//              geometric corrections (volume distortion); can be set to
+//              NULL which will result in no corrections applied
+//   coeff      coefficient applied to the projection operation (default 1)
+//
+// Returns:
+//
+//////////////////////////
+
+void projection_Tij_project(particle_arrays * pcla, Field<Real> * Tij, double a = 1., Field<Real> * phi = NULL, double coeff = 1.)
+{
+	projection_Tmunu_project(pcla, NULL, NULL, Tij, a, phi, coeff);
+}
+
 #ifndef projection_Tij_comm
 #define projection_Tij_comm symtensorProjectionCICNGP_comm
 #endif
 
+// particle handler passed to the projections: with PARTICLE_ARRAYS the
+// contiguous copy is used (Particles_gevolution::updateArrays has to be
+// called before)
+#ifdef PARTICLE_ARRAYS
+#define PROJECTION_PCLS(pcls) ((pcls)->arrays())
+#else
+#define PROJECTION_PCLS(pcls) (pcls)
+#endif
+
 
 //////////////////////////
 // projection_Ti0_project
@@ -13,20 +13,84 @@
 #ifndef HIBERNATION_HEADER
 #define HIBERNATION_HEADER
 
+//////////////////////////
+// writeFieldSpecifiers
+//////////////////////////
+// Description:
+//   writes a comma-separated list of the field snapshots selected by an
+//   output mask (as used for the compression settings)
+//
+// Arguments:
+//   outfile        settings file
+//   mask           output mask
+//
+// Returns:
+//
+//////////////////////////
+
+void writeFieldSpecifiers(FILE * outfile, const int mask)
+{
+	const int masks[] = {MASK_PHI, MASK_PI_K, MASK_ZETA, MASK_CHI, MASK_POT, MASK_B, MASK_T00, MASK_TIJ, MASK_RBARE, MASK_HIJ, MASK_P, MASK_VEL, MASK_T_KGB};
+	const char * names[] = {"phi", "pi_k", "zeta", "chi", "psiN", "B", "T00", "Tij", "rhoN", "hij", "p", "v", "T00_kgb"};
+	int first = 1;
+
+	for (int i = 0; i < (int) (sizeof(masks) / sizeof(masks[0])); i++)
+	{
+		if (mask & masks[i])
+		{
+			fprintf(outfile, first ? "%s" : ", %s", names[i]);
+			first = 0;
+		}
+	}
+	fprintf(outfile, "\n");
+}
+
+
+//////////////////////////
+// restartSettingsFilename
+//////////////////////////
+// Description:
+//   name of the settings file of a hibernation point
+//
+// Arguments:
+//   sim            simulation metadata structure
+//   restartcount   restart counter aka number of hibernation point
+//                  if < 0 no number is associated to the hibernation point
+//
+// Returns: file name
+//
+//////////////////////////
+
+string restartSettingsFilename(metadata & sim, const int restartcount)
+{
+	char buffer[2*PARAM_MAX_LENGTH+24];
+
+	if (restartcount >= 0)
+		sprintf(buffer, "%s%s%03d.ini", sim.restart_path, sim.basename_restart, restartcount);
+	else
+		sprintf(buffer, "%s%s.ini", sim.restart_path, sim.basename_restart);
+
+	return string(buffer);
+}
+
+
 //////////////////////////
 // writeRestartSettings
 //////////////////////////
 // Description:
 //   writes a settings file containing all the relevant metadata for restarting
-//   a run from a hibernation point
+//   a run from a hibernation point; it also serves as the manifest of the
+//   integrator state and is therefore written last and replaced atomically
 //
 // Arguments:
 //   sim            simulation metadata structure
 //   ic             settings for IC generation
 //   cosmo          cosmological parameter structure
 //   a              scale factor
+//   a_kgb          scale factor of the KGB sub-cycle
+//   dtau_kgb       sub-step of the last KGB sub-cycle (zeta_half lags pi_k by half of it)
 //   tau            conformal coordinate time
-//   dtau           time step
+//   dtau           time step (becomes dtau_old on restart)
 //   cycle          current main control loop cycle count
 //   restartcount   restart counter aka number of hibernation point (default -1)
 //                  if < 0 no number is associated to the hibernation point
@@ -35,19 +99,17 @@
 //
 //////////////////////////
 
-void writeRestartSettings(metadata & sim, icsettings & ic, cosmology & cosmo, const double a, const double tau, const double dtau, const int cycle, const int restartcount = -1)
+void writeRestartSettings(metadata & sim, icsettings & ic, cosmology & cosmo, const double a, const double a_kgb, const double dtau_kgb, const double tau, const double dtau, const int cycle, const int restartcount = -1)
 {
 	char buffer[2*PARAM_MAX_LENGTH+24];
+	string filename;
 	FILE * outfile;
 	int i;
 
 	if (!parallel.isRoot()) return;
 
-	if (restartcount >= 0)
-		sprintf(buffer, "%s%s%03d.ini", sim.restart_path, sim.basename_restart, restartcount);
-	else
-		sprintf(buffer, "%s%s.ini", sim.restart_path, sim.basename_restart);
-	outfile = fopen(buffer, "w");
+	filename = restartSettingsFilename(sim, restartcount);
+	outfile = fopen((filename + ".tmp").c_str(), "w");
 	if (outfile == NULL)
 	{
 		cout << " error opening file for restart settings!" << endl;
@@ -81,11 +143,6 @@ void writeRestartSettings(metadata & sim, icsettings & ic, cosmology & cosmo, co
 		if (sim.gr_flag > 0)
 		{
 			fprintf(outfile, "metric file        = %s%s%s_phi.h5", sim.restart_path, sim.basename_restart, buffer);
-
-			//KGB
-			fprintf(outfile, "kgb field        = %s%s%s_pi_k.h5", sim.restart_path, sim.basename_restart, buffer);
-			fprintf(outfile, "kgb field        = %s%s%s_zeta_k.h5", sim.restart_path, sim.basename_restart, buffer);
-
 			fprintf(outfile, ", %s%s%s_chi.h5", sim.restart_path, sim.basename_restart, buffer);
 			if (sim.vector_flag == VECTOR_PARABOLIC)
 				fprintf(outfile, ", %s%s%s_B.h5\n", sim.restart_path, sim.basename_restart, buffer);
@@ -103,10 +160,21 @@ void writeRestartSettings(metadata & sim, icsettings & ic, cosmology & cosmo, co
 			fprintf(outfile, "metric file        = %s%s%s_B_check.h5\n", sim.restart_path, sim.basename_restart, buffer);
 #endif
 
+		//KGB
+		fprintf(outfile, "kgb file           = %s%s%s_pi_k.h5, %s%s%s_zeta.h5\n", sim.restart_path, sim.basename_restart, buffer, sim.restart_path, sim.basename_restart, buffer);
+		fprintf(outfile, "old metric file    = %s%s%s_phi_old.h5, %s%s%s_chi_old.h5\n", sim.restart_path, sim.basename_restart, buffer, sim.restart_path, sim.basename_restart, buffer);
+
+#ifdef HAVE_HICLASS_BG
+		fprintf(outfile, "background file    = %s%s_bg.dat\n", sim.restart_path, sim.basename_restart);
+#endif
+		if (ic.precisionfile[0] != '\0')
+			fprintf(outfile, "precision file     = %s\n", ic.precisionfile);
 		fprintf(outfile, "restart redshift   = %.15lf\n", (1./a) - 1.);
 		fprintf(outfile, "cycle              = %d\n", cycle);
 		fprintf(outfile, "tau                = %.15le\n", tau);
 		fprintf(outfile, "dtau               = %.15le\n", dtau);
+		fprintf(outfile, "a_kgb              = %.15le\n", a_kgb);
+		fprintf(outfile, "dtau_kgb           = %.17le\n", dtau_kgb);
 		fprintf(outfile, "gevolution version = %g\n\n", GEVOLUTION_VERSION);
 		fprintf(outfile, "seed               = %d\n", ic.seed);
 		if (ic.flags & ICFLAG_KSPHERE)
@@ -118,11 +186,11 @@ void writeRestartSettings(metadata & sim, icsettings & ic, cosmology & cosmo, co
 		fprintf(outfile, "A_s     = %lg\n", ic.A_s);
 		fprintf(outfile, "n_s     = %lg\n", ic.n_s);
 		fprintf(outfile, "\n\n# cosmological parameters\n\n");
-		fprintf(outfile, "h         = %lg\n", cosmo.h);
-		fprintf(outfile, "Omega_cdm = %.15le\n", cosmo.Omega_cdm);
-		fprintf(outfile, "Omega_b   = %.15le\n", cosmo.Omega_b);
-		fprintf(outfile, "Omega_g   = %.15le\n", cosmo.Omega_g);
-		fprintf(outfile, "Omega_ur  = %.15le\n", cosmo.Omega_ur);
+		fprintf(outfile, "h         = %.17g\n", cosmo.h);
+		fprintf(outfile, "Omega_cdm = %.17g\n", cosmo.Omega_cdm);
+		fprintf(outfile, "Omega_b   = %.17g\n", cosmo.Omega_b);
+		fprintf(outfile, "Omega_g   = %.17g\n", cosmo.Omega_g);
+		fprintf(outfile, "Omega_ur  = %.17g\n", cosmo.Omega_ur);
 		// if (cosmo.Omega_fld > 0.)
 		// {
 		// 	fprintf(outfile, "Omega_fld = %.15le\n", cosmo.Omega_fld);
@@ -135,27 +203,50 @@ void writeRestartSettings(metadata & sim, icsettings & ic, cosmology & cosmo, co
 		//KGB
     #ifndef HAVE_HICLASS_BG
 		fprintf(outfile, "Omega_kgb   = %.15le\n", cosmo.Omega_kgb);
-		fprintf(outfile, "w_kgb   = %.15le\n", cosmo.Omega_b);
+		fprintf(outfile, "w_kgb   = %.15le\n", cosmo.w_kgb);
 		fprintf(outfile, "cs2_kgb   = %.15le\n", cosmo.cs2_kgb);
     #else
-    if(parallel.isRoot())  cout << " \033[1;31m ERROR: You shouldn't use hibernation option for this version of KGB-evolution! It needs to be implemented carefully! \033[0m"<< endl;
-    parallel.abortForce();
+		if (cosmo.gravity_model == 3)
+		{
+			fprintf(outfile, "gravity_model = k_essence_power\n");
+			fprintf(outfile, "Xt        = %.17g\n", cosmo.Xt);
+			fprintf(outfile, "g0        = %.17g\n", cosmo.g0);
+			fprintf(outfile, "g2        = %.17g\n", cosmo.g2);
+			fprintf(outfile, "g4        = %.17g\n", cosmo.g4);
+			fprintf(outfile, "phi_i     = %.17g\n", cosmo.phi_i);
+			fprintf(outfile, "X_i       = %.17g\n", cosmo.X_i);
+		}
+		else
+		{
+			if (cosmo.gravity_model == 0)
+				fprintf(outfile, "gravity_model = propto_omega\n");
+			else if (cosmo.gravity_model == 1)
+				fprintf(outfile, "gravity_model = propto_scale\n");
+			else
+				fprintf(outfile, "gravity_model = constant_alphas\n");
+			fprintf(outfile, "parameters_smg = %.17g, %.17g, %.17g, %.17g, %.17g\n", cosmo.x_i[0], cosmo.x_i[1], cosmo.x_i[2], cosmo.x_i[3], cosmo.x_i[4]);
+			fprintf(outfile, "expansion_smg  = %.17g, %.17g\n", cosmo.bg_i[0], cosmo.bg_i[1]);
+			if (cosmo.Omega_Lambda != 0.)
+				fprintf(outfile, "Omega_Lambda = %.17g\n", cosmo.Omega_Lambda);
+		}
+		if (sim.check_bg_file)
+			fprintf(outfile, "check_bg_file = yes\n");
     #endif
 
 		if (cosmo.num_ncdm > 0)
 		{
-			fprintf(outfile, "m_cdm     = ");
+			fprintf(outfile, "m_ncdm    = ");
 			for (i = 0; i < cosmo.num_ncdm - 1; i++)
-				fprintf(outfile, "%9lf, ", cosmo.m_ncdm[i]);
-			fprintf(outfile, "%9lf\n", cosmo.m_ncdm[i]);
-			fprintf(outfile, "T_cdm     = ");
+				fprintf(outfile, "%.17g, ", cosmo.m_ncdm[i]);
+			fprintf(outfile, "%.17g\n", cosmo.m_ncdm[i]);
+			fprintf(outfile, "T_ncdm    = ");
 			for (i = 0; i < cosmo.num_ncdm - 1; i++)
-				fprintf(outfile, "%9lf, ", cosmo.T_ncdm[i]);
-			fprintf(outfile, "%9lf\n", cosmo.T_ncdm[i]);
-			fprintf(outfile, "deg_cdm   = ");
+				fprintf(outfile, "%.17g, ", cosmo.T_ncdm[i]);
+			fprintf(outfile, "%.17g\n", cosmo.T_ncdm[i]);
+			fprintf(outfile, "deg_ncdm  = ");
 			for (i = 0; i < cosmo.num_ncdm - 1; i++)
-				fprintf(outfile, "%lf, ", cosmo.deg_ncdm[i]);
-			fprintf(outfile, "%lg\n", cosmo.deg_ncdm[i]);
+				fprintf(outfile, "%.17g, ", cosmo.deg_ncdm[i]);
+			fprintf(outfile, "%.17g\n", cosmo.deg_ncdm[i]);
 		}
 		fprintf(outfile, "\n\n# simulation settings\n\n");
 		if (sim.baryon_flag > 0)
@@ -190,6 +281,15 @@ void writeRestartSettings(metadata & sim, icsettings & ic, cosmology & cosmo, co
 		fprintf(outfile, "time step limit     = %lg\n", sim.steplimit);
 		if (cosmo.num_ncdm > 0)
 			fprintf(outfile, "move limit          = %lg\n", sim.movelimit);
+		fprintf(outfile, "\nn_kgb_numsteps      = %d\n", sim.n_kgb_numsteps);
+		if (sim.Cf_kgb > 0.)
+			fprintf(outfile, "kgb Courant factor  = %.17g\n", sim.Cf_kgb);
+		fprintf(outfile, "kgb halo            = %d\n", sim.kgb_halo);
+		fprintf(outfile, "kgb table size      = %d\n", sim.kgb_table_size);
+		fprintf(outfile, "background table size = %d\n", sim.bg_table_size);
+		fprintf(outfile, "kgb source gravity  = %d\n", sim.kgb_source_gravity);
+		fprintf(outfile, "NL_kgb              = %d\n", sim.NL_kgb);
+		fprintf(outfile, "background hiclass  = %d\n", sim.bg_hiclass);
 		fprintf(outfile, "\n\n# output\n\n");
 		fprintf(outfile, "output path         = %s\n", sim.output_path);
 		fprintf(outfile, "generic file base   = %s\n", sim.basename_generic);
@@ -315,7 +415,22 @@ void writeRestartSettings(metadata & sim, icsettings & ic, cosmology & cosmo, co
 			fprintf(outfile, "\n");
 		}
 		if (sim.downgrade_factor > 1)
-			fprintf(outfile, "downgrade factor    = %d", sim.downgrade_factor);
+			fprintf(outfile, "downgrade factor    = %d\n", sim.downgrade_factor);
+		if (sim.snapshot_single)
+			fprintf(outfile, "snapshot precision  = single\n");
+		if (sim.out_deflate & ~sim.out_lossy)
+		{
+			fprintf(outfile, "snapshot compression = ");
+			writeFieldSpecifiers(outfile, sim.out_deflate & ~sim.out_lossy);
+		}
+		if (sim.out_lossy)
+		{
+			fprintf(outfile, "snapshot lossy compression = ");
+			writeFieldSpecifiers(outfile, sim.out_lossy);
+			fprintf(outfile, "significant bits    = %d\n", sim.snapshot_bits);
+		}
+		if (sim.out_deflate)
+			fprintf(outfile, "compression level   = %d\n", sim.deflate_level);
 		if (sim.num_pk > 0)
 		{
 			fprintf(outfile, "Pk redshifts        = ");
@@ -414,6 +529,8 @@ void writeRestartSettings(metadata & sim, icsettings & ic, cosmology & cosmo, co
 			fprintf(outfile, "\n");
 		}
 		fprintf(outfile, "Pk bins             = %d\n", sim.numbins);
+		if (sim.pk_binning == KBIN_LOG)
+			fprintf(outfile, "Pk binning          = log\n");
 		if (sim.num_lightcone == 1)
 		{
 			fprintf(outfile, "lightcone vertex    = %lg, %lg, %lg\n", sim.lightcone[0].vertex[0], sim.lightcone[0].vertex[1], sim.lightcone[0].vertex[2]);
@@ -520,8 +637,16 @@ void writeRestartSettings(metadata & sim, icsettings & ic, cosmology & cosmo, co
 		if (sim.restart_path[0] != '\0')
 			fprintf(outfile, "hibernation path            = %s\n", sim.restart_path);
 		fprintf(outfile, "hibernation file base       = %s\n", sim.basename_restart);
+		if (sim.checkpoint_interval > 0)
+		{
+			fprintf(outfile, "checkpoint interval         = %d\n", sim.checkpoint_interval);
+			fprintf(outfile, "checkpoint path             = %s\n", sim.checkpoint_path);
+			if (sim.checkpoint_disk > 0)
+				fprintf(outfile, "checkpoint disk interval    = %d\n", sim.checkpoint_disk);
+		}
 
-		fclose(outfile);
+		if (fclose(outfile) != 0 || rename((filename + ".tmp").c_str(), filename.c_str()) != 0)
+			cout << " error writing file for restart settings!" << endl;
 	}
 }
 
@@ -530,7 +655,12 @@ void writeRestartSettings(metadata & sim, icsettings & ic, cosmology & cosmo, co
 // hibernate
 //////////////////////////
 // Description:
-//   creates a hibernation point by writing snapshots of the simulation data and metadata
+//   creates a hibernation point by writing snapshots of the simulation data and metadata;
+//   the data files are first written under temporary names and only renamed once
+//   all of them are complete, after which the settings file is written as the
+//   manifest of the hibernation point. With EXTERNAL_IO the files are written
+//   directly by the I/O server; the previous manifest is removed beforehand and
+//   the new one is only written once the server has finished writing the files.
 //
 // Arguments:
 //   sim            simulation metadata structure
@@ -540,9 +670,15 @@ void writeRestartSettings(metadata & sim, icsettings & ic, cosmology & cosmo, co
 //   pcls_b         pointer to particle handler for baryons
 //   pcls_ncdm      array of particle handlers for non-cold DM
 //   phi            reference to field containing first Bardeen potential
+//   pi_k           reference to field containing the KGB scalar field
+//   zeta           reference to field containing the KGB momentum (zeta_half)
 //   chi            reference to field containing difference of Bardeen potentials
 //   Bi             reference to vector field containing frame-dragging potential
+//   phi_old        reference to field containing phi of the previous cycle
+//   chi_old        reference to field containing chi of the previous cycle
 //   a              scale factor
+//   a_kgb          scale factor of the KGB sub-cycle
+//   dtau_kgb       sub-step of the last KGB sub-cycle
 //   tau            conformal coordinate time
 //   dtau           time step
 //   cycle          current main control loop cycle count
@@ -553,9 +689,11 @@ void writeRestartSettings(metadata & sim, icsettings & ic, cosmology & cosmo, co
 //
 //////////////////////////
 
-void hibernate(metadata & sim, icsettings & ic, cosmology & cosmo, Particles<part_simple,part_simple_info,part_simple_dataType> * pcls_cdm, Particles<part_simple,part_simple_info,part_simple_dataType> * pcls_b, Particles<part_simple,part_simple_info,part_simple_dataType> * pcls_ncdm, Field<Real> & phi, Field<Real> & pi_k,Field<Real> & zeta, Field<Real> & chi, Field<Real> & Bi, const double a, const double tau, const double dtau, const int cycle, const int restartcount = -1)
+void hibernate(metadata & sim, icsettings & ic, cosmology & cosmo, Particles<part_simple,part_simple_info,part_simple_dataType> * pcls_cdm, Particles<part_simple,part_simple_info,part_simple_dataType> * pcls_b, Particles<part_simple,part_simple_info,part_simple_dataType> * pcls_ncdm, Field<Real> & phi, Field<Real> & pi_k, Field<Real> & zeta, Field<Real> & chi, Field<Real> & Bi, Field<Real> & phi_old, Field<Real> & chi_old, const double a, const double a_kgb, const double dtau_kgb, const double tau, const double dtau, const int cycle, const int restartcount = -1)
 {
 	string h5filename;
+	string stagename;
+	vector<string> files;
 	char buffer[5];
 	int i;
 	Site x(Bi.lattice());
@@ -569,7 +707,37 @@ void hibernate(metadata & sim, icsettings & ic, cosmology & cosmo, Particles<par
 		h5filename += buffer;
 	}
 
-	writeRestartSettings(sim, ic, cosmo, a, tau, dtau, cycle, restartcount);
+#ifdef EXTERNAL_IO
+	stagename = h5filename;
+#else
+	stagename = h5filename + "_tmp";
+#endif
+
+	files.push_back("_cdm");
+	if (sim.baryon_flag)
+		files.push_back("_b");
+	for (i = 0; i < cosmo.num_ncdm; i++)
+	{
+		if (sim.numpcl[1+sim.baryon_flag+i] < 1) continue;
+		sprintf(buffer, "%d", i);
+		files.push_back(string("_ncdm") + buffer);
+	}
+	if (sim.gr_flag > 0)
+	{
+		files.push_back("_phi");
+		files.push_back("_chi");
+	}
+	//kgb
+	files.push_back("_pi_k");
+	files.push_back("_zeta");
+	files.push_back("_phi_old");
+	files.push_back("_chi_old");
+	if (sim.vector_flag == VECTOR_PARABOLIC)
+		files.push_back("_B");
+#ifdef CHECK_B
+	else
+		files.push_back("_B_check");
+#endif
 
 #ifndef CHECK_B
 	if (sim.vector_flag == VECTOR_PARABOLIC)
@@ -582,32 +750,38 @@ void hibernate(metadata & sim, icsettings & ic, cosmology & cosmo, Particles<par
 	}
 
 #ifdef EXTERNAL_IO
+	// the files are replaced in place, so the previous manifest has to go first
+	if (parallel.isRoot())
+		remove(restartSettingsFilename(sim, restartcount).c_str());
+
 	while (ioserver.openOstream()== OSTREAM_FAIL);
 
-	pcls_cdm->saveHDF5_server_open(h5filename + "_cdm");
+	pcls_cdm->saveHDF5_server_open(stagename + "_cdm");
 	if (sim.baryon_flag)
-		pcls_b->saveHDF5_server_open(h5filename + "_b");
+		pcls_b->saveHDF5_server_open(stagename + "_b");
 	for (i = 0; i < cosmo.num_ncdm; i++)
 	{
 		if (sim.numpcl[1+sim.baryon_flag+i] < 1) continue;
 		sprintf(buffer, "%d", i);
-		pcls_ncdm[i].saveHDF5_server_open(h5filename + "_ncdm" + buffer);
+		pcls_ncdm[i].saveHDF5_server_open(stagename + "_ncdm" + buffer);
 	}
 
 	if (sim.gr_flag > 0)
 	{
-		phi.saveHDF5_server_open(h5filename + "_phi");
-		//kgb
-		pi_k.saveHDF5_server_open(h5filename + "_pi_k");
-		zeta.saveHDF5_server_open(h5filename + "_zeta");
-		chi.saveHDF5_server_open(h5filename + "_chi");
+		phi.saveHDF5_server_open(stagename + "_phi");
+		chi.saveHDF5_server_open(stagename + "_chi");
 	}
+	//kgb
+	pi_k.saveHDF5_server_open(stagename + "_pi_k");
+	zeta.saveHDF5_server_open(stagename + "_zeta");
+	phi_old.saveHDF5_server_open(stagename + "_phi_old");
+	chi_old.saveHDF5_server_open(stagename + "_chi_old");
 
 	if (sim.vector_flag == VECTOR_PARABOLIC)
-		Bi.saveHDF5_server_open(h5filename + "_B");
+		Bi.saveHDF5_server_open(stagename + "_B");
 #ifdef CHECK_B
 	else
-		Bi.saveHDF5_server_open(h5filename + "_B_check");
+		Bi.saveHDF5_server_open(stagename + "_B_check");
 #endif
 
 	pcls_cdm->saveHDF5_server_write();
@@ -624,6 +798,11 @@ void hibernate(metadata & sim, icsettings & ic, cosmology & cosmo, Particles<par
 		phi.saveHDF5_server_write(NUMBER_OF_IO_FILES);
 		chi.saveHDF5_server_write(NUMBER_OF_IO_FILES);
 	}
+	//kgb
+	pi_k.saveHDF5_server_write(NUMBER_OF_IO_FILES);
+	zeta.saveHDF5_server_write(NUMBER_OF_IO_FILES);
+	phi_old.saveHDF5_server_write(NUMBER_OF_IO_FILES);
+	chi_old.saveHDF5_server_write(NUMBER_OF_IO_FILES);
 
 #ifndef CHECK_B
 	if (sim.vector_flag == VECTOR_PARABOLIC)
@@ -631,33 +810,695 @@ void hibernate(metadata & sim, icsettings & ic, cosmology & cosmo, Particles<par
 		Bi.saveHDF5_server_write(NUMBER_OF_IO_FILES);
 
 	ioserver.closeOstream();
+
+	// the server accepts a new output stream only once it has finished
+	// writing the previous one; an empty stream is used to wait for that
+	while (ioserver.openOstream()== OSTREAM_FAIL);
+	ioserver.closeOstream();
 #else
-	pcls_cdm->saveHDF5(h5filename + "_cdm", 1);
+	pcls_cdm->saveHDF5(stagename + "_cdm", 1);
 	if (sim.baryon_flag)
-		pcls_b->saveHDF5(h5filename + "_b", 1);
+		pcls_b->saveHDF5(stagename + "_b", 1);
 	for (i = 0; i < cosmo.num_ncdm; i++)
 	{
 		if (sim.numpcl[1+sim.baryon_flag+i] < 1) continue;
 		sprintf(buffer, "%d", i);
-		pcls_ncdm[i].saveHDF5(h5filename + "_ncdm" + buffer, 1);
+		pcls_ncdm[i].saveHDF5(stagename + "_ncdm" + buffer, 1);
 	}
 
 	if (sim.gr_flag > 0)
 	{
-		phi.saveHDF5(h5filename + "_phi.h5");
-		//kgb
-		pi_k.saveHDF5(h5filename + "_pi_k.h5");
-		zeta.saveHDF5(h5filename + "_zeta.h5");
-		chi.saveHDF5(h5filename + "_chi.h5");
+		phi.saveHDF5(stagename + "_phi.h5");
+		chi.saveHDF5(stagename + "_chi.h5");
 	}
+	//kgb
+	pi_k.saveHDF5(stagename + "_pi_k.h5");
+	zeta.saveHDF5(stagename + "_zeta.h5");
+	phi_old.saveHDF5(stagename + "_phi_old.h5");
+	chi_old.saveHDF5(stagename + "_chi_old.h5");
 
 	if (sim.vector_flag == VECTOR_PARABOLIC)
-		Bi.saveHDF5(h5filename + "_B.h5");
+		Bi.saveHDF5(stagename + "_B.h5");
 #ifdef CHECK_B
 	else
-		Bi.saveHDF5(h5filename + "_B_check.h5");
+		Bi.saveHDF5(stagename + "_B_check.h5");
+#endif
+
+	MPI_Barrier(parallel.lat_world_comm());
+
+	if (parallel.isRoot())
+	{
+		// the previous manifest may refer to files which are about to be replaced
+		remove(restartSettingsFilename(sim, restartcount).c_str());
+
+		for (i = 0; i < (int) files.size(); i++)
+		{
+			if (rename((stagename + files[i] + ".h5").c_str(), (h5filename + files[i] + ".h5").c_str()) != 0)
+				cout << " error renaming hibernation file " << h5filename << files[i] << ".h5!" << endl;
+		}
+	}
+#endif
+
+	writeRestartSettings(sim, ic, cosmo, a, a_kgb, dtau_kgb, tau, dtau, cycle, restartcount);
+}
+
+
+//////////////////////////
+// multi-level checkpoints
+//////////////////////////
+// Checkpoints are written every sim.checkpoint_interval cycles on three
+// levels: each process writes its raw local state to node-local storage
+// (level 1), sends a copy to a partner process on another node which keeps
+// it on its own node-local storage (level 2), and every
+// sim.checkpoint_disk-th checkpoint is also written as a regular
+// hibernation point to the parallel file system (level 3, see hibernate).
+// The rank-local levels can only be restored on the same process layout and
+// only by the same run (see checkpointRunID); a fresh run only continues
+// from them if sim.checkpoint_restore is set.
+//
+//////////////////////////
+
+#define CHECKPOINT_MAGIC  0x45766567   // "gevE", to be changed with the layout of checkpoint_header
+#define CHECKPOINT_CHUNK  (1l << 30)   // maximum message size for the buddy copies
+
+struct checkpoint_field
+{
+	void * data;
+	long bytes;
+};
+
+struct checkpoint_header
+{
+	int magic;
+	int owner;           // process whose state is stored
+	int numprocs;
+	int numpts;
+	int nfield;
+	int numspecies;
+	int cycle;           // next cycle to be computed
+	int snapcount;
+	int pkcount;
+	int restartcount;
+	uint64_t run_id;     // fingerprint of the run (see checkpointRunID)
+	double boxsize;
+	double z_in;
+	double a;
+	double tau;
+	double dtau;
+	double dtau_old;
+	double dtau_kgb;     // sub-step of the last KGB sub-cycle
+	double maxvel[MAX_PCL_SPECIES];
+	long numpcl[MAX_PCL_SPECIES];  // local particles per species
+	long size;           // size of the payload in bytes
+	uint64_t checksum;   // of the payload
+};
+
+
+//////////////////////////
+// checkpointField
+//////////////////////////
+// Description:
+//   describes the local data of a field (including halos) for the
+//   rank-local checkpoints
+//
+// Arguments:
+//   field          field to be checkpointed (has to be allocated)
+//
+// Returns: checkpoint_field descriptor
+//
+//////////////////////////
+
+template <typename FieldType>
+checkpoint_field checkpointField(Field<FieldType> & field)
+{
+	checkpoint_field f;
+
+	f.data = (void *) field.data();
+	f.bytes = field.lattice().sitesLocalGross() * (long) field.components() * (long) sizeof(FieldType);
+
+	return f;
+}
+
+
+//////////////////////////
+// checkpointChecksum
+//////////////////////////
+// Description:
+//   FNV-1a type checksum over a buffer, processed in 64-bit words
+//
+// Arguments:
+//   buffer         data
+//   size           size in bytes
+//
+// Returns: checksum
+//
+//////////////////////////
+
+uint64_t checkpointChecksum(const char * buffer, const long size)
+{
+	uint64_t hash = 14695981039346656037ull;
+	uint64_t word;
+	long i;
+
+	for (i = 0; i + 8 <= size; i += 8)
+	{
+		memcpy(&word, buffer + i, 8);
+		hash = (hash ^ word) * 1099511628211ull;
+	}
+	for (; i < size; i++)
+		hash = (hash ^ (uint64_t) (unsigned char) buffer[i]) * 1099511628211ull;
+
+	return hash;
+}
+
+
+//////////////////////////
+// checkpointPartnerShift
+//////////////////////////
+// Description:
+//   determines the rank offset of the partner process which keeps the buddy
+//   copy; the offset is the (maximum) number of processes per node, such
+//   that the partner normally runs on a different node
+//
+// Arguments:
+//   comm           communicator
+//
+// Returns: rank offset (0 if there is only one process)
+//
+//////////////////////////
+
+int checkpointPartnerShift(MPI_Comm comm)
+{
+	MPI_Comm node;
+	int nodesize, numprocs;
+
+	MPI_Comm_size(comm, &numprocs);
+	MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &node);
+	MPI_Comm_size(node, &nodesize);
+	MPI_Comm_free(&node);
+	MPI_Allreduce(MPI_IN_PLACE, &nodesize, 1, MPI_INT, MPI_MAX, comm);
+
+	if (nodesize < numprocs)
+		return nodesize;
+	else
+		return numprocs / 2;  // single node: the copy at least survives the loss of the own file
+}
+
+
+//////////////////////////
+// checkpointRunID
+//////////////////////////
+// Description:
+//   fingerprint of a run which tags its rank-local checkpoints, such that
+//   files left behind by another run (different cosmology, gravity model,
+//   seed or output location) are never restored; it does not change when
+//   the run is restarted from one of its hibernation points
+//
+// Arguments:
+//   sim            simulation metadata structure
+//   ic             settings for IC generation
+//   cosmo          cosmological parameter structure
+//   params         additional parameters passed to hiclass
+//   numparam       number of additional parameters
+//
+// Returns: fingerprint
+//
+//////////////////////////
+
+uint64_t checkpointRunID(metadata & sim, icsettings & ic, cosmology & cosmo, parameter * params = NULL, int numparam = 0)
+{
+	char buffer[3*PARAM_MAX_LENGTH+32];
+	uint64_t hash = backgroundChecksum(cosmo, params, numparam);
+	int i;
+
+	snprintf(buffer, sizeof(buffer), "%d;%s;%s;%s", ic.seed, sim.output_path, sim.restart_path, sim.basename_restart);
+
+	for (i = 0; buffer[i] != '\0'; i++)
+		hash = (hash ^ (uint64_t) (unsigned char) buffer[i]) * 1099511628211ull;
+
+	return hash;
+}
+
+
+//////////////////////////
+// checkpointFilename
+//////////////////////////
+// Description:
+//   name of a rank-local checkpoint file; the name contains the
+//   fingerprint of the run, such that several runs can share the same
+//   node-local storage
+//
+// Arguments:
+//   sim            simulation metadata structure
+//   owner          process whose state is stored
+//   buddy          0 for the own copy, 1 for the buddy copy
+//
+// Returns: file name
+//
+//////////////////////////
+
+string checkpointFilename(metadata & sim, const int owner, const int buddy)
+{
+	char buffer[48];
+
+	sprintf(buffer, "_%016llx_ckpt%05d.%s", (unsigned long long) sim.checkpoint_id, owner, buddy ? "buddy" : "dat");
+
+	return string(sim.checkpoint_path) + sim.basename_restart + buffer;
+}
+
+
+//////////////////////////
+// writeCheckpointFile / readCheckpointFile
+//////////////////////////
+// Description:
+//   write and read a rank-local checkpoint file; the file is written under a
+//   temporary name and renamed afterwards, such that an interrupted write
+//   leaves the previous checkpoint intact. If payload is NULL, only the
+//   header is read; otherwise the payload is allocated, read and verified.
+//
+// Arguments:
+//   filename       file name
+//   hdr            checkpoint header
+//   payload        checkpoint data
+//
+// Returns: 1 on success, 0 otherwise
+//
+//////////////////////////
+
+int writeCheckpointFile(const string & filename, checkpoint_header & hdr, const char * payload)
+{
+	FILE * outfile;
+	string tmpname = filename + ".tmp";
+	int ok;
+
+	outfile = fopen(tmpname.c_str(), "wb");
+	if (outfile == NULL)
+		return 0;
+
+	ok = (fwrite(&hdr, sizeof(checkpoint_header), 1, outfile) == 1);
+	if (ok && hdr.size > 0)
+		ok = (fwrite(payload, 1, hdr.size, outfile) == (size_t) hdr.size);
+	ok = (fclose(outfile) == 0) && ok;
+
+	if (ok)
+		ok = (rename(tmpname.c_str(), filename.c_str()) == 0);
+	else
+		remove(tmpname.c_str());
+
+	return ok;
+}
+
+int readCheckpointFile(const string & filename, checkpoint_header & hdr, char ** payload)
+{
+	FILE * infile;
+	int ok;
+
+	infile = fopen(filename.c_str(), "rb");
+	if (infile == NULL)
+		return 0;
+
+	ok = (fread(&hdr, sizeof(checkpoint_header), 1, infile) == 1 && hdr.magic == CHECKPOINT_MAGIC && hdr.size >= 0);
+
+	if (ok && payload != NULL)
+	{
+		*payload = (char *) malloc(hdr.size > 0 ? hdr.size : 1);
+		ok = (*payload != NULL && fread(*payload, 1, hdr.size, infile) == (size_t) hdr.size && checkpointChecksum(*payload, hdr.size) == hdr.checksum);
+		if (!ok)
+		{
+			free(*payload);
+			*payload = NULL;
+		}
+	}
+
+	fclose(infile);
+
+	return ok;
+}
+
+
+//////////////////////////
+// checkpointExchange
+//////////////////////////
+// Description:
+//   sends a buffer to one process while receiving one from another, in
+//   messages of at most CHECKPOINT_CHUNK bytes
+//
+// Arguments:
+//   sendbuf        data to send
+//   sendbytes      number of bytes to send
+//   dest           destination rank
+//   recvbuf        receive buffer
+//   recvbytes      number of bytes to receive
+//   source         source rank
+//   comm           communicator
+//
+// Returns:
+//
+//////////////////////////
+
+void checkpointExchange(const char * sendbuf, const long sendbytes, const int dest, char * recvbuf, const long recvbytes, const int source, MPI_Comm comm)
+{
+	vector<MPI_Request> requests;
+	MPI_Request req;
+	long offset;
+
+	for (offset = 0; offset < recvbytes; offset += CHECKPOINT_CHUNK)
+	{
+		MPI_Irecv(recvbuf + offset, (int) (recvbytes - offset < CHECKPOINT_CHUNK ? recvbytes - offset : CHECKPOINT_CHUNK), MPI_BYTE, source, 0, comm, &req);
+		requests.push_back(req);
+	}
+	for (offset = 0; offset < sendbytes; offset += CHECKPOINT_CHUNK)
+	{
+		MPI_Isend((void *) (sendbuf + offset), (int) (sendbytes - offset < CHECKPOINT_CHUNK ? sendbytes - offset : CHECKPOINT_CHUNK), MPI_BYTE, dest, 0, comm, &req);
+		requests.push_back(req);
+	}
+
+	if (!requests.empty())
+		MPI_Waitall((int) requests.size(), &requests[0], MPI_STATUSES_IGNORE);
+}
+
+
+//////////////////////////
+// writeCheckpoint
+//////////////////////////
+// Description:
+//   writes a rank-local checkpoint (levels 1 and 2); has to be called at the
+//   end of a cycle, after the cycle counter has been incremented
+//
+// Arguments:
+//   sim            simulation metadata structure
+//   cosmo          cosmological parameter structure
+//   pcls_cdm       pointer to particle handler for CDM
+//   pcls_b         pointer to particle handler for baryons
+//   pcls_ncdm      array of particle handlers for non-cold DM
+//   fields         array of field descriptors (see checkpointField)
+//   nfield         number of fields
+//   maxvel         array of maximum particle velocities
+//   a              scale factor
+//   tau            conformal coordinate time
+//   dtau           next time step
+//   dtau_old       last time step
+//   dtau_kgb       sub-step of the last KGB sub-cycle
+//   cycle          next main control loop cycle
+//   snapcount      snapshot counter
+//   pkcount        spectra counter
+//   restartcount   restart counter
+//
+// Returns:
+//
+//////////////////////////
+
+void writeCheckpoint(metadata & sim, cosmology & cosmo, Particles_gevolution<part_simple,part_simple_info,part_simple_dataType> * pcls_cdm, Particles_gevolution<part_simple,part_simple_info,part_simple_dataType> * pcls_b, Particles_gevolution<part_simple,part_simple_info,part_simple_dataType> * pcls_ncdm, checkpoint_field * fields, const int nfield, const double * maxvel, const double a, const double tau, const double dtau, const double dtau_old, const double dtau_kgb, const int cycle, const int snapcount, const int pkcount, const int restartcount)
+{
+	MPI_Comm comm = parallel.lat_world_comm();
+	checkpoint_header hdr, bhdr;
+	char * payload;
+	char * buddy;
+	long offset;
+	int rank, numprocs, shift, ok, i;
+	Particles_gevolution<part_simple,part_simple_info,part_simple_dataType> * pcls[MAX_PCL_SPECIES];
+#ifdef BENCHMARK
+	double ref_time = MPI_Wtime();
 #endif
+
+	MPI_Comm_rank(comm, &rank);
+	MPI_Comm_size(comm, &numprocs);
+	shift = checkpointPartnerShift(comm);
+
+	memset(&hdr, 0, sizeof(checkpoint_header));
+	hdr.magic = CHECKPOINT_MAGIC;
+	hdr.owner = rank;
+	hdr.numprocs = numprocs;
+	hdr.numpts = sim.numpts;
+	hdr.nfield = nfield;
+	hdr.numspecies = 1 + sim.baryon_flag + cosmo.num_ncdm;
+	hdr.cycle = cycle;
+	hdr.snapcount = snapcount;
+	hdr.pkcount = pkcount;
+	hdr.restartcount = restartcount;
+	hdr.run_id = sim.checkpoint_id;
+	hdr.boxsize = sim.boxsize;
+	hdr.z_in = sim.z_in;
+	hdr.a = a;
+	hdr.tau = tau;
+	hdr.dtau = dtau;
+	hdr.dtau_old = dtau_old;
+	hdr.dtau_kgb = dtau_kgb;
+
+	pcls[0] = pcls_cdm;
+	if (sim.baryon_flag)
+		pcls[1] = pcls_b;
+	for (i = 0; i < cosmo.num_ncdm; i++)
+		pcls[1+sim.baryon_flag+i] = (sim.numpcl[1+sim.baryon_flag+i] > 0) ? pcls_ncdm+i : NULL;
+
+	hdr.size = 0;
+	for (i = 0; i < nfield; i++)
+		hdr.size += fields[i].bytes;
+	for (i = 0; i < hdr.numspecies; i++)
+	{
+		hdr.maxvel[i] = maxvel[i];
+		hdr.numpcl[i] = (pcls[i] != NULL) ? pcls[i]->packLocal() : 0;
+		hdr.size += hdr.numpcl[i] * (long) sizeof(part_simple);
+	}
+
+	payload = (char *) malloc(hdr.size > 0 ? hdr.size : 1);
+	if (payload == NULL)
+	{
+		cerr << " proc#" << parallel.rank() << ": error in writeCheckpoint! Memory error." << endl;
+		parallel.abortForce();
+	}
+
+	for (i = 0, offset = 0; i < nfield; i++)
+	{
+		memcpy(payload + offset, fields[i].data, fields[i].bytes);
+		offset += fields[i].bytes;
+	}
+	for (i = 0; i < hdr.numspecies; i++)
+	{
+		if (pcls[i] != NULL)
+			pcls[i]->packLocal((part_simple *) (payload + offset));
+		offset += hdr.numpcl[i] * (long) sizeof(part_simple);
+	}
+
+	hdr.checksum = checkpointChecksum(payload, hdr.size);
+
+	ok = writeCheckpointFile(checkpointFilename(sim, rank, 0), hdr, payload);
+
+	if (shift > 0)
+	{
+		MPI_Sendrecv(&hdr, sizeof(checkpoint_header), MPI_BYTE, (rank + shift) % numprocs, 0, &bhdr, sizeof(checkpoint_header), MPI_BYTE, (rank + numprocs - shift) % numprocs, 0, comm, MPI_STATUS_IGNORE);
+
+		buddy = (char *) malloc(bhdr.size > 0 ? bhdr.size : 1);
+		if (buddy == NULL)
+		{
+			cerr << " proc#" << parallel.rank() << ": error in writeCheckpoint! Memory error." << endl;
+			parallel.abortForce();
+		}
+
+		checkpointExchange(payload, hdr.size, (rank + shift) % numprocs, buddy, bhdr.size, (rank + numprocs - shift) % numprocs, comm);
+
+		ok = writeCheckpointFile(checkpointFilename(sim, bhdr.owner, 1), bhdr, buddy) && ok;
+		free(buddy);
+	}
+
+	free(payload);
+
+	MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_MIN, comm);
+
+	if (!ok)
+	{
+		COUT << COLORTEXT_YELLOW << " /!\\ warning" << COLORTEXT_RESET << ": could not write checkpoint for cycle " << cycle << " to " << sim.checkpoint_path << "!" << endl;
+	}
+#ifdef BENCHMARK
+	else
+	{
+		ref_time = MPI_Wtime() - ref_time;
+		parallel.max(ref_time);
+		COUT << " checkpoint for cycle " << cycle << " written in " << ref_time << " s" << endl;
+	}
 #endif
 }
 
+
+//////////////////////////
+// restoreCheckpoint
+//////////////////////////
+// Description:
+//   looks for the newest rank-local checkpoint which is available to all
+//   processes, either as own copy or as buddy copy kept by the partner, and
+//   restores it if it is newer than the current state (which may come from
+//   a hibernation point read by readIC). Has to be called after the
+//   initial conditions have been set up.
+//
+// Arguments:
+//   (as for writeCheckpoint, but the state is returned)
+//
+// Returns: 1 if a checkpoint was restored, 0 otherwise
+//
+//////////////////////////
+
+int restoreCheckpoint(metadata & sim, cosmology & cosmo, Particles_gevolution<part_simple,part_simple_info,part_simple_dataType> * pcls_cdm, Particles_gevolution<part_simple,part_simple_info,part_simple_dataType> * pcls_b, Particles_gevolution<part_simple,part_simple_info,part_simple_dataType> * pcls_ncdm, checkpoint_field * fields, const int nfield, double * maxvel, double & a, double & tau, double & dtau, double & dtau_old, double & dtau_kgb, int & cycle, int & snapcount, int & pkcount, int & restartcount)
+{
+	MPI_Comm comm = parallel.lat_world_comm();
+	checkpoint_header hdr, bhdr, rhdr;
+	char * payload = NULL;
+	char * buddy = NULL;
+	long offset, size;
+	int rank, numprocs, shift, partner, owner, i, ok;
+	int avail[2], newest, oldest, have, need, owner_needs, numbuddy;
+	Particles_gevolution<part_simple,part_simple_info,part_simple_dataType> * pcls[MAX_PCL_SPECIES];
+
+	if (sim.checkpoint_interval <= 0) return 0;
+
+	MPI_Comm_rank(comm, &rank);
+	MPI_Comm_size(comm, &numprocs);
+	shift = checkpointPartnerShift(comm);
+	partner = (rank + shift) % numprocs;
+	owner = (rank + numprocs - shift) % numprocs;
+
+	size = 0;
+	for (i = 0; i < nfield; i++)
+		size += fields[i].bytes;
+
+	// cycle of the own copy and of the buddy copy kept by the partner
+	avail[0] = (readCheckpointFile(checkpointFilename(sim, rank, 0), hdr, NULL) && hdr.owner == rank && hdr.run_id == sim.checkpoint_id && hdr.numprocs == numprocs && hdr.numpts == sim.numpts && hdr.nfield == nfield && hdr.numspecies == 1 + sim.baryon_flag + cosmo.num_ncdm && hdr.boxsize == sim.boxsize && hdr.z_in == sim.z_in) ? hdr.cycle : -1;
+	avail[1] = -1;
+	if (shift > 0)
+	{
+		i = (readCheckpointFile(checkpointFilename(sim, owner, 1), bhdr, NULL) && bhdr.owner == owner && bhdr.run_id == sim.checkpoint_id && bhdr.numprocs == numprocs && bhdr.numpts == sim.numpts && bhdr.nfield == nfield && bhdr.numspecies == 1 + sim.baryon_flag + cosmo.num_ncdm && bhdr.boxsize == sim.boxsize && bhdr.z_in == sim.z_in) ? bhdr.cycle : -1;
+		MPI_Sendrecv(&i, 1, MPI_INT, owner, 0, avail+1, 1, MPI_INT, partner, 0, comm, MPI_STATUS_IGNORE);
+	}
+
+	// newest cycle for which every process has a copy
+	newest = (avail[0] > avail[1]) ? avail[0] : avail[1];
+	oldest = (avail[0] < 0) ? avail[1] : ((avail[1] < 0 || avail[0] < avail[1]) ? avail[0] : avail[1]);
+	MPI_Allreduce(MPI_IN_PLACE, &newest, 1, MPI_INT, MPI_MIN, comm);
+	have = (avail[0] == newest || avail[1] == newest);
+	MPI_Allreduce(MPI_IN_PLACE, &have, 1, MPI_INT, MPI_MIN, comm);
+	if (!have)
+	{
+		MPI_Allreduce(MPI_IN_PLACE, &oldest, 1, MPI_INT, MPI_MIN, comm);
+		newest = oldest;
+		have = (avail[0] == newest || avail[1] == newest);
+		MPI_Allreduce(MPI_IN_PLACE, &have, 1, MPI_INT, MPI_MIN, comm);
+	}
+
+	if (!have || newest <= cycle)
+		return 0;
+
+	// own copy first, buddy copy from the partner if necessary
+	ok = (avail[0] == newest && readCheckpointFile(checkpointFilename(sim, rank, 0), hdr, &payload) && hdr.cycle == newest && hdr.size >= size);
+	need = !ok;
+
+	if (shift > 0)
+	{
+		MPI_Sendrecv(&need, 1, MPI_INT, partner, 1, &owner_needs, 1, MPI_INT, owner, 1, comm, MPI_STATUS_IGNORE);
+
+		memset(&bhdr, 0, sizeof(checkpoint_header));
+		if (owner_needs && !(readCheckpointFile(checkpointFilename(sim, owner, 1), bhdr, &buddy) && bhdr.owner == owner && bhdr.cycle == newest))
+		{
+			free(buddy);
+			buddy = NULL;
+			bhdr.magic = 0;
+		}
+		MPI_Sendrecv(&bhdr, sizeof(checkpoint_header), MPI_BYTE, owner, 2, &rhdr, sizeof(checkpoint_header), MPI_BYTE, partner, 2, comm, MPI_STATUS_IGNORE);
+
+		if (need && rhdr.magic == CHECKPOINT_MAGIC)
+		{
+			hdr = rhdr;
+			payload = (char *) malloc(hdr.size > 0 ? hdr.size : 1);
+			if (payload == NULL)
+			{
+				cerr << " proc#" << parallel.rank() << ": error in restoreCheckpoint! Memory error." << endl;
+				parallel.abortForce();
+			}
+		}
+
+		checkpointExchange(buddy, (buddy != NULL) ? bhdr.size : 0, owner, payload, (need && rhdr.magic == CHECKPOINT_MAGIC) ? hdr.size : 0, partner, comm);
+		free(buddy);
+
+		if (need && rhdr.magic == CHECKPOINT_MAGIC)
+			ok = (checkpointChecksum(payload, hdr.size) == hdr.checksum && hdr.size >= size);
+	}
+
+	numbuddy = need && ok;
+	MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_MIN, comm);
+	MPI_Allreduce(MPI_IN_PLACE, &numbuddy, 1, MPI_INT, MPI_SUM, comm);
+
+	if (!ok)
+	{
+		COUT << COLORTEXT_YELLOW << " /!\\ warning" << COLORTEXT_RESET << ": checkpoint for cycle " << newest << " is incomplete or corrupted, not restored!" << endl;
+		free(payload);
+		return 0;
+	}
+
+	pcls[0] = pcls_cdm;
+	if (sim.baryon_flag)
+		pcls[1] = pcls_b;
+	for (i = 0; i < cosmo.num_ncdm; i++)
+		pcls[1+sim.baryon_flag+i] = (sim.numpcl[1+sim.baryon_flag+i] > 0) ? pcls_ncdm+i : NULL;
+
+	for (i = 0, offset = 0; i < nfield; i++)
+	{
+		memcpy(fields[i].data, payload + offset, fields[i].bytes);
+		offset += fields[i].bytes;
+	}
+	for (i = 0; i < hdr.numspecies; i++)
+	{
+		if (pcls[i] != NULL)
+			pcls[i]->unpackLocal((part_simple *) (payload + offset), hdr.numpcl[i]);
+		offset += hdr.numpcl[i] * (long) sizeof(part_simple);
+		maxvel[i] = hdr.maxvel[i];
+	}
+
+	free(payload);
+
+	a = hdr.a;
+	tau = hdr.tau;
+	dtau = hdr.dtau;
+	dtau_old = hdr.dtau_old;
+	dtau_kgb = hdr.dtau_kgb;
+	cycle = hdr.cycle;
+	snapcount = hdr.snapcount;
+	pkcount = hdr.pkcount;
+	restartcount = hdr.restartcount;
+
+	COUT << COLORTEXT_CYAN << " restored checkpoint" << COLORTEXT_RESET << " at z = " << ((1./a) - 1.) << " (cycle " << cycle << ") from " << sim.checkpoint_path;
+	if (numbuddy > 0)
+		COUT << " (" << numbuddy << " process(es) from buddy copies)";
+	COUT << endl;
+
+	return 1;
+}
+
+
+//////////////////////////
+// removeCheckpoint
+//////////////////////////
+// Description:
+//   removes the rank-local checkpoint files of this process, such that a
+//   later run cannot pick them up by mistake
+//
+// Arguments:
+//   sim            simulation metadata structure
+//
+// Returns:
+//
+//////////////////////////
+
+void removeCheckpoint(metadata & sim)
+{
+	int rank, numprocs, shift;
+
+	if (sim.checkpoint_interval <= 0) return;
+
+	MPI_Comm_rank(parallel.lat_world_comm(), &rank);
+	MPI_Comm_size(parallel.lat_world_comm(), &numprocs);
+	shift = checkpointPartnerShift(parallel.lat_world_comm());
+
+	remove(checkpointFilename(sim, rank, 0).c_str());
+	if (shift > 0)
+		remove(checkpointFilename(sim, (rank + numprocs - shift) % numprocs, 1).c_str());
+}
+
 #endif
@@ -17,8 +17,14 @@
 #if defined(HAVE_HICLASS)
 #define HAVE_HICLASS_BG HAVE_HICLASS
 #include <gsl/gsl_spline.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "parser.hpp"
 
+#define BG_CACHE_MAGIC  0x42766567   // "gevB"
+
 using namespace std;
 using namespace LATfield2;
 
@@ -731,6 +737,132 @@ void loadBGFunctions(background & class_background, gsl_spline * & bg_data, cons
 	free(a);
 	free(bg);
 }
+
+
+//////////////////////////
+// saveBackgroundCache
+//////////////////////////
+// Description:
+//   writes the tabulated background functions (the nodes of the splines)
+//   to a binary file, such that a restart does not need to run hiclass
+//   again; only called on the root process
+//
+// Arguments:
+//   filename          name of the cache file
+//   checksum          parameter checksum (see backgroundChecksum)
+//   splines           array of pointers to the splines
+//   num               number of splines
+//
+// Returns: 1 on success, 0 otherwise
+//
+//////////////////////////
+
+int saveBackgroundCache(const char * filename, const uint64_t checksum, gsl_spline *** splines, const int num)
+{
+	FILE * outfile;
+	string tmpname = string(filename) + ".tmp";
+	uint64_t header[4];
+	long size;
+	int i, ok;
+
+	outfile = fopen(tmpname.c_str(), "wb");
+	if (outfile == NULL)
+		return 0;
+
+	header[0] = BG_CACHE_MAGIC;
+	header[1] = num;
+	header[2] = checksum;
+	header[3] = 0;
+	ok = (fwrite(header, sizeof(uint64_t), 4, outfile) == 4);
+
+	for (i = 0; ok && i < num; i++)
+	{
+		size = (long) (*splines[i])->size;
+		ok = (fwrite(&size, sizeof(long), 1, outfile) == 1);
+	}
+	for (i = 0; ok && i < num; i++)
+	{
+		ok = (fwrite((*splines[i])->x, sizeof(double), (*splines[i])->size, outfile) == (*splines[i])->size);
+		ok = ok && (fwrite((*splines[i])->y, sizeof(double), (*splines[i])->size, outfile) == (*splines[i])->size);
+	}
+
+	ok = (fclose(outfile) == 0) && ok;
+
+	if (ok)
+		ok = (rename(tmpname.c_str(), filename) == 0);
+	else
+		remove(tmpname.c_str());
+
+	return ok;
+}
+
+
+//////////////////////////
+// loadBackgroundCache
+//////////////////////////
+// Description:
+//   maps a background cache written by saveBackgroundCache into memory and
+//   sets up the splines from it
+//
+// Arguments:
+//   filename          name of the cache file
+//   checksum          parameter checksum (see backgroundChecksum)
+//   splines           array of pointers to the splines (which are allocated)
+//   num               number of splines
+//
+// Returns: 1 on success, 0 if the file is missing, incomplete or does not
+//          match the checksum (the splines are then left untouched)
+//
+//////////////////////////
+
+int loadBackgroundCache(const char * filename, const uint64_t checksum, gsl_spline *** splines, const int num)
+{
+	struct stat st;
+	const uint64_t * header;
+	const long * size;
+	const double * data;
+	void * map;
+	long total;
+	int fd, i, ok;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		return 0;
+
+	if (fstat(fd, &st) != 0 || st.st_size < (off_t) (4 * sizeof(uint64_t) + num * sizeof(long)))
+	{
+		close(fd);
+		return 0;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return 0;
+
+	header = (const uint64_t *) map;
+	size = (const long *) (header + 4);
+	data = (const double *) (size + num);
+
+	ok = (header[0] == BG_CACHE_MAGIC && header[1] == (uint64_t) num && header[2] == checksum);
+	for (i = 0, total = 0; ok && i < num; i++)
+	{
+		ok = (size[i] > 2);
+		total += 2 * size[i];
+	}
+	ok = ok && (st.st_size == (off_t) (4 * sizeof(uint64_t) + num * sizeof(long) + total * sizeof(double)));
+
+	for (i = 0; ok && i < num; i++)
+	{
+		*splines[i] = gsl_spline_alloc(gsl_interp_cspline, size[i]);
+		gsl_spline_init(*splines[i], data, data + size[i], size[i]);
+		data += 2 * size[i];
+	}
+
+	munmap(map, st.st_size);
+
+	return ok;
+}
 #endif
 
 #endif
@@ -576,11 +576,11 @@ void generateIC_prevolution(metadata & sim, icsettings & ic, cosmology & cosmo,
 		if (relax_cycles == 1)
 	    {
 	    	plan_phi->execute(FFT_FORWARD);
-			extractPowerSpectrum(*scalarFT, kbin, power, kscatter, pscatter, occupation, sim.numbins, false, KTYPE_LINEAR);
+			extractPowerSpectrum(*scalarFT, kbin, power, kscatter, pscatter, occupation, sim.numbins, false, KTYPE_LINEAR, sim.pk_binning);
 			sprintf(filename, "%s%sICtarget_phi.dat", sim.output_path, sim.basename_pk);
 			writePowerSpectrum(kbin, power, kscatter, pscatter, occupation, sim.numbins, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI, filename, "power spectrum of phi", a);
 			plan_chi->execute(FFT_FORWARD);
-			extractPowerSpectrum(*scalarFT, kbin, power, kscatter, pscatter, occupation, sim.numbins, false, KTYPE_LINEAR);
+			extractPowerSpectrum(*scalarFT, kbin, power, kscatter, pscatter, occupation, sim.numbins, false, KTYPE_LINEAR, sim.pk_binning);
 			sprintf(filename, "%s%sICactual_phi.dat", sim.output_path, sim.basename_pk);
 			writePowerSpectrum(kbin, power, kscatter, pscatter, occupation, sim.numbins, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI, filename, "power spectrum of phi", a);
 		}
@@ -598,7 +598,7 @@ void generateIC_prevolution(metadata & sim, icsettings & ic, cosmology & cosmo,
 			phi->saveHDF5(h5filename + filename);
 
 			plan_phi->execute(FFT_FORWARD);
-			extractPowerSpectrum(*scalarFT, kbin, power, kscatter, pscatter, occupation, sim.numbins, false, KTYPE_LINEAR);
+			extractPowerSpectrum(*scalarFT, kbin, power, kscatter, pscatter, occupation, sim.numbins, false, KTYPE_LINEAR, sim.pk_binning);
 			sprintf(filename, "%s%sICinit_phi.dat", sim.output_path, sim.basename_pk);
 			writePowerSpectrum(kbin, power, kscatter, pscatter, occupation, sim.numbins, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI, filename, "power spectrum of phi", a);
 		}
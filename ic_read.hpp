@@ -29,14 +29,21 @@
 //   tau            reference to conformal coordinate time
 //   dtau           time step
 //   dtau_old       previous time step (will be passed back)
+//   H_spline       Hubble rate (hiclass background)
+//   tau_spline     conformal time (hiclass background)
+//   acc            interpolation accelerator
 //   pcls_cdm       pointer to (uninitialized) particle handler for CDM
 //   pcls_b         pointer to (uninitialized) particle handler for baryons
 //   pcls_ncdm      array of (uninitialized) particle handlers for
 //                  non-cold DM (may be set to NULL)
 //   maxvel         array that will contain the maximum q/m/a (max. velocity)
 //   phi            pointer to allocated field
+//   pi_k           pointer to allocated field (KGB scalar field)
+//   zeta           pointer to allocated field (KGB momentum at half step)
 //   chi            pointer to allocated field
 //   Bi             pointer to allocated field
+//   phi_old        pointer to allocated field (phi of the previous cycle)
+//   chi_old        pointer to allocated field (chi of the previous cycle)
 //   source         pointer to allocated field
 //   Sij            pointer to allocated field
 //   scalarFT       pointer to allocated field
@@ -56,7 +63,11 @@
 //
 //////////////////////////
 
-void readIC(metadata & sim, icsettings & ic, cosmology & cosmo, const double fourpiG, double & a, double & tau, double & dtau, double & dtau_old, Particles_gevolution<part_simple,part_simple_info,part_simple_dataType> * pcls_cdm, Particles_gevolution<part_simple,part_simple_info,part_simple_dataType> * pcls_b, Particles_gevolution<part_simple,part_simple_info,part_simple_dataType> * pcls_ncdm, double * maxvel, Field<Real> * phi, Field<Real> * chi, Field<Real> * Bi, Field<Real> * source, Field<Real> * Sij, Field<Cplx> * scalarFT, Field<Cplx> * BiFT, Field<Cplx> * SijFT, PlanFFT<Cplx> * plan_phi, PlanFFT<Cplx> * plan_chi, PlanFFT<Cplx> * plan_Bi, PlanFFT<Cplx> * plan_source, PlanFFT<Cplx> * plan_Sij, int & cycle, int & snapcount, int & pkcount, int & restartcount, set<long> * IDbacklog, parameter * params, int & numparam)
+void readIC(metadata & sim, icsettings & ic, cosmology & cosmo, const double fourpiG, double & a, double & tau, double & dtau, double & dtau_old,
+#ifdef HAVE_HICLASS_BG
+gsl_spline * H_spline, gsl_spline * tau_spline, gsl_interp_accel * acc,
+#endif
+Particles_gevolution<part_simple,part_simple_info,part_simple_dataType> * pcls_cdm, Particles_gevolution<part_simple,part_simple_info,part_simple_dataType> * pcls_b, Particles_gevolution<part_simple,part_simple_info,part_simple_dataType> * pcls_ncdm, double * maxvel, Field<Real> * phi, Field<Real> * pi_k, Field<Real> * zeta, Field<Real> * chi, Field<Real> * Bi, Field<Real> * phi_old, Field<Real> * chi_old, Field<Real> * source, Field<Real> * Sij, Field<Cplx> * scalarFT, Field<Cplx> * BiFT, Field<Cplx> * SijFT, PlanFFT<Cplx> * plan_phi, PlanFFT<Cplx> * plan_chi, PlanFFT<Cplx> * plan_Bi, PlanFFT<Cplx> * plan_source, PlanFFT<Cplx> * plan_Sij, int & cycle, int & snapcount, int & pkcount, int & restartcount, set<long> * IDbacklog, parameter * params, int & numparam)
 {
 	part_simple_info pcls_cdm_info;
 	part_simple_dataType pcls_cdm_dataType;
@@ -87,17 +98,6 @@ void readIC(metadata & sim, icsettings & ic, cosmology & cosmo, const double fou
 	void * buf2;
 	set<long> IDlookup;
 
-  #ifdef HAVE_HICLASS_BG
-	background class_background;
-  thermo class_thermo;
-  perturbs class_perturbs;
-	gsl_interp_accel * acc = gsl_interp_accel_alloc();
-	//Background variables EFTevolution
-	gsl_spline * H_spline = NULL;
-	//add BG functions here
-	initializeCLASSstructures(sim, ic, cosmo, class_background, class_thermo, class_perturbs, params, numparam);
-	loadBGFunctions(class_background, H_spline, "H [1/Mpc]", sim.z_in);
-	#endif
 	double Hc = Hconf(a, fourpiG,
 		#ifdef HAVE_HICLASS_BG
 			H_spline, acc
@@ -313,7 +313,7 @@ void readIC(metadata & sim, icsettings & ic, cosmology & cosmo, const double fou
 	else
   tau = particleHorizon(a, fourpiG,
     #ifdef HAVE_HICLASS_BG
-    gsl_spline_eval(H_spline, 1., acc), class_background
+    gsl_spline_eval(H_spline, 1., acc), tau_spline, acc
     #else
     cosmo
     #endif
@@ -352,6 +352,29 @@ void readIC(metadata & sim, icsettings & ic, cosmology & cosmo, const double fou
 			chi->updateHalo();
 		}
 
+		//KGB: scalar field and the metric of the previous cycle for the leapfrog
+		if (ic.kgbfile[0][0] != '\0' && ic.kgbfile[1][0] != '\0')
+		{
+			filename.assign(ic.kgbfile[0]);
+			pi_k->loadHDF5(filename);
+			pi_k->updateHalo();
+			filename.assign(ic.kgbfile[1]);
+			zeta->loadHDF5(filename);
+			zeta->updateHalo();
+		}
+		else
+			COUT << COLORTEXT_YELLOW << " /!\\ warning" << COLORTEXT_RESET << ": no KGB field files specified for restart, pi_k and zeta are reinitialized!" << endl;
+
+		if (ic.oldmetricfile[0][0] != '\0' && ic.oldmetricfile[1][0] != '\0')
+		{
+			filename.assign(ic.oldmetricfile[0]);
+			phi_old->loadHDF5(filename);
+			phi_old->updateHalo();
+			filename.assign(ic.oldmetricfile[1]);
+			chi_old->loadHDF5(filename);
+			chi_old->updateHalo();
+		}
+
 		if (parallel.isRoot())
 		{
 			sprintf(line, "%s%s_background.dat", sim.output_path, sim.basename_generic);
@@ -647,7 +670,7 @@ void readIC(metadata & sim, icsettings & ic, cosmology & cosmo, const double fou
 
       d = particleHorizon(1. / (1. + sim.lightcone[i].z), fourpiG,
 				#ifdef HAVE_HICLASS_BG
-				gsl_spline_eval(H_spline, 1., acc), class_background
+				gsl_spline_eval(H_spline, 1., acc), tau_spline, acc
 				#else
 				cosmo
 				#endif
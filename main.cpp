@@ -74,6 +74,10 @@
 #include "velocity.hpp"
 #endif
 
+#if defined(OVERLAP_BI) && defined(FFT_BATCH)
+#error OVERLAP_BI cannot be combined with FFT_BATCH (chi would only be available together with Bi)
+#endif
+
 using namespace std;
 using namespace LATfield2;
 
@@ -98,7 +102,6 @@ int main(int argc, char **argv)
 		double moveParts_time = 0;
 		int  moveParts_count =0;
 		// KGB
-		double a_kgb;
 		double Hc;
 	#endif  //BENCHMARK
 
@@ -107,9 +110,14 @@ int main(int argc, char **argv)
 	int io_group_size = 0;
 	int i, j, cycle = 0, snapcount = 0, pkcount = 0, restartcount = 0, usedparams, numparam = 0, numsteps, numspecies, done_hij;
 	int numsteps_ncdm[MAX_PCL_SPECIES-2];
+	int numsteps_kgb;
+#ifdef OVERLAP_BI
+	int Bi_pending = 0;  // Bi has been updated in k-space but not yet transformed back to position space
+	int Bi_overlap = 0;  // the back-transform of Bi may run concurrently with the KGB source preparation
+#endif
 	long numpts3d;
 	int box[3];
-	double dtau, dtau_old, dx, tau, a, fourpiG, tmp, start_time;
+	double dtau, dtau_old, dtau_kgb, dx, tau, a, a_kgb, fourpiG, tmp, start_time;
 	double maxvel[MAX_PCL_SPECIES];
 	FILE * outfile;
 	FILE * check_file;
@@ -123,6 +131,7 @@ int main(int argc, char **argv)
 	icsettings ic;
 	double T00hom;
 	double T00KGBhom;
+	double T00sums[2] = {0., 0.}; // sums of source and T00_kgb, accumulated during the KGB projection
 	#ifdef HAVE_HICLASS_BG
 		gsl_interp_accel * acc = gsl_interp_accel_alloc();
 		gsl_spline * H_spline = NULL;
@@ -146,6 +155,11 @@ int main(int argc, char **argv)
 		gsl_spline * cs2num_spline = NULL;
 		gsl_spline * kin_D_spline = NULL;
 		gsl_spline * lambda_2_spline = NULL;
+		gsl_spline * tau_spline = NULL;
+		kgb_coefficient_table kgb_table;
+		background_table bg_table;  // Hconf, Hconf_prime and cs2 for the time stepping
+		double bg_dev[3];
+		kgb_coefficients kgb_coeff;
 	#endif
 
 	#ifndef H5_DEBUG
@@ -241,6 +255,14 @@ int main(int argc, char **argv)
 
 	usedparams = parseMetadata(params, numparam, sim, cosmo, ic);
 
+	if (precisionfile != NULL)
+	{
+		strncpy(ic.precisionfile, precisionfile, PARAM_MAX_LENGTH-1);
+		ic.precisionfile[PARAM_MAX_LENGTH-1] = '\0';
+	}
+	else if (ic.precisionfile[0] != '\0')
+		precisionfile = ic.precisionfile;
+
 	COUT << " parsing of settings file completed. " << numparam << " parameters found, " << usedparams << " were used." << endl;
 
 	sprintf(filename, "%s%s_settings_used.ini", sim.output_path, sim.basename_generic);
@@ -267,30 +289,40 @@ int main(int argc, char **argv)
 		if(parallel.isRoot())  COUT << " Precision parameters are found and being read!" <<" The number of precision parameters are:"<<numparam << endl;
 		}
 		else numparam = 0;
+		sim.checkpoint_id = checkpointRunID(sim, ic, cosmo, params, numparam);
 		#ifdef HAVE_HICLASS_BG
-			initializeCLASSstructures(sim, ic, cosmo, class_background, class_thermo, class_perturbs, params, numparam);
-			loadBGFunctions(class_background, H_spline, "H [1/Mpc]", sim.z_in);
-			loadBGFunctions(class_background, H_prime_spline, "H_prime", sim.z_in);
-  			loadBGFunctions(class_background, H_prime_prime_spline, "H_prime_prime", sim.z_in);
-			loadBGFunctions(class_background, rho_cdm_spline, "(.)rho_cdm", sim.z_in);
-			loadBGFunctions(class_background, rho_b_spline, "(.)rho_b", sim.z_in);
-			loadBGFunctions(class_background, rho_g_spline, "(.)rho_g", sim.z_in);
-			loadBGFunctions(class_background, rho_crit_spline, "(.)rho_crit", sim.z_in);
-			loadBGFunctions(class_background, rho_ur_spline, "(.)rho_ur", sim.z_in);
-			loadBGFunctions(class_background, cs2_spline, "c_s^2", sim.z_in);
-			loadBGFunctions(class_background, cs2_prime_spline, "c_s^2_prime", sim.z_in);
-			loadBGFunctions(class_background, rho_smg_spline, "(.)rho_smg", sim.z_in);
-			loadBGFunctions(class_background, rho_smg_prime_spline, "(.)rho_smg_prime", sim.z_in);
-			loadBGFunctions(class_background, p_smg_spline, "(.)p_smg", sim.z_in);
-			loadBGFunctions(class_background, p_smg_prime_spline, "(.)p_smg_prime", sim.z_in);
-			loadBGFunctions(class_background, alpha_K_spline, "kineticity_smg", sim.z_in);
-			loadBGFunctions(class_background, alpha_K_prime_spline, "kineticity_prime_smg", sim.z_in);
-			loadBGFunctions(class_background, alpha_B_spline, "braiding_smg", sim.z_in);
-			loadBGFunctions(class_background, alpha_B_prime_spline, "braiding_prime_smg", sim.z_in);
-			loadBGFunctions(class_background, cs2num_spline, "cs2num", sim.z_in);
-			loadBGFunctions(class_background, kin_D_spline, "kin (D)", sim.z_in);
-			loadBGFunctions(class_background, lambda_2_spline, "lambda_2", sim.z_in);
+			// the tabulated background is cached for restarts, such that hiclass does not have to be run again
+			gsl_spline ** bg_splines[] = {&H_spline, &H_prime_spline, &H_prime_prime_spline, &rho_cdm_spline, &rho_b_spline, &rho_g_spline, &rho_crit_spline, &rho_ur_spline, &cs2_spline, &cs2_prime_spline, &rho_smg_spline, &rho_smg_prime_spline, &p_smg_spline, &p_smg_prime_spline, &alpha_K_spline, &alpha_K_prime_spline, &alpha_B_spline, &alpha_B_prime_spline, &cs2num_spline, &kin_D_spline, &lambda_2_spline, &tau_spline};
+			const char * bg_names[] = {"H [1/Mpc]", "H_prime", "H_prime_prime", "(.)rho_cdm", "(.)rho_b", "(.)rho_g", "(.)rho_crit", "(.)rho_ur", "c_s^2", "c_s^2_prime", "(.)rho_smg", "(.)rho_smg_prime", "(.)p_smg", "(.)p_smg_prime", "kineticity_smg", "kineticity_prime_smg", "braiding_smg", "braiding_prime_smg", "cs2num", "kin (D)", "lambda_2", "conf. time [Mpc]"};
+			const int num_bg_splines = sizeof(bg_names) / sizeof(bg_names[0]);
+			const uint64_t bg_checksum = backgroundChecksum(cosmo, params, numparam);
+			int bg_cached = 0;
+
+			if (ic.generator == ICGEN_READ_FROM_DISK && ic.bgfile[0] != '\0' && loadBackgroundCache(ic.bgfile, bg_checksum, bg_splines, num_bg_splines))
+			{
+				bg_cached = 1;
+				COUT << " background tables read from " << ic.bgfile << ", hiclass background not recomputed" << endl;
+			}
+			else
+			{
+				if (ic.generator == ICGEN_READ_FROM_DISK && ic.bgfile[0] != '\0')
+				{
+					COUT << COLORTEXT_YELLOW << " /!\\ warning" << COLORTEXT_RESET << ": background file " << ic.bgfile << " is missing or does not match the cosmological parameters, running hiclass" << endl;
+				}
+				initializeCLASSstructures(sim, ic, cosmo, class_background, class_thermo, class_perturbs, params, numparam);
+				for (i = 0; i < num_bg_splines; i++)
+					loadBGFunctions(class_background, *bg_splines[i], bg_names[i], sim.z_in);
+			}
+
+			if (parallel.isRoot() && (sim.num_restart > 0 || sim.wallclocklimit > 0. || sim.checkpoint_disk > 0))
+			{
+				sprintf(filename, "%s%s_bg.dat", sim.restart_path, sim.basename_restart);
+				if ((!bg_cached || strcmp(filename, ic.bgfile) != 0) && !saveBackgroundCache(filename, bg_checksum, bg_splines, num_bg_splines))
+					cout << COLORTEXT_YELLOW << " /!\\ warning" << COLORTEXT_RESET << ": could not write background file " << filename << endl;
+			}
 		#endif
+	#else
+	sim.checkpoint_id = checkpointRunID(sim, ic, cosmo);
 	#endif
 
 	h5filename.reserve(2*PARAM_MAX_LENGTH);
@@ -304,14 +336,30 @@ int main(int argc, char **argv)
 	Lattice latFT;
 	latFT.initializeRealFFT(lat,0);
 
+	i = (lat.sizeLocal(1) < lat.sizeLocal(2)) ? lat.sizeLocal(1) : lat.sizeLocal(2);
+	parallel.min(i);
+	if (sim.kgb_halo > i)
+	{
+		COUT << COLORTEXT_YELLOW << " /!\\ warning" << COLORTEXT_RESET << ": kgb halo = " << sim.kgb_halo << " exceeds the local domain, using kgb halo = " << i << " instead." << endl;
+		sim.kgb_halo = i;
+	}
+	Lattice lat_kgb(3,box,sim.kgb_halo); // deep halo for the KGB sub-cycle: sim.kgb_halo sub-steps per halo exchange
+
 	Particles_gevolution<part_simple,part_simple_info,part_simple_dataType> pcls_cdm;
 	Particles_gevolution<part_simple,part_simple_info,part_simple_dataType> pcls_b;
 	Particles_gevolution<part_simple,part_simple_info,part_simple_dataType> pcls_ncdm[MAX_PCL_SPECIES-2];
 	Field<Real> * update_cdm_fields[3];
 	Field<Real> * update_b_fields[3];
 	Field<Real> * update_ncdm_fields[3];
-	double f_params[5];
+	double f_params[6];
+	int nfield_geodesic;
+	update_q_function update_q_cycle;
+	update_pos_function update_pos_cycle, update_q_pos_cycle;
 	set<long> IDbacklog[MAX_PCL_SPECIES];
+#ifdef ASYNC_SNAPSHOTS
+	snapshot_writer snapshots;
+	snapshots.initialize(sim.snapshot_single);
+#endif
 
 	Field<Real> phi;
 	Field<Cplx> scalarFT;
@@ -339,78 +387,83 @@ int main(int argc, char **argv)
 	BiFT.initialize(latFT,3);
 	PlanFFT<Cplx> plan_Bi(&Bi, &BiFT);
 
+#ifdef FFT_BATCH
+	Field<Real> chiBi;  // chi and Bi are transformed back to position space in one batch
+	Field<Cplx> chiBiFT;
+	chiBi.initialize(lat,4);
+	chiBiFT.initialize(latFT,4);
+	PlanFFT<Cplx> plan_chiBi(&chiBi, &chiBiFT);
+	Field<Cplx> * chiBiFT_parts[2] = {&scalarFT, &BiFT};
+	Field<Real> * chiBi_parts[2] = {&chi, &Bi};
+#endif
+
 
 	// KGB
+	// The scratch fields of the KGB evolution only live in position space.
+	// The KGB fields for which power spectra can be requested (or which are
+	// generated in Fourier space for the initial conditions) share a single
+	// Fourier image, scalarFT_kgb, since they are transformed one at a time;
+	// the plans, and with them the buffer, are only set up if needed (below).
 	Field<Real> phi_old;
-	Field<Cplx> scalarFT_phi_old;
 	phi_old.initialize(lat,1);
-	scalarFT_phi_old.initialize(latFT,1);
-	PlanFFT<Cplx> plan_phi_old(&phi_old, &scalarFT_phi_old);
-	
-	Field<Real> zeta_half;
-	Field<Cplx> scalarFT_zeta_half;
-	zeta_half.initialize(lat,1);
-	scalarFT_zeta_half.initialize(latFT,1);
-	PlanFFT<Cplx> plan_zeta_half(&zeta_half, &scalarFT_zeta_half);
-  
+	phi_old.alloc();
+
 	Field<Real> chi_old;
-	Field<Cplx> scalarFT_chi_old;
 	chi_old.initialize(lat,1);
-	scalarFT_chi_old.initialize(latFT,1);
-	PlanFFT<Cplx> plan_chi_old(&chi_old, &scalarFT_chi_old);
+	chi_old.alloc();
 
+	Field<Real> psi_prime;
+	psi_prime.initialize(lat,1);
+	psi_prime.alloc();
 
-	Field<Real> phi_prime;
-	Field<Cplx> phi_prime_scalarFT;
-	phi_prime.initialize(lat,1);
-	phi_prime_scalarFT.initialize(latFT,1);
-	PlanFFT<Cplx> phi_prime_plan(&phi_prime, &phi_prime_scalarFT);
+	Field<Real> deltaPm;
+	deltaPm.initialize(lat,1);
+	deltaPm.alloc();
 
+	Field<Real> T0i_kgb;
+	T0i_kgb.initialize(lat,3);
+	T0i_kgb.alloc();
 
-	Field<Real> psi_prime;
-	Field<Cplx> psi_prime_scalarFT;
-	psi_prime.initialize(lat,1);
-	psi_prime_scalarFT.initialize(latFT,1);
-	PlanFFT<Cplx> psi_prime_plan(&psi_prime, &psi_prime_scalarFT);
+	Field<Real> Tij_kgb;
+	Tij_kgb.initialize(lat,3,3,symmetric);
+	Tij_kgb.alloc();
 
-	Field<Real> psi_half;
-	Field<Cplx> psi_half_scalarFT;
-	psi_half.initialize(lat,1);
-	psi_half_scalarFT.initialize(latFT,1);
-	PlanFFT<Cplx> psi_half_plan(&psi_half, &psi_half_scalarFT);
+	Field<Real> kgb_source; // frozen source terms for the KGB sub-cycle, see prepare_kgb_source
+	kgb_source.initialize(lat_kgb,5);
+	kgb_source.alloc();
 
+	Field<Cplx> scalarFT_kgb;
+	scalarFT_kgb.initialize(latFT,1);
 
 	Field<Real> pi_k;
-	Field<Cplx> scalarFT_pi;
-	pi_k.initialize(lat,1);
-	scalarFT_pi.initialize(latFT,1);
-	PlanFFT<Cplx> plan_pi_k(&pi_k, &scalarFT_pi);
+	pi_k.initialize(lat_kgb,1);
+	pi_k.alloc();
+	PlanFFT<Cplx> plan_pi_k;
+
+	Field<Real> zeta_half;
+	zeta_half.initialize(lat_kgb,1);
+	zeta_half.alloc();
+	PlanFFT<Cplx> plan_zeta_half;
 
 	Field<Real> T00_kgb;
-	Field<Cplx> T00_kgbFT;
 	T00_kgb.initialize(lat,1);
-	T00_kgbFT.initialize(latFT,1);
-	PlanFFT<Cplx> plan_T00_kgb(&T00_kgb, &T00_kgbFT);
-
-	Field<Real> T0i_kgb;
-	Field<Cplx> T0i_kgbFT;
-	T0i_kgb.initialize(lat,3);
-	T0i_kgbFT.initialize(latFT,3);
-	PlanFFT<Cplx> plan_T0i_kgb(&T0i_kgb, &T0i_kgbFT);
-
-	Field<Real> Tij_kgb;
-	Field<Cplx> Tij_kgbFT;
-	Tij_kgb.initialize(lat,3,3,symmetric);
-	Tij_kgbFT.initialize(latFT,3,3,symmetric);
-	PlanFFT<Cplx> plan_Tij_kgb(&Tij_kgb, &Tij_kgbFT);	
+	T00_kgb.alloc();
+	PlanFFT<Cplx> plan_T00_kgb;
 
+	Field<Real> phi_prime;
+	phi_prime.initialize(lat,1);
+	phi_prime.alloc();
+	PlanFFT<Cplx> phi_prime_plan;
+
+	if (ic.generator == ICGEN_BASIC || sim.out_pk & MASK_PI_K)
+		plan_pi_k.initialize(&pi_k, &scalarFT_kgb);
+	if (ic.generator == ICGEN_BASIC || sim.out_pk & MASK_ZETA)
+		plan_zeta_half.initialize(&zeta_half, &scalarFT_kgb);
+	if (sim.out_pk & MASK_T_KGB || sim.out_pk & MASK_DELTA_KGB)
+		plan_T00_kgb.initialize(&T00_kgb, &scalarFT_kgb);
+	if (sim.out_pk & MASK_PHI_PRIME)
+		phi_prime_plan.initialize(&phi_prime, &scalarFT_kgb);
 
-	Field<Real> deltaPm;
-	Field<Cplx> scalarFT_deltaPm;
-	deltaPm.initialize(lat,1);
-	scalarFT_deltaPm.initialize(latFT,1);
-	PlanFFT<Cplx> plan_deltaPm(&deltaPm, &scalarFT_deltaPm);
-	
 	#ifdef CHECK_B
 		Field<Real> Bi_check;
 		Field<Cplx> BiFT_check;
@@ -427,6 +480,10 @@ int main(int argc, char **argv)
 		double a_old;
 	#endif
 	
+	// fields which carry state from one cycle to the next, for the rank-local checkpoints
+	checkpoint_field checkpoint_fields[] = {checkpointField(phi), checkpointField(chi), checkpointField(Bi), checkpointField(BiFT), checkpointField(pi_k), checkpointField(zeta_half), checkpointField(phi_old), checkpointField(chi_old)};
+	const int num_checkpoint_fields = sizeof(checkpoint_fields) / sizeof(checkpoint_field);
+
 	update_cdm_fields[0] = &phi;
 	update_cdm_fields[1] = &chi;
 	update_cdm_fields[2] = &Bi;
@@ -452,11 +509,29 @@ int main(int argc, char **argv)
 	}
 	parallel.min(sim.movelimit);
 	fourpiG = 1.5 * sim.boxsize * sim.boxsize / C_SPEED_OF_LIGHT / C_SPEED_OF_LIGHT; // Just a definition to make Friedmann equation simplified! and working with normal numbers
+	#ifdef HAVE_HICLASS_BG
+		initialize_background_table(bg_table, sim.bg_table_size, 0.5 / (1. + sim.z_in), fourpiG, H_spline, cs2_spline);
+		if (background_table_deviation(bg_table, fourpiG, H_spline, cs2_spline, bg_dev) > BG_TABLE_TOLERANCE)
+		{
+			COUT << COLORTEXT_YELLOW << " /!\\ warning" << COLORTEXT_RESET << ": background table deviates from the hiclass splines by up to " << bg_dev[0] << " (Hconf), "
+				<< bg_dev[1] << " (Hconf_prime), " << bg_dev[2] << " (cs2); consider increasing the background table size (currently " << bg_table.size << ")." << endl;
+		}
+		initialize_kgb_coefficient_table(kgb_table, sim.kgb_table_size, 0.5 / (1. + sim.z_in), fourpiG, H_spline, rho_smg_spline, p_smg_spline, p_smg_prime_spline, rho_crit_spline,
+			alpha_K_spline, alpha_B_spline, alpha_K_prime_spline, alpha_B_prime_spline, acc);
+		tmp = kgb_coefficient_table_deviation(kgb_table, fourpiG, H_spline, rho_smg_spline, p_smg_spline, p_smg_prime_spline, rho_crit_spline,
+			alpha_K_spline, alpha_B_spline, alpha_K_prime_spline, alpha_B_prime_spline, acc);
+		if (tmp > KGB_TABLE_TOLERANCE)
+		{
+			// the error of the linear interpolation scales with the square of the node spacing (suggestion with 10% margin)
+			COUT << COLORTEXT_YELLOW << " /!\\ warning" << COLORTEXT_RESET << ": KGB coefficient table deviates from the hiclass splines by up to " << tmp
+				<< "; consider increasing the kgb table size (currently " << kgb_table.size << ") to about " << (int) ceil(1.1 * (kgb_table.size - 1) * sqrt(tmp / KGB_TABLE_TOLERANCE)) + 1 << "." << endl;
+		}
+	#endif
 	a = 1. / (1. + sim.z_in);
   	tau = particleHorizon
 	(a, fourpiG,
     #ifdef HAVE_HICLASS_BG
-    gsl_spline_eval(H_spline, 1., acc), class_background
+    gsl_spline_eval(H_spline, 1., acc), tau_spline, acc
     #else
     cosmo
     #endif
@@ -464,7 +539,7 @@ int main(int argc, char **argv)
 
   	if (sim.Cf * dx < sim.steplimit / Hconf(a, fourpiG,
     #ifdef HAVE_HICLASS_BG
-      H_spline, acc
+      bg_table
     #else
       cosmo
     #endif
@@ -473,7 +548,7 @@ int main(int argc, char **argv)
   	else
     dtau = sim.steplimit / 	Hconf(a, fourpiG,
       #ifdef HAVE_HICLASS_BG
-        H_spline, acc
+        bg_table
       #else
         cosmo
       #endif
@@ -481,10 +556,14 @@ int main(int argc, char **argv)
 
 	dtau_old = 0.;
 	if (ic.generator == ICGEN_BASIC)
-		generateIC_basic(sim, ic, cosmo, fourpiG, &pcls_cdm, &pcls_b, pcls_ncdm, maxvel, &phi, &pi_k, &zeta_half, &chi, &Bi, &source, &Sij, &scalarFT, &scalarFT_pi, &scalarFT_zeta_half, &BiFT, &SijFT, &plan_phi, &plan_pi_k, &plan_zeta_half, &plan_chi, &plan_Bi, &plan_source, &plan_Sij, params, numparam);
+		generateIC_basic(sim, ic, cosmo, fourpiG, &pcls_cdm, &pcls_b, pcls_ncdm, maxvel, &phi, &pi_k, &zeta_half, &chi, &Bi, &source, &Sij, &scalarFT, &scalarFT_kgb, &scalarFT_kgb, &BiFT, &SijFT, &plan_phi, &plan_pi_k, &plan_zeta_half, &plan_chi, &plan_Bi, &plan_source, &plan_Sij, params, numparam);
 	// generates ICs on the fly
 	else if (ic.generator == ICGEN_READ_FROM_DISK)
-  	readIC(sim, ic, cosmo, fourpiG, a, tau, dtau, dtau_old, &pcls_cdm, &pcls_b, pcls_ncdm, maxvel, &phi, &chi, &Bi, &source, &Sij, &scalarFT, &BiFT, &SijFT, &plan_phi, &plan_chi, &plan_Bi, &plan_source, &plan_Sij, cycle, snapcount, pkcount, restartcount, IDbacklog, params, numparam);
+  	readIC(sim, ic, cosmo, fourpiG, a, tau, dtau, dtau_old,
+	#ifdef HAVE_HICLASS_BG
+		H_spline, tau_spline, acc,
+	#endif
+		&pcls_cdm, &pcls_b, pcls_ncdm, maxvel, &phi, &pi_k, &zeta_half, &chi, &Bi, &phi_old, &chi_old, &source, &Sij, &scalarFT, &BiFT, &SijFT, &plan_phi, &plan_chi, &plan_Bi, &plan_source, &plan_Sij, cycle, snapcount, pkcount, restartcount, IDbacklog, params, numparam);
 	#ifdef ICGEN_PREVOLUTION
 		else if (ic.generator == ICGEN_PREVOLUTION)
 			generateIC_prevolution(sim, ic, cosmo, fourpiG, a, tau, dtau, dtau_old, &pcls_cdm, &pcls_b, pcls_ncdm, maxvel, &phi, &chi, &Bi, &source, &Sij, &scalarFT, &BiFT, &SijFT, &plan_phi, &plan_chi, &plan_Bi, &plan_source, &plan_Sij, params, numparam);
@@ -505,6 +584,9 @@ int main(int argc, char **argv)
 		parallel.abortForce();
 	}
 
+	a_kgb = (ic.restart_a_kgb > 0.) ? ic.restart_a_kgb : a;
+	dtau_kgb = ic.restart_dtau_kgb;  // 0 before the first KGB sub-cycle
+
 	numspecies = 1 + sim.baryon_flag + cosmo.num_ncdm;
 	parallel.max<double>(maxvel, numspecies);
 
@@ -514,6 +596,11 @@ int main(int argc, char **argv)
 			maxvel[i] /= sqrt(maxvel[i] * maxvel[i] + 1.0);
 	}
 
+	// a rank-local checkpoint of the same run which is newer than the initial conditions takes
+	// precedence; a fresh run only continues from one if this is requested in the settings
+	if (ic.restart_cycle >= 0 || sim.checkpoint_restore)
+		restoreCheckpoint(sim, cosmo, &pcls_cdm, &pcls_b, pcls_ncdm, checkpoint_fields, num_checkpoint_fields, maxvel, a, tau, dtau, dtau_old, dtau_kgb, cycle, snapcount, pkcount, restartcount);
+
 	#ifdef CHECK_B
 		if (sim.vector_flag == VECTOR_ELLIPTIC)
 		{
@@ -548,7 +635,7 @@ int main(int argc, char **argv)
 			if (sim.radiation_flag > 0 || sim.fluid_flag > 0)
 			{
 				initializeCLASSstructures(sim, ic, cosmo, class_background, class_thermo, class_perturbs, params, numparam);
-				if (sim.gr_flag > 0 && a < 1. / (sim.z_switch_linearchi + 1.) && (ic.generator == ICGEN_BASIC || (ic.generator == ICGEN_READ_FROM_DISK && cycle == 0)))
+				if (sim.gr_flag > 0 && a < 1. / (sim.z_switch_linearchi + 1.) && cycle == 0 && (ic.generator == ICGEN_BASIC || ic.generator == ICGEN_READ_FROM_DISK))
 				{
 					prepareFTchiLinear(class_background, class_perturbs, scalarFT, sim, ic, cosmo, fourpiG, a);
 					plan_source.execute(FFT_BACKWARD);
@@ -559,17 +646,56 @@ int main(int argc, char **argv)
 			}	
 		if (numparam > 0) free(params);
 	#endif
-        
+
+#ifdef OVERLAP_BI
+#ifdef _OPENMP
+	// LATfield2 initialises MPI without requesting thread support; the overlap is only
+	// used if the library nevertheless allows MPI calls from the master thread while
+	// other threads are active
+	MPI_Query_thread(&i);
+	if (omp_get_max_threads() > 1)
+	{
+		if (i >= MPI_THREAD_FUNNELED)
+			Bi_overlap = 1;
+		else
+			COUT << COLORTEXT_YELLOW << " /!\\ warning" << COLORTEXT_RESET << ": MPI does not provide MPI_THREAD_FUNNELED, Bi is transformed back before the KGB source is prepared" << endl;
+	}
+#endif
+
+	// Bi is only needed in position space by the output and by the particle update; the
+	// back-transform is therefore postponed and, if no output needs Bi earlier, carried
+	// out while the other threads prepare the KGB source
+	auto complete_Bi = [&]()
+	{
+		if (!Bi_pending) return;
+	#ifdef BENCHMARK
+		double fft_start_time = MPI_Wtime();
+	#endif
+		plan_Bi.execute(FFT_BACKWARD);  // go back to position space
+	#ifdef BENCHMARK
+		fft_time += MPI_Wtime() - fft_start_time;
+		fft_count += 3;
+	#endif
+		Bi.updateHalo();  // communicate halo values
+		Bi_pending = 0;
+	};
+#endif
 
 	while (true)    // main loop
 	{
-		for (x.first(); x.test(); x.next())
-			{
-				phi_old(x) = phi(x);
-				chi_old(x) = chi(x);
-			}
 		#ifdef BENCHMARK
 				cycle_start_time = MPI_Wtime();
+		#endif
+		#ifdef PARTICLE_ARRAYS
+				// contiguous copies of the particles, used by the projections below
+				pcls_cdm.updateArrays();
+				if (sim.baryon_flag)
+					pcls_b.updateArrays();
+				for (i = 0; i < cosmo.num_ncdm; i++)
+				{
+					if (sim.numpcl[1+sim.baryon_flag+i] > 0)
+						pcls_ncdm[i].updateArrays();
+				}
 		#endif
 				// construct stress-energy tensor
 				projection_init(&source);
@@ -577,15 +703,25 @@ int main(int argc, char **argv)
 				if (sim.radiation_flag > 0 || sim.fluid_flag > 0)
 					projection_T00_project(class_background, class_perturbs, source, scalarFT, &plan_source, sim, ic, cosmo, fourpiG, a);
 		#endif
+		#ifdef PARTICLE_ARRAYS
+				projection_init(&Sij);
+		#endif
 		if (sim.gr_flag > 0)
 		{
+		#ifdef PARTICLE_ARRAYS
+			// T00 and Tij of cdm and baryons in one pass
+			projection_Tmunu_project(pcls_cdm.arrays(), &source, NULL, &Sij, a, &phi);
+			if (sim.baryon_flag)
+				projection_Tmunu_project(pcls_b.arrays(), &source, NULL, &Sij, a, &phi);
+		#else
 			projection_T00_project(&pcls_cdm, &source, a, &phi);
 			if (sim.baryon_flag)
 				projection_T00_project(&pcls_b, &source, a, &phi);
+		#endif
 			for (i = 0; i < cosmo.num_ncdm; i++)
 			{
 				if (a >= 1. / (sim.z_switch_deltancdm[i] + 1.) && sim.numpcl[1+sim.baryon_flag+i] > 0)
-					projection_T00_project(pcls_ncdm+i, &source, a, &phi);
+					projection_T00_project(PROJECTION_PCLS(pcls_ncdm+i), &source, a, &phi);
 				else if (sim.radiation_flag == 0 || (a >= 1. / (sim.z_switch_deltancdm[i] + 1.) && sim.numpcl[1+sim.baryon_flag+i] == 0))
 				{
 					tmp = bg_ncdm(a, cosmo, i);
@@ -624,27 +760,33 @@ int main(int argc, char **argv)
 		if (sim.vector_flag == VECTOR_ELLIPTIC)
 		{
 			projection_init(&Bi);
-			projection_T0i_project(&pcls_cdm, &Bi, &phi);
+			projection_T0i_project(PROJECTION_PCLS(&pcls_cdm), &Bi, &phi);
 			if (sim.baryon_flag)
-				projection_T0i_project(&pcls_b, &Bi, &phi);
+				projection_T0i_project(PROJECTION_PCLS(&pcls_b), &Bi, &phi);
 			for (i = 0; i < cosmo.num_ncdm; i++)
 			{
 				if (a >= 1. / (sim.z_switch_Bncdm[i] + 1.) && sim.numpcl[1+sim.baryon_flag+i] > 0)
-					projection_T0i_project(pcls_ncdm+i, &Bi, &phi);
+					projection_T0i_project(PROJECTION_PCLS(pcls_ncdm+i), &Bi, &phi);
 			}
 			projection_T0i_comm(&Bi);
 		}
 
+		#ifdef PARTICLE_ARRAYS
+		if (sim.gr_flag == 0)  // otherwise done together with T00
+		#else
 		projection_init(&Sij);
-		projection_Tij_project(&pcls_cdm, &Sij, a, &phi);
-		if (sim.baryon_flag)
-			projection_Tij_project(&pcls_b, &Sij, a, &phi);
+		#endif
+		{
+			projection_Tij_project(PROJECTION_PCLS(&pcls_cdm), &Sij, a, &phi);
+			if (sim.baryon_flag)
+				projection_Tij_project(PROJECTION_PCLS(&pcls_b), &Sij, a, &phi);
+		}
 		if (a >= 1. / (sim.z_switch_linearchi + 1.))
 		{
 			for (i = 0; i < cosmo.num_ncdm; i++)
 			{
 				if (sim.numpcl[1+sim.baryon_flag+i] > 0)
-					projection_Tij_project(pcls_ncdm+i, &Sij, a, &phi);
+					projection_Tij_project(PROJECTION_PCLS(pcls_ncdm+i), &Sij, a, &phi);
 			}
 		}
 		projection_Tij_comm(&Sij);
@@ -658,7 +800,7 @@ int main(int argc, char **argv)
 		{
 			Hc = Hconf(a, fourpiG,
 			#ifdef HAVE_HICLASS_BG
-				H_spline, acc
+				bg_table
 			#else
 				cosmo
 			#endif
@@ -666,23 +808,14 @@ int main(int argc, char **argv)
 		// KGB projection Tmunu
 		// In the projection zeta_integer comes, since synched with particles..
 		#ifdef HAVE_HICLASS_BG // hiclass used to provide quantities!
+			kgb_coefficients_lookup(kgb_table, a, kgb_coeff);
 			// CHECK! the coeffs and etc!
-			if (sim.vector_flag == VECTOR_ELLIPTIC)
-			{
-				projection_Tmunu_kgb(T00_kgb, T0i_kgb, Tij_kgb, dx, a, fourpiG, gsl_spline_eval(H_spline, 1., acc), phi, chi, phi_prime, pi_k, zeta_half, deltaPm, 
-				Hconf(a, fourpiG, H_spline, acc), Hconf_prime(a, fourpiG, H_spline, acc), Hconf_prime_prime(a, fourpiG, H_spline, acc),
-				gsl_spline_eval(rho_smg_spline, a, acc), gsl_spline_eval(p_smg_spline, a, acc), gsl_spline_eval(p_smg_prime_spline, a, acc), gsl_spline_eval(rho_crit_spline, 1., acc),
-				gsl_spline_eval(alpha_K_spline, a, acc), gsl_spline_eval(alpha_B_spline, a, acc), gsl_spline_eval(alpha_K_prime_spline, a, acc), 
-				gsl_spline_eval(alpha_B_prime_spline, a, acc));
-			}
-			else
-			{
-				projection_Tmunu_kgb(T00_kgb, T0i_kgb, Tij_kgb, dx, a, fourpiG, gsl_spline_eval(H_spline, 1., acc), phi, chi, phi_prime, pi_k, zeta_half, deltaPm, 
-				Hconf(a, fourpiG, H_spline, acc), Hconf_prime(a, fourpiG, H_spline, acc), Hconf_prime_prime(a, fourpiG, H_spline, acc),
-				gsl_spline_eval(rho_smg_spline, a, acc),  gsl_spline_eval(p_smg_spline, a, acc), gsl_spline_eval(p_smg_prime_spline, a, acc), gsl_spline_eval(rho_crit_spline, 1., acc),
-				gsl_spline_eval(alpha_K_spline, a, acc), gsl_spline_eval(alpha_B_spline, a, acc), gsl_spline_eval(alpha_K_prime_spline, a, acc), 
-				gsl_spline_eval(alpha_B_prime_spline, a, acc));
-			}
+			// The coefficient is because it wanted to to be sourced according to eq C.2 of gevolution paper
+			// Note that it is multiplied to dx^2 and is divived by -a^3 because of definition of T00 which is scaled by a^3
+			// We have T00 and Tij according to code's units, but source is important to calculate potentials and moving particles.
+			// There is coefficient between Tij and Sij as source.
+			// T00_kgb and 2 Tij_kgb are added to source and Sij in the same sweep; T0i_kgb vanishes, so Bi is unchanged
+			projection_Tmunu_kgb(T00_kgb, T0i_kgb, Tij_kgb, dx, phi, chi, phi_prime, pi_k, zeta_half, deltaPm, kgb_coeff, &source, &Sij, T00sums);
 		#else // default KGB-evolution or CLASS // No hiclass BG used
 			if (sim.vector_flag == VECTOR_ELLIPTIC)
 			{
@@ -693,17 +826,6 @@ int main(int argc, char **argv)
 				projection_Tmunu_kgb(T00_kgb, T0i_kgb, Tij_kgb, dx, a, phi, pi_k, zeta_half, cosmo.Omega_kgb * pow(a , -3. * cosmo.w_kgb) * (1. + cosmo.w_kgb) / (cosmo.cs2_kgb), cosmo.Omega_kgb * pow(a , -3. * cosmo.w_kgb) * (1. + cosmo.w_kgb), cosmo.w_kgb, cosmo.cs2_kgb, Hc, sim.NL_kgb, 0);
 			}
 		#endif
-
-		for (x.first(); x.test(); x.next())
-		{   // CHECK! the coeffs and etc!
-			// The coefficient is because it wanted to to be sourced according to eq C.2 of gevolution paper
-			// Note that it is multiplied to dx^2 and is divived by -a^3 because of definition of T00 which is scaled by a^3
-			// We have T00 and Tij according to code's units, but source is important to calculate potentials and moving particles.
-			// There is coefficient between Tij and Sij as source.
-			source(x) += T00_kgb(x);
-			if (sim.vector_flag == VECTOR_ELLIPTIC) for (int c=0;c<3;c++) Bi(x,c) += T0i_kgb(x,c);
-			for(int c=0;c<6;c++) Sij(x,c) += (2.) * Tij_kgb(x,c);
-		}
 		}
 		#ifdef BENCHMARK
 			kgb_update_time += MPI_Wtime() - ref_time;
@@ -713,17 +835,18 @@ int main(int argc, char **argv)
 
 		if (sim.gr_flag > 0)
 		{
-			T00hom = 0.;
-			for (x.first(); x.test(); x.next())
-				T00hom += source(x);
-			parallel.sum<double>(T00hom);
-			T00hom /= (double) numpts3d;
-
-			T00KGBhom= 0.;
-			for (x.first(); x.test(); x.next())
-				T00KGBhom+= T00_kgb(x);
-			parallel.sum<double>(T00KGBhom);
-			T00KGBhom /= (double) numpts3d;
+		#ifdef HAVE_HICLASS_BG
+			if (sim.kgb_source_gravity == 1) // already accumulated during the KGB projection
+			{
+				T00hom = T00sums[0] / (double) numpts3d;
+				T00KGBhom = T00sums[1] / (double) numpts3d;
+			}
+			else
+		#endif
+			{
+				T00hom = average_field(source, (double) numpts3d);
+				T00KGBhom = average_field(T00_kgb, (double) numpts3d);
+			}
 
 			if (cycle % CYCLE_INFO_INTERVAL == 0)
 			{
@@ -734,12 +857,12 @@ int main(int argc, char **argv)
 			{
 				Hc = Hconf(a, fourpiG,
 				#ifdef HAVE_HICLASS_BG
-				H_spline, acc
+				bg_table
 				#else
 				cosmo
 				#endif
 				);
-				prepareFTsource<Real>(phi, chi, source, cosmo.Omega_cdm + cosmo.Omega_b + bg_ncdm(a, cosmo), source, 3. * Hc * dx * dx / dtau_old, fourpiG * dx * dx / a, 3. * Hc * Hc * dx * dx);  // prepare nonlinear source for phi update
+				prepareFTsource<Real>(phi, chi, source, cosmo.Omega_cdm + cosmo.Omega_b + bg_ncdm(a, cosmo), source, 3. * Hc * dx * dx / dtau_old, fourpiG * dx * dx / a, 3. * Hc * Hc * dx * dx, &phi_old, &chi_old);  // prepare nonlinear source for phi update; keeps phi(n) and chi(n) for the time derivatives
 				#ifdef BENCHMARK
 					ref2_time= MPI_Wtime();
 				#endif
@@ -760,9 +883,12 @@ int main(int argc, char **argv)
 					fft_count++;
 				#endif
 			}
+			else
+				copy_potentials(phi, chi, phi_old, chi_old);
 		}
 		else
 		{
+			copy_potentials(phi, chi, phi_old, chi_old);
 			#ifdef BENCHMARK
 				ref2_time= MPI_Wtime();
 			#endif
@@ -793,6 +919,16 @@ int main(int argc, char **argv)
 		// 	for(int c=0;c<6;c++) Sij(x,c) -= (2.) * Tij_kgb(x,c);
 		// }
 
+		// number of KGB sub-steps for this cycle
+		numsteps_kgb = sim.n_kgb_numsteps;
+	#ifdef HAVE_HICLASS_BG
+		if (sim.Cf_kgb > 0)
+		{
+			kgb_coefficients_lookup(kgb_table, a, kgb_coeff);
+			numsteps_kgb = kgb_numsteps(dtau, dx, kgb_coeff, cs2_kgb(a, bg_table), sim.Cf_kgb);
+		}
+	#endif
+
 		// record some background data
 		if (kFT.setCoord(0, 0, 0))
 		    {
@@ -820,7 +956,7 @@ int main(int argc, char **argv)
 				fprintf(outfile, "# H0[1/Mpc] = %24e\n", gsl_spline_eval(H_spline, 1, acc));
                 
                 // Header line with fixed-width fields (25 characters each)
-                fprintf(outfile, "\n# %-12s %-24s %-24s %-24s %-24s %-24s %-24s %-24s %-24s %-24s %-24s %-24s %-24s %-24s %-24s %-24s %-24s %-24s %-24s %-24s %-24s %-24s %-24s %-24s %-24s %-24s %-24s\n",
+                fprintf(outfile, "\n# %-12s %-24s %-24s %-24s %-24s %-24s %-24s %-24s %-24s %-24s %-24s %-24s %-24s %-24s %-24s %-24s %-24s %-24s %-24s %-24s %-24s %-24s %-24s %-24s %-24s %-24s %-24s %-24s\n",
                     "0:cycle",
                     "1:tau/boxsize",
                     "2:a",
@@ -847,13 +983,14 @@ int main(int argc, char **argv)
 					"23:kin (D)",
 					"24:phi(k=0)",
 					"25:T00_hom",
-					"26:T00_KGB_hom"
+					"26:T00_KGB_hom",
+					"27:n_kgb"
                 );
             }
     
             // Define a format string with fixed-width fields for alignment (25 characters each)
             // Left-align each field using the '-' flag
-            const char* format = " %-15d %-24e %-24e %-24e %-24e %-24e %-24e %-24e %-24e %-24e %-24e %-24e %-24e %-24e %-24e %-24e %-24e %-24e %-24e %-24e %-24e %-24e %-24e %-24e %-24e %-24e %-24e\n";
+            const char* format = " %-15d %-24e %-24e %-24e %-24e %-24e %-24e %-24e %-24e %-24e %-24e %-24e %-24e %-24e %-24e %-24e %-24e %-24e %-24e %-24e %-24e %-24e %-24e %-24e %-24e %-24e %-24e %-24d\n";
     
             // Write the data with alignment
             fprintf(outfile, format,
@@ -883,7 +1020,8 @@ int main(int argc, char **argv)
                     gsl_spline_eval(kin_D_spline, a, acc),                // 23:kin (D)
 					scalarFT(kFT).real(),                                 // 24:phi(k=0)
 					T00hom,                                               // 25:T00hom
-					T00KGBhom                                             // 26:T00KGBhom
+					T00KGBhom,                                            // 26:T00KGBhom
+					numsteps_kgb                                          // 27:n_kgb
 				); 
 				
 
@@ -1067,16 +1205,45 @@ int main(int argc, char **argv)
 			fft_count += 6;
 		#endif
 
+		// the tensor projection is done in the same sweep if a snapshot of hij is due
+		done_hij = ((sim.out_snapshot & MASK_HIJ) && snapcount < sim.num_snapshot && 1. / a < sim.z_snapshot[snapcount] + 1.) ? 1 : 0;
+
+		i = 0;
 		#if defined(HAVE_CLASS) || defined(HAVE_HICLASS)
 			if (sim.radiation_flag > 0 && a < 1. / (sim.z_switch_linearchi + 1.))
 			{
 				prepareFTchiLinear(class_background, class_perturbs, scalarFT, sim, ic, cosmo, fourpiG, a);
-				projectFTscalar(SijFT, scalarFT, 1);
+				i = 1;  // projection is added to the linear solution
 			}
-			else
 		#endif
-		projectFTscalar(SijFT, scalarFT);  // construct chi by scalar projection (k-space)
 
+		// construct chi by scalar projection and evolve B using vector projection (k-space)
+		if (sim.vector_flag == VECTOR_ELLIPTIC)
+		#ifdef CHECK_B
+			projectFTsources(SijFT, scalarFT, &BiFT_check, a * a * dtau_old, (done_hij ? &SijFT : NULL), i);
+		#else
+			projectFTsources(SijFT, scalarFT, NULL, a * a * dtau_old, (done_hij ? &SijFT : NULL), i);
+		#endif
+		else
+			projectFTsources(SijFT, scalarFT, &BiFT, a * a * dtau_old, (done_hij ? &SijFT : NULL), i);
+
+		if (done_hij)
+		{
+		#ifdef BENCHMARK
+			ref2_time= MPI_Wtime();
+		#endif
+			plan_Sij.execute(FFT_BACKWARD);  // hij goes to position space
+		#ifdef BENCHMARK
+			fft_time += MPI_Wtime() - ref2_time;
+			fft_count += 6;
+		#endif
+			Sij.updateHalo();  // communicate halo values
+		}
+
+		#ifdef FFT_BATCH
+		if (sim.gr_flag == 0)  // otherwise chi is transformed together with Bi below
+		#endif
+		{
 		#ifdef BENCHMARK
 			ref2_time= MPI_Wtime();
 		#endif
@@ -1086,6 +1253,7 @@ int main(int argc, char **argv)
 			fft_count++;
 		#endif
 			chi.updateHalo();  // communicate halo values
+		}
 
 				if (sim.vector_flag == VECTOR_ELLIPTIC)
 				{
@@ -1098,24 +1266,36 @@ int main(int argc, char **argv)
 					fft_count++;
 		#endif
 					projectFTvector(BiFT, BiFT, fourpiG * dx * dx); // solve B using elliptic constraint (k-space)
-		#ifdef CHECK_B
-					evolveFTvector(SijFT, BiFT_check, a * a * dtau_old);
-		#endif
 				}
-				else
-					evolveFTvector(SijFT, BiFT, a * a * dtau_old);  // evolve B using vector projection (k-space)
 
 				if (sim.gr_flag > 0)
 				{
+		#ifdef OVERLAP_BI
+					Bi_pending = 1;
+		#else
 		#ifdef BENCHMARK
 					ref2_time= MPI_Wtime();
 		#endif
+		#ifdef FFT_BATCH
+					pack_FTbatch(chiBiFT, chiBiFT_parts, 2);
+					plan_chiBi.execute(FFT_BACKWARD);  // chi and Bi go back to position space together
+					unpack_batch(chiBi, chiBi_parts, 2);
+		#else
 					plan_Bi.execute(FFT_BACKWARD);  // go back to position space
+		#endif
 		#ifdef BENCHMARK
 					fft_time += MPI_Wtime() - ref2_time;
+		#ifdef FFT_BATCH
+					fft_count += 4;
+		#else
 					fft_count += 3;
+		#endif
+		#endif
+		#ifdef FFT_BATCH
+					chi.updateHalo();  // communicate halo values
 		#endif
 					Bi.updateHalo();  // communicate halo values
+		#endif // OVERLAP_BI
 				}
 
 		#ifdef BENCHMARK
@@ -1125,13 +1305,15 @@ int main(int argc, char **argv)
 
 
 		// lightcone output
+		#ifdef OVERLAP_BI
+		if (sim.num_lightcone > 0) complete_Bi();
+		#endif
 		if (sim.num_lightcone > 0)
 			writeLightcones(sim, cosmo, fourpiG, a, tau, dtau, dtau_old, maxvel[0], cycle, h5filename + sim.basename_lightcone,
 			#ifdef HAVE_HICLASS_BG
-			class_background, H_spline, acc,
+			tau_spline, H_spline, acc,
 			#endif
 		&pcls_cdm, &pcls_b, pcls_ncdm, &phi, &chi, &Bi, &Sij, &BiFT, &SijFT, &plan_Bi, &plan_Sij, done_hij, IDbacklog);
-		else done_hij = 0;
 
 		#ifdef BENCHMARK
 		lightcone_output_time += MPI_Wtime() - ref_time;
@@ -1139,9 +1321,15 @@ int main(int argc, char **argv)
 		#endif
 
 		// snapshot output
+		#ifdef ASYNC_SNAPSHOTS
+			snapshots.test();  // progress of the previous snapshot
+		#endif
 		if (snapcount < sim.num_snapshot && 1. / a < sim.z_snapshot[snapcount] + 1.)
 		{
 			COUT << COLORTEXT_CYAN << " writing snapshot" << COLORTEXT_RESET << " at z = " << ((1./a) - 1.) <<  " (cycle " << cycle << "), tau/boxsize = " << tau << endl;
+		#ifdef OVERLAP_BI
+			complete_Bi();
+		#endif
 
 			writeSnapshots(sim, cosmo, fourpiG, a, dtau_old, done_hij, snapcount, h5filename + sim.basename_snapshot,
 			#ifdef HAVE_HICLASS_BG
@@ -1154,6 +1342,9 @@ int main(int argc, char **argv)
 				#ifdef VELOCITY
 						, &vi
 				#endif
+				#ifdef ASYNC_SNAPSHOTS
+						, &snapshots
+				#endif
 			);
 
 			snapcount++;
@@ -1168,6 +1359,9 @@ int main(int argc, char **argv)
 		if (pkcount < sim.num_pk && 1. / a < sim.z_pk[pkcount] + 1.)
 		{
 			COUT << COLORTEXT_CYAN << " writing power spectra" << COLORTEXT_RESET << " at z = " << ((1./a) - 1.) <<  " (cycle " << cycle << "), tau/boxsize = " << tau << endl;
+		#ifdef OVERLAP_BI
+			complete_Bi();
+		#endif
 			writeSpectra(sim, cosmo, fourpiG, a, pkcount,
 			#if defined(HAVE_CLASS) || defined(HAVE_HICLASS)
 							class_background, class_perturbs, ic,
@@ -1175,7 +1369,7 @@ int main(int argc, char **argv)
 					H_spline, acc, gsl_spline_eval(rho_smg_spline, a, acc), gsl_spline_eval(rho_crit_spline, 1., acc),
 			#endif
 			#endif
-							&pcls_cdm, &pcls_b, pcls_ncdm, &phi, &pi_k, &zeta_half, &chi, &Bi, &T00_kgb, &T0i_kgb, &Tij_kgb ,&source, &Sij, &scalarFT, &scalarFT_pi, &scalarFT_zeta_half, &BiFT, &T00_kgbFT, &T0i_kgbFT, &Tij_kgbFT, &SijFT, &plan_phi, &plan_pi_k , &plan_zeta_half, &plan_chi, &plan_Bi, &plan_T00_kgb, &plan_T0i_kgb, &plan_Tij_kgb, &plan_source, &plan_Sij
+							&pcls_cdm, &pcls_b, pcls_ncdm, &phi, &pi_k, &zeta_half, &chi, &Bi, &T00_kgb, &T0i_kgb, &Tij_kgb ,&source, &Sij, &scalarFT, &scalarFT_kgb, &scalarFT_kgb, &BiFT, &scalarFT_kgb, &SijFT, &plan_phi, &plan_pi_k , &plan_zeta_half, &plan_chi, &plan_Bi, &plan_T00_kgb, &plan_source, &plan_Sij
 			#ifdef CHECK_B
 							, &Bi_check, &BiFT_check, &plan_Bi_check
 			#endif
@@ -1190,7 +1384,7 @@ int main(int argc, char **argv)
 					#ifdef HAVE_HICLASS_BG
 					 H_spline, acc,
 					#endif
-					&phi_prime ,&phi_prime_scalarFT ,  &phi_prime_plan);
+					&phi_prime, &scalarFT_kgb, &phi_prime_plan);
 
 			}
 
@@ -1201,14 +1395,14 @@ int main(int argc, char **argv)
 				tmp = a;
 			rungekutta4bg(tmp, fourpiG,
 			#ifdef HAVE_HICLASS_BG
-				H_spline, acc,
+				bg_table,
 			#else
 				cosmo,
 			#endif
 			0.5 * dtau);
 			rungekutta4bg(tmp, fourpiG,
 			#ifdef HAVE_HICLASS_BG
-				H_spline, acc,
+				bg_table,
 			#else
 				cosmo,
 			#endif
@@ -1216,6 +1410,9 @@ int main(int argc, char **argv)
 
 			if (pkcount < sim.num_pk && 1. / tmp < sim.z_pk[pkcount] + 1.)
 			{
+		#ifdef OVERLAP_BI
+					complete_Bi();
+		#endif
 					writeSpectra(sim, cosmo, fourpiG, a, pkcount,
 		#if defined(HAVE_CLASS) || defined(HAVE_HICLASS)
 								class_background, class_perturbs, ic,
@@ -1223,7 +1420,7 @@ int main(int argc, char **argv)
 				H_spline, acc, gsl_spline_eval(rho_smg_spline, a, acc), gsl_spline_eval(rho_crit_spline, 1., acc),
 			#endif
 		#endif
-								&pcls_cdm, &pcls_b, pcls_ncdm, &phi,&pi_k, &zeta_half, &chi, &Bi, &T00_kgb, &T0i_kgb, &Tij_kgb, &source, &Sij, &scalarFT ,&scalarFT_pi, &scalarFT_zeta_half, &BiFT, &T00_kgbFT, &T0i_kgbFT, &Tij_kgbFT, &SijFT, &plan_phi, &plan_pi_k, &plan_zeta_half, &plan_chi, &plan_Bi, &plan_T00_kgb, &plan_T0i_kgb, &plan_Tij_kgb, &plan_source, &plan_Sij
+								&pcls_cdm, &pcls_b, pcls_ncdm, &phi,&pi_k, &zeta_half, &chi, &Bi, &T00_kgb, &T0i_kgb, &Tij_kgb, &source, &Sij, &scalarFT, &scalarFT_kgb, &scalarFT_kgb, &BiFT, &scalarFT_kgb, &SijFT, &plan_phi, &plan_pi_k, &plan_zeta_half, &plan_chi, &plan_Bi, &plan_T00_kgb, &plan_source, &plan_Sij
 			#ifdef CHECK_B
 								, &Bi_check, &BiFT_check, &plan_Bi_check
 			#endif
@@ -1239,7 +1436,7 @@ int main(int argc, char **argv)
 						#ifdef HAVE_HICLASS_BG
 						 H_spline, acc,
 						#endif
-						&phi_prime ,&phi_prime_scalarFT ,  &phi_prime_plan);
+						&phi_prime, &scalarFT_kgb, &phi_prime_plan);
 	
 				}		
 			}
@@ -1279,7 +1476,7 @@ int main(int argc, char **argv)
 
       COUT << "), time step / Hubble time = " << Hconf(a, fourpiG,
       #ifdef HAVE_HICLASS_BG
-        H_spline, acc
+        bg_table
       #else
         cosmo
       #endif
@@ -1306,31 +1503,66 @@ int main(int argc, char **argv)
 			ref_time = MPI_Wtime();
 		#endif
 		#ifdef HAVE_HICLASS_BG // If we have BG vlaues from hicalss/CLASS!
-			derivatives_update(dtau_old, cycle, phi, phi_old, chi, chi_old, phi_prime, psi_prime); // The derivatives of phi and psi computed at step n! At cycle 0 they are 0! We should use dtau not dtau_old to be the derivative at the requested time similar to the way we update the background a_n -> a_n+1 where we use dtau!
-
 			a_kgb = a;
-			if(cycle==0)
+			// The derivatives of phi and psi computed at step n (as in derivatives_update)! At cycle 0 they are 0! We should use dtau not dtau_old to be the derivative at the requested time similar to the way we update the background a_n -> a_n+1 where we use dtau!
+		#ifdef OVERLAP_BI
+			if (Bi_pending)
 			{
-				update_zeta(-dtau/ (2.0 * sim.n_kgb_numsteps), dx, a_kgb, fourpiG, gsl_spline_eval(H_spline, 1., acc), phi, chi, phi_prime, pi_k, zeta_half, deltaPm, 
-				Hconf(a_kgb, fourpiG, H_spline, acc), Hconf_prime(a_kgb, fourpiG, H_spline, acc), Hconf_prime_prime(a_kgb, fourpiG, H_spline, acc),
-				 gsl_spline_eval(rho_smg_spline, a_kgb, acc), gsl_spline_eval(p_smg_spline, a_kgb, acc), gsl_spline_eval(p_smg_prime_spline, a_kgb, acc), gsl_spline_eval(rho_crit_spline, 1., acc),
-				 gsl_spline_eval(alpha_K_spline, a_kgb, acc), gsl_spline_eval(alpha_B_spline, a_kgb, acc), gsl_spline_eval(alpha_K_prime_spline, a_kgb, acc), 
-				 gsl_spline_eval(alpha_B_prime_spline, a_kgb, acc), sim.NL_kgb);
-				zeta_half.updateHalo();
+		#ifdef _OPENMP
+				if (Bi_overlap)
+				{
+					const int levels = omp_get_max_active_levels();  // nesting is only enabled for this region
+					i = omp_get_max_threads() - 1;
+					omp_set_max_active_levels(2);
+					#pragma omp parallel num_threads(2)
+					{
+						if (omp_get_thread_num() == 0)
+							complete_Bi();  // the master thread carries out all MPI communication
+						else
+						{
+							omp_set_num_threads(i);  // the remaining threads prepare the KGB source meanwhile
+							prepare_kgb_source(dx, dtau, dtau_old, cycle, phi, chi, phi_old, chi_old, phi_prime, psi_prime, deltaPm, kgb_source, 0);
+						}
+					}
+					omp_set_max_active_levels(levels);
+				}
+				else
+		#endif
+				{
+					complete_Bi();
+					prepare_kgb_source(dx, dtau, dtau_old, cycle, phi, chi, phi_old, chi_old, phi_prime, psi_prime, deltaPm, kgb_source, 0);
+				}
+				if (kgb_source.lattice().halo() > 1)
+					kgb_source.updateHalo();
 			}
-			for (i=0;i<sim.n_kgb_numsteps;i++)
+			else
+		#endif
+			prepare_kgb_source(dx, dtau, dtau_old, cycle, phi, chi, phi_old, chi_old, phi_prime, psi_prime, deltaPm, kgb_source); // metric sources are frozen during the sub-cycle
+			// zeta_half lags pi_k by half of the last sub-step; if the sub-step changes (number of
+			// sub-steps or dtau), zeta_half is shifted to half of the new one. In cycle 0 this is
+			// the initial half step backwards to -1/2. After a restart from an old hibernation
+			// point without dtau_kgb, the lag is not known and kept.
+			if (dtau / numsteps_kgb != dtau_kgb && (cycle == 0 || dtau_kgb > 0.))
 			{
-				update_zeta(dtau/ sim.n_kgb_numsteps, dx, a_kgb, fourpiG, gsl_spline_eval(H_spline, 1., acc), phi, chi, phi_prime, pi_k, zeta_half, deltaPm, 
-				Hconf(a_kgb, fourpiG, H_spline, acc), Hconf_prime(a_kgb, fourpiG, H_spline, acc), Hconf_prime_prime(a_kgb, fourpiG, H_spline, acc),
-				 gsl_spline_eval(rho_smg_spline, a_kgb, acc), gsl_spline_eval(p_smg_spline, a_kgb, acc), gsl_spline_eval(p_smg_prime_spline, a_kgb, acc), gsl_spline_eval(rho_crit_spline, 1., acc),
-				 gsl_spline_eval(alpha_K_spline, a_kgb, acc), gsl_spline_eval(alpha_B_spline, a_kgb, acc), gsl_spline_eval(alpha_K_prime_spline, a_kgb, acc), 
-				 gsl_spline_eval(alpha_B_prime_spline, a_kgb, acc), sim.NL_kgb);
+				kgb_coefficients_lookup(kgb_table, a_kgb, kgb_coeff);
+				update_kgb((dtau_kgb - dtau / numsteps_kgb) / 2.0, dx, pi_k, zeta_half, kgb_source, kgb_coeff, 0., 0, 0); // zeta_half only
 				zeta_half.updateHalo();
-
-				rungekutta4bg(a_kgb, fourpiG, H_spline, acc, dtau  / sim.n_kgb_numsteps / 2.0);
-				update_pi(dtau/ sim.n_kgb_numsteps, dtau,  phi, chi, psi_prime, pi_k, zeta_half, Hconf(a_kgb, fourpiG, H_spline, acc)); // H_old is updated here in the function
-				pi_k.updateHalo();
-				rungekutta4bg(a_kgb, fourpiG, H_spline, acc, dtau  / sim.n_kgb_numsteps / 2.0);
+			}
+			dtau_kgb = dtau / numsteps_kgb;
+			for (i=0;i<numsteps_kgb;i++)
+			{
+				j = sim.kgb_halo - 1 - (i % sim.kgb_halo); // number of valid halo layers that can still be advanced
+				tmp = a_kgb;
+				rungekutta4bg(tmp, fourpiG, bg_table, dtau  / numsteps_kgb / 2.0); // scale factor at the half sub-step for the pi update
+				kgb_coefficients_lookup(kgb_table, a_kgb, kgb_coeff);
+				update_kgb(dtau/ numsteps_kgb, dx, pi_k, zeta_half, kgb_source, kgb_coeff, Hconf(tmp, fourpiG, bg_table), j); // zeta_half and pi_k in one sweep
+				if (j == 0 || i == numsteps_kgb - 1) // halo used up (or end of sub-cycle): exchange
+				{
+					pi_k.updateHalo();
+					zeta_half.updateHalo();
+				}
+				a_kgb = tmp;
+				rungekutta4bg(a_kgb, fourpiG, bg_table, dtau  / numsteps_kgb / 2.0);
 			}
 		#else // If not HAVE_HICLASS_BG We use  KGB-evolution with w, c_s^2 constants.
 			derivatives_update(dtau_old, cycle, phi, phi_old, chi, chi_old, phi_prime, psi_prime); // The derivatives of phi and psi computed at step n! At cycle 0 they are 0! We should use dtau not dtau_old to be the derivative at the requested time similar to the way we update the background a_n -> a_n+1 where we use dtau!
@@ -1351,6 +1583,9 @@ int main(int argc, char **argv)
 				rungekutta4bg(a_kgb, fourpiG, cosmo, dtau/sim.n_kgb_numsteps/2.0 );
 			}
 		#endif // KGB - LeapFrog: End
+		#ifdef OVERLAP_BI
+			complete_Bi();  // in case it was not needed before
+		#endif
 
 
 		#ifdef BENCHMARK
@@ -1358,6 +1593,15 @@ int main(int argc, char **argv)
 			ref_time = MPI_Wtime();
 		#endif
 		
+		// field configuration of the geodesic equation, fixed for this cycle
+		if (sim.gr_flag > 0)
+			nfield_geodesic = (1. / a < ic.z_relax + 1. ? 3 : 2);
+		else
+			nfield_geodesic = ((sim.radiation_flag + sim.fluid_flag > 0 && a < 1. / (sim.z_switch_linearchi + 1.)) ? 2 : 1);
+		update_q_cycle = select_update_q(sim.gr_flag, nfield_geodesic);
+		update_pos_cycle = select_update_pos(sim.gr_flag, nfield_geodesic);
+		update_q_pos_cycle = select_update_q_pos(sim.gr_flag, nfield_geodesic);
+
 		#ifdef BENCHMARK
 				ref2_time = MPI_Wtime();
 		#endif
@@ -1371,10 +1615,7 @@ int main(int argc, char **argv)
 			{
 				f_params[0] = tmp;
 				f_params[1] = tmp * tmp * sim.numpts;
-				if (sim.gr_flag > 0)
-					maxvel[i+1+sim.baryon_flag] = pcls_ncdm[i].updateVel(update_q, (dtau + dtau_old) / 2. / numsteps_ncdm[i], update_ncdm_fields, (1. / a < ic.z_relax + 1. ? 3 : 2), f_params);
-				else
-					maxvel[i+1+sim.baryon_flag] = pcls_ncdm[i].updateVel(update_q_Newton, (dtau + dtau_old) / 2. / numsteps_ncdm[i], update_ncdm_fields, ((sim.radiation_flag + sim.fluid_flag > 0 && a < 1. / (sim.z_switch_linearchi + 1.)) ? 2 : 1), f_params);
+				maxvel[i+1+sim.baryon_flag] = pcls_ncdm[i].updateVel(update_q_cycle, (dtau + dtau_old) / 2. / numsteps_ncdm[i], update_ncdm_fields, nfield_geodesic, f_params);
 
 		#ifdef BENCHMARK
 			update_q_count++;
@@ -1384,7 +1625,7 @@ int main(int argc, char **argv)
 
 		rungekutta4bg(tmp, fourpiG,
         #ifdef HAVE_HICLASS_BG
-          H_spline, acc,
+          bg_table,
         #else
           cosmo,
         #endif
@@ -1392,9 +1633,9 @@ int main(int argc, char **argv)
 				f_params[0] = tmp;
 				f_params[1] = tmp * tmp * sim.numpts;
 		if (sim.gr_flag > 0)
-			pcls_ncdm[i].moveParticles(update_pos, dtau / numsteps_ncdm[i], update_ncdm_fields, (1. / a < ic.z_relax + 1. ? 3 : 2), f_params);
+			pcls_ncdm[i].moveParticles(update_pos_cycle, dtau / numsteps_ncdm[i], update_ncdm_fields, nfield_geodesic, f_params);
 		else
-			pcls_ncdm[i].moveParticles(update_pos_Newton, dtau / numsteps_ncdm[i], NULL, 0, f_params);
+			pcls_ncdm[i].moveParticles(update_pos_cycle, dtau / numsteps_ncdm[i], NULL, 0, f_params);
 		#ifdef BENCHMARK
 			moveParts_count++;
 			moveParts_time += MPI_Wtime() - ref2_time;
@@ -1402,7 +1643,7 @@ int main(int argc, char **argv)
 		#endif
 				rungekutta4bg(tmp, fourpiG,
           #ifdef HAVE_HICLASS_BG
-            H_spline, acc,
+            bg_table,
           #else
             cosmo,
           #endif
@@ -1410,49 +1651,29 @@ int main(int argc, char **argv)
 			}
 		}
 
-		// cdm and baryon particle update
-		f_params[0] = a;
-		f_params[1] = a * a * sim.numpts;
-		if (sim.gr_flag > 0)
-		{
-			maxvel[0] = pcls_cdm.updateVel(update_q, (dtau + dtau_old) / 2., update_cdm_fields, (1. / a < ic.z_relax + 1. ? 3 : 2), f_params);
-			if (sim.baryon_flag)
-				maxvel[1] = pcls_b.updateVel(update_q, (dtau + dtau_old) / 2., update_b_fields, (1. / a < ic.z_relax + 1. ? 3 : 2), f_params);
-		}
-		else
-		{
-			maxvel[0] = pcls_cdm.updateVel(update_q_Newton, (dtau + dtau_old) / 2., update_cdm_fields, ((sim.radiation_flag + sim.fluid_flag > 0 && a < 1. / (sim.z_switch_linearchi + 1.)) ? 2 : 1), f_params);
-			if (sim.baryon_flag)
-				maxvel[1] = pcls_b.updateVel(update_q_Newton, (dtau + dtau_old) / 2., update_b_fields, ((sim.radiation_flag + sim.fluid_flag > 0 && a < 1. / (sim.z_switch_linearchi + 1.)) ? 2 : 1), f_params);
-		}
-
-		#ifdef BENCHMARK
-			update_q_count++;
-			update_q_time += MPI_Wtime() - ref2_time;
-			ref2_time = MPI_Wtime();
-		#endif
-
-		rungekutta4bg(a, fourpiG,
+		// cdm and baryon particle update (kick and drift in one pass)
+		tmp = a;
+		rungekutta4bg(tmp, fourpiG,
 		#ifdef HAVE_HICLASS_BG
-		H_spline, acc,
+		bg_table,
 		#else
 		cosmo,
 		#endif
-		0.5 * dtau);  // evolve background by half a time step
+		0.5 * dtau);  // scale factor after half a time step, used for the drift
 
 		f_params[0] = a;
 		f_params[1] = a * a * sim.numpts;
-		if (sim.gr_flag > 0)
-		{
-			pcls_cdm.moveParticles(update_pos, dtau, update_cdm_fields, (1. / a < ic.z_relax + 1. ? 3 : 0), f_params);
-			if (sim.baryon_flag)
-				pcls_b.moveParticles(update_pos, dtau, update_b_fields, (1. / a < ic.z_relax + 1. ? 3 : 0), f_params);
-		}
-		else
+		f_params[2] = (dtau + dtau_old) / 2.;
+		f_params[3] = tmp;
+		f_params[4] = tmp * tmp * sim.numpts;
+		f_params[5] = 0.;
+		pcls_cdm.moveParticles(update_q_pos_cycle, dtau, update_cdm_fields, nfield_geodesic, f_params);
+		maxvel[0] = sqrt(f_params[5]);
+		if (sim.baryon_flag)
 		{
-			pcls_cdm.moveParticles(update_pos_Newton, dtau, NULL, 0, f_params);
-			if (sim.baryon_flag)
-				pcls_b.moveParticles(update_pos_Newton, dtau, NULL, 0, f_params);
+			f_params[5] = 0.;
+			pcls_b.moveParticles(update_q_pos_cycle, dtau, update_b_fields, nfield_geodesic, f_params);
+			maxvel[1] = sqrt(f_params[5]);
 		}
 
 		#ifdef BENCHMARK
@@ -1460,9 +1681,11 @@ int main(int argc, char **argv)
 			moveParts_time += MPI_Wtime() - ref2_time;
 		#endif
 
+		a = tmp;  // background evolved by half a time step
+
 		rungekutta4bg(a, fourpiG,
 		#ifdef HAVE_HICLASS_BG
-			H_spline, acc,
+			bg_table,
 		#else
 			cosmo,
 		#endif
@@ -1493,11 +1716,11 @@ int main(int argc, char **argv)
 				if (sim.vector_flag == VECTOR_ELLIPTIC)
 				{
 					plan_Bi_check.execute(FFT_BACKWARD);
-					hibernate(sim, ic, cosmo, &pcls_cdm, &pcls_b, pcls_ncdm, phi, pi_k, zeta_half, chi, Bi_check, a, tau, dtau, cycle);
+					hibernate(sim, ic, cosmo, &pcls_cdm, &pcls_b, pcls_ncdm, phi, pi_k, zeta_half, chi, Bi_check, phi_old, chi_old, a, a_kgb, dtau_kgb, tau, dtau, cycle);
 				}
 				else
 		#endif
-				hibernate(sim, ic, cosmo, &pcls_cdm, &pcls_b, pcls_ncdm, phi, pi_k, zeta_half, chi, Bi, a, tau, dtau, cycle);
+				hibernate(sim, ic, cosmo, &pcls_cdm, &pcls_b, pcls_ncdm, phi, pi_k, zeta_half, chi, Bi, phi_old, chi_old, a, a_kgb, dtau_kgb, tau, dtau, cycle);
 				break;
 			}
 		}
@@ -1511,11 +1734,11 @@ int main(int argc, char **argv)
 			if (sim.vector_flag == VECTOR_ELLIPTIC)
 			{
 				plan_Bi_check.execute(FFT_BACKWARD);
-				hibernate(sim, ic, cosmo, &pcls_cdm, &pcls_b, pcls_ncdm, phi, pi_k, zeta_half, chi, Bi, a, tau, dtau, cycle, restartcount);
+				hibernate(sim, ic, cosmo, &pcls_cdm, &pcls_b, pcls_ncdm, phi, pi_k, zeta_half, chi, Bi, phi_old, chi_old, a, a_kgb, dtau_kgb, tau, dtau, cycle, restartcount);
 			}
 			else
 		#endif
-			hibernate(sim, ic, cosmo, &pcls_cdm, &pcls_b, pcls_ncdm, phi, pi_k, zeta_half, chi, Bi, a, tau, dtau, cycle, restartcount);
+			hibernate(sim, ic, cosmo, &pcls_cdm, &pcls_b, pcls_ncdm, phi, pi_k, zeta_half, chi, Bi, phi_old, chi_old, a, a_kgb, dtau_kgb, tau, dtau, cycle, restartcount);
 			restartcount++;
 		}
 
@@ -1523,7 +1746,7 @@ int main(int argc, char **argv)
 
     if (sim.Cf * dx < sim.steplimit / Hconf(a, fourpiG,
     #ifdef HAVE_HICLASS_BG
-      H_spline, acc
+      bg_table
     #else
       cosmo
     #endif
@@ -1532,7 +1755,7 @@ int main(int argc, char **argv)
 	else
       dtau = sim.steplimit / Hconf(a, fourpiG,
       #ifdef HAVE_HICLASS_BG
-        H_spline, acc
+        bg_table
       #else
         cosmo
       #endif
@@ -1540,11 +1763,30 @@ int main(int argc, char **argv)
 
 	cycle++;
 
+		if (sim.checkpoint_interval > 0 && cycle % sim.checkpoint_interval == 0)
+		{
+			writeCheckpoint(sim, cosmo, &pcls_cdm, &pcls_b, pcls_ncdm, checkpoint_fields, num_checkpoint_fields, maxvel, a, tau, dtau, dtau_old, dtau_kgb, cycle, snapcount, pkcount, restartcount);
+
+			if (sim.checkpoint_disk > 0 && (cycle / sim.checkpoint_interval) % sim.checkpoint_disk == 0)
+			{
+				COUT << COLORTEXT_CYAN << " writing hibernation point" << COLORTEXT_RESET << " at z = " << ((1./a) - 1.) <<  " (cycle " << cycle-1 << "), tau/boxsize = " << tau << endl;
+				if (sim.vector_flag == VECTOR_PARABOLIC && sim.gr_flag == 0)
+					plan_Bi.execute(FFT_BACKWARD);
+				hibernate(sim, ic, cosmo, &pcls_cdm, &pcls_b, pcls_ncdm, phi, pi_k, zeta_half, chi, Bi, phi_old, chi_old, a, a_kgb, dtau_kgb, tau, dtau_old, cycle-1);
+			}
+		}
+
 	#ifdef BENCHMARK
 		cycle_time += MPI_Wtime()-cycle_start_time;
 	#endif
 	}
 
+	removeCheckpoint(sim);
+
+	#ifdef ASYNC_SNAPSHOTS
+		snapshots.wait();
+	#endif
+
 		COUT << COLORTEXT_GREEN << " simulation complete." << COLORTEXT_RESET << endl;
 
 	#ifdef BENCHMARK
@@ -1556,6 +1798,11 @@ int main(int argc, char **argv)
 			freeCLASSstructures(class_background, class_thermo, class_perturbs);
 	#endif
 
+	#ifdef HAVE_HICLASS_BG
+		free_kgb_coefficient_table(kgb_table);
+		free_background_table(bg_table);
+	#endif
+
 	#ifdef BENCHMARK
 		lightcone_output_time += MPI_Wtime() - ref_time;
 		run_time = MPI_Wtime() - start_time;
@@ -14,6 +14,8 @@
 #ifndef METADATA_HEADER
 #define METADATA_HEADER
 
+#include <stdint.h>
+
 #define GEVOLUTION_VERSION 1.2
 
 #ifndef MAX_OUTPUTS
@@ -96,6 +98,9 @@
 #define VECTOR_PARABOLIC            0
 #define VECTOR_ELLIPTIC             1
 
+#define KBIN_LINEAR                 0
+#define KBIN_LOG                    1
+
 // Physical constants
 #define C_PLANCK_LAW      4.48147e-7    // omega_g / (T_cmb [K])^4
 #define C_BOLTZMANN_CST   8.61733e-5    // Boltzmann constant [eV/K]
@@ -124,6 +129,12 @@
 #ifndef GADGET_ID_BYTES
 #define GADGET_ID_BYTES 8
 #endif
+#ifndef GADGET_CB_NODES
+#define GADGET_CB_NODES 0               // number of MPI-IO aggregators for Gadget2 output (0 = MPI-IO default)
+#endif
+#ifndef GADGET_CB_BUFFER_SIZE
+#define GADGET_CB_BUFFER_SIZE 16777216  // MPI-IO collective buffer size for Gadget2 output (bytes)
+#endif
 
 #ifdef EXTERNAL_IO
 #ifndef NUMBER_OF_IO_FILES
@@ -211,6 +222,9 @@ struct metadata
 {
 	int numpts;
 	int downgrade_factor;
+	int snapshot_single;
+	int deflate_level;
+	int snapshot_bits;
 	long numpcl[MAX_PCL_SPECIES];
 	int tracer_factor[MAX_PCL_SPECIES];
 	int baryon_flag;
@@ -220,13 +234,19 @@ struct metadata
 	int fluid_flag=0;
 	int out_pk;
 	int out_snapshot;
+	int out_deflate;
+	int out_lossy;
 	int out_lightcone[MAX_OUTPUTS];
 
 	int num_pk;
 	int numbins;
+	int pk_binning;                                // KBIN_LINEAR or KBIN_LOG
 	int num_snapshot;
 	int num_lightcone;
 	int num_restart;
+	int checkpoint_interval;                       // cycles between rank-local checkpoints (0: none)
+	int checkpoint_disk;                           // every checkpoint_disk-th checkpoint is also a hibernation point (0: never)
+	int checkpoint_restore;                        // 1: a fresh run may continue from a rank-local checkpoint of the same run
 	int Nside[MAX_OUTPUTS][2];
 	double Cf;
 	double movelimit;
@@ -252,10 +272,16 @@ struct metadata
 	char output_path[PARAM_MAX_LENGTH];
 	char restart_path[PARAM_MAX_LENGTH];
 	char basename_restart[PARAM_MAX_LENGTH];
+	char checkpoint_path[PARAM_MAX_LENGTH];        // node-local storage for the rank-local checkpoints
+	uint64_t checkpoint_id;                        // fingerprint of the run, tags its rank-local checkpoints (see checkpointRunID)
 	// KGB part
 	int check_bg_file;                             // 0 means there will be no check_bg_file and 1 means a check_bg_file is generated
     int num_snapshot_kgb;                         // not too important as it was originally defined for illustrating blowup (only appears here and in parser.hpp)
 	int n_kgb_numsteps;
+	double Cf_kgb;                                // Courant factor for adaptive kgb sub-stepping, 0 means fixed n_kgb_numsteps
+	int kgb_halo;                                 // halo width of the KGB fields = number of KGB sub-steps per halo exchange
+	int kgb_table_size;                           // number of nodes (uniform in ln a) of the tabulated KGB coefficients
+	int bg_table_size;                            // number of nodes (uniform in ln a) of the tabulated background (Hconf, Hconf_prime, cs2)
 	int kgb_source_gravity;
     int NL_kgb;                                   // 0 means using only linear kgb equations, 1 means adding also nonlinearities
     int bg_hiclass;                               // Using hiclass to evaluate time dependence of quantities!
@@ -273,8 +299,14 @@ struct icsettings
 	char pkfile[PARAM_MAX_LENGTH];
 	char tkfile[PARAM_MAX_LENGTH];
 	char metricfile[3][PARAM_MAX_LENGTH];
+	char kgbfile[2][PARAM_MAX_LENGTH];        // pi_k, zeta_half
+	char oldmetricfile[2][PARAM_MAX_LENGTH];  // phi_old, chi_old
+	char bgfile[PARAM_MAX_LENGTH];
+	char precisionfile[PARAM_MAX_LENGTH];    // CLASS precision file (from the command line or the restart settings)
 	double restart_tau;
 	double restart_dtau;
+	double restart_a_kgb;
+	double restart_dtau_kgb;
 	double restart_version;
 	double z_ic;
 	double z_relax;
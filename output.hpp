@@ -21,6 +21,538 @@
 using namespace std;
 
 
+#include <vector>
+
+#if defined(ASYNC_SNAPSHOTS) && !defined(H5_HAVE_PARALLEL)
+#error "ASYNC_SNAPSHOTS requires parallel HDF5 (-DH5_HAVE_PARALLEL)"
+#endif
+
+#ifdef H5_HAVE_PARALLEL
+//////////////////////////
+// snapshot_file
+//////////////////////////
+// Description:
+//   staged copy of one field snapshot (and the state of its nonblocking
+//   write, see snapshot_writer)
+//
+//////////////////////////
+
+struct snapshot_file
+{
+	string filename;
+	void * buffer;           // local block, x fastest, components innermost
+	long count;              // number of elements in the buffer
+	int components;
+	int global[3];           // global size (downgraded)
+	int local[3];            // local size (downgraded)
+	int start[3];            // global coordinates of the first local point
+	int single;              // single precision
+	int deflate;             // deflate level (0: no compression)
+	int bits;                // significant mantissa bits (0: lossless)
+	MPI_File fh;
+	MPI_Datatype filetype;
+	MPI_Request request;
+};
+
+
+//////////////////////////
+// stage_snapshot_field
+//////////////////////////
+// Description:
+//   copies a field into a snapshot buffer; the downgraded field is the
+//   average over blocks of downgrade_factor^3 points (the parser ensures
+//   that the process layout is compatible with the downgrade factor). If
+//   file.bits > 0, the values are rounded to that many mantissa bits, such
+//   that the remaining low bits are zero and compress well.
+//
+// Arguments:
+//   field            field to be written
+//   file             snapshot file; filename, single, deflate and bits
+//                    have to be set, the rest is filled in
+//   downgrade_factor downgrade factor
+//
+// Returns:
+//
+//////////////////////////
+
+void stage_snapshot_field(Field<Real> & field, snapshot_file & file, const int downgrade_factor)
+{
+	Site x(field.lattice());
+	double * acc;
+	long i, idx;
+	int c;
+	const int nc = field.components();
+	const double norm = 1. / ((double) downgrade_factor * (double) downgrade_factor * (double) downgrade_factor);
+
+	file.components = nc;
+	for (i = 0; i < 3; i++)
+	{
+		file.global[i] = field.lattice().size(i) / downgrade_factor;
+		file.local[i] = field.lattice().sizeLocal(i) / downgrade_factor;
+	}
+	file.start[0] = 0;
+	file.start[1] = field.lattice().coordSkip()[1] / downgrade_factor;
+	file.start[2] = field.lattice().coordSkip()[0] / downgrade_factor;
+	file.count = (long) file.local[0] * (long) file.local[1] * (long) file.local[2] * (long) nc;
+
+	acc = (double *) calloc(file.count, sizeof(double));
+
+	if (acc == NULL)
+	{
+		cerr << " proc#" << parallel.rank() << ": error in stage_snapshot_field! Memory error." << endl;
+		parallel.abortForce();
+	}
+
+	for (x.first(); x.test(); x.next())
+	{
+		idx = (((long) ((x.coord(2) - field.lattice().coordSkip()[0]) / downgrade_factor) * file.local[1] + (long) ((x.coord(1) - field.lattice().coordSkip()[1]) / downgrade_factor)) * file.local[0] + (long) (x.coord(0) / downgrade_factor)) * nc;
+		if (nc == 1)
+			acc[idx] += field(x);
+		else
+		{
+			for (c = 0; c < nc; c++)
+				acc[idx+c] += field(x, c);
+		}
+	}
+
+	if (file.single)
+	{
+		file.buffer = malloc(file.count * sizeof(float));
+		if (file.buffer == NULL)
+		{
+			cerr << " proc#" << parallel.rank() << ": error in stage_snapshot_field! Memory error." << endl;
+			parallel.abortForce();
+		}
+		for (i = 0; i < file.count; i++)
+			((float *) file.buffer)[i] = (float) (acc[i] * norm);
+		free(acc);
+
+		if (file.bits > 0 && file.bits < 23)
+		{
+			const uint32_t half = (uint32_t) 1 << (22 - file.bits);
+			const uint32_t mask = ~((half << 1) - 1);
+			uint32_t * u = (uint32_t *) file.buffer;
+			for (i = 0; i < file.count; i++)
+			{
+				if ((u[i] & 0x7f800000) != 0x7f800000)  // leave inf and nan alone
+					u[i] = (u[i] + half) & mask;
+			}
+		}
+	}
+	else
+	{
+		if (downgrade_factor > 1)
+		{
+			for (i = 0; i < file.count; i++)
+				acc[i] *= norm;
+		}
+		file.buffer = (void *) acc;
+
+		if (file.bits > 0 && file.bits < 52)
+		{
+			const uint64_t half = (uint64_t) 1 << (51 - file.bits);
+			const uint64_t mask = ~((half << 1) - 1);
+			uint64_t * u = (uint64_t *) file.buffer;
+			for (i = 0; i < file.count; i++)
+			{
+				if ((u[i] & 0x7ff0000000000000ull) != 0x7ff0000000000000ull)
+					u[i] = (u[i] + half) & mask;
+			}
+		}
+	}
+}
+
+
+//////////////////////////
+// create_snapshot_dataset
+//////////////////////////
+// Description:
+//   creates (collectively) the HDF5 file of a staged snapshot with the
+//   dataset "/data" of dimensions [N2][N1][N0] (scalars) or
+//   [N2][N1][N0][components]. Compressed datasets are chunked and filtered
+//   with shuffle and deflate; the compression settings are recorded as
+//   attributes of the dataset. Uncompressed datasets are contiguous and
+//   allocated at creation.
+//
+// Arguments:
+//   file       staged snapshot
+//   file_id    HDF5 file (output)
+//
+// Returns: HDF5 dataset
+//
+//////////////////////////
+
+hid_t create_snapshot_dataset(snapshot_file & file, hid_t & file_id)
+{
+	hid_t plist, dcpl, space, aspace, attr, dset;
+	hsize_t dims[4], chunk[4];
+	int local[3], i;
+
+	plist = H5Pcreate(H5P_FILE_ACCESS);
+	H5Pset_fapl_mpio(plist, parallel.lat_world_comm(), MPI_INFO_NULL);
+	file_id = H5Fcreate(file.filename.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, plist);
+	H5Pclose(plist);
+
+	dims[0] = file.global[2];
+	dims[1] = file.global[1];
+	dims[2] = file.global[0];
+	dims[3] = file.components;
+
+	dcpl = H5Pcreate(H5P_DATASET_CREATE);
+	if (file.deflate > 0)
+	{
+		// one chunk per process block if the domain decomposition is even
+		for (i = 0; i < 3; i++) local[i] = file.local[i];
+		MPI_Allreduce(MPI_IN_PLACE, local, 3, MPI_INT, MPI_MIN, parallel.lat_world_comm());
+		chunk[0] = local[2];
+		chunk[1] = local[1];
+		chunk[2] = local[0];
+		chunk[3] = file.components;
+		while (chunk[0] > 1 && chunk[0] * chunk[1] * chunk[2] * chunk[3] * (file.single ? sizeof(float) : sizeof(double)) > (1ull << 30))
+			chunk[0] = (chunk[0] + 1) / 2;
+		H5Pset_chunk(dcpl, (file.components > 1) ? 4 : 3, chunk);
+		H5Pset_shuffle(dcpl);
+		H5Pset_deflate(dcpl, file.deflate);
+	}
+	else
+	{
+		H5Pset_layout(dcpl, H5D_CONTIGUOUS);
+		H5Pset_alloc_time(dcpl, H5D_ALLOC_TIME_EARLY);
+		H5Pset_fill_time(dcpl, H5D_FILL_TIME_NEVER);
+	}
+	space = H5Screate_simple((file.components > 1) ? 4 : 3, dims, NULL);
+	dset = H5Dcreate2(file_id, "/data", file.single ? H5T_NATIVE_FLOAT : H5T_NATIVE_DOUBLE, space, H5P_DEFAULT, dcpl, H5P_DEFAULT);
+	H5Sclose(space);
+	H5Pclose(dcpl);
+
+	if (file.deflate > 0)
+	{
+		aspace = H5Screate(H5S_SCALAR);
+		attr = H5Acreate2(dset, "deflate level", H5T_NATIVE_INT, aspace, H5P_DEFAULT, H5P_DEFAULT);
+		H5Awrite(attr, H5T_NATIVE_INT, &file.deflate);
+		H5Aclose(attr);
+		attr = H5Acreate2(dset, "significant bits", H5T_NATIVE_INT, aspace, H5P_DEFAULT, H5P_DEFAULT);
+		i = (file.bits > 0) ? file.bits : (file.single ? 23 : 52);
+		H5Awrite(attr, H5T_NATIVE_INT, &i);
+		H5Aclose(attr);
+		H5Sclose(aspace);
+	}
+
+	return dset;
+}
+
+
+//////////////////////////
+// write_snapshot_file
+//////////////////////////
+// Description:
+//   writes a staged snapshot with a collective HDF5 write and releases its
+//   buffer
+//
+// Arguments:
+//   file       staged snapshot
+//
+// Returns:
+//
+//////////////////////////
+
+void write_snapshot_file(snapshot_file & file)
+{
+	hid_t file_id, dset, fspace, mspace, dxpl;
+	hsize_t count[4], offset[4];
+
+	dset = create_snapshot_dataset(file, file_id);
+
+	count[0] = file.local[2];
+	count[1] = file.local[1];
+	count[2] = file.local[0];
+	count[3] = file.components;
+	offset[0] = file.start[2];
+	offset[1] = file.start[1];
+	offset[2] = file.start[0];
+	offset[3] = 0;
+
+	fspace = H5Dget_space(dset);
+	H5Sselect_hyperslab(fspace, H5S_SELECT_SET, offset, NULL, count, NULL);
+	mspace = H5Screate_simple((file.components > 1) ? 4 : 3, count, NULL);
+	dxpl = H5Pcreate(H5P_DATASET_XFER);
+	H5Pset_dxpl_mpio(dxpl, H5FD_MPIO_COLLECTIVE);
+
+	H5Dwrite(dset, file.single ? H5T_NATIVE_FLOAT : H5T_NATIVE_DOUBLE, mspace, fspace, dxpl, file.buffer);
+
+	H5Pclose(dxpl);
+	H5Sclose(mspace);
+	H5Sclose(fspace);
+	H5Dclose(dset);
+	H5Fclose(file_id);
+
+	free(file.buffer);
+	file.buffer = NULL;
+}
+#endif // H5_HAVE_PARALLEL
+
+
+#ifdef ASYNC_SNAPSHOTS
+//////////////////////////
+// snapshot_writer
+//////////////////////////
+// Description:
+//   double-buffered writer for the field snapshots. stage() copies a field
+//   into the staging slot (see stage_snapshot_field), such that the field
+//   can be modified again right away. flush() creates the HDF5 files of the
+//   slot (see create_snapshot_dataset) and starts nonblocking collective
+//   MPI-IO writes of the data into the datasets; these complete while the
+//   simulation continues and are finished by the next flush(), by wait()
+//   or at destruction. Compressed snapshots cannot be written this way and
+//   are written by flush() directly. test() should be called regularly to
+//   let the MPI library progress the writes.
+//
+//////////////////////////
+
+class snapshot_writer
+{
+	public:
+		snapshot_writer();
+		~snapshot_writer();
+		void initialize(const int single);
+		void stage(Field<Real> & field, string filename, const int downgrade_factor = 1, const int deflate = 0, const int bits = 0);
+		void flush();
+		void test();
+		void wait();
+
+	private:
+		vector<snapshot_file> files_[2];
+		int slot_;    // slot being staged; the other one may be in flight
+		int single_;  // write single precision
+};
+
+snapshot_writer::snapshot_writer()
+{
+	slot_ = 0;
+	single_ = 0;
+}
+
+snapshot_writer::~snapshot_writer()
+{
+	wait();
+}
+
+void snapshot_writer::initialize(const int single)
+{
+	single_ = single;
+}
+
+
+//////////////////////////
+// snapshot_writer::stage
+//////////////////////////
+// Description:
+//   copies a field into the staging slot
+//
+// Arguments:
+//   field            field to be written
+//   filename         name of the HDF5 file
+//   downgrade_factor downgrade factor
+//   deflate          deflate level (0: no compression)
+//   bits             significant mantissa bits (0: lossless)
+//
+// Returns:
+//
+//////////////////////////
+
+void snapshot_writer::stage(Field<Real> & field, string filename, const int downgrade_factor, const int deflate, const int bits)
+{
+	snapshot_file file;
+
+	file.filename = filename;
+	file.single = single_;
+	file.deflate = deflate;
+	file.bits = bits;
+
+	stage_snapshot_field(field, file, downgrade_factor);
+
+	files_[slot_].push_back(file);
+}
+
+
+//////////////////////////
+// snapshot_writer::flush
+//////////////////////////
+// Description:
+//   finishes the writes in flight, creates the files of the staging slot
+//   and starts their nonblocking writes; the slots are then swapped
+//
+// Arguments:
+//
+// Returns:
+//
+//////////////////////////
+
+void snapshot_writer::flush()
+{
+	hid_t file_id, dset;
+	haddr_t offset;
+	int gsizes[4], lsizes[4], starts[4];
+	MPI_Datatype etype = single_ ? MPI_FLOAT : MPI_DOUBLE;
+	vector<snapshot_file>::iterator it;
+
+	wait();
+
+	for (it = files_[slot_].begin(); it != files_[slot_].end(); )
+	{
+		if (it->deflate > 0)
+		{
+			write_snapshot_file(*it);
+			it = files_[slot_].erase(it);
+			continue;
+		}
+
+		gsizes[0] = it->global[2];
+		gsizes[1] = it->global[1];
+		gsizes[2] = it->global[0];
+		gsizes[3] = it->components;
+		lsizes[0] = it->local[2];
+		lsizes[1] = it->local[1];
+		lsizes[2] = it->local[0];
+		lsizes[3] = it->components;
+		starts[0] = it->start[2];
+		starts[1] = it->start[1];
+		starts[2] = it->start[0];
+		starts[3] = 0;
+
+		dset = create_snapshot_dataset(*it, file_id);
+		offset = H5Dget_offset(dset);
+		H5Dclose(dset);
+		H5Fclose(file_id);
+
+		if (offset == HADDR_UNDEF)
+		{
+			COUT << COLORTEXT_RED << " error" << COLORTEXT_RESET << ": could not allocate dataset in " << it->filename << "!" << endl;
+			parallel.abortForce();
+		}
+
+		MPI_File_open(parallel.lat_world_comm(), (char *) it->filename.c_str(), MPI_MODE_WRONLY, MPI_INFO_NULL, &(it->fh));
+		MPI_Type_create_subarray(4, gsizes, lsizes, starts, MPI_ORDER_C, etype, &(it->filetype));
+		MPI_Type_commit(&(it->filetype));
+		MPI_File_set_view(it->fh, (MPI_Offset) offset, etype, it->filetype, (char *) "native", MPI_INFO_NULL);
+		MPI_File_iwrite_all(it->fh, it->buffer, (int) it->count, etype, &(it->request));
+
+		++it;
+	}
+
+	slot_ = 1 - slot_;
+}
+
+
+//////////////////////////
+// snapshot_writer::test
+//////////////////////////
+// Description:
+//   lets the MPI library progress the writes in flight
+//
+// Arguments:
+//
+// Returns:
+//
+//////////////////////////
+
+void snapshot_writer::test()
+{
+	int flag;
+	vector<snapshot_file>::iterator it;
+
+	for (it = files_[1-slot_].begin(); it != files_[1-slot_].end(); ++it)
+		MPI_Test(&(it->request), &flag, MPI_STATUS_IGNORE);
+}
+
+
+//////////////////////////
+// snapshot_writer::wait
+//////////////////////////
+// Description:
+//   finishes the writes in flight and releases their buffers
+//
+// Arguments:
+//
+// Returns:
+//
+//////////////////////////
+
+void snapshot_writer::wait()
+{
+	vector<snapshot_file>::iterator it;
+
+	for (it = files_[1-slot_].begin(); it != files_[1-slot_].end(); ++it)
+	{
+		MPI_Wait(&(it->request), MPI_STATUS_IGNORE);
+		MPI_File_close(&(it->fh));
+		MPI_Type_free(&(it->filetype));
+		free(it->buffer);
+	}
+
+	files_[1-slot_].clear();
+}
+#else
+class snapshot_writer;
+#endif
+
+
+//////////////////////////
+// save_snapshot_field
+//////////////////////////
+// Description:
+//   writes one field snapshot; outputs selected for compression in the
+//   settings are written with chunking and filters (see
+//   create_snapshot_dataset, requires parallel HDF5), the others with
+//   LATfield2. If an asynchronous writer is given, the snapshot is staged
+//   there instead.
+//
+// Arguments:
+//   sim        simulation metadata structure
+//   field      field to be written
+//   mask       output mask of the snapshot (MASK_PHI, ...)
+//   filename   name of the HDF5 file
+//   snapshots  pointer to asynchronous writer (may be NULL)
+//
+// Returns:
+//
+//////////////////////////
+
+void save_snapshot_field(metadata & sim, Field<Real> & field, const int mask, string filename, snapshot_writer * snapshots)
+{
+	const int deflate = (sim.out_deflate & mask) ? sim.deflate_level : 0;
+	const int bits = (sim.out_lossy & mask) ? sim.snapshot_bits : 0;
+
+#ifdef ASYNC_SNAPSHOTS
+	if (snapshots != NULL)
+	{
+		snapshots->stage(field, filename, sim.downgrade_factor, deflate, bits);
+		return;
+	}
+#endif
+
+#ifdef H5_HAVE_PARALLEL
+	if (deflate > 0)
+	{
+		snapshot_file file;
+
+		file.filename = filename;
+		file.single = sim.snapshot_single;
+		file.deflate = deflate;
+		file.bits = bits;
+
+		stage_snapshot_field(field, file, sim.downgrade_factor);
+		write_snapshot_file(file);
+	}
+	else
+#endif
+	if (sim.downgrade_factor > 1)
+		field.saveHDF5_coarseGrain3D(filename, sim.downgrade_factor);
+	else
+		field.saveHDF5(filename);
+}
+
+
 //////////////////////////
 // writeSnapshots
 //////////////////////////
@@ -60,6 +592,8 @@ using namespace std;
 //   BiFT_check     pointer to allocated field
 //   plan_Bi_check  pointer to FFT planner
 //   vi             pointer to allocated field
+//   snapshots      pointer to asynchronous writer for the field snapshots
+//                  (optional, only with ASYNC_SNAPSHOTS)
 //
 // Returns:
 //
@@ -76,6 +610,7 @@ void writeSnapshots(metadata & sim, cosmology & cosmo, const double fourpiG, con
 #ifdef VELOCITY
 , Field<Real> * vi
 #endif
+, snapshot_writer * snapshots = NULL
 )
 {
 	char filename[2*PARAM_MAX_LENGTH+24];
@@ -156,10 +691,7 @@ void writeSnapshots(metadata & sim, cosmology & cosmo, const double fourpiG, con
 
 	if (sim.out_snapshot & MASK_RBARE)
 	{
-		if (sim.downgrade_factor > 1)
-			source->saveHDF5_coarseGrain3D(h5filename + filename + "_rhoN.h5", sim.downgrade_factor);
-		else
-			source->saveHDF5(h5filename + filename + "_rhoN.h5");
+		save_snapshot_field(sim, *source, MASK_RBARE, h5filename + filename + "_rhoN.h5", snapshots);
 	}
 
 	if (sim.out_snapshot & MASK_POT)
@@ -167,10 +699,7 @@ void writeSnapshots(metadata & sim, cosmology & cosmo, const double fourpiG, con
 		plan_source->execute(FFT_FORWARD);
 		solveModifiedPoissonFT(*scalarFT, *scalarFT, fourpiG / a);
 		plan_source->execute(FFT_BACKWARD);
-		if (sim.downgrade_factor > 1)
-			source->saveHDF5_coarseGrain3D(h5filename + filename + "_psiN.h5", sim.downgrade_factor);
-		else
-			source->saveHDF5(h5filename + filename + "_psiN.h5");
+		save_snapshot_field(sim, *source, MASK_POT, h5filename + filename + "_psiN.h5", snapshots);
 	}
 
 	if (sim.out_snapshot & MASK_T00)
@@ -202,10 +731,7 @@ void writeSnapshots(metadata & sim, cosmology & cosmo, const double fourpiG, con
 #ifdef EXTERNAL_IO
 		source->saveHDF5_server_write(NUMBER_OF_IO_FILES);
 #else
-		if (sim.downgrade_factor > 1)
-			source->saveHDF5_coarseGrain3D(h5filename + filename + "_T00.h5", sim.downgrade_factor);
-		else
-			source->saveHDF5(h5filename + filename + "_T00.h5");
+		save_snapshot_field(sim, *source, MASK_T00, h5filename + filename + "_T00.h5", snapshots);
 #endif
 	}
 
@@ -215,10 +741,7 @@ void writeSnapshots(metadata & sim, cosmology & cosmo, const double fourpiG, con
 #ifdef EXTERNAL_IO
 		vi->saveHDF5_server_write(NUMBER_OF_IO_FILES);
 #else
-		if (sim.downgrade_factor > 1)
-			vi->saveHDF5_coarseGrain3D(h5filename + filename + "_v.h5", sim.downgrade_factor);
-		else
-			vi->saveHDF5(h5filename + filename + "_v.h5");
+		save_snapshot_field(sim, *vi, MASK_VEL, h5filename + filename + "_v.h5", snapshots);
 #endif
 	}
 #endif
@@ -243,10 +766,7 @@ void writeSnapshots(metadata & sim, cosmology & cosmo, const double fourpiG, con
 #ifdef EXTERNAL_IO
 		Bi->saveHDF5_server_write(NUMBER_OF_IO_FILES);
 #else
-		if (sim.downgrade_factor > 1)
-			Bi->saveHDF5_coarseGrain3D(h5filename + filename + "_B.h5", sim.downgrade_factor);
-		else
-			Bi->saveHDF5(h5filename + filename + "_B.h5");
+		save_snapshot_field(sim, *Bi, MASK_B, h5filename + filename + "_B.h5", snapshots);
 #endif
 
 		if (sim.gr_flag > 0)
@@ -260,10 +780,7 @@ void writeSnapshots(metadata & sim, cosmology & cosmo, const double fourpiG, con
 #ifdef EXTERNAL_IO
 		phi->saveHDF5_server_write(NUMBER_OF_IO_FILES);
 #else
-		if (sim.downgrade_factor > 1)
-			phi->saveHDF5_coarseGrain3D(h5filename + filename + "_phi.h5", sim.downgrade_factor);
-		else
-			phi->saveHDF5(h5filename + filename + "_phi.h5");
+		save_snapshot_field(sim, *phi, MASK_PHI, h5filename + filename + "_phi.h5", snapshots);
 #endif
 
 
@@ -271,40 +788,28 @@ void writeSnapshots(metadata & sim, cosmology & cosmo, const double fourpiG, con
 #ifdef EXTERNAL_IO
 		pi_k->saveHDF5_server_write(NUMBER_OF_IO_FILES);
 #else
-		if (sim.downgrade_factor > 1)
-			pi_k->saveHDF5_coarseGrain3D(h5filename + filename + "_pi_k.h5", sim.downgrade_factor);
-		else
-			pi_k->saveHDF5(h5filename + filename + "_pi_k.h5");
+		save_snapshot_field(sim, *pi_k, MASK_PI_K, h5filename + filename + "_pi_k.h5", snapshots);
 #endif
 
 if (sim.out_snapshot & MASK_ZETA)
 #ifdef EXTERNAL_IO
   zeta->saveHDF5_server_write(NUMBER_OF_IO_FILES);
 #else
-  if (sim.downgrade_factor > 1)
-    zeta->saveHDF5_coarseGrain3D(h5filename + filename + "_zeta.h5", sim.downgrade_factor);
-  else
-    zeta->saveHDF5(h5filename + filename + "_zeta.h5");
+  save_snapshot_field(sim, *zeta, MASK_ZETA, h5filename + filename + "_zeta.h5", snapshots);
 #endif
 
 if (sim.out_snapshot & MASK_T_KGB)
 #ifdef EXTERNAL_IO
   T00_kgb->saveHDF5_server_write(NUMBER_OF_IO_FILES);
 #else
-  if (sim.downgrade_factor > 1)
-    T00_kgb->saveHDF5_coarseGrain3D(h5filename + filename + "_T00_kgb.h5", sim.downgrade_factor);
-  else
-    T00_kgb->saveHDF5(h5filename + filename + "_T00_kgb.h5");
+  save_snapshot_field(sim, *T00_kgb, MASK_T_KGB, h5filename + filename + "_T00_kgb.h5", snapshots);
 #endif
 
 	if (sim.out_snapshot & MASK_CHI)
 #ifdef EXTERNAL_IO
 		chi->saveHDF5_server_write(NUMBER_OF_IO_FILES);
 #else
-		if (sim.downgrade_factor > 1)
-			chi->saveHDF5_coarseGrain3D(h5filename + filename + "_chi.h5", sim.downgrade_factor);
-		else
-			chi->saveHDF5(h5filename + filename + "_chi.h5");
+		save_snapshot_field(sim, *chi, MASK_CHI, h5filename + filename + "_chi.h5", snapshots);
 #endif
 
 	if (sim.out_snapshot & MASK_HIJ)
@@ -322,10 +827,7 @@ if (sim.out_snapshot & MASK_T_KGB)
 #ifdef EXTERNAL_IO
 		Sij->saveHDF5_server_write(NUMBER_OF_IO_FILES);
 #else
-		if (sim.downgrade_factor > 1)
-			Sij->saveHDF5_coarseGrain3D(h5filename + filename + "_hij.h5", sim.downgrade_factor);
-		else
-			Sij->saveHDF5(h5filename + filename + "_hij.h5");
+		save_snapshot_field(sim, *Sij, MASK_HIJ, h5filename + filename + "_hij.h5", snapshots);
 #endif
 	}
 
@@ -342,10 +844,7 @@ if (sim.out_snapshot & MASK_T_KGB)
 		}
 		projection_Tij_comm(Sij);
 
-		if (sim.downgrade_factor > 1)
-			Sij->saveHDF5_coarseGrain3D(h5filename + filename + "_Tij.h5", sim.downgrade_factor);
-		else
-			Sij->saveHDF5(h5filename + filename + "_Tij.h5");
+		save_snapshot_field(sim, *Sij, MASK_TIJ, h5filename + filename + "_Tij.h5", snapshots);
 	}
 
 	if (sim.out_snapshot & MASK_P)
@@ -360,10 +859,7 @@ if (sim.out_snapshot & MASK_T_KGB)
 			projection_T0i_project(pcls_ncdm+i, Bi, phi);
 		}
 		projection_T0i_comm(Bi);
-		if (sim.downgrade_factor > 1)
-			Bi->saveHDF5_coarseGrain3D(h5filename + filename + "_p.h5", sim.downgrade_factor);
-		else
-			Bi->saveHDF5(h5filename + filename + "_p.h5");
+		save_snapshot_field(sim, *Bi, MASK_P, h5filename + filename + "_p.h5", snapshots);
 		if (sim.gr_flag > 0)
 		{
 			plan_Bi->execute(FFT_BACKWARD);
@@ -400,10 +896,7 @@ if (sim.out_snapshot & MASK_T_KGB)
 #ifdef EXTERNAL_IO
 		Bi_check->saveHDF5_server_write(NUMBER_OF_IO_FILES);
 #else
-		if (sim.downgrade_factor > 1)
-			Bi_check->saveHDF5_coarseGrain3D(h5filename + filename + "_B_check.h5", sim.downgrade_factor);
-		else
-			Bi_check->saveHDF5(h5filename + filename + "_B_check.h5");
+		save_snapshot_field(sim, *Bi_check, MASK_B, h5filename + filename + "_B_check.h5", snapshots);
 #endif
 	}
 #endif
@@ -547,6 +1040,10 @@ if (sim.out_snapshot & MASK_T_KGB)
 #ifdef EXTERNAL_IO
 	ioserver.closeOstream();
 #endif
+#ifdef ASYNC_SNAPSHOTS
+	if (snapshots != NULL)
+		snapshots->flush();
+#endif
 }
 
 
@@ -588,7 +1085,7 @@ if (sim.out_snapshot & MASK_T_KGB)
 
 void writeLightcones(metadata & sim, cosmology & cosmo, const double fourpiG, const double a, const double tau, const double dtau, const double dtau_old, const double maxvel, const int cycle, string h5filename,
 #ifdef HAVE_HICLASS_BG
-background & class_background, gsl_spline * H_spline, gsl_interp_accel * acc,
+gsl_spline * tau_spline, gsl_spline * H_spline, gsl_interp_accel * acc,
 #endif
 Particles_gevolution<part_simple,part_simple_info,part_simple_dataType> * pcls_cdm, Particles_gevolution<part_simple,part_simple_info,part_simple_dataType> * pcls_b, Particles_gevolution<part_simple,part_simple_info,part_simple_dataType> * pcls_ncdm, Field<Real> * phi, Field<Real> * chi, Field<Real> * Bi, Field<Real> * Sij, Field<Cplx> * BiFT, Field<Cplx> * SijFT, PlanFFT<Cplx> * plan_Bi, PlanFFT<Cplx> * plan_Sij, int & done_hij, set<long> * IDbacklog)
 {
@@ -642,8 +1139,6 @@ Particles_gevolution<part_simple,part_simple_info,part_simple_dataType> * pcls_c
 		outbuf[j] = NULL;
 #endif
 
-	done_hij = 0;
-
 	domain[0] = -0.5;
 	domain[1] = phi->lattice().coordSkip()[1] - 0.5;
 	domain[2] = phi->lattice().coordSkip()[0] - 0.5;
@@ -678,7 +1173,7 @@ Particles_gevolution<part_simple,part_simple_info,part_simple_dataType> * pcls_c
 
     d = particleHorizon(1. / (1. + sim.lightcone[i].z), fourpiG,
       #ifdef HAVE_HICLASS_BG
-      gsl_spline_eval(H_spline, 1., acc), class_background
+      gsl_spline_eval(H_spline, 1., acc), tau_spline, acc
       #else
       cosmo
       #endif
@@ -1855,9 +2350,16 @@ Particles_gevolution<part_simple,part_simple_info,part_simple_dataType> * pcls_c
 //   scalarFT       pointer to allocated field
 //   BiFT           pointer to allocated field
 //   SijFT          pointer to allocated field
+//   scalarFT_pi    pointer to allocated field (Fourier image of pi_k)
+//   scalarFT_zeta  pointer to allocated field (Fourier image of zeta)
+//   T00_kgbFT      pointer to allocated field (Fourier image of T00_kgb); the three
+//                  KGB Fourier images may be the same field, since they are used in turn
 //   plan_phi       pointer to FFT planner
+//   plan_pi_k      pointer to FFT planner (only used if pi_k spectra are requested)
+//   plan_zeta      pointer to FFT planner (only used if zeta spectra are requested)
 //   plan_chi       pointer to FFT planner
 //   plan_Bi        pointer to FFT planner
+//   plan_T00_kgb   pointer to FFT planner (only used if T_kgb or delta_kgb spectra are requested)
 //   plan_source    pointer to FFT planner
 //   plan_Sij       pointer to FFT planner
 //   Bi_check       pointer to allocated field (or NULL)
@@ -1875,7 +2377,7 @@ background & class_background, perturbs & class_perturbs, icsettings & ic,
 gsl_spline * H_spline, gsl_interp_accel * acc, const double rho_s, const double rho_crit_0,
 #endif
 #endif
-Particles_gevolution<part_simple,part_simple_info,part_simple_dataType> * pcls_cdm, Particles_gevolution<part_simple,part_simple_info,part_simple_dataType> * pcls_b, Particles_gevolution<part_simple,part_simple_info,part_simple_dataType> * pcls_ncdm, Field<Real> * phi, Field<Real> * pi_k ,Field<Real> * zeta, Field<Real> * chi, Field<Real> * Bi,  Field<Real> * T00_kgb, Field<Real> * T0i_kgb, Field<Real> * Tij_kgb, Field<Real> * source, Field<Real> * Sij, Field<Cplx> * scalarFT, Field<Cplx> * scalarFT_pi, Field<Cplx> * scalarFT_zeta, Field<Cplx> * BiFT, Field<Cplx> * T00_kgbFT, Field<Cplx> * T0i_kgbFT, Field<Cplx> * Tij_kgbFT, Field<Cplx> * SijFT, PlanFFT<Cplx> * plan_phi, PlanFFT<Cplx> * plan_pi_k , PlanFFT<Cplx> * plan_zeta, PlanFFT<Cplx> * plan_chi, PlanFFT<Cplx> * plan_Bi, PlanFFT<Cplx> * plan_T00_kgb, PlanFFT<Cplx> * plan_T0i_kgb, PlanFFT<Cplx> * plan_Tij_kgb, PlanFFT<Cplx> * plan_source, PlanFFT<Cplx> * plan_Sij
+Particles_gevolution<part_simple,part_simple_info,part_simple_dataType> * pcls_cdm, Particles_gevolution<part_simple,part_simple_info,part_simple_dataType> * pcls_b, Particles_gevolution<part_simple,part_simple_info,part_simple_dataType> * pcls_ncdm, Field<Real> * phi, Field<Real> * pi_k ,Field<Real> * zeta, Field<Real> * chi, Field<Real> * Bi,  Field<Real> * T00_kgb, Field<Real> * T0i_kgb, Field<Real> * Tij_kgb, Field<Real> * source, Field<Real> * Sij, Field<Cplx> * scalarFT, Field<Cplx> * scalarFT_pi, Field<Cplx> * scalarFT_zeta, Field<Cplx> * BiFT, Field<Cplx> * T00_kgbFT, Field<Cplx> * SijFT, PlanFFT<Cplx> * plan_phi, PlanFFT<Cplx> * plan_pi_k , PlanFFT<Cplx> * plan_zeta, PlanFFT<Cplx> * plan_chi, PlanFFT<Cplx> * plan_Bi, PlanFFT<Cplx> * plan_T00_kgb, PlanFFT<Cplx> * plan_source, PlanFFT<Cplx> * plan_Sij
 #ifdef CHECK_B
 , Field<Real> * Bi_check, Field<Cplx> * BiFT_check, PlanFFT<Cplx> * plan_Bi_check
 #endif
@@ -1892,18 +2394,11 @@ Particles_gevolution<part_simple,part_simple_info,part_simple_dataType> * pcls_c
 	long numpts3d = (long) sim.numpts * (long) sim.numpts * (long) sim.numpts;
 	Cplx tempk;
 	double Omega_ncdm;
+	int slot;
 
-	Real * kbin;
-	Real * power;
-	Real * kscatter;
-	Real * pscatter;
-	int * occupation;
-
-	kbin = (Real *) malloc(sim.numbins * sizeof(Real));
-	power = (Real *) malloc(sim.numbins * sizeof(Real));
-	kscatter = (Real *) malloc(sim.numbins * sizeof(Real));
-	pscatter = (Real *) malloc(sim.numbins * sizeof(Real));
-	occupation = (int *) malloc(sim.numbins * sizeof(int));
+	// all spectra are accumulated by one engine, which only sweeps the k-lattice when
+	// a Fourier image it still needs is about to be overwritten (see spectrum_engine)
+	spectrum_engine spectra(sim.numbins, KTYPE_LINEAR, sim.pk_binning);
 
   double H0 = Hconf(1., fourpiG,
   	#ifdef HAVE_HICLASS_BG
@@ -1919,6 +2414,7 @@ Particles_gevolution<part_simple,part_simple_info,part_simple_dataType> * pcls_c
   #if defined(HAVE_CLASS) || defined(HAVE_HICLASS)
 		if ((sim.radiation_flag > 0 || sim.fluid_flag > 0) && sim.gr_flag == 0)
 		{
+			spectra.release(*scalarFT);
 			projection_T00_project(class_background, class_perturbs, *source, *scalarFT, plan_source, sim, ic, cosmo, fourpiG, a);
 			if (sim.out_pk & MASK_DELTA)
 			{
@@ -1940,15 +2436,16 @@ Particles_gevolution<part_simple,part_simple_info,part_simple_dataType> * pcls_c
 			scalarProjectionCIC_project(pcls_ncdm+i, source);
 		}
 		scalarProjectionCIC_comm(source);
+		spectra.release(*scalarFT);
 		plan_source->execute(FFT_FORWARD);
 
 		if (sim.out_pk & MASK_RBARE || sim.out_pk & MASK_DBARE || ((sim.out_pk & MASK_T00 || sim.out_pk & MASK_DELTA) && sim.gr_flag == 0))
-			extractPowerSpectrum(*scalarFT, kbin, power, kscatter, pscatter, occupation, sim.numbins, true, KTYPE_LINEAR);
+			slot = spectra.add(*scalarFT, true);
 
 		if (sim.out_pk & MASK_RBARE)
 		{
 			sprintf(filename, "%s%s%03d_rhoN.dat", sim.output_path, sim.basename_pk, pkcount);
-			writePowerSpectrum(kbin, power, kscatter, pscatter, occupation, sim.numbins, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * pow(a, 6.0), filename, "power spectrum of rho_N", a, sim.z_pk[pkcount]);
+			spectra.output(slot, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * pow(a, 6.0), filename, "power spectrum of rho_N", a, sim.z_pk[pkcount]);
 		}
 
 		if (sim.out_pk & MASK_DBARE)
@@ -1956,27 +2453,28 @@ Particles_gevolution<part_simple,part_simple_info,part_simple_dataType> * pcls_c
 			// For deltaN we have k which is in unit of boxsize must divided by boxsize to give h/Mpc unit.
 			//
 			sprintf(filename, "%s%s%03d_deltaN.dat", sim.output_path, sim.basename_pk, pkcount);
-			writePowerSpectrum(kbin, power, kscatter, pscatter, occupation, sim.numbins, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * cosmo.Omega_m * cosmo.Omega_m, filename, "power spectrum of delta_N", a, sim.z_pk[pkcount]);
+			spectra.output(slot, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * cosmo.Omega_m * cosmo.Omega_m, filename, "power spectrum of delta_N", a, sim.z_pk[pkcount]);
 		}
 
 		if (sim.out_pk & MASK_T00 && sim.gr_flag == 0)
 		{
 			sprintf(filename, "%s%s%03d_T00.dat", sim.output_path, sim.basename_pk, pkcount);
-			writePowerSpectrum(kbin, power, kscatter, pscatter, occupation, sim.numbins, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * pow(a, 6.0), filename, "power spectrum of T00", a, sim.z_pk[pkcount]);
+			spectra.output(slot, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * pow(a, 6.0), filename, "power spectrum of T00", a, sim.z_pk[pkcount]);
 		}
 
 		if (sim.out_pk & MASK_DELTA && sim.gr_flag == 0)
 		{
 			sprintf(filename, "%s%s%03d_delta.dat", sim.output_path, sim.basename_pk, pkcount);
-			writePowerSpectrum(kbin, power, kscatter, pscatter, occupation, sim.numbins, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * cosmo.Omega_m * cosmo.Omega_m, filename, "power spectrum of delta", a, sim.z_pk[pkcount]);
+			spectra.output(slot, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * cosmo.Omega_m * cosmo.Omega_m, filename, "power spectrum of delta", a, sim.z_pk[pkcount]);
 		}
 
 		if (sim.out_pk & MASK_POT)
 		{
+			spectra.release(*scalarFT);
 			solveModifiedPoissonFT(*scalarFT, *scalarFT, fourpiG / a);
-			extractPowerSpectrum(*scalarFT, kbin, power, kscatter, pscatter, occupation, sim.numbins, false, KTYPE_LINEAR);
+			slot = spectra.add(*scalarFT, false);
 			sprintf(filename, "%s%s%03d_psiN.dat", sim.output_path, sim.basename_pk, pkcount);
-			writePowerSpectrum(kbin, power, kscatter, pscatter, occupation, sim.numbins, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI, filename, "power spectrum of psi_N", a, sim.z_pk[pkcount]);
+			spectra.output(slot, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI, filename, "power spectrum of psi_N", a, sim.z_pk[pkcount]);
 		}
 
 		if ((cosmo.num_ncdm > 0 || sim.baryon_flag) && (sim.out_pk & MASK_DBARE || (sim.out_pk & MASK_DELTA && sim.gr_flag == 0)))
@@ -1984,30 +2482,33 @@ Particles_gevolution<part_simple,part_simple_info,part_simple_dataType> * pcls_c
 			projection_init(source);
 			scalarProjectionCIC_project(pcls_cdm, source);
 			scalarProjectionCIC_comm(source);
+			spectra.release(*scalarFT);
 			plan_source->execute(FFT_FORWARD);
-			extractPowerSpectrum(*scalarFT, kbin, power, kscatter, pscatter, occupation, sim.numbins, true, KTYPE_LINEAR);
+			slot = spectra.add(*scalarFT, true);
 			sprintf(filename, "%s%s%03d_cdm.dat", sim.output_path, sim.basename_pk, pkcount);
-			writePowerSpectrum(kbin, power, kscatter, pscatter, occupation, sim.numbins, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * (sim.baryon_flag ? (cosmo.Omega_cdm * cosmo.Omega_cdm) : ((cosmo.Omega_cdm + cosmo.Omega_b) * (cosmo.Omega_cdm + cosmo.Omega_b))), filename, "power spectrum of delta_N for cdm", a, sim.z_pk[pkcount]);
+			spectra.output(slot, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * (sim.baryon_flag ? (cosmo.Omega_cdm * cosmo.Omega_cdm) : ((cosmo.Omega_cdm + cosmo.Omega_b) * (cosmo.Omega_cdm + cosmo.Omega_b))), filename, "power spectrum of delta_N for cdm", a, sim.z_pk[pkcount]);
 			if (sim.baryon_flag)
 			{
 				// store k-space information for cross-spectra using SijFT as temporary array
 				if (sim.out_pk & MASK_XSPEC)
 				{
+					spectra.release(*SijFT);
 					for (kFT.first(); kFT.test(); kFT.next())
 						(*SijFT)(kFT, 0) = (*scalarFT)(kFT);
 				}
 				projection_init(source);
 				scalarProjectionCIC_project(pcls_b, source);
 				scalarProjectionCIC_comm(source);
+				spectra.release(*scalarFT);
 				plan_source->execute(FFT_FORWARD);
-				extractPowerSpectrum(*scalarFT, kbin, power, kscatter, pscatter, occupation, sim.numbins, true, KTYPE_LINEAR);
+				slot = spectra.add(*scalarFT, true);
 				sprintf(filename, "%s%s%03d_b.dat", sim.output_path, sim.basename_pk, pkcount);
-				writePowerSpectrum(kbin, power, kscatter, pscatter, occupation, sim.numbins, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * cosmo.Omega_b * cosmo.Omega_b, filename, "power spectrum of delta_N for baryons", a, sim.z_pk[pkcount]);
+				spectra.output(slot, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * cosmo.Omega_b * cosmo.Omega_b, filename, "power spectrum of delta_N for baryons", a, sim.z_pk[pkcount]);
 				if (sim.out_pk & MASK_XSPEC)
 				{
-					extractCrossSpectrum(*scalarFT, *SijFT, kbin, power, kscatter, pscatter, occupation, sim.numbins, true, KTYPE_LINEAR);
+					slot = spectra.add(*scalarFT, *SijFT, true);
 					sprintf(filename, "%s%s%03d_cdmxb.dat", sim.output_path, sim.basename_pk, pkcount);
-					writePowerSpectrum(kbin, power, kscatter, pscatter, occupation, sim.numbins, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * cosmo.Omega_cdm * cosmo.Omega_b, filename, "cross power spectrum of delta_N for cdm x baryons", a, sim.z_pk[pkcount]);
+					spectra.output(slot, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * cosmo.Omega_cdm * cosmo.Omega_b, filename, "cross power spectrum of delta_N for cdm x baryons", a, sim.z_pk[pkcount]);
 				}
 			}
 			Omega_ncdm = 0.;
@@ -2017,29 +2518,32 @@ Particles_gevolution<part_simple,part_simple_info,part_simple_dataType> * pcls_c
 				if (sim.numpcl[1+sim.baryon_flag+i] > 0)
 					scalarProjectionCIC_project(pcls_ncdm+i, source);
 				scalarProjectionCIC_comm(source);
+				spectra.release(*scalarFT);
 				plan_source->execute(FFT_FORWARD);
-				extractPowerSpectrum(*scalarFT, kbin, power, kscatter, pscatter, occupation, sim.numbins, true, KTYPE_LINEAR);
+				slot = spectra.add(*scalarFT, true);
 				sprintf(filename, "%s%s%03d_ncdm%d.dat", sim.output_path, sim.basename_pk, pkcount, i);
 				sprintf(buffer, "power spectrum of delta_N for ncdm %d", i);
-				writePowerSpectrum(kbin, power, kscatter, pscatter, occupation, sim.numbins, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * cosmo.Omega_ncdm[i] * cosmo.Omega_ncdm[i], filename, buffer, a, sim.z_pk[pkcount]);
+				spectra.output(slot, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * cosmo.Omega_ncdm[i] * cosmo.Omega_ncdm[i], filename, buffer, a, sim.z_pk[pkcount]);
 				Omega_ncdm += cosmo.Omega_ncdm[i];
 				// store k-space information for cross-spectra using SijFT as temporary array
 				if (cosmo.num_ncdm > 1 && i < 6)
 				{
+					spectra.release(*SijFT);
 					for (kFT.first(); kFT.test(); kFT.next())
 						(*SijFT)(kFT, i) = (*scalarFT)(kFT);
 				}
 			}
 			if (cosmo.num_ncdm > 1 && cosmo.num_ncdm <= 7)
 			{
+				spectra.release(*scalarFT);
 				for (kFT.first(); kFT.test(); kFT.next())
 				{
 					for (i = 0; i < cosmo.num_ncdm-1; i++)
 						(*scalarFT)(kFT) += (*SijFT)(kFT, i);
 				}
-				extractPowerSpectrum(*scalarFT, kbin, power, kscatter, pscatter, occupation, sim.numbins, true, KTYPE_LINEAR);
+				slot = spectra.add(*scalarFT, true);
 				sprintf(filename, "%s%s%03d_ncdm.dat", sim.output_path, sim.basename_pk, pkcount);
-				writePowerSpectrum(kbin, power, kscatter, pscatter, occupation, sim.numbins, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * Omega_ncdm * Omega_ncdm, filename, "power spectrum of delta_N for total ncdm", a, sim.z_pk[pkcount]);
+				spectra.output(slot, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * Omega_ncdm * Omega_ncdm, filename, "power spectrum of delta_N for total ncdm", a, sim.z_pk[pkcount]);
 			}
 			if (cosmo.num_ncdm > 1)
 			{
@@ -2049,10 +2553,10 @@ Particles_gevolution<part_simple,part_simple_info,part_simple_dataType> * pcls_c
 					{
 						if (sim.out_pk & MASK_XSPEC || (i == 0 && j == 1) || (i == 2 && j == 3) || (i == 4 && j == 5))
 						{
-							extractCrossSpectrum(*SijFT, *SijFT, kbin, power, kscatter, pscatter, occupation, sim.numbins, true, KTYPE_LINEAR, i, j);
+							slot = spectra.add(*SijFT, *SijFT, true, i, j);
 							sprintf(filename, "%s%s%03d_ncdm%dx%d.dat", sim.output_path, sim.basename_pk, pkcount, i, j);
 							sprintf(buffer, "cross power spectrum of delta_N for ncdm %d x %d", i, j);
-							writePowerSpectrum(kbin, power, kscatter, pscatter, occupation, sim.numbins, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * cosmo.Omega_ncdm[i] * cosmo.Omega_ncdm[j], filename, buffer, a, sim.z_pk[pkcount]);
+							spectra.output(slot, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * cosmo.Omega_ncdm[i] * cosmo.Omega_ncdm[j], filename, buffer, a, sim.z_pk[pkcount]);
 						}
 					}
 				}
@@ -2062,10 +2566,11 @@ Particles_gevolution<part_simple,part_simple_info,part_simple_dataType> * pcls_c
 
 	if (sim.out_pk & MASK_PHI)
 	{
+		spectra.release(*scalarFT);
 		plan_phi->execute(FFT_FORWARD);
-		extractPowerSpectrum(*scalarFT, kbin, power, kscatter, pscatter, occupation, sim.numbins, false, KTYPE_LINEAR);
+		slot = spectra.add(*scalarFT, false);
 		sprintf(filename, "%s%s%03d_phi.dat", sim.output_path, sim.basename_pk, pkcount);
-		writePowerSpectrum(kbin, power, kscatter, pscatter, occupation, sim.numbins, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI, filename, "power spectrum of phi", a, sim.z_pk[pkcount]);
+		spectra.output(slot, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI, filename, "power spectrum of phi", a, sim.z_pk[pkcount]);
 	}
 
 
@@ -2074,49 +2579,56 @@ Particles_gevolution<part_simple,part_simple_info,part_simple_dataType> * pcls_c
    // Note that according to definition and since pi is dimensionfull, so in the output we write \pi * H_conf which is dimensionless and can be compared to class and hiclass
 	  if (sim.out_pk & MASK_PI_K)
 		{
+			spectra.release(*scalarFT_pi);
 			plan_pi_k->execute(FFT_FORWARD);
-			extractPowerSpectrum(*scalarFT_pi , kbin, power, kscatter, pscatter, occupation, sim.numbins, true, KTYPE_LINEAR);
+			slot = spectra.add(*scalarFT_pi, true);
 			sprintf(filename, "%s%s%03d_pi_k.dat", sim.output_path, sim.basename_pk, pkcount);
-			writePowerSpectrum(kbin, power, kscatter, pscatter, occupation, sim.numbins, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI/H0/H0, filename, "power spectrum of pi_k * H0 (dimensionless)", a, sim.z_pk[pkcount]);
+			spectra.output(slot, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI/H0/H0, filename, "power spectrum of pi_k * H0 (dimensionless)", a, sim.z_pk[pkcount]);
 		}
 
 	     if (sim.out_pk & MASK_ZETA)
 		{
+			spectra.release(*scalarFT_zeta);
 			plan_zeta->execute(FFT_FORWARD);
-			extractPowerSpectrum(*scalarFT_zeta, kbin, power, kscatter, pscatter, occupation, sim.numbins, true, KTYPE_LINEAR);
+			slot = spectra.add(*scalarFT_zeta, true);
 			sprintf(filename, "%s%s%03d_zeta.dat", sim.output_path, sim.basename_pk, pkcount);
-			writePowerSpectrum(kbin, power, kscatter, pscatter, occupation, sim.numbins, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI, filename, "power spectrum of zeta (dimensionless)", a, sim.z_pk[pkcount]);
+			spectra.output(slot, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI, filename, "power spectrum of zeta (dimensionless)", a, sim.z_pk[pkcount]);
 		}
 
-	   if (sim.out_pk & MASK_T_KGB)
+	   // T00(kgb) and delta_kgb are the same spectrum with different normalizations
+	   if (sim.out_pk & MASK_T_KGB || sim.out_pk & MASK_DELTA_KGB)
 		{
+      spectra.release(*T00_kgbFT);
       plan_T00_kgb->execute(FFT_FORWARD);
-      extractPowerSpectrum(*T00_kgbFT, kbin, power, kscatter, pscatter, occupation, sim.numbins, true, KTYPE_LINEAR);
+      slot = spectra.add(*T00_kgbFT, true);
+		}
+
+	   if (sim.out_pk & MASK_T_KGB)
+		{
       sprintf(filename, "%s%s%03d_T00_kgb.dat", sim.output_path, sim.basename_pk, pkcount);
-        writePowerSpectrum(kbin, power, kscatter, pscatter, occupation, sim.numbins, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * pow(a, 6.0), filename, "power spectrum of T00(kgb)", a, sim.z_pk[pkcount]);
+        spectra.output(slot, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * pow(a, 6.0), filename, "power spectrum of T00(kgb)", a, sim.z_pk[pkcount]);
     }
 
     if (sim.out_pk & MASK_DELTA_KGB)
    {
-     plan_T00_kgb->execute(FFT_FORWARD);
-     extractPowerSpectrum(*T00_kgbFT, kbin, power, kscatter, pscatter, occupation, sim.numbins, true, KTYPE_LINEAR);
      sprintf(filename, "%s%s%03d_delta_kgb.dat", sim.output_path, sim.basename_pk, pkcount);
      #ifdef HAVE_HICLASS_BG
-       writePowerSpectrum(kbin, power, kscatter, pscatter, occupation, sim.numbins, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * pow(a,3) * (rho_s/rho_crit_0) * pow(a,3) * (rho_s/rho_crit_0), filename, "power spectrum of delta_kgb", a, sim.z_pk[pkcount]);
+       spectra.output(slot, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * pow(a,3) * (rho_s/rho_crit_0) * pow(a,3) * (rho_s/rho_crit_0), filename, "power spectrum of delta_kgb", a, sim.z_pk[pkcount]);
      #else
      // P (\delta)= deltarho_kgb^2/ Omega_kgb *a^(-3(1+w)) ) Omega_kgb *a^(-3(1+w)) ) since in the defnition we have a^3 T00
      // We already included a^(-3) in the denominator, so we only need take the rest into account.
-       writePowerSpectrum(kbin, power, kscatter, pscatter, occupation, sim.numbins, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI* cosmo.Omega_kgb * cosmo.Omega_kgb * pow(a, -3.* cosmo.w_kgb) * pow(a, -3.* cosmo.w_kgb), filename, "power spectrum of delta_kgb", a, sim.z_pk[pkcount]);
+       spectra.output(slot, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI* cosmo.Omega_kgb * cosmo.Omega_kgb * pow(a, -3.* cosmo.w_kgb) * pow(a, -3.* cosmo.w_kgb), filename, "power spectrum of delta_kgb", a, sim.z_pk[pkcount]);
      #endif
    }
 	   //kgb END
 
 	if (sim.out_pk & MASK_CHI)
 	{
+		spectra.release(*scalarFT);
 		plan_chi->execute(FFT_FORWARD);
-		extractPowerSpectrum(*scalarFT, kbin, power, kscatter, pscatter, occupation, sim.numbins, false, KTYPE_LINEAR);
+		slot = spectra.add(*scalarFT, false);
 		sprintf(filename, "%s%s%03d_chi.dat", sim.output_path, sim.basename_pk, pkcount);
-		writePowerSpectrum(kbin, power, kscatter, pscatter, occupation, sim.numbins, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI, filename, "power spectrum of chi", a, sim.z_pk[pkcount]);
+		spectra.output(slot, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI, filename, "power spectrum of chi", a, sim.z_pk[pkcount]);
 	}
 
 	if (sim.out_pk & MASK_HIJ)
@@ -2133,12 +2645,13 @@ Particles_gevolution<part_simple,part_simple_info,part_simple_dataType> * pcls_c
 		projection_Tij_comm(Sij);
 
 		prepareFTsource<Real>(*phi, *Sij, *Sij, 2. * fourpiG / (double) sim.numpts / (double) sim.numpts / a);
+		spectra.release(*SijFT);
 		plan_Sij->execute(FFT_FORWARD);
 		projectFTtensor(*SijFT, *SijFT);
 
-		extractPowerSpectrum(*SijFT, kbin, power, kscatter, pscatter, occupation, sim.numbins, false, KTYPE_LINEAR);
+		slot = spectra.add(*SijFT, false);
 		sprintf(filename, "%s%s%03d_hij.dat", sim.output_path, sim.basename_pk, pkcount);
-		writePowerSpectrum(kbin, power, kscatter, pscatter, occupation, sim.numbins, sim.boxsize, 2. * M_PI * M_PI, filename, "power spectrum of hij", a, sim.z_pk[pkcount]);
+		spectra.output(slot, sim.boxsize, 2. * M_PI * M_PI, filename, "power spectrum of hij", a, sim.z_pk[pkcount]);
 	}
 
 	if ((sim.out_pk & MASK_T00 || sim.out_pk & MASK_DELTA) && sim.gr_flag > 0)
@@ -2147,6 +2660,7 @@ Particles_gevolution<part_simple,part_simple_info,part_simple_dataType> * pcls_c
 #if defined(HAVE_CLASS) || defined(HAVE_HICLASS)
 		if (sim.radiation_flag > 0 || sim.fluid_flag > 0)
 		{
+			spectra.release(*scalarFT);
 			projection_T00_project(class_background, class_perturbs, *source, *scalarFT, plan_source, sim, ic, cosmo, fourpiG, a);
 			if (sim.out_pk & MASK_DELTA)
 			{
@@ -2173,19 +2687,20 @@ Particles_gevolution<part_simple,part_simple_info,part_simple_dataType> * pcls_c
 		}
 		projection_T00_comm(source);
 
+		spectra.release(*scalarFT);
 		plan_source->execute(FFT_FORWARD);
-		extractPowerSpectrum(*scalarFT, kbin, power, kscatter, pscatter, occupation, sim.numbins, true, KTYPE_LINEAR);
+		slot = spectra.add(*scalarFT, true);
 
 		if (sim.out_pk & MASK_T00)
 		{
 			sprintf(filename, "%s%s%03d_T00.dat", sim.output_path, sim.basename_pk, pkcount);
-			writePowerSpectrum(kbin, power, kscatter, pscatter, occupation, sim.numbins, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * pow(a, 6.0), filename, "power spectrum of T00", a, sim.z_pk[pkcount]);
+			spectra.output(slot, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * pow(a, 6.0), filename, "power spectrum of T00", a, sim.z_pk[pkcount]);
 		}
 
 		if (sim.out_pk & MASK_DELTA)
 		{
 			sprintf(filename, "%s%s%03d_delta.dat", sim.output_path, sim.basename_pk, pkcount);
-			writePowerSpectrum(kbin, power, kscatter, pscatter, occupation, sim.numbins, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * (cosmo.Omega_cdm + cosmo.Omega_b + bg_ncdm(a, cosmo)) * (cosmo.Omega_cdm + cosmo.Omega_b + bg_ncdm(a, cosmo)), filename, "power spectrum of delta", a, sim.z_pk[pkcount]);
+			spectra.output(slot, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * (cosmo.Omega_cdm + cosmo.Omega_b + bg_ncdm(a, cosmo)) * (cosmo.Omega_cdm + cosmo.Omega_b + bg_ncdm(a, cosmo)), filename, "power spectrum of delta", a, sim.z_pk[pkcount]);
 		}
 
     //kgb Cross Power delta_kgb * delta_m
@@ -2196,12 +2711,12 @@ Particles_gevolution<part_simple,part_simple_info,part_simple_dataType> * pcls_c
          // P (\deltam \delta_kgb)= deltarho_kgb * \delta_m / Omega_kgb *a^(-3(1+w)) ) Omega_m *a^-3 since in the defnition we have a^3 T00
          // We already included a^(-3) in the denominator, so we only need take the rest into account.
          // Which are just a^{-3w} and Omega_kgb and Omega_m
-        extractCrossSpectrum(*scalarFT, *T00_kgbFT, kbin, power, kscatter, pscatter, occupation, sim.numbins, true, KTYPE_LINEAR);
+        slot = spectra.add(*scalarFT, *T00_kgbFT, true);
         sprintf(filename, "%s%s%03d_deltakgb_deltam.dat", sim.output_path, sim.basename_pk, pkcount);
         #ifdef HAVE_HICLASS_BG
-        writePowerSpectrum(kbin, power, kscatter, pscatter, occupation, sim.numbins, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * (cosmo.Omega_cdm + cosmo.Omega_b + bg_ncdm(a, cosmo)) * pow(a,3) * rho_s/rho_crit_0 , filename, "cross power spectrum of delta_m and  delta_kgb", a, sim.z_pk[pkcount]);
+        spectra.output(slot, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * (cosmo.Omega_cdm + cosmo.Omega_b + bg_ncdm(a, cosmo)) * pow(a,3) * rho_s/rho_crit_0 , filename, "cross power spectrum of delta_m and  delta_kgb", a, sim.z_pk[pkcount]);
         #else
-        writePowerSpectrum(kbin, power, kscatter, pscatter, occupation, sim.numbins, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * (cosmo.Omega_cdm + cosmo.Omega_b + bg_ncdm(a, cosmo)) * cosmo.Omega_kgb *  pow(a, -3.* cosmo.w_kgb)  , filename, "cross power spectrum of delta_m and  delta_kgb", a, sim.z_pk[pkcount]);
+        spectra.output(slot, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * (cosmo.Omega_cdm + cosmo.Omega_b + bg_ncdm(a, cosmo)) * cosmo.Omega_kgb *  pow(a, -3.* cosmo.w_kgb)  , filename, "cross power spectrum of delta_m and  delta_kgb", a, sim.z_pk[pkcount]);
         #endif
       }
       else
@@ -2217,48 +2732,51 @@ Particles_gevolution<part_simple,part_simple_info,part_simple_dataType> * pcls_c
 			projection_init(source);
 			projection_T00_project(pcls_cdm, source, a, phi);
 			projection_T00_comm(source);
+			spectra.release(*scalarFT);
 			plan_source->execute(FFT_FORWARD);
-			extractPowerSpectrum(*scalarFT, kbin, power, kscatter, pscatter, occupation, sim.numbins, true, KTYPE_LINEAR);
+			slot = spectra.add(*scalarFT, true);
 			if (sim.out_pk & MASK_T00)
 			{
 				sprintf(filename, "%s%s%03d_T00cdm.dat", sim.output_path, sim.basename_pk, pkcount);
-				writePowerSpectrum(kbin, power, kscatter, pscatter, occupation, sim.numbins, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * pow(a, 6.0), filename, "power spectrum of T00 for cdm", a, sim.z_pk[pkcount]);
+				spectra.output(slot, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * pow(a, 6.0), filename, "power spectrum of T00 for cdm", a, sim.z_pk[pkcount]);
 			}
 
 
 			if (sim.out_pk & MASK_DELTA)
 			{
 				sprintf(filename, "%s%s%03d_deltacdm.dat", sim.output_path, sim.basename_pk, pkcount);
-				writePowerSpectrum(kbin, power, kscatter, pscatter, occupation, sim.numbins, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * (sim.baryon_flag ? (cosmo.Omega_cdm * cosmo.Omega_cdm) : ((cosmo.Omega_cdm + cosmo.Omega_b) * (cosmo.Omega_cdm + cosmo.Omega_b))), filename, "power spectrum of delta for cdm", a, sim.z_pk[pkcount]);
+				spectra.output(slot, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * (sim.baryon_flag ? (cosmo.Omega_cdm * cosmo.Omega_cdm) : ((cosmo.Omega_cdm + cosmo.Omega_b) * (cosmo.Omega_cdm + cosmo.Omega_b))), filename, "power spectrum of delta for cdm", a, sim.z_pk[pkcount]);
 			}
 			if (sim.baryon_flag)
 			{
 				// store k-space information for cross-spectra using SijFT as temporary array
 				if (sim.out_pk & MASK_XSPEC)
 				{
+					spectra.release(*SijFT);
 					for (kFT.first(); kFT.test(); kFT.next())
 						(*SijFT)(kFT, 0) = (*scalarFT)(kFT);
 				}
 				projection_init(source);
 				projection_T00_project(pcls_b, source, a, phi);
 				projection_T00_comm(source);
+				spectra.release(*scalarFT);
 				plan_source->execute(FFT_FORWARD);
-				extractPowerSpectrum(*scalarFT, kbin, power, kscatter, pscatter, occupation, sim.numbins, true, KTYPE_LINEAR);
+				slot = spectra.add(*scalarFT, true);
 				if (sim.out_pk & MASK_T00)
 				{
 					sprintf(filename, "%s%s%03d_T00b.dat", sim.output_path, sim.basename_pk, pkcount);
-					writePowerSpectrum(kbin, power, kscatter, pscatter, occupation, sim.numbins, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * pow(a, 6.0), filename, "power spectrum of T00 for baryons", a, sim.z_pk[pkcount]);
+					spectra.output(slot, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * pow(a, 6.0), filename, "power spectrum of T00 for baryons", a, sim.z_pk[pkcount]);
 				}
 				if (sim.out_pk & MASK_DELTA)
 				{
 					sprintf(filename, "%s%s%03d_deltab.dat", sim.output_path, sim.basename_pk, pkcount);
-					writePowerSpectrum(kbin, power, kscatter, pscatter, occupation, sim.numbins, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * cosmo.Omega_b * cosmo.Omega_b, filename, "power spectrum of delta for baryons", a, sim.z_pk[pkcount]);
+					spectra.output(slot, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * cosmo.Omega_b * cosmo.Omega_b, filename, "power spectrum of delta for baryons", a, sim.z_pk[pkcount]);
 				}
 				if (sim.out_pk & MASK_XSPEC)
 				{
-					extractCrossSpectrum(*scalarFT, *SijFT, kbin, power, kscatter, pscatter, occupation, sim.numbins, true, KTYPE_LINEAR);
+					slot = spectra.add(*scalarFT, *SijFT, true);
 					sprintf(filename, "%s%s%03d_deltacdmxb.dat", sim.output_path, sim.basename_pk, pkcount);
-					writePowerSpectrum(kbin, power, kscatter, pscatter, occupation, sim.numbins, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * cosmo.Omega_b * cosmo.Omega_cdm, filename, "cross power spectrum of delta for cdm x baryons", a, sim.z_pk[pkcount]);
+					spectra.output(slot, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * cosmo.Omega_b * cosmo.Omega_cdm, filename, "cross power spectrum of delta for cdm x baryons", a, sim.z_pk[pkcount]);
 				}
 			}
 			for (i = 0; i < cosmo.num_ncdm; i++)
@@ -2267,44 +2785,47 @@ Particles_gevolution<part_simple,part_simple_info,part_simple_dataType> * pcls_c
 				if (sim.numpcl[1+sim.baryon_flag+i] > 0)
 					projection_T00_project(pcls_ncdm+i, source, a, phi);
 				projection_T00_comm(source);
+				spectra.release(*scalarFT);
 				plan_source->execute(FFT_FORWARD);
-				extractPowerSpectrum(*scalarFT, kbin, power, kscatter, pscatter, occupation, sim.numbins, true, KTYPE_LINEAR);
+				slot = spectra.add(*scalarFT, true);
 				if (sim.out_pk & MASK_T00)
 				{
 					sprintf(filename, "%s%s%03d_T00ncdm%d.dat", sim.output_path, sim.basename_pk, pkcount, i);
 					sprintf(buffer, "power spectrum of T00 for ncdm %d", i);
-					writePowerSpectrum(kbin, power, kscatter, pscatter, occupation, sim.numbins, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * pow(a, 6.0), filename, buffer, a, sim.z_pk[pkcount]);
+					spectra.output(slot, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * pow(a, 6.0), filename, buffer, a, sim.z_pk[pkcount]);
 				}
 				if (sim.out_pk & MASK_DELTA)
 				{
 					sprintf(filename, "%s%s%03d_deltancdm%d.dat", sim.output_path, sim.basename_pk, pkcount, i);
 					sprintf(buffer, "power spectrum of delta for ncdm %d", i);
-					writePowerSpectrum(kbin, power, kscatter, pscatter, occupation, sim.numbins, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * bg_ncdm(a, cosmo, i) * bg_ncdm(a, cosmo, i), filename, buffer, a, sim.z_pk[pkcount]);
+					spectra.output(slot, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * bg_ncdm(a, cosmo, i) * bg_ncdm(a, cosmo, i), filename, buffer, a, sim.z_pk[pkcount]);
 				}
 				// store k-space information for cross-spectra using SijFT as temporary array
 				if (cosmo.num_ncdm > 1 && i < 6)
 				{
+					spectra.release(*SijFT);
 					for (kFT.first(); kFT.test(); kFT.next())
 						(*SijFT)(kFT, i) = (*scalarFT)(kFT);
 				}
 			}
 			if (cosmo.num_ncdm > 1 && cosmo.num_ncdm <= 7)
 			{
+				spectra.release(*scalarFT);
 				for (kFT.first(); kFT.test(); kFT.next())
 				{
 					for (i = 0; i < cosmo.num_ncdm-1; i++)
 						(*scalarFT)(kFT) += (*SijFT)(kFT, i);
 				}
-				extractPowerSpectrum(*scalarFT, kbin, power, kscatter, pscatter, occupation, sim.numbins, true, KTYPE_LINEAR);
+				slot = spectra.add(*scalarFT, true);
 				if (sim.out_pk & MASK_T00)
 				{
 					sprintf(filename, "%s%s%03d_T00ncdm.dat", sim.output_path, sim.basename_pk, pkcount);
-					writePowerSpectrum(kbin, power, kscatter, pscatter, occupation, sim.numbins, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * pow(a, 6.0), filename, "power spectrum of T00 for total ncdm", a, sim.z_pk[pkcount]);
+					spectra.output(slot, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * pow(a, 6.0), filename, "power spectrum of T00 for total ncdm", a, sim.z_pk[pkcount]);
 				}
 				if (sim.out_pk & MASK_DELTA)
 				{
 					sprintf(filename, "%s%s%03d_deltancdm.dat", sim.output_path, sim.basename_pk, pkcount);
-					writePowerSpectrum(kbin, power, kscatter, pscatter, occupation, sim.numbins, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * bg_ncdm(a, cosmo) * bg_ncdm(a, cosmo), filename, "power spectrum of delta for total ncdm", a, sim.z_pk[pkcount]);
+					spectra.output(slot, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * bg_ncdm(a, cosmo) * bg_ncdm(a, cosmo), filename, "power spectrum of delta for total ncdm", a, sim.z_pk[pkcount]);
 				}
 			}
 			if (cosmo.num_ncdm > 1)
@@ -2315,18 +2836,18 @@ Particles_gevolution<part_simple,part_simple_info,part_simple_dataType> * pcls_c
 					{
 						if (sim.out_pk & MASK_XSPEC || (i == 0 && j == 1) || (i == 2 && j == 3) || (i == 4 && j == 5))
 						{
-							extractCrossSpectrum(*SijFT, *SijFT, kbin, power, kscatter, pscatter, occupation, sim.numbins, true, KTYPE_LINEAR, i, j);
+							slot = spectra.add(*SijFT, *SijFT, true, i, j);
 							if (sim.out_pk & MASK_T00)
 							{
 								sprintf(filename, "%s%s%03d_T00ncdm%dx%d.dat", sim.output_path, sim.basename_pk, pkcount, i, j);
 								sprintf(buffer, "cross power spectrum of T00 for ncdm %d x %d", i, j);
-								writePowerSpectrum(kbin, power, kscatter, pscatter, occupation, sim.numbins, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * pow(a, 6.0), filename, buffer, a, sim.z_pk[pkcount]);
+								spectra.output(slot, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * pow(a, 6.0), filename, buffer, a, sim.z_pk[pkcount]);
 							}
 							if (sim.out_pk & MASK_DELTA)
 							{
 								sprintf(filename, "%s%s%03d_deltancdm%dx%d.dat", sim.output_path, sim.basename_pk, pkcount, i, j);
 								sprintf(buffer, "cross power spectrum of delta for ncdm %d x %d", i, j);
-								writePowerSpectrum(kbin, power, kscatter, pscatter, occupation, sim.numbins, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * bg_ncdm(a, cosmo, i) * bg_ncdm(a, cosmo, j), filename, buffer, a, sim.z_pk[pkcount]);
+								spectra.output(slot, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * bg_ncdm(a, cosmo, i) * bg_ncdm(a, cosmo, j), filename, buffer, a, sim.z_pk[pkcount]);
 							}
 						}
 					}
@@ -2337,9 +2858,9 @@ Particles_gevolution<part_simple,part_simple_info,part_simple_dataType> * pcls_c
 
 	if (sim.out_pk & MASK_B)
 	{
-		extractPowerSpectrum(*BiFT, kbin, power, kscatter, pscatter, occupation, sim.numbins, false, KTYPE_LINEAR);
+		slot = spectra.add(*BiFT, false);
 		sprintf(filename, "%s%s%03d_B.dat", sim.output_path, sim.basename_pk, pkcount);
-		writePowerSpectrum(kbin, power, kscatter, pscatter, occupation, sim.numbins, sim.boxsize, a * a * a * a * sim.numpts * sim.numpts * 2. * M_PI * M_PI, filename, "power spectrum of B", a, sim.z_pk[pkcount]);
+		spectra.output(slot, sim.boxsize, a * a * a * a * sim.numpts * sim.numpts * 2. * M_PI * M_PI, filename, "power spectrum of B", a, sim.z_pk[pkcount]);
 
 #ifdef CHECK_B
 		if (sim.vector_flag == VECTOR_PARABOLIC)
@@ -2354,40 +2875,40 @@ Particles_gevolution<part_simple,part_simple_info,part_simple_dataType> * pcls_c
 				projection_T0i_project(pcls_ncdm+i, Bi_check, phi);
 			}
 			projection_T0i_comm(Bi_check);
+			spectra.release(*BiFT_check);
 			plan_Bi_check->execute(FFT_FORWARD);
 			projectFTvector(*BiFT_check, *BiFT_check, fourpiG / (double) sim.numpts / (double) sim.numpts);
 		}
-		extractPowerSpectrum(*BiFT_check, kbin, power, kscatter, pscatter, occupation, sim.numbins, false, KTYPE_LINEAR);
+		slot = spectra.add(*BiFT_check, false);
 		sprintf(filename, "%s%s%03d_B_check.dat", sim.output_path, sim.basename_pk, pkcount);
-		writePowerSpectrum(kbin, power, kscatter, pscatter, occupation, sim.numbins, sim.boxsize, a * a * a * a * sim.numpts * sim.numpts * 2. * M_PI * M_PI, filename, "power spectrum of B", a, sim.z_pk[pkcount]);
+		spectra.output(slot, sim.boxsize, a * a * a * a * sim.numpts * sim.numpts * 2. * M_PI * M_PI, filename, "power spectrum of B", a, sim.z_pk[pkcount]);
 #endif
 	}
 
 #ifdef VELOCITY
 	if (sim.out_pk & MASK_VEL)
 	{
+		spectra.release(*viFT);
 		plan_vi->execute(FFT_FORWARD);
-		extractPowerSpectrum(*viFT, kbin, power, kscatter, pscatter, occupation, sim.numbins, false, KTYPE_LINEAR);
+		slot = spectra.add(*viFT, false);
 		sprintf(filename, "%s%s%03d_v.dat", sim.output_path, sim.basename_pk, pkcount);
-		writePowerSpectrum(kbin, power, kscatter, pscatter, occupation, sim.numbins, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI, filename, "power spectrum of velocity", a, sim.z_pk[pkcount]);
+		spectra.output(slot, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI, filename, "power spectrum of velocity", a, sim.z_pk[pkcount]);
 
+		spectra.release(*scalarFT);
 		projectFTtheta(*scalarFT, *viFT);
-		extractPowerSpectrum(*scalarFT, kbin, power, kscatter, pscatter, occupation, sim.numbins, false, KTYPE_LINEAR);
+		slot = spectra.add(*scalarFT, false);
 		sprintf(filename, "%s%s%03d_theta.dat", sim.output_path, sim.basename_pk, pkcount);
-		writePowerSpectrum(kbin, power, kscatter, pscatter, occupation, sim.numbins, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * sim.boxsize * sim.boxsize / cosmo.h / cosmo.h, filename, "power spectrum of theta (div v)", a, sim.z_pk[pkcount]);
+		spectra.output(slot, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * sim.boxsize * sim.boxsize / cosmo.h / cosmo.h, filename, "power spectrum of theta (div v)", a, sim.z_pk[pkcount]);
 
+		spectra.release(*viFT);
 		projectFTomega(*viFT);
-		extractPowerSpectrum(*viFT, kbin, power, kscatter, pscatter, occupation, sim.numbins, false, KTYPE_LINEAR);
+		slot = spectra.add(*viFT, false);
 		sprintf(filename, "%s%s%03d_omega.dat", sim.output_path, sim.basename_pk, pkcount);
-		writePowerSpectrum(kbin, power, kscatter, pscatter, occupation, sim.numbins, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * sim.boxsize * sim.boxsize / cosmo.h / cosmo.h, filename, "power spectrum of omega (curl v)", a, sim.z_pk[pkcount]);
+		spectra.output(slot, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * sim.boxsize * sim.boxsize / cosmo.h / cosmo.h, filename, "power spectrum of omega (curl v)", a, sim.z_pk[pkcount]);
 	}
 #endif
 
-	free(kbin);
-	free(power);
-	free(kscatter);
-	free(pscatter);
-	free(occupation);
+	spectra.finish();
 }
 
 #endif
@@ -2431,7 +2952,7 @@ double H0 = Hconf(1., fourpiG,
 if (sim.out_pk & MASK_PHI_PRIME)
   {
     phi_prime_plan->execute(FFT_FORWARD);
-    extractPowerSpectrum(*phi_prime_scalarFT , kbin, power, kscatter, pscatter, occupation, sim.numbins, true, KTYPE_LINEAR);
+    extractPowerSpectrum(*phi_prime_scalarFT , kbin, power, kscatter, pscatter, occupation, sim.numbins, true, KTYPE_LINEAR, sim.pk_binning);
     sprintf(filename, "%s%s%03d_phi_prime.dat", sim.output_path, sim.basename_pk, pkcount);
     writePowerSpectrum(kbin, power, kscatter, pscatter, occupation, sim.numbins, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * (H0 * H0), filename, "power spectrum of phi_prime/H0 (dimensionless)", a, sim.z_pk[pkcount]);
   }
@@ -2487,7 +3008,7 @@ double H0 = Hconf(1., fourpiG,
 
     // We divide by H_conf^2 to make it dimentionless!
     short_wave_plan->execute(FFT_FORWARD);
-    extractPowerSpectrum(*short_wave_scalarFT , kbin, power, kscatter, pscatter, occupation, sim.numbins, true, KTYPE_LINEAR);
+    extractPowerSpectrum(*short_wave_scalarFT , kbin, power, kscatter, pscatter, occupation, sim.numbins, true, KTYPE_LINEAR, sim.pk_binning);
     sprintf(filename, "%s%s%03d_short_wave.dat", sim.output_path, sim.basename_pk, pkcount);
     writePowerSpectrum(kbin, power, kscatter, pscatter, occupation, sim.numbins, sim.boxsize, (Real) numpts3d * (Real) numpts3d * 2. * M_PI * M_PI * (H0 * H0,  H0,  H0) , filename, "power spectrum of short wave correction (dimensionless)", a, sim.z_pk[pkcount]);
 
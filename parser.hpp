@@ -19,6 +19,8 @@
 #include <string.h>
 #include <stdlib.h>
 #include <cstring>
+#include <stdint.h>
+#include <string>
 #include "metadata.hpp"
 
 using namespace std;
@@ -276,6 +278,58 @@ void saveParameterFile(const char * filename, parameter * params, const int nump
 }
 
 
+//////////////////////////
+// backgroundChecksum
+//////////////////////////
+// Description:
+//   checksum of the parameters which determine the background (cosmology,
+//   gravity model and the additional hiclass parameters); a background cache
+//   or a rank-local checkpoint is only used if it was written for the same
+//   checksum
+//
+// Arguments:
+//   cosmo             cosmological parameter structure
+//   params            additional parameters passed to hiclass (only the unused ones are passed)
+//   numparam          number of additional parameters
+//
+// Returns: checksum
+//
+//////////////////////////
+
+uint64_t backgroundChecksum(cosmology & cosmo, parameter * params = NULL, int numparam = 0)
+{
+	char buffer[1024];
+	string key;
+	uint64_t hash = 14695981039346656037ull;
+	int i;
+
+	snprintf(buffer, 1024, "%.17g %.17g %.17g %.17g %.17g %.17g %d ", cosmo.h, cosmo.Omega_cdm, cosmo.Omega_b, cosmo.Omega_g, cosmo.Omega_ur, cosmo.Omega_Lambda, cosmo.num_ncdm);
+	key += buffer;
+	for (i = 0; i < cosmo.num_ncdm; i++)
+	{
+		snprintf(buffer, 1024, "%.17g %.17g %.17g ", cosmo.m_ncdm[i], cosmo.T_ncdm[i], cosmo.deg_ncdm[i]);
+		key += buffer;
+	}
+	snprintf(buffer, 1024, "%d %.17g %.17g %.17g %.17g %.17g %.17g %.17g %.17g ", cosmo.gravity_model, cosmo.Omega_kgb, cosmo.w_kgb, cosmo.w_a_kgb, cosmo.x_k, cosmo.x_b, cosmo.x_m, cosmo.x_t, cosmo.M_star_ini);
+	key += buffer;
+	snprintf(buffer, 1024, "%.17g %.17g %.17g %.17g %.17g %.17g ", cosmo.Xt, cosmo.g0, cosmo.g2, cosmo.g4, cosmo.phi_i, cosmo.X_i);
+	key += buffer;
+	for (i = 0; i < numparam; i++)
+	{
+		if (params[i].used) continue;
+		key += params[i].name;
+		key += "=";
+		key += params[i].value;
+		key += ";";
+	}
+
+	for (i = 0; i < (int) key.length(); i++)
+		hash = (hash ^ (uint64_t) (unsigned char) key[i]) * 1099511628211ull;
+
+	return hash;
+}
+
+
 //////////////////////////
 // parseParameter (int)
 //////////////////////////
@@ -808,6 +862,12 @@ int parseMetadata(parameter * & params, const int numparam, metadata & sim, cosm
 	ic.metricfile[0][0] = '\0';
 	ic.metricfile[1][0] = '\0';
 	ic.metricfile[2][0] = '\0';
+	ic.kgbfile[0][0] = '\0';
+	ic.kgbfile[1][0] = '\0';
+	ic.oldmetricfile[0][0] = '\0';
+	ic.oldmetricfile[1][0] = '\0';
+	ic.bgfile[0] = '\0';
+	ic.precisionfile[0] = '\0';
 	ic.seed = 0;
 	ic.flags = 0;
 	ic.z_ic = -2.;
@@ -819,6 +879,8 @@ int parseMetadata(parameter * & params, const int numparam, metadata & sim, cosm
 	ic.restart_cycle = -1;
 	ic.restart_tau = 0.;
 	ic.restart_dtau = 0.;
+	ic.restart_a_kgb = 0.;
+	ic.restart_dtau_kgb = 0.;
 	ic.restart_version = -1.;
 
 	parseParameter(params, numparam, "seed", ic.seed);
@@ -1170,6 +1232,16 @@ parallel.abortForce();
 		for (i = 0; i < 3; i++)
 			pptr[i] = ic.metricfile[i];
 		parseParameter(params, numparam, "metric file", pptr, i);
+		for (i = 0; i < 2; i++)
+			pptr[i] = ic.kgbfile[i];
+		parseParameter(params, numparam, "kgb file", pptr, i);
+		for (i = 0; i < 2; i++)
+			pptr[i] = ic.oldmetricfile[i];
+		parseParameter(params, numparam, "old metric file", pptr, i);
+		parseParameter(params, numparam, "a_kgb", ic.restart_a_kgb);
+		parseParameter(params, numparam, "dtau_kgb", ic.restart_dtau_kgb);
+		parseParameter(params, numparam, "background file", ic.bgfile);
+		parseParameter(params, numparam, "precision file", ic.precisionfile);
 		if (parseParameter(params, numparam, "gevolution version", ic.restart_version))
 		{
 			if (ic.restart_version - GEVOLUTION_VERSION > 0.0001)
@@ -1233,11 +1305,16 @@ parallel.abortForce();
 
 	sim.numpts = 0;
 	sim.downgrade_factor = 1;
+	sim.snapshot_single = 0;
+	sim.deflate_level = 4;
+	sim.snapshot_bits = 0;
 	for (i = 0; i < MAX_PCL_SPECIES; i++) sim.numpcl[i] = 0;
 	sim.vector_flag = VECTOR_PARABOLIC;
 	sim.gr_flag = 0;
 	sim.out_pk = 0;
 	sim.out_snapshot = 0;
+	sim.out_deflate = 0;
+	sim.out_lossy = 0;
 	sim.out_lightcone[0] = 0;
 	sim.num_pk = MAX_OUTPUTS;
 	sim.numbins = 0;
@@ -1293,6 +1370,9 @@ parallel.abortForce();
 	if (!parseParameter(params, numparam, "hibernation file base", sim.basename_restart))
 		strcpy(sim.basename_restart, "restart");
 
+	if (!parseParameter(params, numparam, "checkpoint path", sim.checkpoint_path))
+		strcpy(sim.checkpoint_path, "/tmp/");
+
 	parseParameter(params, numparam, "boxsize", sim.boxsize);
 	if (sim.boxsize <= 0. || !isfinite(sim.boxsize))
 	{
@@ -1327,6 +1407,22 @@ parallel.abortForce();
 		}
 	}
 
+	if (parseParameter(params, numparam, "snapshot precision", par_string))
+	{
+		if (par_string[0] == 's' || par_string[0] == 'S')
+			sim.snapshot_single = 1;
+		else if (par_string[0] != 'd' && par_string[0] != 'D')
+		{
+			COUT << COLORTEXT_YELLOW << " /!\\ warning" << COLORTEXT_RESET << ": snapshot precision \"" << par_string << "\" not recognized, using double precision" << endl;
+		}
+#ifndef ASYNC_SNAPSHOTS
+		if (sim.snapshot_single)
+		{
+			COUT << COLORTEXT_YELLOW << " /!\\ warning" << COLORTEXT_RESET << ": without the asynchronous snapshot writer (-DASYNC_SNAPSHOTS), snapshot precision only applies to compressed snapshot outputs" << endl;
+		}
+#endif
+	}
+
 	parseParameter(params, numparam, "Courant factor", sim.Cf);
 
 	if (ic.Cf < 0.) ic.Cf = sim.Cf;
@@ -1375,8 +1471,59 @@ parallel.abortForce();
 
 	parseParameter(params, numparam, "hibernation wallclock limit", sim.wallclocklimit);
 
+	if (!parseParameter(params, numparam, "checkpoint interval", sim.checkpoint_interval) || sim.checkpoint_interval < 0)
+		sim.checkpoint_interval = 0;
+
+	if (!parseParameter(params, numparam, "checkpoint disk interval", sim.checkpoint_disk) || sim.checkpoint_disk < 0)
+		sim.checkpoint_disk = 0;
+
+	sim.checkpoint_restore = 0;
+	if (parseParameter(params, numparam, "checkpoint restore", par_string))
+	{
+		if (par_string[0] == 'Y' || par_string[0] == 'y')
+			sim.checkpoint_restore = 1;
+		else if (par_string[0] != 'N' && par_string[0] != 'n')
+			COUT << COLORTEXT_YELLOW << " /!\\ warning" << COLORTEXT_RESET << ": setting chosen for checkpoint restore option not recognized, using default (no)" << endl;
+	}
+
 	parseFieldSpecifiers(params, numparam, "lightcone outputs", sim.out_lightcone[0]);
 	parseFieldSpecifiers(params, numparam, "snapshot outputs", sim.out_snapshot);
+	parseFieldSpecifiers(params, numparam, "snapshot compression", sim.out_deflate);
+	parseFieldSpecifiers(params, numparam, "snapshot lossy compression", sim.out_lossy);
+	sim.out_deflate |= sim.out_lossy;
+
+#ifndef H5_HAVE_PARALLEL
+	if (sim.out_deflate)
+	{
+		COUT << COLORTEXT_RED << " error" << COLORTEXT_RESET << ": snapshot compression requires parallel HDF5 (-DH5_HAVE_PARALLEL)!" << endl;
+#ifdef LATFIELD2_HPP
+		parallel.abortForce();
+#endif
+	}
+#endif
+
+	if (parseParameter(params, numparam, "compression level", sim.deflate_level))
+	{
+		if (sim.deflate_level < 1 || sim.deflate_level > 9)
+		{
+			COUT << COLORTEXT_YELLOW << " /!\\ warning" << COLORTEXT_RESET << ": compression level must be between 1 and 9, using 4" << endl;
+			sim.deflate_level = 4;
+		}
+	}
+
+	if (parseParameter(params, numparam, "significant bits", sim.snapshot_bits))
+	{
+		if (sim.snapshot_bits < 1 || sim.snapshot_bits > (sim.snapshot_single ? 23 : 52))
+		{
+			COUT << COLORTEXT_RED << " error" << COLORTEXT_RESET << ": significant bits must be between 1 and " << (sim.snapshot_single ? 23 : 52) << " for the given snapshot precision!" << endl;
+#ifdef LATFIELD2_HPP
+			parallel.abortForce();
+#endif
+		}
+	}
+	else if (sim.out_lossy)
+		sim.snapshot_bits = sim.snapshot_single ? 12 : 24;
+
 	parseFieldSpecifiers(params, numparam, "Pk outputs", sim.out_pk);
 
 	if(!parseParameter(params, numparam, "lightcone pixel factor", sim.pixelfactor[0]))
@@ -1677,6 +1824,20 @@ parallel.abortForce();
 		sim.numbins = 64;
 	}
 
+	sim.pk_binning = KBIN_LINEAR;
+	if (parseParameter(params, numparam, "Pk binning", par_string))
+	{
+		if ((par_string[0] == 'l' || par_string[0] == 'L') && (par_string[1] == 'o' || par_string[1] == 'O'))
+		{
+			COUT << " Pk binning set to: " << COLORTEXT_CYAN << "logarithmic" << COLORTEXT_RESET << endl;
+			sim.pk_binning = KBIN_LOG;
+		}
+		else if (par_string[0] != 'l' && par_string[0] != 'L')
+		{
+			COUT << COLORTEXT_YELLOW << " /!\\ warning" << COLORTEXT_RESET << ": Pk binning not recognized; using linear bins" << endl;
+		}
+	}
+
 	if (parseParameter(params, numparam, "gravity theory", par_string))
 	{
 		if (par_string[0] == 'N' || par_string[0] == 'n')
@@ -1923,6 +2084,31 @@ parallel.abortForce();
   {
     sim.n_kgb_numsteps = 1;
   }
+  if (!parseParameter(params, numparam, "kgb Courant factor", sim.Cf_kgb))
+  {
+    sim.Cf_kgb = 0.; //Default is a fixed number of kgb updates.
+  }
+  else if (sim.Cf_kgb > 1.)
+  {
+    COUT << COLORTEXT_YELLOW << " /!\\ warning" << COLORTEXT_RESET << ": kgb Courant factor = " << sim.Cf_kgb << " may lead to an unstable kgb evolution." << endl;
+  }
+  if (!parseParameter(params, numparam, "kgb halo", sim.kgb_halo))
+  {
+    sim.kgb_halo = 1; //Default is one halo exchange per kgb update.
+  }
+  else if (sim.kgb_halo < 1)
+  {
+    COUT << COLORTEXT_YELLOW << " /!\\ warning" << COLORTEXT_RESET << ": kgb halo = " << sim.kgb_halo << " is not allowed, using kgb halo = 1 instead." << endl;
+    sim.kgb_halo = 1;
+  }
+  if (!parseParameter(params, numparam, "kgb table size", sim.kgb_table_size) || sim.kgb_table_size < 2)
+  {
+    sim.kgb_table_size = 10000; //Default resolution of the kgb coefficient table, d ln a ~ 5e-4 for z_in = 100.
+  }
+  if (!parseParameter(params, numparam, "background table size", sim.bg_table_size) || sim.bg_table_size < 2)
+  {
+    sim.bg_table_size = 10000; //Default resolution of the background table, d ln a ~ 1e-3 for z_in = 100.
+  }
   if (!parseParameter(params, numparam, "kgb source gravity", sim.kgb_source_gravity))
   {
     sim.kgb_source_gravity = 0;
@@ -2113,6 +2299,8 @@ parallel.abortForce();
   COUT << "kgb source gravity = " << sim.kgb_source_gravity<< ", Non-linear kgb = " << sim.NL_kgb<< ", Number of kgb update = " <<sim.n_kgb_numsteps <<endl;
   COUT << " cosmological parameters are: Omega_m0 = " << cosmo.Omega_m << ", Omega_rad0 = " << cosmo.Omega_rad<< ", Omega_g0 = " << cosmo.Omega_g<< ", Omega_ur0 = " << cosmo.Omega_ur << ", h = " << cosmo.h << ", Omega_Lambda= "<<cosmo.Omega_Lambda<<" "<<endl;
   #endif
+  if (sim.Cf_kgb > 0)
+    COUT << " number of kgb updates is chosen adaptively with kgb Courant factor = " << sim.Cf_kgb << endl;
 
 	}
 
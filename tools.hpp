@@ -14,6 +14,8 @@
 #ifndef TOOLS_HEADER
 #define TOOLS_HEADER
 
+#include <vector>
+
 #ifndef Cplx
 #define Cplx Imag
 #endif
@@ -25,224 +27,6 @@ using namespace std;
 using namespace LATfield2;
 
 
-#ifdef FFT3D
-//////////////////////////
-// extractCrossSpectrum
-//////////////////////////
-// Description:
-//   generates the cross spectrum for two Fourier images
-//
-// Arguments:
-//   fld1FT     reference to the first Fourier image for which the cross spectrum should be extracted
-//   fld2FT     reference to the second Fourier image for which the cross spectrum should be extracted
-//   kbin       allocated array that will contain the central k-value for the bins
-//   power      allocated array that will contain the average power in each bin
-//   kscatter   allocated array that will contain the k-scatter for each bin
-//   pscatter   allocated array that will contain the scatter in power for each bin
-//   occupation allocated array that will count the number of grid points contributing to each bin
-//   numbin     number of bins (minimum size of all arrays)
-//   ktype      flag indicating which definition of momentum to be used
-//                  0: grid momentum
-//                  1: linear (default)
-//   comp1      for component-wise cross spectra, the component for the first field (ignored if negative)
-//   comp2      for component-wise cross spectra, the component for the second field (ignored if negative)
-//
-// Returns:
-//
-//////////////////////////
-
-void extractCrossSpectrum(Field<Cplx> & fld1FT, Field<Cplx> & fld2FT, Real * kbin, Real * power, Real * kscatter, Real * pscatter, int * occupation, const int numbins, const bool deconvolve = true, const int ktype = KTYPE_LINEAR, const int comp1 = -1, const int comp2 = -1)
-{
-	int i, weight;
-	const int linesize = fld1FT.lattice().size(1);
-	Real * typek2;
-	Real * sinc;
-	Real k2max, k2, s;
-	rKSite k(fld1FT.lattice());
-	Cplx p;
-
-	typek2 = (Real *) malloc(linesize * sizeof(Real));
-	sinc = (Real *) malloc(linesize * sizeof(Real));
-
-	if (ktype == KTYPE_GRID)
-	{
-		for (i = 0; i < linesize; i++)
-		{
-			typek2[i] = 2. * (Real) linesize * sin(M_PI * (Real) i / (Real) linesize);
-			typek2[i] *= typek2[i];
-		}
-	}
-	else
-	{
-		for (i = 0; i <= linesize/2; i++)
-		{
-			typek2[i] = 2. * M_PI * (Real) i;
-			typek2[i] *= typek2[i];
-		}
-		for (; i < linesize; i++)
-		{
-			typek2[i] = 2. * M_PI * (Real) (linesize-i);
-			typek2[i] *= typek2[i];
-		}
-	}
-
-	sinc[0] = 1.;
-	if (deconvolve)
-	{
-		for (i = 1; i <= linesize / 2; i++)
-		{
-			sinc[i] = sin(M_PI * (float) i / (float) linesize) * (float) linesize / (M_PI * (float) i);
-		}
-	}
-	else
-	{
-		for (i = 1; i <= linesize / 2; i++)
-		{
-			sinc[i] = 1.;
-		}
-	}
-	for (; i < linesize; i++)
-	{
-		sinc[i] = sinc[linesize-i];
-	}
-
-	k2max = 3. * typek2[linesize/2];
-
-	for (i = 0; i < numbins; i++)
-	{
-		kbin[i] = 0.;
-		power[i] = 0.;
-		kscatter[i] = 0.;
-		pscatter[i] = 0.;
-		occupation[i] = 0;
-	}
-
-	for (k.first(); k.test(); k.next())
-	{
-		if (k.coord(0) == 0 && k.coord(1) == 0 && k.coord(2) == 0)
-			continue;
-		else if (k.coord(0) == 0)
-			weight = 1;
-		else if ((k.coord(0) == linesize/2) && (linesize % 2 == 0))
-			weight = 1;
-		else
-			weight = 2;
-
-		k2 = typek2[k.coord(0)] + typek2[k.coord(1)] + typek2[k.coord(2)];
-		s = sinc[k.coord(0)] * sinc[k.coord(1)] * sinc[k.coord(2)];
-		s *= s;
-
-		if (comp1 >= 0 && comp2 >= 0 && comp1 < fld1FT.components() && comp2 < fld2FT.components())
-		{
-			p = fld1FT(k, comp1) * fld2FT(k, comp2).conj();
-		}
-		else if (fld1FT.symmetry() == LATfield2::symmetric)
-		{
-			p = fld1FT(k, 0, 1) * fld2FT(k, 0, 1).conj();
-			p += fld1FT(k, 0, 2) * fld2FT(k, 0, 2).conj();
-			p += fld1FT(k, 1, 2) * fld2FT(k, 1, 2).conj();
-			p *= 2.;
-			p += fld1FT(k, 0, 0) * fld2FT(k, 0, 0).conj();
-			p += fld1FT(k, 1, 1) * fld2FT(k, 1, 1).conj();
-			p += fld1FT(k, 2, 2) * fld2FT(k, 2, 2).conj();
-		}
-		else
-		{
-			p = Cplx(0., 0.);
-			for (i = 0; i < fld1FT.components(); i++)
-				p += fld1FT(k, i) * fld2FT(k, i).conj();
-		}
-
-		i = (int) floor((double) ((Real) numbins * sqrt(k2 / k2max)));
-		if (i < numbins)
-		{
-			kbin[i] += weight * sqrt(k2);
-			kscatter[i] += weight * k2;
-			power[i] += weight * p.real() * k2 * sqrt(k2) / s;
-			pscatter[i] += weight * p.real() * p.real() * k2 * k2 * k2 / s / s;
-			occupation[i] += weight;
-		}
-	}
-
-	free(typek2);
-	free(sinc);
-
-	if (parallel.isRoot())
-	{
-#ifdef SINGLE
-		MPI_Reduce(MPI_IN_PLACE, (void *) kbin, numbins, MPI_FLOAT, MPI_SUM, 0, parallel.lat_world_comm());
-		MPI_Reduce(MPI_IN_PLACE, (void *) kscatter, numbins, MPI_FLOAT, MPI_SUM, 0, parallel.lat_world_comm());
-		MPI_Reduce(MPI_IN_PLACE, (void *) power, numbins, MPI_FLOAT, MPI_SUM, 0, parallel.lat_world_comm());
-		MPI_Reduce(MPI_IN_PLACE, (void *) pscatter, numbins, MPI_FLOAT, MPI_SUM, 0, parallel.lat_world_comm());
-#else
-		MPI_Reduce(MPI_IN_PLACE, (void *) kbin, numbins, MPI_DOUBLE, MPI_SUM, 0, parallel.lat_world_comm());
-		MPI_Reduce(MPI_IN_PLACE, (void *) kscatter, numbins, MPI_DOUBLE, MPI_SUM, 0, parallel.lat_world_comm());
-		MPI_Reduce(MPI_IN_PLACE, (void *) power, numbins, MPI_DOUBLE, MPI_SUM, 0, parallel.lat_world_comm());
-		MPI_Reduce(MPI_IN_PLACE, (void *) pscatter, numbins, MPI_DOUBLE, MPI_SUM, 0, parallel.lat_world_comm());
-#endif
-		MPI_Reduce(MPI_IN_PLACE, (void *) occupation, numbins, MPI_INT, MPI_SUM, 0, parallel.lat_world_comm());
-
-		for (i = 0; i < numbins; i++)
-		{
-			if (occupation[i] > 0)
-			{
-				kscatter[i] = sqrt(kscatter[i] * occupation[i] - kbin[i] * kbin[i]) / occupation[i];
-				if (!isfinite(kscatter[i])) kscatter[i] = 0.;
-				kbin[i] = kbin[i] / occupation[i];
-				power[i] /= occupation[i];
-				pscatter[i] = sqrt(pscatter[i] / occupation[i] - power[i] * power[i]);
-				if (!isfinite(pscatter[i])) pscatter[i] = 0.;
-			}
-		}
-	}
-	else
-	{
-#ifdef SINGLE
-		MPI_Reduce((void *) kbin, NULL, numbins, MPI_FLOAT, MPI_SUM, 0, parallel.lat_world_comm());
-		MPI_Reduce((void *) kscatter, NULL, numbins, MPI_FLOAT, MPI_SUM, 0, parallel.lat_world_comm());
-		MPI_Reduce((void *) power, NULL, numbins, MPI_FLOAT, MPI_SUM, 0, parallel.lat_world_comm());
-		MPI_Reduce((void *) pscatter, NULL, numbins, MPI_FLOAT, MPI_SUM, 0, parallel.lat_world_comm());
-#else
-		MPI_Reduce((void *) kbin, NULL, numbins, MPI_DOUBLE, MPI_SUM, 0, parallel.lat_world_comm());
-		MPI_Reduce((void *) kscatter, NULL, numbins, MPI_DOUBLE, MPI_SUM, 0, parallel.lat_world_comm());
-		MPI_Reduce((void *) power, NULL, numbins, MPI_DOUBLE, MPI_SUM, 0, parallel.lat_world_comm());
-		MPI_Reduce((void *) pscatter, NULL, numbins, MPI_DOUBLE, MPI_SUM, 0, parallel.lat_world_comm());
-#endif
-		MPI_Reduce((void *) occupation, NULL, numbins, MPI_INT, MPI_SUM, 0, parallel.lat_world_comm());
-	}
-}
-
-
-
-//////////////////////////
-// extractPowerSpectrum
-//////////////////////////
-// Description:
-//   generates the power spectrum for a Fourier image
-//
-// Arguments:
-//   fldFT      reference to the Fourier image for which the power spectrum should be extracted
-//   kbin       allocated array that will contain the central k-value for the bins
-//   power      allocated array that will contain the average power in each bin
-//   kscatter   allocated array that will contain the k-scatter for each bin
-//   pscatter   allocated array that will contain the scatter in power for each bin
-//   occupation allocated array that will count the number of grid points contributing to each bin
-//   numbin     number of bins (minimum size of all arrays)
-//   ktype      flag indicating which definition of momentum to be used
-//                  0: grid momentum
-//                  1: linear (default)
-//
-// Returns:
-//
-//////////////////////////
-
-void extractPowerSpectrum(Field<Cplx> & fldFT, Real * kbin, Real * power, Real * kscatter, Real * pscatter, int * occupation, const int numbins, const bool deconvolve = true, const int ktype = KTYPE_LINEAR)
-{
-	extractCrossSpectrum(fldFT, fldFT, kbin, power, kscatter, pscatter, occupation, numbins, deconvolve, ktype);
-}
-#endif
-
-
 ///////////////////////////
 // writePowerSpectrum
 //////////////////////////
@@ -407,6 +191,604 @@ void writePowerSpectrum(Real * kbin, Real * power, Real * kscatter, Real * pscat
 // +      psi_old=phi_old_FT(k) + chi_old_FT(k);
 // +      ksquared=2.0 *(cos(2.0*M_PI*k.coord(0)/BoxSize)+ cos(2.0*M_PI*k.coord(1)/BoxSize) + cos(2.0*M_PI*k.coord(2)/BoxSize)-3.0)/(dx*dx);
 
+#ifdef FFT3D
+//////////////////////////
+// spectrum_binning
+//////////////////////////
+// Description:
+//   k-bin map of the local Fourier modes for one lattice and bin
+//   configuration. For each mode, in rKSite order, it stores the bin index
+//   (negative if the mode does not contribute) and the weight from the
+//   Hermitian symmetry. k^2 and the inverse squared CIC window factorise
+//   over the three axes and are kept as 1-D tables instead. The sums
+//   over k and the occupation are the same for all spectra; they are summed
+//   over all processes once, when the map is built. Maps are cached by
+//   getSpectrumBinning and live until the end of the run.
+//
+//////////////////////////
+
+struct spectrum_binning
+{
+	Lattice * lat;
+	int numbins;
+	int ktype;
+	int binning;
+	long nummodes;
+	int * bin;
+	unsigned char * weight;
+	double * typek2;       // k^2 per axis, indexed by the k-coordinate
+	double * deconv;       // inverse squared sinc per axis, indexed by the k-coordinate
+	double * kbin;         // sum of k over all processes
+	double * kscatter;     // sum of k^2 over all processes
+	double * occupation;   // weighted mode count over all processes
+};
+
+
+//////////////////////////
+// getSpectrumBinning
+//////////////////////////
+// Description:
+//   returns the k-bin map for a Fourier lattice, building it on first use;
+//   has to be called by all processes
+//
+// Arguments:
+//   lat        reference to the Fourier lattice
+//   numbins    number of bins
+//   ktype      flag indicating which definition of momentum to be used
+//                  0: grid momentum
+//                  1: linear (default)
+//   binning    flag indicating the spacing of the bins
+//                  0: linear in k (default)
+//                  1: linear in ln k, from the fundamental mode to the corner of the lattice
+//
+// Returns: pointer to the (cached) map
+//
+//////////////////////////
+
+spectrum_binning * getSpectrumBinning(Lattice & lat, const int numbins, const int ktype = KTYPE_LINEAR, const int binning = KBIN_LINEAR)
+{
+	static vector<spectrum_binning *> cache;
+
+	for (int n = 0; n < (int) cache.size(); n++)
+	{
+		if (cache[n]->lat == &lat && cache[n]->numbins == numbins && cache[n]->ktype == ktype && cache[n]->binning == binning)
+			return cache[n];
+	}
+
+	spectrum_binning * map = new spectrum_binning;
+	const int linesize = lat.size(1);
+	double * typek2;
+	double * sinc;
+	double k2max, k2, lnkmin, lnkrange;
+	long m;
+	int i, weight;
+	rKSite k(lat);
+
+	map->lat = &lat;
+	map->numbins = numbins;
+	map->ktype = ktype;
+	map->binning = binning;
+
+	typek2 = (double *) malloc(linesize * sizeof(double));
+	sinc = (double *) malloc(linesize * sizeof(double));
+
+	if (ktype == KTYPE_GRID)
+	{
+		for (i = 0; i < linesize; i++)
+		{
+			typek2[i] = 2. * (Real) linesize * sin(M_PI * (Real) i / (Real) linesize);
+			typek2[i] *= typek2[i];
+		}
+	}
+	else
+	{
+		for (i = 0; i <= linesize/2; i++)
+		{
+			typek2[i] = 2. * M_PI * (Real) i;
+			typek2[i] *= typek2[i];
+		}
+		for (; i < linesize; i++)
+		{
+			typek2[i] = 2. * M_PI * (Real) (linesize-i);
+			typek2[i] *= typek2[i];
+		}
+	}
+
+	sinc[0] = 1.;
+	for (i = 1; i <= linesize / 2; i++)
+	{
+		sinc[i] = sin(M_PI * (float) i / (float) linesize) * (float) linesize / (M_PI * (float) i);
+	}
+	for (; i < linesize; i++)
+	{
+		sinc[i] = sinc[linesize-i];
+	}
+
+	k2max = 3. * typek2[linesize/2];
+	lnkmin = 0.5 * log(typek2[1]);
+	lnkrange = 0.5 * log(k2max) - lnkmin;
+
+	for (k.first(), map->nummodes = 0; k.test(); k.next(), map->nummodes++);
+
+	map->bin = (int *) malloc(map->nummodes * sizeof(int));
+	map->weight = (unsigned char *) malloc(map->nummodes * sizeof(unsigned char));
+	map->kbin = (double *) calloc(3 * numbins, sizeof(double));
+	map->kscatter = map->kbin + numbins;
+	map->occupation = map->kbin + 2 * numbins;
+
+	for (k.first(), m = 0; k.test(); k.next(), m++)
+	{
+		map->bin[m] = -1;
+		map->weight[m] = 0;
+
+		if (k.coord(0) == 0 && k.coord(1) == 0 && k.coord(2) == 0)
+			continue;
+		else if (k.coord(0) == 0)
+			weight = 1;
+		else if ((k.coord(0) == linesize/2) && (linesize % 2 == 0))
+			weight = 1;
+		else
+			weight = 2;
+
+		k2 = typek2[k.coord(0)] + typek2[k.coord(1)] + typek2[k.coord(2)];
+
+		if (binning == KBIN_LOG)
+			i = (int) floor((double) numbins * (0.5 * log(k2) - lnkmin) / lnkrange);
+		else
+			i = (int) floor((double) numbins * sqrt(k2 / k2max));
+		if (i < 0 || i >= numbins) continue;
+
+		map->bin[m] = i;
+		map->weight[m] = (unsigned char) weight;
+
+		map->kbin[i] += weight * sqrt(k2);
+		map->kscatter[i] += weight * k2;
+		map->occupation[i] += weight;
+	}
+
+	for (i = 0; i < linesize; i++)
+		sinc[i] = 1. / (sinc[i] * sinc[i]);
+
+	map->typek2 = typek2;
+	map->deconv = sinc;
+
+	MPI_Allreduce(MPI_IN_PLACE, (void *) map->kbin, 3 * numbins, MPI_DOUBLE, MPI_SUM, parallel.lat_world_comm());
+
+	cache.push_back(map);
+
+	return map;
+}
+
+
+//////////////////////////
+// spectrum_engine
+//////////////////////////
+// Description:
+//   accumulates any number of auto- and cross-spectra in one sweep over the
+//   k-lattice, using the k-bin map of getSpectrumBinning. The bins of all
+//   spectra are kept in one contiguous buffer which is reduced with a single
+//   MPI call. Spectra are registered with add;
+//   their Fourier images have to stay unchanged until they have been swept,
+//   which release triggers when one of them is about to be overwritten.
+//   Output files registered with output are written by finish.
+//
+//////////////////////////
+
+#define SPECTRUM_OWN     2   // power and pscatter sums of each spectrum
+
+struct spectrum_slot
+{
+	Field<Cplx> * fld1FT;
+	Field<Cplx> * fld2FT;
+	int comp1;
+	int comp2;
+	bool deconvolve;
+	bool swept;
+};
+
+struct spectrum_output
+{
+	int slot;
+	Real rescalek;
+	Real rescalep;
+	string filename;
+	string description;
+	double a;
+	double z_target;
+};
+
+class spectrum_engine
+{
+	public:
+		spectrum_engine(const int numbins, const int ktype = KTYPE_LINEAR, const int binning = KBIN_LINEAR);
+		int add(Field<Cplx> & fld1FT, Field<Cplx> & fld2FT, const bool deconvolve = true, const int comp1 = -1, const int comp2 = -1);
+		int add(Field<Cplx> & fldFT, const bool deconvolve = true);
+		void output(const int slot, const Real rescalek, const Real rescalep, const char * filename, const char * description, const double a, const double z_target = -1);
+		void release(Field<Cplx> & fldFT);
+		void sweep();
+		void reduce();
+		void result(const int slot, Real * kbin, Real * power, Real * kscatter, Real * pscatter, int * occupation);
+		void finish();
+
+	private:
+		vector<spectrum_slot> slots_;
+		vector<spectrum_output> outputs_;
+		vector<double> sums_;   // own sums of each slot
+		spectrum_binning * map_;
+		int numbins_;
+		int ktype_;
+		int binning_;
+		bool reduced_;
+};
+
+spectrum_engine::spectrum_engine(const int numbins, const int ktype, const int binning)
+{
+	numbins_ = numbins;
+	ktype_ = ktype;
+	binning_ = binning;
+	map_ = NULL;
+	reduced_ = false;
+}
+
+
+//////////////////////////
+// spectrum_engine::add
+//////////////////////////
+// Description:
+//   registers a cross spectrum (or an auto spectrum if only one Fourier
+//   image is given)
+//
+// Arguments:
+//   fld1FT     reference to the first Fourier image
+//   fld2FT     reference to the second Fourier image
+//   deconvolve flag indicating whether the CIC window should be deconvolved
+//   comp1      for component-wise cross spectra, the component for the first field (ignored if negative)
+//   comp2      for component-wise cross spectra, the component for the second field (ignored if negative)
+//
+// Returns: slot of the spectrum
+//
+//////////////////////////
+
+int spectrum_engine::add(Field<Cplx> & fld1FT, Field<Cplx> & fld2FT, const bool deconvolve, const int comp1, const int comp2)
+{
+	spectrum_slot slot;
+
+	slot.fld1FT = &fld1FT;
+	slot.fld2FT = &fld2FT;
+	slot.comp1 = comp1;
+	slot.comp2 = comp2;
+	slot.deconvolve = deconvolve;
+	slot.swept = false;
+
+	slots_.push_back(slot);
+	sums_.resize(sums_.size() + SPECTRUM_OWN * numbins_, 0.);
+
+	return (int) slots_.size() - 1;
+}
+
+int spectrum_engine::add(Field<Cplx> & fldFT, const bool deconvolve)
+{
+	return add(fldFT, fldFT, deconvolve);
+}
+
+
+//////////////////////////
+// spectrum_engine::output
+//////////////////////////
+// Description:
+//   registers an output file for a spectrum (see writePowerSpectrum); the
+//   same spectrum can be written several times with different normalizations
+//
+//////////////////////////
+
+void spectrum_engine::output(const int slot, const Real rescalek, const Real rescalep, const char * filename, const char * description, const double a, const double z_target)
+{
+	spectrum_output out;
+
+	out.slot = slot;
+	out.rescalek = rescalek;
+	out.rescalep = rescalep;
+	out.filename = filename;
+	out.description = description;
+	out.a = a;
+	out.z_target = z_target;
+
+	outputs_.push_back(out);
+}
+
+
+//////////////////////////
+// spectrum_engine::release
+//////////////////////////
+// Description:
+//   has to be called before a Fourier image is overwritten; sweeps the
+//   pending spectra if one of them depends on it
+//
+// Arguments:
+//   fldFT      reference to the Fourier image which is about to change
+//
+// Returns:
+//
+//////////////////////////
+
+void spectrum_engine::release(Field<Cplx> & fldFT)
+{
+	for (int n = 0; n < (int) slots_.size(); n++)
+	{
+		if (!slots_[n].swept && (slots_[n].fld1FT == &fldFT || slots_[n].fld2FT == &fldFT))
+		{
+			sweep();
+			return;
+		}
+	}
+}
+
+
+//////////////////////////
+// spectrum_engine::sweep
+//////////////////////////
+// Description:
+//   accumulates all pending spectra in one pass over the k-lattice
+//
+//////////////////////////
+
+void spectrum_engine::sweep()
+{
+	vector<int> pending;
+	long m;
+	int i, n;
+
+	for (n = 0; n < (int) slots_.size(); n++)
+	{
+		if (!slots_[n].swept)
+			pending.push_back(n);
+	}
+
+	if (pending.empty()) return;
+
+	Field<Cplx> & ref = *slots_[pending[0]].fld1FT;
+	const int numpending = (int) pending.size();
+	double * own;
+	double w, pk, k2, k3, deconv;
+	rKSite k(ref.lattice());
+	Cplx p;
+
+	if (map_ == NULL)
+		map_ = getSpectrumBinning(ref.lattice(), numbins_, ktype_, binning_);
+
+	for (k.first(), m = 0; k.test(); k.next(), m++)
+	{
+		i = map_->bin[m];
+		if (i < 0) continue;
+
+		w = (double) map_->weight[m];
+		k2 = map_->typek2[k.coord(0)] + map_->typek2[k.coord(1)] + map_->typek2[k.coord(2)];
+		k3 = k2 * sqrt(k2);
+		deconv = map_->deconv[k.coord(0)] * map_->deconv[k.coord(1)] * map_->deconv[k.coord(2)];
+
+		for (n = 0; n < numpending; n++)
+		{
+			const spectrum_slot & slot = slots_[pending[n]];
+
+			if (slot.comp1 >= 0 && slot.comp2 >= 0 && slot.comp1 < slot.fld1FT->components() && slot.comp2 < slot.fld2FT->components())
+			{
+				p = (*slot.fld1FT)(k, slot.comp1) * (*slot.fld2FT)(k, slot.comp2).conj();
+			}
+			else if (slot.fld1FT->symmetry() == LATfield2::symmetric)
+			{
+				p = (*slot.fld1FT)(k, 0, 1) * (*slot.fld2FT)(k, 0, 1).conj();
+				p += (*slot.fld1FT)(k, 0, 2) * (*slot.fld2FT)(k, 0, 2).conj();
+				p += (*slot.fld1FT)(k, 1, 2) * (*slot.fld2FT)(k, 1, 2).conj();
+				p *= 2.;
+				p += (*slot.fld1FT)(k, 0, 0) * (*slot.fld2FT)(k, 0, 0).conj();
+				p += (*slot.fld1FT)(k, 1, 1) * (*slot.fld2FT)(k, 1, 1).conj();
+				p += (*slot.fld1FT)(k, 2, 2) * (*slot.fld2FT)(k, 2, 2).conj();
+			}
+			else
+			{
+				p = Cplx(0., 0.);
+				for (int c = 0; c < slot.fld1FT->components(); c++)
+					p += (*slot.fld1FT)(k, c) * (*slot.fld2FT)(k, c).conj();
+			}
+
+			pk = (double) p.real() * k3;
+			if (slot.deconvolve) pk *= deconv;
+			own = &sums_[SPECTRUM_OWN * pending[n] * numbins_];
+			own[i] += w * pk;                // power
+			own[numbins_ + i] += w * pk * pk; // pscatter
+		}
+	}
+
+	for (n = 0; n < numpending; n++)
+		slots_[pending[n]].swept = true;
+}
+
+
+//////////////////////////
+// spectrum_engine::reduce
+//////////////////////////
+// Description:
+//   sweeps the pending spectra and reduces all bins to the root process in
+//   a single call; no spectra can be added afterwards
+//
+//////////////////////////
+
+void spectrum_engine::reduce()
+{
+	if (reduced_) return;
+
+	sweep();
+
+	if (sums_.empty())
+	{
+		reduced_ = true;
+		return;
+	}
+
+	if (parallel.isRoot())
+		MPI_Reduce(MPI_IN_PLACE, (void *) &sums_[0], (int) sums_.size(), MPI_DOUBLE, MPI_SUM, 0, parallel.lat_world_comm());
+	else
+		MPI_Reduce((void *) &sums_[0], NULL, (int) sums_.size(), MPI_DOUBLE, MPI_SUM, 0, parallel.lat_world_comm());
+
+	reduced_ = true;
+}
+
+
+//////////////////////////
+// spectrum_engine::result
+//////////////////////////
+// Description:
+//   bin averages of a spectrum (only valid on the root process after reduce)
+//
+// Arguments:
+//   slot       slot of the spectrum
+//   kbin       allocated array that will contain the central k-value for the bins
+//   power      allocated array that will contain the average power in each bin
+//   kscatter   allocated array that will contain the k-scatter for each bin
+//   pscatter   allocated array that will contain the scatter in power for each bin
+//   occupation allocated array that will count the number of grid points contributing to each bin
+//
+// Returns:
+//
+//////////////////////////
+
+void spectrum_engine::result(const int slot, Real * kbin, Real * power, Real * kscatter, Real * pscatter, int * occupation)
+{
+	const double * own = &sums_[SPECTRUM_OWN * slot * numbins_];
+	double k2, pk;
+
+	for (int i = 0; i < numbins_; i++)
+	{
+		occupation[i] = (int) map_->occupation[i];
+		kbin[i] = map_->kbin[i];
+		kscatter[i] = map_->kscatter[i];
+		power[i] = own[i];
+		pscatter[i] = own[numbins_ + i];
+
+		if (occupation[i] > 0)
+		{
+			k2 = map_->kbin[i] / occupation[i];  // average k
+			pk = own[i] / occupation[i];         // average power
+			kscatter[i] = sqrt(map_->kscatter[i] * occupation[i] - map_->kbin[i] * map_->kbin[i]) / occupation[i];
+			if (!isfinite(kscatter[i])) kscatter[i] = 0.;
+			kbin[i] = k2;
+			power[i] = pk;
+			pscatter[i] = sqrt(own[numbins_ + i] / occupation[i] - pk * pk);
+			if (!isfinite(pscatter[i])) pscatter[i] = 0.;
+		}
+	}
+}
+
+
+//////////////////////////
+// spectrum_engine::finish
+//////////////////////////
+// Description:
+//   reduces all spectra and writes the registered output files
+//
+//////////////////////////
+
+void spectrum_engine::finish()
+{
+	Real * kbin;
+	Real * power;
+	Real * kscatter;
+	Real * pscatter;
+	int * occupation;
+
+	reduce();
+
+	if (!parallel.isRoot()) return;
+
+	kbin = (Real *) malloc(numbins_ * sizeof(Real));
+	power = (Real *) malloc(numbins_ * sizeof(Real));
+	kscatter = (Real *) malloc(numbins_ * sizeof(Real));
+	pscatter = (Real *) malloc(numbins_ * sizeof(Real));
+	occupation = (int *) malloc(numbins_ * sizeof(int));
+
+	for (int n = 0; n < (int) outputs_.size(); n++)
+	{
+		result(outputs_[n].slot, kbin, power, kscatter, pscatter, occupation);
+		writePowerSpectrum(kbin, power, kscatter, pscatter, occupation, numbins_, outputs_[n].rescalek, outputs_[n].rescalep, outputs_[n].filename.c_str(), outputs_[n].description.c_str(), outputs_[n].a, outputs_[n].z_target);
+	}
+
+	free(kbin);
+	free(power);
+	free(kscatter);
+	free(pscatter);
+	free(occupation);
+}
+
+
+//////////////////////////
+// extractCrossSpectrum
+//////////////////////////
+// Description:
+//   generates the cross spectrum for two Fourier images
+//
+// Arguments:
+//   fld1FT     reference to the first Fourier image for which the cross spectrum should be extracted
+//   fld2FT     reference to the second Fourier image for which the cross spectrum should be extracted
+//   kbin       allocated array that will contain the central k-value for the bins
+//   power      allocated array that will contain the average power in each bin
+//   kscatter   allocated array that will contain the k-scatter for each bin
+//   pscatter   allocated array that will contain the scatter in power for each bin
+//   occupation allocated array that will count the number of grid points contributing to each bin
+//   numbin     number of bins (minimum size of all arrays)
+//   ktype      flag indicating which definition of momentum to be used
+//                  0: grid momentum
+//                  1: linear (default)
+//   comp1      for component-wise cross spectra, the component for the first field (ignored if negative)
+//   comp2      for component-wise cross spectra, the component for the second field (ignored if negative)
+//   binning    flag indicating the spacing of the bins (see getSpectrumBinning)
+//
+// Returns:
+//
+//////////////////////////
+
+void extractCrossSpectrum(Field<Cplx> & fld1FT, Field<Cplx> & fld2FT, Real * kbin, Real * power, Real * kscatter, Real * pscatter, int * occupation, const int numbins, const bool deconvolve = true, const int ktype = KTYPE_LINEAR, const int comp1 = -1, const int comp2 = -1, const int binning = KBIN_LINEAR)
+{
+	spectrum_engine spectra(numbins, ktype, binning);
+	const int slot = spectra.add(fld1FT, fld2FT, deconvolve, comp1, comp2);
+
+	spectra.reduce();
+
+	if (parallel.isRoot())
+		spectra.result(slot, kbin, power, kscatter, pscatter, occupation);
+}
+
+
+
+//////////////////////////
+// extractPowerSpectrum
+//////////////////////////
+// Description:
+//   generates the power spectrum for a Fourier image
+//
+// Arguments:
+//   fldFT      reference to the Fourier image for which the power spectrum should be extracted
+//   kbin       allocated array that will contain the central k-value for the bins
+//   power      allocated array that will contain the average power in each bin
+//   kscatter   allocated array that will contain the k-scatter for each bin
+//   pscatter   allocated array that will contain the scatter in power for each bin
+//   occupation allocated array that will count the number of grid points contributing to each bin
+//   numbin     number of bins (minimum size of all arrays)
+//   ktype      flag indicating which definition of momentum to be used
+//                  0: grid momentum
+//                  1: linear (default)
+//   binning    flag indicating the spacing of the bins (see getSpectrumBinning)
+//
+// Returns:
+//
+//////////////////////////
+
+void extractPowerSpectrum(Field<Cplx> & fldFT, Real * kbin, Real * power, Real * kscatter, Real * pscatter, int * occupation, const int numbins, const bool deconvolve = true, const int ktype = KTYPE_LINEAR, const int binning = KBIN_LINEAR)
+{
+	extractCrossSpectrum(fldFT, fldFT, kbin, power, kscatter, pscatter, occupation, numbins, deconvolve, ktype, -1, -1, binning);
+}
+#endif
+
+
 //////////////////////////
 // computeVectorDiagnostics
 //////////////////////////
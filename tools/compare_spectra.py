@@ -0,0 +1,90 @@
+#!/usr/bin/env python3
+#
+# compare_spectra.py
+#
+# Regression check for the mixed-precision build (-DSINGLE): compares the
+# power spectra written by two runs with identical settings, e.g. a double-
+# precision reference and a single-precision run, and reports the largest
+# relative deviation of P(k) in each file. Only bins that are occupied in
+# both runs are compared, and bins in which the reference power is below
+# "floor" times the maximum of that spectrum are skipped (they are
+# dominated by round-off and cancellation, e.g. for cross spectra).
+#
+# usage: compare_spectra.py <reference prefix> <test prefix> [tolerance] [floor]
+#
+#   prefix      output path and basename of the power spectra of a run, as
+#               set by "output path" and "Pk file base" (e.g. output/pk)
+#   tolerance   maximum relative deviation accepted (default 1e-3)
+#   floor       relative power below which bins are ignored (default 1e-8)
+#
+# The exit status is 1 if any spectrum exceeds the tolerance or is missing
+# in the test run, 0 otherwise.
+#
+
+import glob
+import os
+import sys
+
+
+def read_spectrum(filename):
+	k, p, occ = [], [], []
+	with open(filename) as f:
+		for line in f:
+			if line.startswith('#') or not line.strip():
+				continue
+			col = line.split()
+			k.append(float(col[0]))
+			p.append(float(col[1]))
+			occ.append(int(col[4]))
+	return k, p, occ
+
+
+def compare(reffile, testfile, floor):
+	kr, pr, occr = read_spectrum(reffile)
+	kt, pt, occt = read_spectrum(testfile)
+	if len(kr) != len(kt):
+		return None
+	pmax = max([abs(x) for x in pr] + [0.])
+	dmax = 0.
+	for i in range(len(kr)):
+		if occr[i] == 0 or occt[i] == 0 or abs(pr[i]) <= floor * pmax:
+			continue
+		dmax = max(dmax, abs(pt[i] - pr[i]) / abs(pr[i]))
+	return dmax
+
+
+def main():
+	if len(sys.argv) < 3:
+		print('usage: %s <reference prefix> <test prefix> [tolerance] [floor]' % sys.argv[0])
+		return 2
+
+	refprefix, testprefix = sys.argv[1], sys.argv[2]
+	tol = float(sys.argv[3]) if len(sys.argv) > 3 else 1e-3
+	floor = float(sys.argv[4]) if len(sys.argv) > 4 else 1e-8
+
+	reffiles = sorted(glob.glob(glob.escape(refprefix) + '*.dat'))
+	if not reffiles:
+		print(' error: no spectra found for %s' % refprefix)
+		return 2
+
+	status = 0
+	for reffile in reffiles:
+		name = os.path.basename(reffile)
+		testfile = testprefix + reffile[len(refprefix):]
+		try:
+			d = compare(reffile, testfile, floor)
+		except (IOError, ValueError, IndexError):
+			d = None
+		if d is None:
+			print(' %-40s  missing or incompatible' % name)
+			status = 1
+		else:
+			print(' %-40s  max. rel. deviation = %.3e  %s' % (name, d, 'ok' if d <= tol else 'FAILED'))
+			if d > tol:
+				status = 1
+
+	return status
+
+
+if __name__ == '__main__':
+	sys.exit(main())